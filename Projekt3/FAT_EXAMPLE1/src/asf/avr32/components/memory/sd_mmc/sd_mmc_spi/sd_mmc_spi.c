@@ -61,6 +61,34 @@
 
 #define        NO_SUPPORT_USB_PING_PONG                     // defines if USB endpoints do not support ping pong mode
 
+#ifndef SD_MMC_SPI_HIGH_SPEED
+#define        SD_MMC_SPI_HIGH_SPEED        false           // switch SD 2.0 cards to high-speed mode (CMD6)
+#endif
+
+#ifndef SD_MMC_SPI_BUSY_POLLS
+#define        SD_MMC_SPI_BUSY_POLLS        64              // busy polls between two calls of the busy callback
+#endif
+
+#ifndef SD_MMC_SPI_CRC
+#define        SD_MMC_SPI_CRC               false           // check the CRC of the commands and data blocks (CMD59)
+#endif
+
+#ifndef SD_MMC_SPI_RETRIES
+#define        SD_MMC_SPI_RETRIES           1               // times a failed block transfer is issued again
+#endif
+
+#ifndef SD_MMC_SPI_LINK_ERRORS
+#define        SD_MMC_SPI_LINK_ERRORS       3               // consecutive transfer errors before lowering the SPI clock
+#endif
+
+#ifndef SD_MMC_SPI_BUS
+#define        SD_MMC_SPI_BUS               false           // run the block transfers through the SPI bus scheduler
+#endif
+
+#if SD_MMC_SPI_BUS == true
+#include "spi_bus.h"
+#endif
+
 
 /*_____ D E F I N I T I O N ________________________________________________*/
 
@@ -68,6 +96,75 @@ static uint32_t  gl_ptr_mem;                       // Memory data pointer
 static uint8_t   sector_buf[MMC_SECTOR_SIZE];  // Sector buffer
 static spi_options_t sd_mmc_opt;
 static unsigned int sd_mmc_pba_hz;
+static uint8_t   sd_mmc_spi_div;                   // SPI clock divisor of the transfers
+static uint8_t   sd_mmc_spi_link_errors;           // consecutive transfer errors
+static bool      sd_mmc_spi_programming;           // card programming the last written block
+static void    (*sd_mmc_spi_busy_callback)(void);  // called while waiting for the card
+static sd_mmc_spi_crc_stats_t sd_mmc_spi_crc_stats; // CRC errors and retries
+#if SD_MMC_SPI_BUS == true
+static uint32_t  sd_mmc_spi_bus_polls;             // busy polls of the scheduler since the last block write
+static bool      sd_mmc_spi_bus_busy(void);
+#endif
+
+// CRC7 (x^7 + x^3 + 1) of the commands, kept in the 7 upper bits
+static const uint8_t sd_mmc_spi_crc7_table[256] =
+{
+  0x00, 0x12, 0x24, 0x36, 0x48, 0x5A, 0x6C, 0x7E, 0x90, 0x82, 0xB4, 0xA6, 0xD8, 0xCA, 0xFC, 0xEE,
+  0x32, 0x20, 0x16, 0x04, 0x7A, 0x68, 0x5E, 0x4C, 0xA2, 0xB0, 0x86, 0x94, 0xEA, 0xF8, 0xCE, 0xDC,
+  0x64, 0x76, 0x40, 0x52, 0x2C, 0x3E, 0x08, 0x1A, 0xF4, 0xE6, 0xD0, 0xC2, 0xBC, 0xAE, 0x98, 0x8A,
+  0x56, 0x44, 0x72, 0x60, 0x1E, 0x0C, 0x3A, 0x28, 0xC6, 0xD4, 0xE2, 0xF0, 0x8E, 0x9C, 0xAA, 0xB8,
+  0xC8, 0xDA, 0xEC, 0xFE, 0x80, 0x92, 0xA4, 0xB6, 0x58, 0x4A, 0x7C, 0x6E, 0x10, 0x02, 0x34, 0x26,
+  0xFA, 0xE8, 0xDE, 0xCC, 0xB2, 0xA0, 0x96, 0x84, 0x6A, 0x78, 0x4E, 0x5C, 0x22, 0x30, 0x06, 0x14,
+  0xAC, 0xBE, 0x88, 0x9A, 0xE4, 0xF6, 0xC0, 0xD2, 0x3C, 0x2E, 0x18, 0x0A, 0x74, 0x66, 0x50, 0x42,
+  0x9E, 0x8C, 0xBA, 0xA8, 0xD6, 0xC4, 0xF2, 0xE0, 0x0E, 0x1C, 0x2A, 0x38, 0x46, 0x54, 0x62, 0x70,
+  0x82, 0x90, 0xA6, 0xB4, 0xCA, 0xD8, 0xEE, 0xFC, 0x12, 0x00, 0x36, 0x24, 0x5A, 0x48, 0x7E, 0x6C,
+  0xB0, 0xA2, 0x94, 0x86, 0xF8, 0xEA, 0xDC, 0xCE, 0x20, 0x32, 0x04, 0x16, 0x68, 0x7A, 0x4C, 0x5E,
+  0xE6, 0xF4, 0xC2, 0xD0, 0xAE, 0xBC, 0x8A, 0x98, 0x76, 0x64, 0x52, 0x40, 0x3E, 0x2C, 0x1A, 0x08,
+  0xD4, 0xC6, 0xF0, 0xE2, 0x9C, 0x8E, 0xB8, 0xAA, 0x44, 0x56, 0x60, 0x72, 0x0C, 0x1E, 0x28, 0x3A,
+  0x4A, 0x58, 0x6E, 0x7C, 0x02, 0x10, 0x26, 0x34, 0xDA, 0xC8, 0xFE, 0xEC, 0x92, 0x80, 0xB6, 0xA4,
+  0x78, 0x6A, 0x5C, 0x4E, 0x30, 0x22, 0x14, 0x06, 0xE8, 0xFA, 0xCC, 0xDE, 0xA0, 0xB2, 0x84, 0x96,
+  0x2E, 0x3C, 0x0A, 0x18, 0x66, 0x74, 0x42, 0x50, 0xBE, 0xAC, 0x9A, 0x88, 0xF6, 0xE4, 0xD2, 0xC0,
+  0x1C, 0x0E, 0x38, 0x2A, 0x54, 0x46, 0x70, 0x62, 0x8C, 0x9E, 0xA8, 0xBA, 0xC4, 0xD6, 0xE0, 0xF2
+};
+
+#if (SD_MMC_SPI_CRC == true)
+// CRC16-CCITT (x^16 + x^12 + x^5 + 1) of the data blocks
+static const uint16_t sd_mmc_spi_crc16_table[256] =
+{
+  0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50A5, 0x60C6, 0x70E7,
+  0x8108, 0x9129, 0xA14A, 0xB16B, 0xC18C, 0xD1AD, 0xE1CE, 0xF1EF,
+  0x1231, 0x0210, 0x3273, 0x2252, 0x52B5, 0x4294, 0x72F7, 0x62D6,
+  0x9339, 0x8318, 0xB37B, 0xA35A, 0xD3BD, 0xC39C, 0xF3FF, 0xE3DE,
+  0x2462, 0x3443, 0x0420, 0x1401, 0x64E6, 0x74C7, 0x44A4, 0x5485,
+  0xA56A, 0xB54B, 0x8528, 0x9509, 0xE5EE, 0xF5CF, 0xC5AC, 0xD58D,
+  0x3653, 0x2672, 0x1611, 0x0630, 0x76D7, 0x66F6, 0x5695, 0x46B4,
+  0xB75B, 0xA77A, 0x9719, 0x8738, 0xF7DF, 0xE7FE, 0xD79D, 0xC7BC,
+  0x48C4, 0x58E5, 0x6886, 0x78A7, 0x0840, 0x1861, 0x2802, 0x3823,
+  0xC9CC, 0xD9ED, 0xE98E, 0xF9AF, 0x8948, 0x9969, 0xA90A, 0xB92B,
+  0x5AF5, 0x4AD4, 0x7AB7, 0x6A96, 0x1A71, 0x0A50, 0x3A33, 0x2A12,
+  0xDBFD, 0xCBDC, 0xFBBF, 0xEB9E, 0x9B79, 0x8B58, 0xBB3B, 0xAB1A,
+  0x6CA6, 0x7C87, 0x4CE4, 0x5CC5, 0x2C22, 0x3C03, 0x0C60, 0x1C41,
+  0xEDAE, 0xFD8F, 0xCDEC, 0xDDCD, 0xAD2A, 0xBD0B, 0x8D68, 0x9D49,
+  0x7E97, 0x6EB6, 0x5ED5, 0x4EF4, 0x3E13, 0x2E32, 0x1E51, 0x0E70,
+  0xFF9F, 0xEFBE, 0xDFDD, 0xCFFC, 0xBF1B, 0xAF3A, 0x9F59, 0x8F78,
+  0x9188, 0x81A9, 0xB1CA, 0xA1EB, 0xD10C, 0xC12D, 0xF14E, 0xE16F,
+  0x1080, 0x00A1, 0x30C2, 0x20E3, 0x5004, 0x4025, 0x7046, 0x6067,
+  0x83B9, 0x9398, 0xA3FB, 0xB3DA, 0xC33D, 0xD31C, 0xE37F, 0xF35E,
+  0x02B1, 0x1290, 0x22F3, 0x32D2, 0x4235, 0x5214, 0x6277, 0x7256,
+  0xB5EA, 0xA5CB, 0x95A8, 0x8589, 0xF56E, 0xE54F, 0xD52C, 0xC50D,
+  0x34E2, 0x24C3, 0x14A0, 0x0481, 0x7466, 0x6447, 0x5424, 0x4405,
+  0xA7DB, 0xB7FA, 0x8799, 0x97B8, 0xE75F, 0xF77E, 0xC71D, 0xD73C,
+  0x26D3, 0x36F2, 0x0691, 0x16B0, 0x6657, 0x7676, 0x4615, 0x5634,
+  0xD94C, 0xC96D, 0xF90E, 0xE92F, 0x99C8, 0x89E9, 0xB98A, 0xA9AB,
+  0x5844, 0x4865, 0x7806, 0x6827, 0x18C0, 0x08E1, 0x3882, 0x28A3,
+  0xCB7D, 0xDB5C, 0xEB3F, 0xFB1E, 0x8BF9, 0x9BD8, 0xABBB, 0xBB9A,
+  0x4A75, 0x5A54, 0x6A37, 0x7A16, 0x0AF1, 0x1AD0, 0x2AB3, 0x3A92,
+  0xFD2E, 0xED0F, 0xDD6C, 0xCD4D, 0xBDAA, 0xAD8B, 0x9DE8, 0x8DC9,
+  0x7C26, 0x6C07, 0x5C64, 0x4C45, 0x3CA2, 0x2C83, 0x1CE0, 0x0CC1,
+  0xEF1F, 0xFF3E, 0xCF5D, 0xDF7C, 0xAF9B, 0xBFBA, 0x8FD9, 0x9FF8,
+  0x6E17, 0x7E36, 0x4E55, 0x5E74, 0x2E93, 0x3EB2, 0x0ED1, 0x1EF0
+};
+#endif
 
 bool  sd_mmc_spi_init_done = false;
 uint8_t   r1;
@@ -89,6 +186,185 @@ volatile  uint32_t  sd_mmc_spi_last_block_address;  // stores the address of the
 
 /*_____ D E C L A R A T I O N ______________________________________________*/
 
+//!
+//! @brief This function computes the CRC7 token (CRC and end bit) of a command.
+//!
+//! @param  buf       command bytes (command index and argument)
+//! @param  len       number of bytes
+//!
+//! @return uint8_t
+//!   Last byte of the command
+static uint8_t sd_mmc_spi_crc7(const uint8_t *buf, uint8_t len)
+{
+  uint8_t crc = 0;
+
+  while (len--)
+    crc = sd_mmc_spi_crc7_table[crc ^ *buf++];
+  return crc | 0x01;
+}
+
+#if (SD_MMC_SPI_CRC == true)
+//!
+//! @brief This function computes the CRC16 of a data block.
+//!
+//! @param  buf       data block
+//! @param  len       number of bytes
+//!
+//! @return uint16_t
+//!   CRC16 sent after the block
+static uint16_t sd_mmc_spi_crc16(const uint8_t *buf, uint16_t len)
+{
+  uint16_t crc = 0;
+
+  while (len--)
+    crc = (crc << 8) ^ sd_mmc_spi_crc16_table[(crc >> 8) ^ *buf++];
+  return crc;
+}
+#endif
+
+//!
+//! @brief This function returns the CRC error counters.
+//!
+//! @param  stats     structure receiving the counters
+void sd_mmc_spi_get_crc_stats(sd_mmc_spi_crc_stats_t *stats)
+{
+  *stats = sd_mmc_spi_crc_stats;
+}
+
+//!
+//! @brief This function returns the maximum transfer rate of the card, decoded
+//! from the TRAN_SPEED field of the CSD.
+//!
+//! @return uint32_t
+//!   Maximum transfer rate in Hz
+uint32_t sd_mmc_spi_get_tran_speed(void)
+{
+  // time value (x10) and transfer rate unit (/10) of TRAN_SPEED
+  static const uint8_t  time_value[16] = {0, 10, 12, 13, 15, 20, 25, 30, 35, 40, 45, 50, 55, 60, 70, 80};
+  static const uint32_t rate_unit[4]   = {10000, 100000, 1000000, 10000000};
+  uint8_t tran_speed = csd[3];
+
+  if ((tran_speed & 0x07) > 3 || !(tran_speed & 0x78))
+    return 25000000;     // reserved code: use the default speed of the SD specification
+
+  return rate_unit[tran_speed & 0x07] * time_value[(tran_speed >> 3) & 0x0F];
+}
+
+//!
+//! @brief This function returns the smallest SPI clock divisor of the PBA clock
+//! giving a clock not above the card and board limits.
+//!
+//! @param  max_hz    maximum transfer rate of the card in Hz
+//!
+//! @return uint8_t
+//!   SPI clock divisor
+static uint8_t sd_mmc_spi_get_divisor(uint32_t max_hz)
+{
+  uint32_t div;
+
+  if (max_hz > SD_MMC_SPI_MASTER_SPEED)
+    max_hz = SD_MMC_SPI_MASTER_SPEED;
+
+  div = (sd_mmc_pba_hz + max_hz - 1) / max_hz;
+  if (div < 1)   div = 1;
+  if (div > 255) div = 255;
+  return div;
+}
+
+//!
+//! @brief This function programs the SPI chip select register of the card with
+//! a given clock divisor.
+//!
+//! @param  div       SPI clock divisor
+static void sd_mmc_spi_set_divisor(uint8_t div)
+{
+  // spi_setupChipReg() rounds the divisor to the nearest one: request the
+  // baud rate lying half a step below pba_hz / div so that div is selected
+  sd_mmc_opt.baudrate = (2 * sd_mmc_pba_hz + 2 * div - 2) / (2 * div - 1);
+  spi_setupChipReg(SD_MMC_SPI, &sd_mmc_opt, sd_mmc_pba_hz);
+}
+
+//!
+//! @brief This function counts the consecutive transfer errors and lowers the
+//! SPI clock by one step when SD_MMC_SPI_LINK_ERRORS errors occurred in a row.
+//!
+//! @param  ok        transfer status
+//!
+//! @return bit
+//!   Transfer status
+static bool sd_mmc_spi_link_status(bool ok)
+{
+  if (ok)
+  {
+    sd_mmc_spi_link_errors = 0;
+  }
+  else if (++sd_mmc_spi_link_errors >= SD_MMC_SPI_LINK_ERRORS && sd_mmc_spi_div < 255)
+  {
+    sd_mmc_spi_link_errors = 0;
+    sd_mmc_spi_set_divisor(++sd_mmc_spi_div);
+  }
+  return ok;
+}
+
+//!
+//! @brief This function returns the current SPI clock of the card.
+//!
+//! @return uint32_t
+//!   SPI clock in Hz
+uint32_t sd_mmc_spi_get_speed(void)
+{
+  return sd_mmc_pba_hz / sd_mmc_spi_div;
+}
+
+#if (SD_MMC_SPI_HIGH_SPEED == true)
+//!
+//! @brief This function switches a SD 2.0 card to high-speed mode (CMD6).
+//!
+//! @return bit
+//!   The card switched to high speed  -> true
+//!   Not supported or failed          -> false
+static bool sd_mmc_spi_switch_high_speed(void)
+{
+  uint8_t  status[64];
+  uint16_t retry;
+
+  // only SD 2.0 cards supporting the switch command class (CCC bit 10)
+  if ((card_type != SD_CARD_2 && card_type != SD_CARD_2_SDHC) || !(csd[4] & 0x40))
+    return false;
+
+  // wait for MMC not busy
+  if (false == sd_mmc_spi_wait_not_busy())
+    return false;
+
+  spi_selectChip(SD_MMC_SPI, SD_MMC_SPI_NPCS);    // select SD_MMC_SPI
+  // issue command: set function 1 (high speed) of group 1 (access mode)
+  r1 = sd_mmc_spi_command(SD_SWITCH_FUNC, 0x80FFFFF1);
+  if (r1 != 0x00)
+  {
+    spi_unselectChip(SD_MMC_SPI, SD_MMC_SPI_NPCS);  // unselect SD_MMC_SPI
+    return false;
+  }
+  // wait for the switch status block
+  retry = 30000;
+  while((r1 = sd_mmc_spi_send_and_read(0xFF)) != MMC_STARTBLOCK_READ)
+  {
+    if (--retry == 0)
+    {
+      spi_unselectChip(SD_MMC_SPI, SD_MMC_SPI_NPCS);  // unselect SD_MMC_SPI
+      return false;
+    }
+  }
+  spi_read_buf(SD_MMC_SPI, status, sizeof(status), 0xFF);
+  spi_write(SD_MMC_SPI,0xFF);   // load CRC (not used)
+  spi_write(SD_MMC_SPI,0xFF);
+  spi_write(SD_MMC_SPI,0xFF);   // give clock again to end transaction (8 clocks before the new timing)
+  spi_unselectChip(SD_MMC_SPI, SD_MMC_SPI_NPCS);  // unselect SD_MMC_SPI
+
+  // function group 1 result (status bits 379:376)
+  return (status[16] & 0x0F) == 0x01;
+}
+#endif
+
 //!
 //! @brief This function initializes the SD/MMC controller.
 //!
@@ -198,9 +474,17 @@ bool sd_mmc_spi_internal_init(void)
       }
   }
 
+#if (SD_MMC_SPI_CRC == true)
+  // ENABLE CRC TO DETECT THE TRANSMISSION ERRORS
+  r1 = sd_mmc_spi_send_command(MMC_CRC_ON_OFF, 1);
+  spi_write(SD_MMC_SPI,0xFF);            // write dummy byte
+  if (r1 != 0x00)
+    return false;
+#else
   // DISABLE CRC TO SIMPLIFY AND SPEED UP COMMUNICATIONS
   r1 = sd_mmc_spi_send_command(MMC_CRC_ON_OFF, 0);  // disable CRC (should be already initialized on SPI init)
   spi_write(SD_MMC_SPI,0xFF);            // write dummy byte
+#endif
 
   // SET BLOCK LENGTH TO 512 BYTES
   r1 = sd_mmc_spi_send_command(MMC_SET_BLOCKLEN, 512);
@@ -223,9 +507,19 @@ bool sd_mmc_spi_internal_init(void)
 
   sd_mmc_spi_init_done = true;
 
-  // Set SPI Speed to MAX
-  sd_mmc_opt.baudrate = SD_MMC_SPI_MASTER_SPEED;
-  spi_setupChipReg(SD_MMC_SPI, &sd_mmc_opt, sd_mmc_pba_hz);
+#if (SD_MMC_SPI_HIGH_SPEED == true)
+  // SWITCH TO HIGH-SPEED MODE, THE CARD THEN REPORTS ITS NEW TRAN_SPEED IN THE CSD
+  if (sd_mmc_spi_switch_high_speed())
+  {
+    if (false == sd_mmc_spi_get_csd(csd))
+      return false;
+  }
+#endif
+
+  // Set SPI Speed to the highest one allowed by the card, the board and the PBA clock
+  sd_mmc_spi_div = sd_mmc_spi_get_divisor(sd_mmc_spi_get_tran_speed());
+  sd_mmc_spi_link_errors = 0;
+  sd_mmc_spi_set_divisor(sd_mmc_spi_div);
   return true;
 }
 
@@ -241,10 +535,40 @@ bool sd_mmc_spi_init(spi_options_t spiOptions, unsigned int pba_hz)
   sd_mmc_pba_hz = pba_hz;
   memcpy( &sd_mmc_opt, &spiOptions, sizeof(spi_options_t) );
 
+#if SD_MMC_SPI_BUS == true
+  // the block transfers are put off by the scheduler while the card programs
+  spi_bus_set_device(SD_MMC_SPI_NPCS, sd_mmc_spi_bus_busy);
+#endif
+
   // Initialize the SD/MMC controller.
   return sd_mmc_spi_internal_init();
 }
 
+//!
+//! @brief This function programs the SPI clock of the card again after a PBA
+//! clock change, not above the clock used so far (which already accounts for
+//! the link errors).
+//!
+//! @param  pba_hz    new PBA clock frequency in Hz
+void sd_mmc_spi_set_pba_hz(unsigned int pba_hz)
+{
+  uint32_t speed;
+
+  if (sd_mmc_spi_div)
+  {
+    speed = sd_mmc_spi_get_speed();
+    sd_mmc_pba_hz = pba_hz;
+    sd_mmc_spi_div = sd_mmc_spi_get_divisor(speed);
+    sd_mmc_spi_set_divisor(sd_mmc_spi_div);
+  }
+  else
+  {
+    // Card not identified yet: still at the initialization clock.
+    sd_mmc_pba_hz = pba_hz;
+    spi_setupChipReg(SD_MMC_SPI, &sd_mmc_opt, sd_mmc_pba_hz);
+  }
+}
+
 //!
 //! @brief This function sends a command WITH NO DATA STATE to the SD/MMC and waits for R1 response
 //!        This function also selects and unselects the memory => should be used only for single command transmission
@@ -274,25 +598,16 @@ uint8_t sd_mmc_spi_send_command(uint8_t command, uint32_t arg)
 uint8_t sd_mmc_spi_command(uint8_t command, uint32_t arg)
 {
   uint8_t retry;
+  uint8_t frame[7];
 
-  spi_write(SD_MMC_SPI, 0xFF);            // write dummy byte
-  spi_write(SD_MMC_SPI, command | 0x40);  // send command
-  spi_write(SD_MMC_SPI, arg>>24);         // send parameter
-  spi_write(SD_MMC_SPI, arg>>16);
-  spi_write(SD_MMC_SPI, arg>>8 );
-  spi_write(SD_MMC_SPI, arg    );
-  switch(command)
-  {
-      case MMC_GO_IDLE_STATE:
-         spi_write(SD_MMC_SPI, 0x95);
-         break;
-      case MMC_SEND_IF_COND:
-         spi_write(SD_MMC_SPI, 0x87);
-         break;
-      default:
-         spi_write(SD_MMC_SPI, 0xff);
-         break;
-  }
+  frame[0] = 0xFF;                        // dummy byte
+  frame[1] = command | 0x40;              // command
+  frame[2] = arg>>24;                     // parameter
+  frame[3] = arg>>16;
+  frame[4] = arg>>8;
+  frame[5] = arg;
+  frame[6] = sd_mmc_spi_crc7(&frame[1], 5);  // CRC (required by CMD0, CMD8 and in CRC mode)
+  spi_write_buf(SD_MMC_SPI, frame, sizeof(frame));
 
   // end command
   // wait for response
@@ -304,6 +619,8 @@ uint8_t sd_mmc_spi_command(uint8_t command, uint32_t arg)
     retry++;
     if(retry > 10) break;
   }
+  if (r1 != 0xFF && (r1 & MMC_R1_COM_CRC))
+    sd_mmc_spi_crc_stats.cmd_errors++;
   return r1;
 }
 
@@ -624,6 +941,8 @@ bool     sd_mmc_spi_get_status(void)
 bool sd_mmc_spi_wait_not_busy(void)
 {
   uint32_t retry;
+  // a block programming may last up to ten times the usual busy time-out
+  uint32_t time_out = (sd_mmc_spi_programming) ? 10 * 200000 : 200000;
 
   // Select the SD_MMC memory gl_ptr_mem points to
   spi_selectChip(SD_MMC_SPI, SD_MMC_SPI_NPCS);
@@ -631,17 +950,107 @@ bool sd_mmc_spi_wait_not_busy(void)
   while((r1 = sd_mmc_spi_send_and_read(0xFF)) != 0xFF)
   {
     retry++;
-    if (retry == 200000)
+    if (retry == time_out)
     {
       spi_unselectChip(SD_MMC_SPI, SD_MMC_SPI_NPCS);
       return false;
     }
+    // let the application work while the card programs (bus released)
+    if (sd_mmc_spi_busy_callback != NULL && !(retry % SD_MMC_SPI_BUSY_POLLS))
+    {
+      spi_unselectChip(SD_MMC_SPI, SD_MMC_SPI_NPCS);
+      sd_mmc_spi_busy_callback();
+      spi_selectChip(SD_MMC_SPI, SD_MMC_SPI_NPCS);
+    }
   }
   spi_unselectChip(SD_MMC_SPI, SD_MMC_SPI_NPCS);
+  sd_mmc_spi_programming = false;
   return true;
 }
 
 
+//!
+//! @brief This function tells if the card may still be programming the last
+//! written block. The next access to the card will wait for its end.
+//!
+//! @return bit
+//!          true when a block write has not been waited for yet
+bool sd_mmc_spi_is_busy(void)
+{
+  return sd_mmc_spi_programming;
+}
+
+
+//!
+//! @brief This function sets the function called while waiting for the card
+//! to leave the busy state (the SPI bus and the card are released during the
+//! call). The callback must not access the card.
+//!
+//! @param  callback   function to call or NULL
+void sd_mmc_spi_set_busy_callback(void (*callback)(void))
+{
+  sd_mmc_spi_busy_callback = callback;
+}
+
+
+#if SD_MMC_SPI_BUS == true
+//!
+//! @brief This function tells the SPI bus scheduler if the card still programs
+//! the last written block, with a single poll.
+//!
+//! @return bit
+//!          true while the card is busy
+static bool sd_mmc_spi_bus_busy(void)
+{
+  if (!sd_mmc_spi_programming)
+    return false;
+
+  spi_selectChip(SD_MMC_SPI, SD_MMC_SPI_NPCS);
+  r1 = sd_mmc_spi_send_and_read(0xFF);
+  spi_unselectChip(SD_MMC_SPI, SD_MMC_SPI_NPCS);
+
+  if (r1 == 0xFF)
+  {
+    sd_mmc_spi_programming = false;
+    sd_mmc_spi_bus_polls = 0;
+    return false;
+  }
+  // time-out: the block access runs and reports it (sd_mmc_spi_wait_not_busy)
+  if (++sd_mmc_spi_bus_polls >= 10 * 200000)
+  {
+    sd_mmc_spi_bus_polls = 0;
+    return false;
+  }
+  return true;
+}
+
+
+//!
+//! @brief This function runs a block transfer through the SPI bus scheduler:
+//! the transactions to the other devices run while the card is busy.
+//!
+//! @param  run   block transfer
+//! @param  tx    RAM buffer written to the card, or NULL
+//! @param  rx    RAM buffer read from the card, or NULL
+//!
+//! @return bit
+//!   The transfer succeeded   -> true
+static bool sd_mmc_spi_bus_block(spi_status_t (*run)(spi_bus_trans_t *), const void *tx, void *rx)
+{
+  spi_bus_trans_t trans;
+
+  memset(&trans, 0, sizeof(trans));
+  trans.chip = SD_MMC_SPI_NPCS;
+  trans.tx = tx;
+  trans.rx = rx;
+  trans.len = MMC_SECTOR_SIZE;
+  trans.run = run;
+  spi_bus_submit(&trans);
+  return spi_bus_wait(&trans) == SPI_OK;
+}
+#endif
+
+
 
 //!
 //! @brief This function check the presence of a memory card
@@ -671,8 +1080,14 @@ bool sd_mmc_spi_check_presence(void)
   }
   else
   {
+    // A programming card does not answer commands: wait for the end of the last write
+    if (sd_mmc_spi_programming && false == sd_mmc_spi_wait_not_busy())
+    {
+      sd_mmc_spi_init_done = false;
+      return false;
+    }
     // If memory already initialized, send a CRC command (CMD59) (supported only if card is initialized)
-    if ((r1 = sd_mmc_spi_send_command(MMC_CRC_ON_OFF, 0)) == 0x00)
+    if ((r1 = sd_mmc_spi_send_command(MMC_CRC_ON_OFF, (SD_MMC_SPI_CRC == true) ? 1 : 0)) == 0x00)
       return true;
     sd_mmc_spi_init_done = false;
     return false;
@@ -911,12 +1326,14 @@ void sd_mmc_spi_write_close (void)
 //! @param  nb_sector   the number of sector to read
 //! @return bit
 //!   The read succeeded      -> true
+//!   A sector read failed    -> false
 bool sd_mmc_spi_read_multiple_sector(uint16_t nb_sector)
 {
   while (nb_sector--)
   {
     // Read the next sector
-    sd_mmc_spi_read_sector_to_ram(sector_buf);
+    if (!sd_mmc_spi_read_sector_to_ram(sector_buf))
+      return false;
     sd_mmc_spi_read_multiple_sector_callback(sector_buf);
   }
 
@@ -929,13 +1346,15 @@ bool sd_mmc_spi_read_multiple_sector(uint16_t nb_sector)
 //! @param  nb_sector   the number of sector to write
 //! @return bit
 //!   The write succeeded      -> true
+//!   A sector write failed    -> false
 bool sd_mmc_spi_write_multiple_sector(uint16_t nb_sector)
 {
   while (nb_sector--)
   {
     // Write the next sector
     sd_mmc_spi_write_multiple_sector_callback(sector_buf);
-    sd_mmc_spi_write_sector_from_ram(sector_buf);
+    if (!sd_mmc_spi_write_sector_from_ram(sector_buf))
+      return false;
   }
 
   return true;
@@ -995,9 +1414,9 @@ bool sd_mmc_spi_erase_sector_group(uint32_t adr_start, uint32_t adr_end)
   { cmd = SD_TAG_WR_ERASE_GROUP_END; }
 
   if(card_type == SD_CARD_2_SDHC) {
-    r1 = sd_mmc_spi_command(cmd,adr_start);
+    r1 = sd_mmc_spi_command(cmd,adr_end);
   } else {
-    r1 = sd_mmc_spi_command(cmd,(adr_start << 9));
+    r1 = sd_mmc_spi_command(cmd,(adr_end << 9));
   }
 
   if (r1 != 0)
@@ -1119,12 +1538,12 @@ bool sd_mmc_spi_read_open_PDCA (uint32_t pos)
 //!   The read succeeded   -> true
 //!   The read failed (bad address, etc.)  -> false
 //!/
-bool sd_mmc_spi_read_sector_to_ram(void *ram)
+static bool sd_mmc_spi_read_block_to_ram(void *ram)
 {
-  uint8_t *_ram = ram;
-  uint16_t  i;
   uint16_t  read_time_out;
-  unsigned short data_read;
+#if (SD_MMC_SPI_CRC == true)
+  uint16_t  crc;
+#endif
   // wait for MMC not busy
   if (false == sd_mmc_spi_wait_not_busy())
     return false;
@@ -1166,17 +1585,23 @@ bool sd_mmc_spi_read_sector_to_ram(void *ram)
   }
 
   // store datablock
-  for(i=0;i<MMC_SECTOR_SIZE;i++)
+  if (spi_read_buf(SD_MMC_SPI, ram, MMC_SECTOR_SIZE, 0xFF) != SPI_OK)
+    r1 = 0xFF;
+
+#if (SD_MMC_SPI_CRC == true)
+  // load 16-bit CRC and check it
+  crc = sd_mmc_spi_send_and_read(0xFF) << 8;
+  crc |= sd_mmc_spi_send_and_read(0xFF);
+  if (r1 == MMC_STARTBLOCK_READ && crc != sd_mmc_spi_crc16(ram, MMC_SECTOR_SIZE))
   {
-    spi_write(SD_MMC_SPI,0xFF);
-    spi_read(SD_MMC_SPI,&data_read);
-    *_ram++=data_read;
+    sd_mmc_spi_crc_stats.read_errors++;
+    r1 = 0xFF;
   }
-  gl_ptr_mem += 512;     // Update the memory pointer.
-
+#else
   // load 16-bit CRC (ignored)
   spi_write(SD_MMC_SPI,0xFF);
   spi_write(SD_MMC_SPI,0xFF);
+#endif
 
   // continue delivering some clock cycles
   spi_write(SD_MMC_SPI,0xFF);
@@ -1185,9 +1610,45 @@ bool sd_mmc_spi_read_sector_to_ram(void *ram)
   // release chip select
   spi_unselectChip(SD_MMC_SPI, SD_MMC_SPI_NPCS);  // unselect SD_MMC_SPI
 
+  if (r1 != MMC_STARTBLOCK_READ)
+    return false;        // data byte lost (SPI overrun) or wrong CRC
+
+  gl_ptr_mem += 512;     // Update the memory pointer.
   return true;   // Read done.
 }
 
+#if SD_MMC_SPI_BUS == true
+static spi_status_t sd_mmc_spi_bus_read_block(spi_bus_trans_t *trans)
+{
+  return (sd_mmc_spi_read_block_to_ram(trans->rx)) ? SPI_OK : SPI_ERROR;
+}
+#endif
+
+//! @brief This function reads one MMC sector to a ram buffer, through the SPI
+//! bus scheduler if enabled
+static bool sd_mmc_spi_read_block(void *ram)
+{
+#if SD_MMC_SPI_BUS == true
+  return sd_mmc_spi_bus_block(sd_mmc_spi_bus_read_block, NULL, ram);
+#else
+  return sd_mmc_spi_read_block_to_ram(ram);
+#endif
+}
+
+bool sd_mmc_spi_read_sector_to_ram(void *ram)
+{
+  uint8_t retry = SD_MMC_SPI_RETRIES;
+
+  // a failed block read is issued again before reporting the error
+  while (!sd_mmc_spi_link_status(sd_mmc_spi_read_block(ram)))
+  {
+    if (!retry--)
+      return false;
+    sd_mmc_spi_crc_stats.retries++;
+  }
+  return true;
+}
+
 
 //! @brief This function writes one MMC sector from a ram buffer
 //!
@@ -1197,7 +1658,8 @@ bool sd_mmc_spi_read_sector_to_ram(void *ram)
 //! NOTE (please read) :
 //!   - First call (if sequential write) must be preceded by a call to the sd_mmc_spi_write_open() function
 //!   - An address error will not detected here, but with the call of sd_mmc_spi_get_status() function
-//!   - The program exits the functions with the memory card busy !
+//!   - The program exits the functions with the memory card busy ! The next
+//!     command waits for the end of the programming (write-behind)
 //!
 //! @param ram         pointer to ram buffer
 //!
@@ -1205,10 +1667,11 @@ bool sd_mmc_spi_read_sector_to_ram(void *ram)
 //!   The write succeeded   -> true
 //!   The write failed      -> false
 //!
-bool sd_mmc_spi_write_sector_from_ram(const void *ram)
+static bool sd_mmc_spi_write_block_from_ram(const void *ram)
 {
-  const uint8_t *_ram = ram;
-  uint16_t i;
+#if (SD_MMC_SPI_CRC == true)
+  uint16_t crc;
+#endif
 
   // wait for MMC not busy
   if (false == sd_mmc_spi_wait_not_busy())
@@ -1235,18 +1698,23 @@ bool sd_mmc_spi_write_sector_from_ram(const void *ram)
   // send data start token
   spi_write(SD_MMC_SPI,MMC_STARTBLOCK_WRITE);
   // write data
-  for(i=0;i<MMC_SECTOR_SIZE;i++)
-  {
-    spi_write(SD_MMC_SPI,*_ram++);
-  }
+  spi_write_buf(SD_MMC_SPI, ram, MMC_SECTOR_SIZE);
 
+#if (SD_MMC_SPI_CRC == true)
+  crc = sd_mmc_spi_crc16(ram, MMC_SECTOR_SIZE);
+  spi_write(SD_MMC_SPI,crc >> 8);  // send CRC
+  spi_write(SD_MMC_SPI,crc);
+#else
   spi_write(SD_MMC_SPI,0xFF);    // send CRC (field required but value ignored)
   spi_write(SD_MMC_SPI,0xFF);
+#endif
 
   // read data response token
   r1 = sd_mmc_spi_send_and_read(0xFF);
   if( (r1&MMC_DR_MASK) != MMC_DR_ACCEPT)
   {
+    if ((r1&MMC_DR_MASK) == MMC_DR_REJECT_CRC)
+      sd_mmc_spi_crc_stats.write_errors++;
     spi_write(SD_MMC_SPI,0xFF);    // send dummy bytes
     spi_write(SD_MMC_SPI,0xFF);
     spi_unselectChip(SD_MMC_SPI, SD_MMC_SPI_NPCS);
@@ -1260,16 +1728,42 @@ bool sd_mmc_spi_write_sector_from_ram(const void *ram)
   spi_unselectChip(SD_MMC_SPI, SD_MMC_SPI_NPCS);  // unselect SD_MMC_SPI
   gl_ptr_mem += 512;        // Update the memory pointer.
 
-  // wait card not busy after last programming operation
-  i=0;
-  while (false == sd_mmc_spi_wait_not_busy())
+  // the card programs the block: the next command waits for its end
+  sd_mmc_spi_programming = true;
+
+  return true;                  // Write done
+}
+
+#if SD_MMC_SPI_BUS == true
+static spi_status_t sd_mmc_spi_bus_write_block(spi_bus_trans_t *trans)
+{
+  return (sd_mmc_spi_write_block_from_ram(trans->tx)) ? SPI_OK : SPI_ERROR;
+}
+#endif
+
+//! @brief This function writes one MMC sector from a ram buffer, through the
+//! SPI bus scheduler if enabled
+static bool sd_mmc_spi_write_block(const void *ram)
+{
+#if SD_MMC_SPI_BUS == true
+  return sd_mmc_spi_bus_block(sd_mmc_spi_bus_write_block, ram, NULL);
+#else
+  return sd_mmc_spi_write_block_from_ram(ram);
+#endif
+}
+
+bool sd_mmc_spi_write_sector_from_ram(const void *ram)
+{
+  uint8_t retry = SD_MMC_SPI_RETRIES;
+
+  // a rejected block write is issued again before reporting the error
+  while (!sd_mmc_spi_link_status(sd_mmc_spi_write_block(ram)))
   {
-    i++;
-    if (i == 10)
+    if (!retry--)
       return false;
+    sd_mmc_spi_crc_stats.retries++;
   }
-
-  return true;                  // Write done
+  return true;
 }
 
 
@@ -100,6 +100,7 @@
 #define MMC_GO_IDLE_STATE                 0     ///< initialize card to SPI-type access
 #define MMC_SEND_OP_COND                  1     ///< set card operational mode
 #define MMC_CMD2                          2     ///< illegal in SPI mode !
+#define SD_SWITCH_FUNC                    6     ///< switch card function (SD 1.10 and later)
 #define MMC_SEND_IF_COND                  8
 #define MMC_SEND_CSD                      9     ///< get card's CSD
 #define MMC_SEND_CID                      10    ///< get card's CID
@@ -158,11 +159,21 @@
 
 #define SD_FAILURE                       -1
 #define SD_MMC                            0
+
+//! CRC error counters (see sd_mmc_spi_get_crc_stats())
+typedef struct
+{
+  uint32_t cmd_errors;     //!< commands rejected by the card (R1 COM_CRC)
+  uint32_t read_errors;    //!< data blocks read with a wrong CRC16
+  uint32_t write_errors;   //!< data blocks rejected by the card (CRC error token)
+  uint32_t retries;        //!< block transfers issued again
+} sd_mmc_spi_crc_stats_t;
 /*_____ D E C L A R A T I O N ______________________________________________*/
 
 //! Low-level functions (basic management)
 extern bool sd_mmc_spi_internal_init(void);
 extern bool sd_mmc_spi_init(spi_options_t spiOptions, unsigned int pba_hz);             // initializes the SD/MMC card (reset, init, analyse)
+extern void sd_mmc_spi_set_pba_hz(unsigned int pba_hz);  // keeps the SPI clock of the card after a PBA clock change
 extern bool sd_mmc_spi_check_presence(void);    // check the presence of the card
 extern bool sd_mmc_spi_mem_check(void);         // check the presence of the card, and initialize if inserted
 extern bool sd_mmc_spi_wait_not_busy (void);    // wait for the card to be not busy (exits with timeout)
@@ -171,6 +182,11 @@ extern bool sd_mmc_spi_get_cid(uint8_t *);      // stores the CID of the card in
 extern int  sd_mmc_spi_get_if(void);
 extern int  sd_mmc_spi_check_hc(void);
 extern void sd_mmc_spi_get_capacity(void);                     // extract parameters from CSD and compute capacity, last block adress, erase group size
+extern uint32_t sd_mmc_spi_get_tran_speed(void);               // maximum transfer rate of the card from the CSD (Hz)
+extern uint32_t sd_mmc_spi_get_speed(void);                    // current SPI clock of the card (Hz)
+extern bool     sd_mmc_spi_is_busy(void);                      // last written block possibly still programming
+extern void     sd_mmc_spi_set_busy_callback(void (*callback)(void)); // function called while waiting for the card
+extern void     sd_mmc_spi_get_crc_stats(sd_mmc_spi_crc_stats_t *stats); // CRC error counters
 extern bool sd_mmc_spi_get_status(void);                       // read the status register of the card (R2 response)
 extern uint8_t   sd_mmc_spi_send_and_read(uint8_t);            // send a byte on SPI and returns the received byte
 extern uint8_t   sd_mmc_spi_send_command(uint8_t, uint32_t);   // send a single command + argument (R1 response expected and returned), with memory select then unselect
@@ -198,6 +198,58 @@ bool  sd_mmc_spi_removal(void)
 }
 
 
+//!
+//! @brief This function returns the erase block size of the card.
+//!
+//! @return erase group size (unit 512B) read from the CSD, 0 if the card isn't initialized
+//!/
+uint16_t sd_mmc_spi_erase_block_size(void)
+{
+   if (!sd_mmc_spi_init_done)
+     return 0;
+   return erase_group_size;
+}
+
+
+//!
+//! @brief This function tells the card that a sector range does not hold data anymore.
+//!
+//! The card erases whole erase groups, so only the groups entirely inside
+//! the range are erased.
+//!
+//! @param addr         Address of first sector to discard
+//! @param nb_sector    Number of sectors to discard
+//!
+//! @return                Ctrl_status
+//!   It is ready       ->    CTRL_GOOD
+//!   An error occurs   ->    CTRL_FAIL
+//!   Memory unplug     ->    CTRL_NO_PRESENT
+//!/
+Ctrl_status sd_mmc_spi_discard(uint32_t addr, uint32_t nb_sector)
+{
+   uint32_t start, end;
+   bool status;
+
+   if (!sd_mmc_spi_init_done)
+     return CTRL_NO_PRESENT;
+   if (addr + nb_sector > sd_mmc_spi_last_block_address + 1)
+     return CTRL_FAIL;
+   if (0 == erase_group_size)
+     return CTRL_GOOD;
+
+   // Round the range inward to the erase group boundaries
+   start = ((addr + erase_group_size - 1) / erase_group_size) * erase_group_size;
+   end   = ((addr + nb_sector) / erase_group_size) * erase_group_size;
+   if (end <= start)
+     return CTRL_GOOD;    // No whole erase group in the range
+
+   Sd_mmc_spi_access_signal_on();
+   status = sd_mmc_spi_erase_sector_group(start, end - 1);
+   Sd_mmc_spi_access_signal_off();
+   return (status) ? CTRL_GOOD : CTRL_FAIL;
+}
+
+
 
 //------------ STANDARD FUNCTIONS to read/write the memory --------------------
 
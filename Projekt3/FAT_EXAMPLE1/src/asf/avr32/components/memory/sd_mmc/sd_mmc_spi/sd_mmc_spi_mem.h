@@ -117,6 +117,30 @@ extern bool           sd_mmc_spi_wr_protect(void);
 //!
 extern bool           sd_mmc_spi_removal(void);
 
+//!
+//! @brief This function returns the erase block size of the card.
+//!
+//! Writes aligned on this boundary avoid a read-modify-write inside the card.
+//!
+//! @return erase group size (unit 512B), 0 if the card isn't initialized
+//!/
+extern uint16_t       sd_mmc_spi_erase_block_size(void);
+
+//!
+//! @brief This function tells the card that a sector range does not hold data anymore.
+//!
+//! Only the erase groups entirely inside the range are erased.
+//!
+//! @param addr         Address of first sector to discard
+//! @param nb_sector    Number of sectors to discard
+//!
+//! @return                Ctrl_status
+//!   It is ready       ->    CTRL_GOOD
+//!   An error occurs   ->    CTRL_FAIL
+//!   Memory unplug     ->    CTRL_NO_PRESENT
+//!/
+extern Ctrl_status    sd_mmc_spi_discard(uint32_t addr, uint32_t nb_sector);
+
 
 //---- ACCESS DATA FONCTIONS ----
 
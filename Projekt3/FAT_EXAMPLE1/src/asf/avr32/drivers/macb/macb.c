@@ -71,7 +71,7 @@
 #endif
 
 /* Size of each receive buffer - DO NOT CHANGE. */
-#define RX_BUFFER_SIZE    128
+#define RX_BUFFER_SIZE    MACB_RX_BUFFER_SIZE
 
 
 /* The buffer addresses written into the descriptors must be aligned so the
@@ -210,11 +210,26 @@ static volatile int DataToRead = 0;
 /* Holds the index to the next buffer from which data will be read. */
 volatile unsigned long ulNextRxBuffer = 0;
 
+/* Receive statistics (the used field is computed on request). */
+static macb_rx_stats_t xRxStats;
+
+/* Set while the Rx interrupt is masked (coalescing mode). */
+static volatile bool xRxPolling = false;
+
+/* Holds the index to the next buffer to which data will be written. */
+static unsigned long uxTxBufferIndex = 0;
+
+/* Number of Tx descriptors given to the MACB and not yet cleared. */
+static volatile unsigned long uxTxInFlight = 0;
+
+/* Completion callback of the frame ending at each Tx descriptor. */
+static macb_tx_callback_t pxTxCallback[ ETHERNET_CONF_NB_TX_BUFFERS ];
+static void *pvTxCallbackArg[ ETHERNET_CONF_NB_TX_BUFFERS ];
+
 
 unsigned long lMACBSend(volatile avr32_macb_t *macb, const void *pvFrom, unsigned long ulLength, long lEndOfFrame)
 {
   const unsigned char *pcFrom = pvFrom;
-  static unsigned long uxTxBufferIndex = 0;
   void *pcBuffer;
   unsigned long ulLastBuffer, ulDataBuffered = 0, ulDataRemainingToSend, ulLengthToSend;
 
@@ -224,7 +239,7 @@ unsigned long lMACBSend(volatile avr32_macb_t *macb, const void *pvFrom, unsigne
   while( ulDataBuffered < ulLength )
   {
     // Is a buffer available ?
-    while( !( xTxDescriptors[ uxTxBufferIndex ].U_Status.status & AVR32_TRANSMIT_OK ) )
+    while( uxTxInFlight >= ETHERNET_CONF_NB_TX_BUFFERS )
     {
       // There is no room to write the Tx data to the Tx buffer.
       // Wait a short while, then try again.
@@ -261,6 +276,7 @@ unsigned long lMACBSend(volatile avr32_macb_t *macb, const void *pvFrom, unsigne
       {
         // No more data remains for this frame so we can start the transmission.
         ulLastBuffer = AVR32_LAST_BUFFER;
+        pxTxCallback[ uxTxBufferIndex ] = NULL;
       }
       else
       {
@@ -282,6 +298,7 @@ unsigned long lMACBSend(volatile avr32_macb_t *macb, const void *pvFrom, unsigne
                                     | ulLastBuffer;
         uxTxBufferIndex++;
       }
+      uxTxInFlight++;
       /* If this is the last buffer to be sent for this frame we can
          start the transmission. */
       if( ulLastBuffer )
@@ -296,6 +313,73 @@ unsigned long lMACBSend(volatile avr32_macb_t *macb, const void *pvFrom, unsigne
 }
 
 
+long lMACBSendFrame(volatile avr32_macb_t *macb, const macb_packet_t *pxSegments, unsigned int uiNbSegments, macb_tx_callback_t pxCallback, void *pvArg)
+{
+  unsigned long ulIndex, ulFirst, ulStatus, ulFirstStatus = 0;
+  unsigned int i;
+
+  if( ( uiNbSegments == 0 ) || ( uiNbSegments > ETHERNET_CONF_NB_TX_BUFFERS ) )
+  {
+    return MACB_TX_INVALID_ARGUMENT;
+  }
+  for( i = 0; i < uiNbSegments; i++ )
+  {
+    if( ( pxSegments[ i ].len == 0 ) || ( pxSegments[ i ].len >= ( 1 << AVR32_MACB_TX_LEN_SIZE ) ) )
+    {
+      return MACB_TX_INVALID_ARGUMENT;
+    }
+  }
+
+  portENTER_CRITICAL();
+  {
+    // Are enough buffers available ?
+    if( ETHERNET_CONF_NB_TX_BUFFERS - uxTxInFlight < uiNbSegments )
+    {
+      portEXIT_CRITICAL();
+      return MACB_TX_WOULD_BLOCK;
+    }
+
+    // Point the descriptors to the segments. The first descriptor is given to
+    // the MACB last, so that it never starts on a partial frame.
+    ulFirst = uxTxBufferIndex;
+    ulIndex = ulFirst;
+    for( i = 0; i < uiNbSegments; i++ )
+    {
+      xTxDescriptors[ ulIndex ].addr = ( unsigned long ) pxSegments[ i ].data;
+      ulStatus = pxSegments[ i ].len;
+      if( i == uiNbSegments - 1 )
+      {
+        ulStatus |= AVR32_LAST_BUFFER;
+        pxTxCallback[ ulIndex ] = pxCallback;
+        pvTxCallbackArg[ ulIndex ] = pvArg;
+      }
+      if( ulIndex >= ( ETHERNET_CONF_NB_TX_BUFFERS - 1 ) )
+      {
+        ulStatus |= AVR32_TRANSMIT_WRAP;
+      }
+      if( i == 0 )
+      {
+        ulFirstStatus = ulStatus;
+      }
+      else
+      {
+        xTxDescriptors[ ulIndex ].U_Status.status = ulStatus;
+      }
+      if( ++ulIndex >= ETHERNET_CONF_NB_TX_BUFFERS ) ulIndex = 0;
+    }
+    xTxDescriptors[ ulFirst ].U_Status.status = ulFirstStatus;
+    uxTxBufferIndex = ulIndex;
+    uxTxInFlight += uiNbSegments;
+
+    // Start the transmission.
+    macb->ncr |=  AVR32_MACB_TSTART_MASK;
+  }
+  portEXIT_CRITICAL();
+
+  return MACB_TX_SUCCESS;
+}
+
+
 unsigned long ulMACBInputLength(void)
 {
   register unsigned long ulIndex , ulLength = 0;
@@ -471,6 +555,180 @@ void vMACBRead(void *pvTo, unsigned long ulSectionLength, unsigned long ulTotalF
   }
 }
 
+/*-----------------------------------------------------------*/
+
+/*
+ * Give the Rx buffers from ulFirst up to (excluding) ulLast back to the MACB.
+ */
+static void prvReleaseRxBuffers(unsigned long ulFirst, unsigned long ulLast)
+{
+  unsigned int uiTemp;
+
+  while( ulFirst != ulLast )
+  {
+    // Mark the buffer as owned by the MACB.
+    uiTemp = xRxDescriptors[ ulFirst ].addr;
+    xRxDescriptors[ ulFirst ].addr = uiTemp & ~( AVR32_OWNERSHIP_BIT );
+    if( ++ulFirst >= ETHERNET_CONF_NB_RX_BUFFERS ) ulFirst = 0;
+  }
+}
+
+bool xMACBRxGet(macb_rx_frame_t *frame)
+{
+  unsigned long ulIndex, ulLength = 0;
+  unsigned int uiNbSegments = 0;
+  volatile unsigned long ulEventStatus;
+
+  // Check if the MACB encountered a problem.
+  ulEventStatus = AVR32_MACB.rsr;
+  if( ulEventStatus & AVR32_MACB_RSR_OVR_MASK )
+  {
+    xRxStats.overruns++;
+    AVR32_MACB.rsr = AVR32_MACB_RSR_OVR_MASK;  // Clear
+  }
+  if( ulEventStatus & AVR32_MACB_RSR_BNA_MASK )
+  {
+    xRxStats.bna++;
+    if( xRxStats.held == 0 )
+    {
+      // Nothing is held by the application: restart from a clean state.
+      vResetMacbRxFrames();
+      return false;
+    }
+    // The MACB resumes by itself once the held buffers are released.
+    AVR32_MACB.rsr = AVR32_MACB_RSR_BNA_MASK;  // Clear
+    AVR32_MACB.rsr; // Read to force the previous write
+  }
+
+  // Skip any fragments.  We are looking for the first buffer that contains
+  // data and has the SOF (start of frame) bit set.
+  while( ( xRxDescriptors[ ulNextRxBuffer ].addr & AVR32_OWNERSHIP_BIT )
+        && !( xRxDescriptors[ ulNextRxBuffer ].U_Status.status & AVR32_SOF ) )
+  {
+    prvReleaseRxBuffers( ulNextRxBuffer, ( ulNextRxBuffer + 1 ) % ETHERNET_CONF_NB_RX_BUFFERS );
+    xRxStats.dropped++;
+    if( ++ulNextRxBuffer >= ETHERNET_CONF_NB_RX_BUFFERS ) ulNextRxBuffer = 0;
+  }
+
+  // Walk through the descriptors until we find the last buffer for this frame,
+  // collecting a view on each buffer on the way.
+  ulIndex = ulNextRxBuffer;
+  while( xRxDescriptors[ ulIndex ].addr & AVR32_OWNERSHIP_BIT )
+  {
+    if( uiNbSegments >= ETHERNET_CONF_NB_RX_SEGMENTS )
+    {
+      // Frame too long: discard the buffers collected so far; the rest of
+      // the frame is skipped as fragments by the next call.
+      prvReleaseRxBuffers( ulNextRxBuffer, ulIndex );
+      ulNextRxBuffer = ulIndex;
+      xRxStats.dropped++;
+      return false;
+    }
+    frame->segment[ uiNbSegments ].data = ( unsigned char * )( xRxDescriptors[ ulIndex ].addr & ADDRESS_MASK );
+    frame->segment[ uiNbSegments ].len = RX_BUFFER_SIZE;
+    uiNbSegments++;
+
+    ulLength = xRxDescriptors[ ulIndex ].U_Status.status & AVR32_LENGTH_FRAME;
+    if( ulLength ) break;
+
+    // Increment to the next buffer, wrapping if necessary.
+    if( ++ulIndex >= ETHERNET_CONF_NB_RX_BUFFERS ) ulIndex = 0;
+
+    // Is the descriptor valid?
+    if( !( xRxDescriptors[ ulIndex ].addr & AVR32_OWNERSHIP_BIT ) ) break;
+
+    // Is it a SOF? If so, the head packet is bad and should be discarded
+    if( xRxDescriptors[ ulIndex ].U_Status.status & AVR32_SOF )
+    {
+      prvReleaseRxBuffers( ulNextRxBuffer, ulIndex );
+      ulNextRxBuffer = ulIndex;
+      uiNbSegments = 0;
+      xRxStats.dropped++;
+    }
+  }
+  if( ulLength == 0 )
+  {
+    // No complete frame yet.
+    return false;
+  }
+
+  // The last buffer only holds the end of the frame.
+  frame->segment[ uiNbSegments - 1 ].len = ulLength - ( uiNbSegments - 1 ) * RX_BUFFER_SIZE;
+  frame->first = ulNextRxBuffer;
+  frame->len = ulLength;
+  frame->nb_segments = uiNbSegments;
+
+  // The buffers now belong to the application: move past them.
+  if( ++ulIndex >= ETHERNET_CONF_NB_RX_BUFFERS ) ulIndex = 0;
+  ulNextRxBuffer = ulIndex;
+
+  xRxStats.frames++;
+  xRxStats.held += uiNbSegments;
+  if( xRxStats.held > xRxStats.held_max )
+  {
+    xRxStats.held_max = xRxStats.held;
+  }
+  return true;
+}
+
+unsigned int uiMACBRxPoll(unsigned int uiBudget, macb_rx_handler_t pxHandler)
+{
+  macb_rx_frame_t xFrame;
+  unsigned int uiCount = 0;
+
+  while( ( uiCount < uiBudget ) && xMACBRxGet( &xFrame ) )
+  {
+    pxHandler( &xFrame );
+    uiCount++;
+  }
+
+#if ETHERNET_CONF_RX_COALESCING == 1
+  if( ( uiCount < uiBudget ) && xRxPolling )
+  {
+    // The ring is empty: back to interrupt mode.
+    portENTER_CRITICAL();
+    {
+      xRxPolling = false;
+      AVR32_MACB.ier = AVR32_MACB_IER_RCOMP_MASK;
+      // A frame received since the ring was checked may have had its RCOMP
+      // flag cleared by a Tx interrupt: signal it ourselves.
+      if( xRxDescriptors[ ulNextRxBuffer ].addr & AVR32_OWNERSHIP_BIT )
+      {
+#ifdef FREERTOS_USED
+        xSemaphoreGive( xSemaphore );
+#else
+        DataToRead++;
+#endif
+      }
+    }
+    portEXIT_CRITICAL();
+  }
+#endif
+
+  return uiCount;
+}
+
+void vMACBRxRelease(const macb_rx_frame_t *frame)
+{
+  prvReleaseRxBuffers( frame->first, ( frame->first + frame->nb_segments ) % ETHERNET_CONF_NB_RX_BUFFERS );
+  xRxStats.held -= frame->nb_segments;
+}
+
+void vMACBGetRxStats(macb_rx_stats_t *stats)
+{
+  unsigned long ulIndex;
+
+  *stats = xRxStats;
+  stats->used = 0;
+  for( ulIndex = 0; ulIndex < ETHERNET_CONF_NB_RX_BUFFERS; ++ulIndex )
+  {
+    if( xRxDescriptors[ ulIndex ].addr & AVR32_OWNERSHIP_BIT )
+    {
+      stats->used++;
+    }
+  }
+}
+
 /*-----------------------------------------------------------*/
 void vMACBSetMACAddress(const unsigned char *MACAddress)
 {
@@ -564,34 +822,43 @@ void vDisableMACBOperations(volatile avr32_macb_t *macb)
 void vClearMACBTxBuffer(void)
 {
   static unsigned long uxNextBufferToClear = 0;
+  unsigned long ulStatus;
+  macb_tx_callback_t pxCallback;
+  void *pvArg;
 
   // Called on Tx interrupt events to set the AVR32_TRANSMIT_OK bit in each
-  // Tx buffer within the frame just transmitted.  This marks all the buffers
+  // Tx buffer within the frames just transmitted.  This marks all the buffers
   // as available again.
 
   // The first buffer in the frame should have the bit set automatically. */
-  if( xTxDescriptors[ uxNextBufferToClear ].U_Status.status & AVR32_TRANSMIT_OK )
+  while( uxTxInFlight && ( xTxDescriptors[ uxNextBufferToClear ].U_Status.status & AVR32_TRANSMIT_OK ) )
   {
-    // Loop through the other buffers in the frame.
-    while( !( xTxDescriptors[ uxNextBufferToClear ].U_Status.status & AVR32_LAST_BUFFER ) )
+    // Loop through the buffers in the frame.
+    do
     {
-      uxNextBufferToClear++;
+      ulStatus = xTxDescriptors[ uxNextBufferToClear ].U_Status.status;
+      xTxDescriptors[ uxNextBufferToClear ].U_Status.status = ulStatus | AVR32_TRANSMIT_OK;
+
+      // Point the buffer back to its own Tx buffer: lMACBSendFrame() sets it
+      // to an application buffer.
+      xTxDescriptors[ uxNextBufferToClear ].addr = ( unsigned long )( pcTxBuffer + ( uxNextBufferToClear * ETHERNET_CONF_TX_BUFFER_SIZE ) );
+      uxTxInFlight--;
 
+      pxCallback = pxTxCallback[ uxNextBufferToClear ];
+      pvArg = pvTxCallbackArg[ uxNextBufferToClear ];
+      pxTxCallback[ uxNextBufferToClear ] = NULL;
+
+      // Start with the next buffer, wrapping back to the first buffer if needed.
+      uxNextBufferToClear++;
       if( uxNextBufferToClear >= ETHERNET_CONF_NB_TX_BUFFERS )
       {
         uxNextBufferToClear = 0;
       }
+    } while( uxTxInFlight && !( ulStatus & AVR32_LAST_BUFFER ) );
 
-      xTxDescriptors[ uxNextBufferToClear ].U_Status.status |= AVR32_TRANSMIT_OK;
-    }
-
-    // Start with the next buffer the next time a Tx interrupt is called.
-    uxNextBufferToClear++;
-
-    // Do we need to wrap back to the first buffer?
-    if( uxNextBufferToClear >= ETHERNET_CONF_NB_TX_BUFFERS )
+    if( ( ulStatus & AVR32_LAST_BUFFER ) && pxCallback )
     {
-      uxNextBufferToClear = 0;
+      pxCallback( pvArg );
     }
   }
 }
@@ -960,8 +1227,14 @@ static long prvMACB_ISR_NonNakedBehaviour(void)
   ulIntStatus = AVR32_MACB.isr;
   ulEventStatus = AVR32_MACB.rsr;
 
-  if( ( ulIntStatus & AVR32_MACB_IDR_RCOMP_MASK ) || ( ulEventStatus & AVR32_MACB_REC_MASK ) )
+  if( !xRxPolling && ( ( ulIntStatus & AVR32_MACB_IDR_RCOMP_MASK ) || ( ulEventStatus & AVR32_MACB_REC_MASK ) ) )
   {
+    xRxStats.interrupts++;
+#if ETHERNET_CONF_RX_COALESCING == 1
+    // Mask the Rx interrupt: the following frames are drained by uiMACBRxPoll().
+    AVR32_MACB.idr = AVR32_MACB_IDR_RCOMP_MASK;
+    xRxPolling = true;
+#endif
     // A frame has been received, signal the IP task so it can process
     // the Rx descriptors.
     portENTER_CRITICAL();
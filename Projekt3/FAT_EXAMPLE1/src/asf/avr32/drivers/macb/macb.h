@@ -218,6 +218,68 @@ typedef struct
 } macb_packet_t;
 //! @}
 
+/*! Size of each receive buffer (fixed by the MACB). */
+#define MACB_RX_BUFFER_SIZE             128
+
+/*! Set to 1 to coalesce the receive interrupts: the interrupt is masked after
+ *  the first frame and the ring is drained by \ref uiMACBRxPoll, which unmasks
+ *  it once the ring is empty. */
+#ifndef ETHERNET_CONF_RX_COALESCING
+#define ETHERNET_CONF_RX_COALESCING     0
+#endif
+
+/*! Maximum number of receive buffers spanned by one frame (1536-byte frames). */
+#ifndef ETHERNET_CONF_NB_RX_SEGMENTS
+#define ETHERNET_CONF_NB_RX_SEGMENTS    ((1536 + MACB_RX_BUFFER_SIZE - 1) / MACB_RX_BUFFER_SIZE)
+#endif
+
+/*! Received frame, as views on the receive buffers it spans. The buffers
+ *  belong to the application until the frame is released.
+ */
+//! @{
+typedef struct
+{
+  unsigned long first;                                      //!< Index of the first Rx descriptor
+  unsigned int len;                                         //!< Length of the frame
+  unsigned int nb_segments;                                 //!< Number of Rx buffers used
+  macb_packet_t segment[ ETHERNET_CONF_NB_RX_SEGMENTS ];   //!< Data of each Rx buffer
+} macb_rx_frame_t;
+//! @}
+
+/*! Received frame handler, called by \ref uiMACBRxPoll. The handler owns the
+ *  frame and must release it with \ref vMACBRxRelease.
+ */
+typedef void (*macb_rx_handler_t)(macb_rx_frame_t *pxFrame);
+
+/*! Transmit completion callback, called from the MACB interrupt once the
+ *  frame is sent and its buffers are no longer used by the MACB.
+ */
+typedef void (*macb_tx_callback_t)(void *pvArg);
+
+/*! \name Transmit status
+ */
+//! @{
+#define MACB_TX_SUCCESS                 0
+#define MACB_TX_WOULD_BLOCK            -1
+#define MACB_TX_INVALID_ARGUMENT       -2
+//! @}
+
+/*! Receive statistics.
+ */
+//! @{
+typedef struct
+{
+  unsigned long frames;         //!< Frames handed to the application
+  unsigned long dropped;        //!< Fragments and faulty frames discarded
+  unsigned long bna;            //!< Buffer not available events
+  unsigned long overruns;       //!< Receive overrun events
+  unsigned long interrupts;     //!< Receive interrupts (frames / interrupts gives the coalescing)
+  unsigned int used;            //!< Rx buffers currently not owned by the MACB
+  unsigned int held;            //!< Rx buffers held by unreleased frames
+  unsigned int held_max;        //!< Maximum of held
+} macb_rx_stats_t;
+//! @}
+
 /*! Receive Transfer descriptor structure.
  */
 //! @{
@@ -356,6 +418,24 @@ extern bool xMACBInit(volatile avr32_macb_t *macb);
  */
 extern unsigned long lMACBSend(volatile avr32_macb_t *macb, const void *pvFrom, unsigned long ulLength, long lEndOfFrame);
 
+/**
+ * \brief Queue a frame made of application buffers, without copying it.
+ * The segments (e.g. header then payload) are given to the MACB as they are
+ * and must stay untouched until the callback is called. This function never
+ * waits for free descriptors. Do not use while a frame started with
+ * \ref lMACBSend is not ended.
+ *
+ * \param *macb        Base address of the MACB
+ * \param *pxSegments  Segments of the frame, 1 to 2047 bytes each
+ * \param uiNbSegments Number of segments
+ * \param pxCallback   Function called when the frame is sent, or NULL
+ * \param *pvArg       Argument of the callback
+ *
+ * \return MACB_TX_SUCCESS, MACB_TX_WOULD_BLOCK if not enough Tx descriptors
+ * are free, MACB_TX_INVALID_ARGUMENT otherwise.
+ */
+extern long lMACBSendFrame(volatile avr32_macb_t *macb, const macb_packet_t *pxSegments, unsigned int uiNbSegments, macb_tx_callback_t pxCallback, void *pvArg);
+
 /**
  * \brief Frames can be read from the MACB in multiple sections.
  * Read ulSectionLength bytes from the MACB receive buffers to pcTo.
@@ -371,8 +451,8 @@ extern void vMACBRead(void *pvTo, unsigned long ulSectionLength, unsigned long u
 
 /**
  * \brief Called by the Tx interrupt, this function traverses the buffers used to
- * hold the frame that has just completed transmission and marks each as
- * free again.
+ * hold the frames that have just completed transmission, marks each as
+ * free again and calls the completion callbacks.
  */
 extern void vClearMACBTxBuffer(void);
 
@@ -398,6 +478,47 @@ extern bool vMACBWaitForInput(unsigned long ulTimeOut);
  */
 extern unsigned long ulMACBInputLength(void);
 
+/**
+ * \brief Get the next received frame without copying it.
+ *
+ * The frame is described by views on the receive buffers; they stay out of
+ * the receive ring until \ref vMACBRxRelease is called, in any order. Do not
+ * mix with \ref ulMACBInputLength / \ref vMACBRead while frames are held.
+ *
+ * \param *frame       Output. Received frame
+ *
+ * \return true if a frame was received, false otherwise.
+ */
+extern bool xMACBRxGet(macb_rx_frame_t *frame);
+
+/**
+ * \brief Drain the received frames, up to a budget.
+ *
+ * Each frame is given to the handler. If the ring is empty before the budget
+ * is spent, the receive interrupt is unmasked again (coalescing mode); else
+ * the caller should call this function again soon.
+ *
+ * \param uiBudget     Maximum number of frames to handle
+ * \param pxHandler    Received frame handler
+ *
+ * \return the number of frames handled.
+ */
+extern unsigned int uiMACBRxPoll(unsigned int uiBudget, macb_rx_handler_t pxHandler);
+
+/**
+ * \brief Give the receive buffers of a frame back to the MACB.
+ *
+ * \param *frame       Frame obtained from \ref xMACBRxGet
+ */
+extern void vMACBRxRelease(const macb_rx_frame_t *frame);
+
+/**
+ * \brief Get the receive statistics.
+ *
+ * \param *stats       Output. Receive statistics
+ */
+extern void vMACBGetRxStats(macb_rx_stats_t *stats);
+
 /**
  * \brief Set the MACB Physical address (SA1B & SA1T registers).
  *
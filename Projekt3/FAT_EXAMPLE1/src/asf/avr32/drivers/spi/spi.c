@@ -45,6 +45,7 @@
 
 
 #include "spi.h"
+#include "trace.h"
 
 #ifdef FREERTOS_USED
 
@@ -397,6 +398,179 @@ spi_status_t spi_read(volatile avr32_spi_t *spi, unsigned short *data)
 }
 
 
+//! Waits until the last frame has been shifted out.
+static spi_status_t spi_wait_tx_empty(volatile avr32_spi_t *spi)
+{
+  unsigned int timeout = SPI_TIMEOUT;
+
+  while (!(spi->sr & AVR32_SPI_SR_TXEMPTY_MASK)) {
+    if (!timeout--) {
+      return SPI_ERROR_TIMEOUT;
+    }
+  }
+
+  return SPI_OK;
+}
+
+
+//! Transfers frames of 8 or 16 bits (most significant byte first) while
+//! keeping the transmit data register loaded during the current shift.
+static spi_status_t spi_transfer_frames(volatile avr32_spi_t *spi,
+                                        const uint8_t *tx, uint8_t *rx,
+                                        size_t frames, uint8_t dummy,
+                                        bool wide)
+{
+  unsigned int timeout;
+  unsigned long sr, status = 0;
+  uint16_t data;
+  size_t to_send = frames;
+  size_t to_receive = (rx) ? frames : 0;
+
+  if (rx) {
+    // Discard the data left by previous write-only transfers.
+    if (spi_wait_tx_empty(spi) != SPI_OK) {
+      return SPI_ERROR_TIMEOUT;
+    }
+    data = spi->rdr;
+  }
+
+  while (to_send || to_receive) {
+    // At most one frame shifting and one frame waiting in TDR.
+    if (to_send && (!rx || to_receive - to_send < 2)) {
+      timeout = SPI_TIMEOUT;
+      while (!((sr = spi->sr) & AVR32_SPI_SR_TDRE_MASK)) {
+        if (!timeout--) {
+          return SPI_ERROR_TIMEOUT;
+        }
+      }
+      status |= sr;
+
+      if (!tx) {
+        data = (wide) ? (dummy << 8) | dummy : dummy;
+      } else if (wide) {
+        data = (tx[0] << 8) | tx[1];
+        tx += 2;
+      } else {
+        data = *tx++;
+      }
+      spi->tdr = data << AVR32_SPI_TDR_TD_OFFSET;
+      to_send--;
+      continue;
+    }
+
+    timeout = SPI_TIMEOUT;
+    while (!((sr = spi->sr) & AVR32_SPI_SR_RDRF_MASK)) {
+      if (!timeout--) {
+        return SPI_ERROR_TIMEOUT;
+      }
+    }
+    status |= sr;
+
+    data = spi->rdr >> AVR32_SPI_RDR_RD_OFFSET;
+    if (wide) {
+      *rx++ = data >> 8;
+    }
+    *rx++ = data;
+    to_receive--;
+  }
+
+  // The overrun flag only matters when the received data is kept.
+  if (rx && (status & AVR32_SPI_SR_OVRES_MASK)) {
+    return SPI_ERROR_OVERRUN;
+  }
+
+  return SPI_OK;
+}
+
+
+#if SPI_BUF_16BIT == true
+//! Returns the chip select register used by the selected chip.
+static volatile unsigned long *spi_get_selected_csr(volatile avr32_spi_t *spi)
+{
+  unsigned int pcs = (spi->mr & AVR32_SPI_MR_PCS_MASK) >> AVR32_SPI_MR_PCS_OFFSET;
+  unsigned int reg = 0;
+
+  if (spi->mr & AVR32_SPI_MR_PCSDEC_MASK) {
+    reg = pcs >> 2;
+  } else {
+    while (reg < 3 && (pcs & (1 << reg))) {
+      reg++;
+    }
+  }
+
+  return &spi->csr0 + reg;
+}
+#endif
+
+
+static spi_status_t spi_transfer(volatile avr32_spi_t *spi,
+                                 const uint8_t *tx, uint8_t *rx,
+                                 size_t len, uint8_t dummy)
+{
+  spi_status_t status = SPI_OK;
+#if SPI_BUF_16BIT == true
+  volatile unsigned long *csr;
+  unsigned long csr_value;
+  size_t wide_len = len & ~1;
+#endif
+
+  Trace_function(TRACE_SPI_TRANSFER);
+
+#if SPI_BUF_16BIT == true
+  csr = spi_get_selected_csr(spi);
+  csr_value = *csr;
+
+  // Send the even part of the buffer in 16-bit frames if the chip uses 8 bits.
+  if (wide_len && !(csr_value & AVR32_SPI_CSR0_BITS_MASK)) {
+    if (spi_wait_tx_empty(spi) != SPI_OK) {
+      return SPI_ERROR_TIMEOUT;
+    }
+    *csr = csr_value | ((16 - 8) << AVR32_SPI_CSR0_BITS_OFFSET);
+
+    status = spi_transfer_frames(spi, tx, rx, wide_len / 2, dummy, true);
+    if (status == SPI_OK && !rx) {
+      status = spi_wait_tx_empty(spi);
+    }
+
+    *csr = csr_value;
+    if (tx) {
+      tx += wide_len;
+    }
+    if (rx) {
+      rx += wide_len;
+    }
+    len -= wide_len;
+  }
+#endif
+
+  if (status == SPI_OK && len) {
+    status = spi_transfer_frames(spi, tx, rx, len, dummy, false);
+  }
+
+  return status;
+}
+
+
+spi_status_t spi_write_buf(volatile avr32_spi_t *spi, const void *buf, size_t len)
+{
+  return spi_transfer(spi, buf, NULL, len, 0);
+}
+
+
+spi_status_t spi_read_buf(volatile avr32_spi_t *spi, void *buf, size_t len,
+                          uint8_t dummy)
+{
+  return spi_transfer(spi, NULL, buf, len, dummy);
+}
+
+
+spi_status_t spi_transfer_buf(volatile avr32_spi_t *spi, const void *tx,
+                              void *rx, size_t len)
+{
+  return spi_transfer(spi, tx, rx, len, 0xFF);
+}
+
+
 unsigned char spi_getStatus(volatile avr32_spi_t *spi)
 {
   spi_status_t ret = SPI_OK;
@@ -62,6 +62,12 @@
 //! Time-out value (number of attempts).
 #define SPI_TIMEOUT       15000
 
+//! Use 16-bit frames for the even part of the buffer transfers on chips set
+//! up for 8-bit characters (fewer frames and status polls per buffer).
+#ifndef SPI_BUF_16BIT
+#define SPI_BUF_16BIT     false
+#endif
+
 //! Spi Mode 0.
 #define SPI_MODE_0       0
 
@@ -690,6 +696,56 @@ extern unsigned char spi_readRegisterFullCheck(volatile avr32_spi_t *spi);
  */
 extern spi_status_t spi_read(volatile avr32_spi_t *spi, uint16_t *data);
 
+/*! \brief Writes a buffer to the selected slave.
+ *
+ * The next data word is loaded in the transmit data register while the
+ * current one is shifted out. The received data is discarded.
+ *
+ * \param spi   Base address of the SPI instance.
+ * \param buf   Data to send.
+ * \param len   Number of bytes to send.
+ *
+ * \return Status.
+ *   \retval SPI_OK             Success.
+ *   \retval SPI_ERROR_TIMEOUT  Time-out.
+ *
+ * \note The function returns when the last data word has been loaded in the
+ *       transmit data register, as \ref spi_write does.
+ */
+extern spi_status_t spi_write_buf(volatile avr32_spi_t *spi, const void *buf,
+                                  size_t len);
+
+/*! \brief Reads a buffer from the selected slave by sending dummy bytes.
+ *
+ * \param spi   Base address of the SPI instance.
+ * \param buf   Pointer to the location where to store the received data.
+ * \param len   Number of bytes to read.
+ * \param dummy Byte sent for each byte read.
+ *
+ * \return Status.
+ *   \retval SPI_OK             Success.
+ *   \retval SPI_ERROR_TIMEOUT  Time-out.
+ *   \retval SPI_ERROR_OVERRUN  A received data word was lost.
+ */
+extern spi_status_t spi_read_buf(volatile avr32_spi_t *spi, void *buf,
+                                 size_t len, uint8_t dummy);
+
+/*! \brief Sends a buffer to the selected slave and stores the received data.
+ *
+ * \param spi   Base address of the SPI instance.
+ * \param tx    Data to send, or NULL to send 0xFF.
+ * \param rx    Pointer to the location where to store the received data, or
+ *              NULL to discard it. \a tx and \a rx may be the same buffer.
+ * \param len   Number of bytes to transfer.
+ *
+ * \return Status.
+ *   \retval SPI_OK             Success.
+ *   \retval SPI_ERROR_TIMEOUT  Time-out.
+ *   \retval SPI_ERROR_OVERRUN  A received data word was lost.
+ */
+extern spi_status_t spi_transfer_buf(volatile avr32_spi_t *spi, const void *tx,
+                                     void *rx, size_t len);
+
 /*! \brief Gets status information from the SPI.
  *
  * \param spi Base address of the SPI instance.
@@ -46,6 +46,7 @@
 #include <avr32/io.h>
 #include "compiler.h"
 #include "intc.h"
+#include "cycle_counter.h"
 #include "twi.h"
 
 
@@ -72,6 +73,28 @@ static volatile bool twi_busy = false;
 //! IT mask.
 static volatile unsigned long twi_it_mask;
 
+//! Head of the queued transactions (in progress if twi_queue_active).
+static twi_trans_t *volatile twi_queue_head = NULL;
+
+//! Tail of the queued transactions.
+static twi_trans_t *volatile twi_queue_tail = NULL;
+
+//! Signal that the queue head is on the bus.
+static volatile bool twi_queue_active = false;
+
+//! Timeout of the queued transaction in progress.
+static t_cpu_time twi_queue_timer;
+
+//! CPU clock frequency, i.e. cycle counter frequency, for the transaction
+//! timeouts.
+static unsigned long twi_cpu_hz;
+
+//! Bus speed set by twi_master_init().
+static unsigned long twi_speed;
+
+//! Clock waveform generator register value, restored after a reset.
+static unsigned long twi_cwgr;
+
 #ifndef AVR32_TWI_180_H_INCLUDED
 
 //! Pointer on TWI slave application routines
@@ -80,6 +103,9 @@ static twi_slave_fct_t twi_slave_fct;
 #endif
 
 
+static void twi_queue_complete(int status);
+
+
 /*! \brief TWI interrupt handler.
  */
 #if (defined __GNUC__)
@@ -112,8 +138,11 @@ static void twi_master_interrupt_handler(void)
     // receive complete
     if (twi_rx_nb_bytes==0)
     {
-      // finish the receive operation
-      goto complete;
+      // wait for the STOP condition before the next transaction may start:
+      // enable TXCOMP IT and unmask all others IT
+      twi_it_mask = AVR32_TWI_IER_TXCOMP_MASK;
+      twi_inst->idr = ~0UL;
+      twi_inst->ier = twi_it_mask;
     }
   }
   // this is a TXRDY
@@ -138,7 +167,7 @@ static void twi_master_interrupt_handler(void)
   // this is a TXCOMP
   else if (status & AVR32_TWI_SR_TXCOMP_MASK)
   {
-    // finish the transmit operation
+    // finish the transmit or receive operation
     goto complete;
   }
 
@@ -153,6 +182,12 @@ complete:
   twi_inst->sr;
   twi_busy = false;
 
+  // chain the next queued transaction
+  if (twi_queue_active)
+  {
+    twi_queue_complete((twi_nack) ? TWI_RECEIVE_NACK : TWI_SUCCESS);
+  }
+
   return;
 }
 
@@ -258,9 +293,10 @@ static int twi_set_speed(volatile avr32_twi_t *twi, unsigned int speed, unsigned
   }
 
   // set clock waveform generator register
-  twi->cwgr = ((c_lh_div << AVR32_TWI_CWGR_CLDIV_OFFSET) |
+  twi_cwgr = ((c_lh_div << AVR32_TWI_CWGR_CLDIV_OFFSET) |
               (c_lh_div << AVR32_TWI_CWGR_CHDIV_OFFSET) |
               (ckdiv << AVR32_TWI_CWGR_CKDIV_OFFSET));
+  twi->cwgr = twi_cwgr;
 
   return TWI_SUCCESS;
 }
@@ -297,6 +333,8 @@ int twi_master_init(volatile avr32_twi_t *twi, const twi_options_t *opt)
 
   // Select the speed
   twi_set_speed(twi, opt->speed, opt->pba_hz);
+  twi_cpu_hz = (opt->cpu_hz) ? opt->cpu_hz : opt->pba_hz;
+  twi_speed = opt->speed;
 
   // Probe the component
   //status = twi_probe(twi, opt->chip);
@@ -305,6 +343,14 @@ int twi_master_init(volatile avr32_twi_t *twi, const twi_options_t *opt)
 }
 
 
+void twi_master_set_clocks(volatile avr32_twi_t *twi, unsigned long cpu_hz,
+                           unsigned long pba_hz)
+{
+  twi_set_speed(twi, twi_speed, pba_hz);
+  twi_cpu_hz = cpu_hz;
+}
+
+
 #ifndef AVR32_TWI_180_H_INCLUDED
 
 int twi_slave_init(volatile avr32_twi_t *twi, const twi_options_t *opt, const twi_slave_fct_t *slave_fct)
@@ -417,18 +463,14 @@ static uint32_t twi_mk_addr(const uint8_t *addr, int len)
 	return val;
 }
 
-int twi_master_read(volatile avr32_twi_t *twi, const twi_package_t *package)
+/*! \brief Start a master read access; completion is signaled by the
+ * interrupt handler through twi_busy.
+ *
+ * \param twi        Base address of the TWI (i.e. &AVR32_TWI).
+ * \param package    Package information and data.
+ */
+static void twi_master_start_read(volatile avr32_twi_t *twi, const twi_package_t *package)
 {
-  // check argument
-  if (package->length == 0)
-  {
-    return TWI_INVALID_ARGUMENT;
-  }
-
-  while( twi_is_busy() ) {
-    cpu_relax();
-  };
-
   twi_nack = false;
   twi_busy = true;
 
@@ -467,34 +509,17 @@ int twi_master_read(volatile avr32_twi_t *twi, const twi_package_t *package)
 
   // update IMR through IER
   twi->ier = twi_it_mask;
-
-  // get data
-  while( twi_is_busy() ) {
-    cpu_relax();
-  }
-
-  // Disable master transfer
-  twi->cr =  AVR32_TWI_CR_MSDIS_MASK;
-
-  if( twi_nack )
-    return TWI_RECEIVE_NACK;
-
-  return TWI_SUCCESS;
 }
 
 
-int twi_master_write(volatile avr32_twi_t *twi, const twi_package_t *package)
+/*! \brief Start a master write access; completion is signaled by the
+ * interrupt handler through twi_busy.
+ *
+ * \param twi        Base address of the TWI (i.e. &AVR32_TWI).
+ * \param package    Package information and data.
+ */
+static void twi_master_start_write(volatile avr32_twi_t *twi, const twi_package_t *package)
 {
-  // No data to send
-  if (package->length == 0)
-  {
-    return TWI_INVALID_ARGUMENT;
-  }
-
-  while( twi_is_busy() ) {
-    cpu_relax();
-  };
-
   twi_nack = false;
   twi_busy = true;
 
@@ -530,15 +555,163 @@ int twi_master_write(volatile avr32_twi_t *twi, const twi_package_t *package)
 
   // update IMR through IER
   twi->ier = twi_it_mask;
+}
+
+
+/*! \brief Start the queue head on the bus if the bus is free.
+ *
+ * Must be called with the TWI interrupt masked or from the TWI interrupt
+ * handler.
+ */
+static void twi_queue_start_locked(void)
+{
+  twi_trans_t *trans = twi_queue_head;
+
+  if (trans == NULL || twi_queue_active || twi_busy)
+  {
+    return;
+  }
+
+  twi_queue_active = true;
+  if (trans->timeout_ms)
+  {
+    cpu_set_timeout(cpu_ms_2_cy(trans->timeout_ms, twi_cpu_hz), &twi_queue_timer);
+  }
+  if (trans->read)
+  {
+    twi_master_start_read(twi_inst, &trans->package);
+  }
+  else
+  {
+    twi_master_start_write(twi_inst, &trans->package);
+  }
+}
+
+
+/*! \brief Start the queue head on the bus if the bus is free.
+ */
+static void twi_queue_start(void)
+{
+  bool global_interrupt_enabled = Is_global_interrupt_enabled();
+
+  if (global_interrupt_enabled) Disable_global_interrupt();
+  twi_queue_start_locked();
+  if (global_interrupt_enabled) Enable_global_interrupt();
+}
+
+
+/*! \brief Retire the transaction in progress and start the next one.
+ *
+ * Called from the TWI interrupt handler, or from twi_master_poll with the
+ * interrupts disabled.
+ *
+ * \param status     Status of the transaction in progress.
+ */
+static void twi_queue_complete(int status)
+{
+  twi_trans_t *trans = twi_queue_head;
+
+  twi_queue_active = false;
+  twi_queue_head = trans->next;
+  if (twi_queue_head == NULL)
+  {
+    twi_queue_tail = NULL;
+  }
+
+  // start the next transaction right away: the bus stays enabled between
+  // back-to-back transfers
+  if (twi_queue_head != NULL)
+  {
+    twi_queue_start_locked();
+  }
+  else
+  {
+    // Disable master transfer
+    twi_inst->cr = AVR32_TWI_CR_MSDIS_MASK;
+  }
+
+  trans->status = status;
+  trans->done = true;
+  if (trans->callback)
+  {
+    trans->callback(trans);
+  }
+}
+
+
+int twi_master_read(volatile avr32_twi_t *twi, const twi_package_t *package)
+{
+  bool global_interrupt_enabled = Is_global_interrupt_enabled();
+
+  // check argument
+  if (package->length == 0)
+  {
+    return TWI_INVALID_ARGUMENT;
+  }
+
+  // wait for the bus, then start before a transaction can be queued from an
+  // interrupt handler
+  for (;;) {
+    if (global_interrupt_enabled) Disable_global_interrupt();
+    if (!twi_is_busy()) break;
+    if (global_interrupt_enabled) Enable_global_interrupt();
+    cpu_relax();
+  }
+
+  twi_master_start_read(twi, package);
+  if (global_interrupt_enabled) Enable_global_interrupt();
+
+  // get data
+  while( twi_busy ) {
+    cpu_relax();
+  }
+
+  // Disable master transfer
+  twi->cr =  AVR32_TWI_CR_MSDIS_MASK;
+
+  // start the transactions queued meanwhile
+  twi_queue_start();
+
+  if( twi_nack )
+    return TWI_RECEIVE_NACK;
+
+  return TWI_SUCCESS;
+}
+
+
+int twi_master_write(volatile avr32_twi_t *twi, const twi_package_t *package)
+{
+  bool global_interrupt_enabled = Is_global_interrupt_enabled();
+
+  // No data to send
+  if (package->length == 0)
+  {
+    return TWI_INVALID_ARGUMENT;
+  }
+
+  // wait for the bus, then start before a transaction can be queued from an
+  // interrupt handler
+  for (;;) {
+    if (global_interrupt_enabled) Disable_global_interrupt();
+    if (!twi_is_busy()) break;
+    if (global_interrupt_enabled) Enable_global_interrupt();
+    cpu_relax();
+  }
+
+  twi_master_start_write(twi, package);
+  if (global_interrupt_enabled) Enable_global_interrupt();
 
   // send data
-  while( twi_is_busy() ) {
+  while( twi_busy ) {
     cpu_relax();
   }
 
   // Disable master transfer
   twi->cr =  AVR32_TWI_CR_MSDIS_MASK;
 
+  // start the transactions queued meanwhile
+  twi_queue_start();
+
   if( twi_nack )
     return TWI_RECEIVE_NACK;
 
@@ -602,9 +775,82 @@ int twi_master_write_ex(volatile avr32_twi_t *twi, const twi_package_t *package)
 }
 
 
+int twi_master_submit(volatile avr32_twi_t *twi, twi_trans_t *trans)
+{
+  bool global_interrupt_enabled;
+
+  // check argument
+  if (trans->package.length == 0)
+  {
+    return TWI_INVALID_ARGUMENT;
+  }
+
+  trans->next = NULL;
+  trans->status = TWI_BUSY;
+  trans->done = false;
+
+  global_interrupt_enabled = Is_global_interrupt_enabled();
+  if (global_interrupt_enabled) Disable_global_interrupt();
+
+  // Set pointer to TWIM instance for IT
+  twi_inst = twi;
+
+  // append to the queue, started now if the bus is free
+  if (twi_queue_tail != NULL)
+  {
+    twi_queue_tail->next = trans;
+  }
+  else
+  {
+    twi_queue_head = trans;
+  }
+  twi_queue_tail = trans;
+  twi_queue_start_locked();
+
+  if (global_interrupt_enabled) Enable_global_interrupt();
+
+  return TWI_SUCCESS;
+}
+
+
+void twi_master_poll(void)
+{
+  bool global_interrupt_enabled = Is_global_interrupt_enabled();
+
+  if (global_interrupt_enabled) Disable_global_interrupt();
+
+  if (twi_queue_active && twi_queue_head->timeout_ms &&
+      cpu_is_timeout(&twi_queue_timer))
+  {
+    // the slave holds the bus or the transfer hung: reset the TWI
+    twi_inst->idr = ~0UL;
+    twi_inst->sr;
+    twi_inst->cr = AVR32_TWI_CR_SWRST_MASK;
+    twi_inst->sr;
+    twi_inst->cwgr = twi_cwgr;
+    twi_busy = false;
+    twi_queue_complete(TWI_TIMEOUT);
+  }
+
+  if (global_interrupt_enabled) Enable_global_interrupt();
+}
+
+
+int twi_master_wait(twi_trans_t *trans)
+{
+  while (!trans->done)
+  {
+    twi_master_poll();
+    cpu_relax();
+  }
+
+  return trans->status;
+}
+
+
 bool twi_is_busy(void)
 {
-  if( twi_busy ) {
+  if( twi_busy || twi_queue_head != NULL ) {
     return true;          // Still receiving/transmitting...
   }
   else {
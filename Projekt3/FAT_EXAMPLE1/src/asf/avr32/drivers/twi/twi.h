@@ -73,6 +73,7 @@
 #define TWI_SEND_OVERRUN        -6
 #define TWI_SEND_NACK           -7
 #define TWI_BUSY                -8
+#define TWI_TIMEOUT             -9
 //! @}
 
 
@@ -83,6 +84,9 @@ typedef struct
 {
   //! The PBA clock frequency.
   unsigned long pba_hz;
+  //! The CPU clock frequency, for the timeouts of the queued transactions
+  //! (0 if it is the PBA one).
+  unsigned long cpu_hz;
   //! The baudrate of the TWI bus.
   unsigned long speed;
   //! The desired address.
@@ -106,6 +110,30 @@ typedef struct
   unsigned int length;
 } twi_package_t;
 
+/*!
+ * \brief Queued master transaction
+ */
+typedef struct twi_trans
+{
+  //! Next queued transaction (used by the driver).
+  struct twi_trans *next;
+  //! Package information and data.
+  twi_package_t package;
+  //! Read the package data if true, else write it. A read with an internal
+  //! address (addr_length > 0) writes the address then reads the data after a
+  //! repeated START condition.
+  bool read;
+  //! Time allowed to the transfer once started, in ms (0 for no limit).
+  unsigned int timeout_ms;
+  //! Called once the transaction is done, from the TWI interrupt handler
+  //! (or from \ref twi_master_poll on a timeout); may submit transactions.
+  void (*callback)(struct twi_trans *trans);
+  //! TWI_SUCCESS or error code, valid once \ref done is set.
+  int status;
+  //! Set by the driver once the transaction is done.
+  volatile bool done;
+} twi_trans_t;
+
 #ifndef AVR32_TWI_180_H_INCLUDED
 
 /*!
@@ -151,6 +179,19 @@ static inline void twi_master_disable(volatile avr32_twi_t *twi)
  */
 extern int twi_master_init(volatile avr32_twi_t *twi, const twi_options_t *opt);
 
+/*!
+ * \brief Set the bus speed and the transaction timeouts of the twi master
+ *        again after a clock change
+ *
+ * To be called while no transfer is in progress.
+ *
+ * \param twi     Base address of the TWI (i.e. &AVR32_TWI).
+ * \param cpu_hz  New CPU clock frequency
+ * \param pba_hz  New PBA clock frequency
+ */
+extern void twi_master_set_clocks(volatile avr32_twi_t *twi, unsigned long cpu_hz,
+                                  unsigned long pba_hz);
+
 #ifndef AVR32_TWI_180_H_INCLUDED
 
 /*!
@@ -217,10 +258,39 @@ extern int twi_master_write_ex(volatile avr32_twi_t *twi, const twi_package_t *p
 /*!
  * \brief Test if a TWI read/write is pending.
  *
- * \return true if a write/read access is pending, false otherwhise
+ * \return true if a write/read access is pending (or queued), false otherwhise
  */
 extern bool twi_is_busy(void);
 
+/*!
+ * \brief Queue a master transaction. This function is not blocking.
+ *
+ * The transactions run in submission order, each one started by the TWI
+ * interrupt handler as soon as the previous one is done.
+ *
+ * \param twi    Base address of the TWI (i.e. &AVR32_TWI), initialized by
+ *               \ref twi_master_init.
+ * \param trans  Transaction, owned by the driver until its \c done is set.
+ * \return TWI_SUCCESS if the transaction is queued, error code otherwhise
+ */
+extern int twi_master_submit(volatile avr32_twi_t *twi, twi_trans_t *trans);
+
+/*!
+ * \brief Abort the transaction in progress if its timeout is reached.
+ *
+ * To be called regularly while transactions are queued; a hung transfer
+ * raises no interrupt.
+ */
+extern void twi_master_poll(void);
+
+/*!
+ * \brief Wait until a queued transaction is done.
+ *
+ * \param trans  Queued transaction.
+ * \return Status of the transaction
+ */
+extern int twi_master_wait(twi_trans_t *trans);
+
 /**
  * \}
  */
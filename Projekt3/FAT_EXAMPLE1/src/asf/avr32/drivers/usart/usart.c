@@ -48,6 +48,10 @@
 #include "usart.h"
 
 
+//! Ring buffers attached to the USARTs.
+static usart_ring_t *usart_ring_list = NULL;
+
+
 //------------------------------------------------------------------------------
 /*! \name Private Functions
  */
@@ -282,6 +286,12 @@ void usart_reset(volatile avr32_usart_t *usart)
 }
 
 
+int usart_set_rs232_baudrate(volatile avr32_usart_t *usart, unsigned int baudrate, long pba_hz)
+{
+  return usart_set_async_baudrate(usart, baudrate, pba_hz);
+}
+
+
 int usart_init_rs232(volatile avr32_usart_t *usart, const usart_options_t *opt, long pba_hz)
 {
   // Reset the USART and shutdown TX and RX.
@@ -816,6 +826,9 @@ int usart_write_char(volatile avr32_usart_t *usart, int c)
 int usart_putchar(volatile avr32_usart_t *usart, int c)
 {
   int timeout = USART_DEFAULT_TIMEOUT;
+  usart_ring_t *ring = usart_ring_get(usart);
+
+  if (ring) return usart_ring_putchar(ring, c);
 
   do
   {
@@ -828,6 +841,11 @@ int usart_putchar(volatile avr32_usart_t *usart, int c)
 
 int usart_read_char(volatile avr32_usart_t *usart, int *c)
 {
+  usart_ring_t *ring = usart_ring_get(usart);
+
+  // The characters are received by the ring interrupt handler.
+  if (ring) return usart_ring_read_char(ring, c);
+
   // Check for errors: frame, parity and overrun. In RS485 mode, a parity error
   // would mean that an address char has been received.
   if (usart->csr & (AVR32_USART_CSR_OVRE_MASK |
@@ -897,4 +915,187 @@ int usart_get_echo_line(volatile avr32_usart_t *usart)
 }
 
 
+//! @}
+
+
+//------------------------------------------------------------------------------
+/*! \name Interrupt-Driven Ring Buffers
+ */
+//! @{
+
+
+void usart_ring_init(usart_ring_t *ring, volatile avr32_usart_t *usart,
+                     void *tx_buf, unsigned short tx_size,
+                     void *rx_buf, unsigned short rx_size)
+{
+  bool global_interrupt_enabled = cpu_irq_is_enabled();
+
+  ring->usart = usart;
+  ring->tx_buf = tx_buf;
+  ring->tx_size = tx_size;
+  ring->tx_head = ring->tx_tail = 0;
+  ring->rx_buf = rx_buf;
+  ring->rx_size = rx_size;
+  ring->rx_head = ring->rx_tail = 0;
+  ring->tx_overflows = 0;
+  ring->rx_overflows = 0;
+  ring->rx_errors = 0;
+
+  if (global_interrupt_enabled) cpu_irq_disable();
+  if (!usart_ring_get(usart))
+  {
+    ring->next = usart_ring_list;
+    usart_ring_list = ring;
+  }
+  usart->cr = AVR32_USART_CR_RSTSTA_MASK;
+  usart->ier = AVR32_USART_IER_RXRDY_MASK;
+  if (global_interrupt_enabled) cpu_irq_enable();
+}
+
+
+usart_ring_t *usart_ring_get(volatile avr32_usart_t *usart)
+{
+  usart_ring_t *ring;
+
+  for (ring = usart_ring_list; ring; ring = ring->next)
+  {
+    if (ring->usart == usart) return ring;
+  }
+  return NULL;
+}
+
+
+void usart_ring_interrupt(usart_ring_t *ring)
+{
+  volatile avr32_usart_t *usart = ring->usart;
+  unsigned long csr = usart->csr;
+  unsigned short next;
+
+  if (csr & (AVR32_USART_CSR_OVRE_MASK |
+             AVR32_USART_CSR_FRAME_MASK |
+             AVR32_USART_CSR_PARE_MASK))
+  {
+    ring->rx_errors++;
+    usart->cr = AVR32_USART_CR_RSTSTA_MASK;
+  }
+
+  if (csr & AVR32_USART_CSR_RXRDY_MASK)
+  {
+    int c = (usart->rhr & AVR32_USART_RHR_RXCHR_MASK) >> AVR32_USART_RHR_RXCHR_OFFSET;
+
+    next = ring->rx_head + 1;
+    if (next == ring->rx_size) next = 0;
+    if (next == ring->rx_tail)
+      ring->rx_overflows++;
+    else
+    {
+      ring->rx_buf[ring->rx_head] = c;
+      ring->rx_head = next;
+    }
+  }
+
+  if ((csr & AVR32_USART_CSR_TXRDY_MASK) &&
+      (usart->imr & AVR32_USART_IMR_TXRDY_MASK))
+  {
+    if (ring->tx_tail == ring->tx_head)
+      // Nothing left to send.
+      usart->idr = AVR32_USART_IDR_TXRDY_MASK;
+    else
+    {
+      usart->thr = (ring->tx_buf[ring->tx_tail] << AVR32_USART_THR_TXCHR_OFFSET) &
+                   AVR32_USART_THR_TXCHR_MASK;
+      next = ring->tx_tail + 1;
+      ring->tx_tail = (next == ring->tx_size) ? 0 : next;
+    }
+  }
+}
+
+
+int usart_ring_write_char(usart_ring_t *ring, int c)
+{
+  unsigned short next = ring->tx_head + 1;
+
+  if (next == ring->tx_size) next = 0;
+  if (next == ring->tx_tail) return USART_TX_BUSY;
+
+  ring->tx_buf[ring->tx_head] = c;
+  ring->tx_head = next;
+  // Let the interrupt handler send it.
+  ring->usart->ier = AVR32_USART_IER_TXRDY_MASK;
+
+  return USART_SUCCESS;
+}
+
+
+int usart_ring_putchar(usart_ring_t *ring, int c)
+{
+  int timeout = USART_DEFAULT_TIMEOUT;
+
+  while (usart_ring_write_char(ring, c) != USART_SUCCESS)
+  {
+    if (!timeout--)
+    {
+      ring->tx_overflows++;
+      return USART_FAILURE;
+    }
+  }
+
+  return USART_SUCCESS;
+}
+
+
+unsigned short usart_ring_write(usart_ring_t *ring, const void *buf, unsigned short len)
+{
+  const unsigned char *ptr = buf;
+  unsigned short nb;
+
+  for (nb = 0; nb < len; nb++)
+  {
+    if (usart_ring_write_char(ring, ptr[nb]) != USART_SUCCESS)
+    {
+      ring->tx_overflows += len - nb;
+      break;
+    }
+  }
+
+  return nb;
+}
+
+
+int usart_ring_read_char(usart_ring_t *ring, int *c)
+{
+  unsigned short next;
+
+  if (ring->rx_tail == ring->rx_head) return USART_RX_EMPTY;
+
+  *c = ring->rx_buf[ring->rx_tail];
+  next = ring->rx_tail + 1;
+  ring->rx_tail = (next == ring->rx_size) ? 0 : next;
+
+  return USART_SUCCESS;
+}
+
+
+unsigned short usart_ring_read(usart_ring_t *ring, void *buf, unsigned short len)
+{
+  unsigned char *ptr = buf;
+  unsigned short nb;
+  int c;
+
+  for (nb = 0; nb < len && usart_ring_read_char(ring, &c) == USART_SUCCESS; nb++)
+    ptr[nb] = c;
+
+  return nb;
+}
+
+
+unsigned short usart_ring_tx_pending(const usart_ring_t *ring)
+{
+  unsigned short head = ring->tx_head;
+  unsigned short tail = ring->tx_tail;
+
+  return (head >= tail) ? head - tail : ring->tx_size - tail + head;
+}
+
+
 //! @}
@@ -214,6 +214,37 @@ typedef struct
 
 #endif  // USART rev. >= 4.0.0
 
+//! Interrupt-driven TX and RX ring buffers of a USART.
+typedef struct usart_ring
+{
+  //! Next ring registered (used by the driver).
+  struct usart_ring *next;
+
+  //! Base address of the USART instance.
+  volatile avr32_usart_t *usart;
+
+  //! TX ring: characters written at \ref tx_head, sent from \ref tx_tail.
+  unsigned char *tx_buf;
+  unsigned short tx_size;
+  volatile unsigned short tx_head;
+  volatile unsigned short tx_tail;
+
+  //! RX ring: characters received at \ref rx_head, read from \ref rx_tail.
+  unsigned char *rx_buf;
+  unsigned short rx_size;
+  volatile unsigned short rx_head;
+  volatile unsigned short rx_tail;
+
+  //! Characters not written because the TX ring was full.
+  volatile unsigned long tx_overflows;
+
+  //! Characters lost because the RX ring was full.
+  volatile unsigned long rx_overflows;
+
+  //! Characters lost because of an overrun, framing or parity error.
+  volatile unsigned long rx_errors;
+} usart_ring_t;
+
 
 //------------------------------------------------------------------------------
 /*! \name Initialization Functions
@@ -237,6 +268,21 @@ extern void usart_reset(volatile avr32_usart_t *usart);
  */
 extern int usart_init_rs232(volatile avr32_usart_t *usart, const usart_options_t *opt, long pba_hz);
 
+/*! \brief Sets the baud rate of a USART in RS232 mode again, e.g. after a PBA
+ *         frequency change, keeping the other settings.
+ *
+ * The characters being sent or received are corrupted: wait until the
+ * transmitter is empty first.
+ *
+ * \param usart     Base address of the USART instance.
+ * \param baudrate  Baud rate set point.
+ * \param pba_hz    USART module input clock frequency (PBA clock, Hz).
+ *
+ * \retval USART_SUCCESS        Baud rate successfully set.
+ * \retval USART_INVALID_INPUT  Baud rate set point is out of range for the given input clock frequency.
+ */
+extern int usart_set_rs232_baudrate(volatile avr32_usart_t *usart, unsigned int baudrate, long pba_hz);
+
 /*! \brief Sets up the USART to use the standard RS232 protocol in TX-only mode.
  *
  * Compared to \ref usart_init_rs232, this function allows very high baud rates
@@ -890,6 +936,111 @@ static inline int usart_lin_transfer_completed(volatile avr32_usart_t *usart)
 
 //! @}
 
+
+//------------------------------------------------------------------------------
+/*! \name Interrupt-Driven Ring Buffers
+ *
+ * Once a ring is attached to a USART, \ref usart_putchar, \ref usart_write_line
+ * and \ref usart_read_char (and the print functions built on them) go through
+ * the ring: writing only waits while the TX ring is full, and the characters
+ * received are kept until read.
+ *
+ * The application registers an interrupt handler for the USART calling
+ * \ref usart_ring_interrupt.
+ */
+//! @{
+
+/*! \brief Attaches TX and RX ring buffers to a USART and enables its RX
+ *         interrupt.
+ *
+ * \param ring    Ring buffers, owned by the driver from now on.
+ * \param usart   Base address of the USART instance, initialized.
+ * \param tx_buf  TX ring buffer.
+ * \param tx_size Size of \a tx_buf (one character less can be queued).
+ * \param rx_buf  RX ring buffer.
+ * \param rx_size Size of \a rx_buf (one character less can be queued).
+ */
+extern void usart_ring_init(usart_ring_t *ring, volatile avr32_usart_t *usart,
+                            void *tx_buf, unsigned short tx_size,
+                            void *rx_buf, unsigned short rx_size);
+
+/*! \brief Moves the characters between the USART and the rings.
+ *
+ * To be called by the interrupt handler of the USART.
+ *
+ * \param ring    Ring buffers of the USART.
+ */
+extern void usart_ring_interrupt(usart_ring_t *ring);
+
+/*! \brief Queues a character to send without waiting.
+ *
+ * \param ring    Ring buffers of the USART.
+ * \param c       The character to transmit.
+ *
+ * \retval USART_SUCCESS  The character was queued.
+ * \retval USART_TX_BUSY  The TX ring was full.
+ */
+extern int usart_ring_write_char(usart_ring_t *ring, int c);
+
+/*! \brief Queues a character to send, waiting while the TX ring is full.
+ *
+ * \param ring    Ring buffers of the USART.
+ * \param c       The character to transmit.
+ *
+ * \retval USART_SUCCESS  The character was queued.
+ * \retval USART_FAILURE  The function timed out before room was made in the
+ *                        TX ring.
+ */
+extern int usart_ring_putchar(usart_ring_t *ring, int c);
+
+/*! \brief Queues characters to send without waiting.
+ *
+ * \param ring    Ring buffers of the USART.
+ * \param buf     Characters to transmit.
+ * \param len     Number of characters.
+ *
+ * \return The number of characters queued.
+ */
+extern unsigned short usart_ring_write(usart_ring_t *ring, const void *buf, unsigned short len);
+
+/*! \brief Gets a received character without waiting.
+ *
+ * \param ring    Ring buffers of the USART.
+ * \param c       Pointer to the where the read character should be stored.
+ *
+ * \retval USART_SUCCESS  The character was read successfully.
+ * \retval USART_RX_EMPTY The RX ring was empty.
+ */
+extern int usart_ring_read_char(usart_ring_t *ring, int *c);
+
+/*! \brief Gets the received characters without waiting.
+ *
+ * \param ring    Ring buffers of the USART.
+ * \param buf     Buffer to fill.
+ * \param len     Size of \a buf.
+ *
+ * \return The number of characters read.
+ */
+extern unsigned short usart_ring_read(usart_ring_t *ring, void *buf, unsigned short len);
+
+/*! \brief Gets the number of characters waiting in the TX ring.
+ *
+ * \param ring    Ring buffers of the USART.
+ *
+ * \return The number of characters not sent yet.
+ */
+extern unsigned short usart_ring_tx_pending(const usart_ring_t *ring);
+
+/*! \brief Gets the ring buffers attached to a USART.
+ *
+ * \param usart   Base address of the USART instance.
+ *
+ * \return The ring buffers, or \c NULL if none is attached.
+ */
+extern usart_ring_t *usart_ring_get(volatile avr32_usart_t *usart);
+
+//! @}
+
 /**
  * \}
  */
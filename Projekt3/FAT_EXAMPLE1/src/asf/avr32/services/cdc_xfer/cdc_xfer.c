@@ -0,0 +1,608 @@
+/*****************************************************************************
+ *
+ * \file
+ *
+ * \brief File transfer protocol over the USB CDC interface.
+ *
+ * Copyright (c) 2009 Atmel Corporation. All rights reserved.
+ *
+ * \asf_license_start
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. The name of Atmel may not be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * 4. This software may only be redistributed and used in connection with an
+ *    Atmel microcontroller product.
+ *
+ * THIS SOFTWARE IS PROVIDED BY ATMEL "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT ARE
+ * EXPRESSLY AND SPECIFICALLY DISCLAIMED. IN NO EVENT SHALL ATMEL BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * \asf_license_stop
+ *
+ ******************************************************************************/
+
+
+
+
+#include <string.h>
+#include "compiler.h"
+#include "udi_cdc.h"
+#include "file.h"
+#include "navigation.h"
+#include "cdc_xfer.h"
+
+
+//! Requests.
+typedef enum
+{
+  CDC_XFER_IDLE,
+  CDC_XFER_LISTING,
+  CDC_XFER_GETTING,
+  CDC_XFER_PUTTING
+} cdc_xfer_state_t;
+
+//! Request in progress.
+static cdc_xfer_state_t cdc_xfer_state;
+
+//! Frame received: header, payload and CRC, and number of bytes received.
+static uint8_t cdc_xfer_rx_header[CDC_XFER_HEADER_SIZE];
+#if (defined __GNUC__)
+__attribute__((__aligned__(4)))
+#elif (defined __ICCAVR32__)
+#pragma data_alignment = 4
+#endif
+static uint8_t cdc_xfer_rx_payload[CDC_XFER_BLOCK_SIZE];
+static uint8_t cdc_xfer_rx_crc[CDC_XFER_CRC_SIZE];
+static uint16_t cdc_xfer_rx_nb;
+
+//! DATA and ENTRY frames, sent by reference from this buffer. The frame starts
+//! after 2 bytes of padding so that its payload is word-aligned and the FAT
+//! reads whole sectors directly into it.
+#if (defined __GNUC__)
+__attribute__((__aligned__(4)))
+#elif (defined __ICCAVR32__)
+#pragma data_alignment = 4
+#endif
+static uint8_t cdc_xfer_tx_frame[2 + CDC_XFER_HEADER_SIZE + CDC_XFER_BLOCK_SIZE + CDC_XFER_CRC_SIZE];
+#define cdc_xfer_tx_payload   (&cdc_xfer_tx_frame[2 + CDC_XFER_HEADER_SIZE])
+
+//! Length of the frame built and not queued yet to the CDC interface.
+static uint16_t cdc_xfer_tx_len;
+
+//! Set while the CDC interface owns the frame buffer.
+static volatile bool cdc_xfer_tx_busy;
+
+//! Sequence number of the next frame sent (LIST) or of the next block sent
+//! (GET) or expected (PUT). The frames carry its 16 low-order bits.
+static uint32_t cdc_xfer_seq;
+
+//! GET: oldest block not acknowledged, number of blocks, range of the file.
+static uint32_t cdc_xfer_base;
+static uint32_t cdc_xfer_nb_blocks;
+static uint32_t cdc_xfer_offset;
+static uint32_t cdc_xfer_length;
+
+//! PUT: a NAK was sent for the next block expected.
+static bool cdc_xfer_nak_sent;
+
+static cdc_xfer_stats_t cdc_xfer_stats;
+
+//! CRC16-CCITT of each nibble value.
+static const uint16_t cdc_xfer_crc16_table[16] =
+{
+  0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50A5, 0x60C6, 0x70E7,
+  0x8108, 0x9129, 0xA14A, 0xB16B, 0xC18C, 0xD1AD, 0xE1CE, 0xF1EF
+};
+
+
+/*! \brief Updates a CRC16-CCITT with a buffer.
+ */
+static uint16_t cdc_xfer_crc16(uint16_t crc, const uint8_t *buf, uint16_t len)
+{
+  while (len--)
+  {
+    crc = (crc << 4) ^ cdc_xfer_crc16_table[(crc >> 12) ^ (*buf >> 4)];
+    crc = (crc << 4) ^ cdc_xfer_crc16_table[(crc >> 12) ^ (*buf++ & 0x0F)];
+  }
+  return crc;
+}
+
+
+static uint16_t cdc_xfer_get_le16(const uint8_t *buf)
+{
+  return buf[0] | ((uint16_t)buf[1] << 8);
+}
+
+
+static uint32_t cdc_xfer_get_le32(const uint8_t *buf)
+{
+  return cdc_xfer_get_le16(buf) | ((uint32_t)cdc_xfer_get_le16(buf + 2) << 16);
+}
+
+
+static void cdc_xfer_put_le16(uint8_t *buf, uint16_t value)
+{
+  buf[0] = LSB(value);
+  buf[1] = MSB(value);
+}
+
+
+static void cdc_xfer_put_le32(uint8_t *buf, uint32_t value)
+{
+  cdc_xfer_put_le16(buf, LSH(value));
+  cdc_xfer_put_le16(buf + 2, MSH(value));
+}
+
+
+/*! \brief Sends a frame.
+ *
+ * \return \c false if the CDC interface was disabled meanwhile.
+ */
+static bool cdc_xfer_send(uint8_t type, uint16_t seq, const uint8_t *payload, uint16_t len)
+{
+  uint8_t header[CDC_XFER_HEADER_SIZE];
+  uint8_t crc[CDC_XFER_CRC_SIZE];
+  uint16_t crc16;
+
+  header[0] = CDC_XFER_SYNC;
+  header[1] = type;
+  cdc_xfer_put_le16(&header[2], seq);
+  cdc_xfer_put_le16(&header[4], len);
+  crc16 = cdc_xfer_crc16(0, header, sizeof(header));
+  crc16 = cdc_xfer_crc16(crc16, payload, len);
+  cdc_xfer_put_le16(crc, crc16);
+
+  return !udi_cdc_write_buf((const int *)header, sizeof(header)) &&
+         !udi_cdc_write_buf((const int *)payload, len) &&
+         !udi_cdc_write_buf((const int *)crc, sizeof(crc));
+}
+
+
+/*! \brief Gets the frame buffer back from the CDC interface.
+ */
+static void cdc_xfer_tx_released(const void *buf, bool b_sent)
+{
+  // A frame dropped is asked for again by the host.
+  cdc_xfer_tx_busy = false;
+}
+
+
+/*! \brief Queues the frame built, if any, to the CDC interface.
+ *
+ * \return \c false if the frame is still waiting for a free TX buffer.
+ */
+static bool cdc_xfer_tx_submit(void)
+{
+  if (!cdc_xfer_tx_len)
+    return true;
+  cdc_xfer_tx_busy = true;
+  if (!udi_cdc_write_buf_ref(&cdc_xfer_tx_frame[2], cdc_xfer_tx_len, cdc_xfer_tx_released))
+  {
+    cdc_xfer_tx_busy = false;
+    return false;
+  }
+  cdc_xfer_tx_len = 0;
+  return true;
+}
+
+
+/*! \brief Sends the frame whose payload is in the frame buffer, without copy.
+ */
+static void cdc_xfer_send_ref(uint8_t type, uint16_t seq, uint16_t len)
+{
+  uint8_t *header = &cdc_xfer_tx_frame[2];
+
+  header[0] = CDC_XFER_SYNC;
+  header[1] = type;
+  cdc_xfer_put_le16(&header[2], seq);
+  cdc_xfer_put_le16(&header[4], len);
+  cdc_xfer_put_le16(&cdc_xfer_tx_payload[len],
+                    cdc_xfer_crc16(0, header, CDC_XFER_HEADER_SIZE + len));
+  cdc_xfer_tx_len = CDC_XFER_HEADER_SIZE + len + CDC_XFER_CRC_SIZE;
+  cdc_xfer_tx_submit();
+}
+
+
+/*! \brief Ends the request in progress, closing its file.
+ *
+ * The transfer navigator shall be selected.
+ */
+static void cdc_xfer_end(void)
+{
+  if (cdc_xfer_state == CDC_XFER_GETTING || cdc_xfer_state == CDC_XFER_PUTTING)
+    file_close();
+  cdc_xfer_state = CDC_XFER_IDLE;
+  // Drop the frame not queued yet.
+  cdc_xfer_tx_len = 0;
+}
+
+
+/*! \brief Ends the request in progress on a FAT error and reports it.
+ */
+static void cdc_xfer_fail(void)
+{
+  uint8_t status = fs_g_status;
+
+  cdc_xfer_end();
+  cdc_xfer_send(CDC_XFER_ERROR, cdc_xfer_seq, &status, sizeof(status));
+}
+
+
+/*! \brief Selects the file or directory of a request.
+ *
+ * The transfer navigator starts from the current directory of the explorer.
+ *
+ * \param path  Path, not NUL-terminated.
+ * \param len   Path length.
+ * \param b_create  Creates the file if it does not exist.
+ */
+static bool cdc_xfer_setcwd(const uint8_t *path, uint16_t len, bool b_create)
+{
+  char sz_path[CDC_XFER_PATH_SIZE];
+
+  nav_select(0);
+  nav_copy(FS_NAV_ID_CDC_XFER);
+  nav_select(FS_NAV_ID_CDC_XFER);
+  if (!len)
+    return true;
+  if (len >= sizeof(sz_path))
+  {
+    fs_g_status = FS_ERR_NAME_INCORRECT;
+    return false;
+  }
+  memcpy(sz_path, path, len);
+  sz_path[len] = '\0';
+  return nav_setcwd((FS_STRING)sz_path, true, b_create);
+}
+
+
+/*! \brief Starts a request.
+ */
+static void cdc_xfer_request(uint8_t type, const uint8_t *payload, uint16_t len)
+{
+  uint32_t size;
+
+  cdc_xfer_end();
+  cdc_xfer_seq = 0;
+
+  switch (type)
+  {
+  case CDC_XFER_LIST:
+    if (!cdc_xfer_setcwd(payload, len, false) || !nav_filelist_reset())
+    {
+      cdc_xfer_fail();
+      return;
+    }
+    cdc_xfer_state = CDC_XFER_LISTING;
+    break;
+
+  case CDC_XFER_GET:
+    if (len < 8)
+      return;
+    cdc_xfer_offset = cdc_xfer_get_le32(payload);
+    cdc_xfer_length = cdc_xfer_get_le32(payload + 4);
+    if (!cdc_xfer_setcwd(payload + 8, len - 8, false) || !file_open(FOPEN_MODE_R))
+    {
+      cdc_xfer_fail();
+      return;
+    }
+    cdc_xfer_state = CDC_XFER_GETTING;
+    size = nav_file_lgt();
+    if (cdc_xfer_offset > size)
+      cdc_xfer_offset = size;
+    if (!cdc_xfer_length || cdc_xfer_length > size - cdc_xfer_offset)
+      cdc_xfer_length = size - cdc_xfer_offset;
+    cdc_xfer_nb_blocks = (cdc_xfer_length + CDC_XFER_BLOCK_SIZE - 1) / CDC_XFER_BLOCK_SIZE;
+    cdc_xfer_base = 0;
+    if (!file_seek(cdc_xfer_offset, FS_SEEK_SET))
+      cdc_xfer_fail();
+    break;
+
+  case CDC_XFER_PUT:
+    if (!cdc_xfer_setcwd(payload, len, true) || !file_open(FOPEN_MODE_W))
+    {
+      cdc_xfer_fail();
+      return;
+    }
+    cdc_xfer_state = CDC_XFER_PUTTING;
+    cdc_xfer_nak_sent = false;
+    cdc_xfer_send(CDC_XFER_ACK, 0, NULL, 0);
+    break;
+  }
+}
+
+
+/*! \brief Handles an acknowledgment of the host during a GET.
+ */
+static void cdc_xfer_get_ack(uint8_t type, uint16_t seq16)
+{
+  // The block acknowledged is in the window, which is much smaller than the
+  // range of the 16-bit sequence numbers.
+  uint32_t seq = cdc_xfer_base + (uint16_t)(seq16 - (uint16_t)cdc_xfer_base);
+
+  if (seq > cdc_xfer_seq)
+    return;
+  cdc_xfer_base = seq;
+  if (type == CDC_XFER_NAK && seq != cdc_xfer_seq)
+  {
+    // Go back to the block asked for.
+    cdc_xfer_stats.blocks_resent += cdc_xfer_seq - seq;
+    cdc_xfer_seq = seq;
+    if (!file_seek(cdc_xfer_offset + (uint32_t)seq * CDC_XFER_BLOCK_SIZE, FS_SEEK_SET))
+      cdc_xfer_fail();
+  }
+}
+
+
+/*! \brief Handles a frame of the host during a PUT.
+ */
+static void cdc_xfer_put_frame(uint8_t type, uint16_t seq, const uint8_t *payload, uint16_t len)
+{
+  if (seq != (uint16_t)cdc_xfer_seq)
+  {
+    if ((int16_t)(seq - (uint16_t)cdc_xfer_seq) < 0)
+    {
+      // Block already written, sent again before the host got the ACK.
+      cdc_xfer_send(CDC_XFER_ACK, cdc_xfer_seq, NULL, 0);
+    }
+    else if (!cdc_xfer_nak_sent)
+    {
+      cdc_xfer_send(CDC_XFER_NAK, cdc_xfer_seq, NULL, 0);
+      cdc_xfer_nak_sent = true;
+    }
+    return;
+  }
+
+  if (type == CDC_XFER_END)
+  {
+    cdc_xfer_end();
+    cdc_xfer_send(CDC_XFER_END, seq, NULL, 0);
+    return;
+  }
+
+  if (len && file_write_buf((uint8_t *)payload, len) != len)
+  {
+    cdc_xfer_fail();
+    return;
+  }
+  cdc_xfer_stats.blocks_written++;
+  cdc_xfer_seq++;
+  cdc_xfer_nak_sent = false;
+  cdc_xfer_send(CDC_XFER_ACK, cdc_xfer_seq, NULL, 0);
+}
+
+
+/*! \brief Handles a frame of the host.
+ */
+static void cdc_xfer_frame(uint8_t type, uint16_t seq, const uint8_t *payload, uint16_t len)
+{
+  switch (type)
+  {
+  case CDC_XFER_LIST:
+  case CDC_XFER_GET:
+  case CDC_XFER_PUT:
+    cdc_xfer_request(type, payload, len);
+    break;
+
+  case CDC_XFER_ABORT:
+    cdc_xfer_end();
+    break;
+
+  case CDC_XFER_ACK:
+  case CDC_XFER_NAK:
+    if (cdc_xfer_state == CDC_XFER_GETTING)
+      cdc_xfer_get_ack(type, seq);
+    break;
+
+  case CDC_XFER_DATA:
+  case CDC_XFER_END:
+    if (cdc_xfer_state == CDC_XFER_PUTTING)
+      cdc_xfer_put_frame(type, seq, payload, len);
+    break;
+  }
+}
+
+
+/*! \brief Receives the bytes available from the host.
+ *
+ * \return \c true if a whole frame with a good CRC was received.
+ */
+static bool cdc_xfer_receive(void)
+{
+  uint16_t len;
+  uint8_t byte;
+
+  while (udi_cdc_is_rx_ready())
+  {
+    byte = udi_cdc_getc();
+    if (cdc_xfer_rx_nb < CDC_XFER_HEADER_SIZE)
+    {
+      // Wait for the first byte of a frame.
+      if (!cdc_xfer_rx_nb && byte != CDC_XFER_SYNC)
+        continue;
+      cdc_xfer_rx_header[cdc_xfer_rx_nb++] = byte;
+      if (cdc_xfer_rx_nb == CDC_XFER_HEADER_SIZE &&
+          cdc_xfer_get_le16(&cdc_xfer_rx_header[4]) > CDC_XFER_BLOCK_SIZE)
+      {
+        cdc_xfer_stats.frames_dropped++;
+        cdc_xfer_rx_nb = 0;
+      }
+      continue;
+    }
+
+    len = cdc_xfer_get_le16(&cdc_xfer_rx_header[4]);
+    if (cdc_xfer_rx_nb < CDC_XFER_HEADER_SIZE + len)
+    {
+      cdc_xfer_rx_payload[cdc_xfer_rx_nb++ - CDC_XFER_HEADER_SIZE] = byte;
+      continue;
+    }
+    cdc_xfer_rx_crc[cdc_xfer_rx_nb++ - CDC_XFER_HEADER_SIZE - len] = byte;
+    if (cdc_xfer_rx_nb < CDC_XFER_HEADER_SIZE + len + CDC_XFER_CRC_SIZE)
+      continue;
+
+    // Whole frame received.
+    cdc_xfer_rx_nb = 0;
+    if (cdc_xfer_get_le16(cdc_xfer_rx_crc) ==
+        cdc_xfer_crc16(cdc_xfer_crc16(0, cdc_xfer_rx_header, CDC_XFER_HEADER_SIZE),
+                       cdc_xfer_rx_payload, len))
+    {
+      cdc_xfer_stats.frames_received++;
+      return true;
+    }
+    cdc_xfer_stats.frames_dropped++;
+    // The sequence number can't be trusted: ask for the block expected.
+    if (cdc_xfer_state == CDC_XFER_PUTTING && !cdc_xfer_nak_sent)
+    {
+      cdc_xfer_send(CDC_XFER_NAK, cdc_xfer_seq, NULL, 0);
+      cdc_xfer_nak_sent = true;
+    }
+  }
+  return false;
+}
+
+
+/*! \brief Sends the next directory entry of a LIST.
+ */
+static void cdc_xfer_list_next(void)
+{
+  uint16_t len;
+
+  if (cdc_xfer_tx_busy || cdc_xfer_tx_len)
+    return;   // Wait for the frame buffer.
+  if (!nav_filelist_set(0, FS_FIND_NEXT))
+  {
+    cdc_xfer_end();
+    cdc_xfer_send(CDC_XFER_END, cdc_xfer_seq, NULL, 0);
+    return;
+  }
+  cdc_xfer_put_le32(&cdc_xfer_tx_payload[0], nav_file_isdir() ? 0 : nav_file_lgt());
+  cdc_xfer_tx_payload[4] = nav_file_attributget();
+  if (!nav_file_name((FS_STRING)&cdc_xfer_tx_payload[5], CDC_XFER_PATH_SIZE, FS_NAME_GET, false))
+  {
+    cdc_xfer_fail();
+    return;
+  }
+  len = 5 + strlen((char *)&cdc_xfer_tx_payload[5]);
+  cdc_xfer_send_ref(CDC_XFER_ENTRY, cdc_xfer_seq++, len);
+}
+
+
+/*! \brief Sends the next block of a GET, or its END once every block is
+ *         acknowledged.
+ */
+static void cdc_xfer_get_next(void)
+{
+  uint32_t pos;
+  uint16_t len;
+
+  if (cdc_xfer_base == cdc_xfer_nb_blocks)
+  {
+    cdc_xfer_end();
+    cdc_xfer_send(CDC_XFER_END, cdc_xfer_nb_blocks, NULL, 0);
+    return;
+  }
+  if (cdc_xfer_seq == cdc_xfer_nb_blocks ||
+      cdc_xfer_seq - cdc_xfer_base >= CDC_XFER_WINDOW)
+    return;   // Wait for the host.
+  if (cdc_xfer_tx_busy || cdc_xfer_tx_len)
+    return;   // Wait for the frame buffer.
+
+  pos = (uint32_t)cdc_xfer_seq * CDC_XFER_BLOCK_SIZE;
+  len = Min(cdc_xfer_length - pos, CDC_XFER_BLOCK_SIZE);
+  // Whole sectors are read directly into the payload buffer.
+  if (file_read_buf(cdc_xfer_tx_payload, len) != len)
+  {
+    cdc_xfer_fail();
+    return;
+  }
+  cdc_xfer_send_ref(CDC_XFER_DATA, cdc_xfer_seq++, len);
+  cdc_xfer_stats.blocks_sent++;
+}
+
+
+void cdc_xfer_init(void)
+{
+  cdc_xfer_state = CDC_XFER_IDLE;
+  cdc_xfer_rx_nb = 0;
+  cdc_xfer_tx_len = 0;
+  cdc_xfer_tx_busy = false;
+  memset(&cdc_xfer_stats, 0, sizeof(cdc_xfer_stats));
+}
+
+
+void cdc_xfer_task(void)
+{
+  uint8_t nav;
+
+  if (cdc_xfer_state == CDC_XFER_IDLE && !udi_cdc_is_rx_ready())
+    return;
+
+  // Leave the explorer navigator alone.
+  nav = nav_get();
+  nav_select(FS_NAV_ID_CDC_XFER);
+
+  while (cdc_xfer_receive())
+  {
+    cdc_xfer_frame(cdc_xfer_rx_header[1], cdc_xfer_get_le16(&cdc_xfer_rx_header[2]),
+                   cdc_xfer_rx_payload, cdc_xfer_get_le16(&cdc_xfer_rx_header[4]));
+  }
+
+  cdc_xfer_tx_submit();
+  switch (cdc_xfer_state)
+  {
+  case CDC_XFER_LISTING:
+    cdc_xfer_list_next();
+    break;
+  case CDC_XFER_GETTING:
+    cdc_xfer_get_next();
+    break;
+  default:
+    break;
+  }
+
+  nav_select(nav);
+}
+
+
+void cdc_xfer_abort(void)
+{
+  uint8_t nav;
+
+  if (cdc_xfer_state == CDC_XFER_IDLE)
+    return;
+  nav = nav_get();
+  nav_select(FS_NAV_ID_CDC_XFER);
+  cdc_xfer_end();
+  nav_select(nav);
+}
+
+
+bool cdc_xfer_is_busy(void)
+{
+  return cdc_xfer_state != CDC_XFER_IDLE;
+}
+
+
+void cdc_xfer_get_stats(cdc_xfer_stats_t *stats)
+{
+  *stats = cdc_xfer_stats;
+}
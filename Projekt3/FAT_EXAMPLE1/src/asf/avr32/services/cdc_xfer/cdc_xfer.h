@@ -0,0 +1,208 @@
+/*****************************************************************************
+ *
+ * \file
+ *
+ * \brief File transfer protocol over the USB CDC interface.
+ *
+ * Copyright (c) 2009 Atmel Corporation. All rights reserved.
+ *
+ * \asf_license_start
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. The name of Atmel may not be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * 4. This software may only be redistributed and used in connection with an
+ *    Atmel microcontroller product.
+ *
+ * THIS SOFTWARE IS PROVIDED BY ATMEL "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT ARE
+ * EXPRESSLY AND SPECIFICALLY DISCLAIMED. IN NO EVENT SHALL ATMEL BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * \asf_license_stop
+ *
+ ******************************************************************************/
+
+
+
+
+#ifndef _CDC_XFER_H_
+#define _CDC_XFER_H_
+
+/**
+ * \defgroup group_avr32_services_cdc_xfer File transfer over USB CDC
+ *
+ * Binary protocol moving files between the FAT drives and the USB host
+ * through the data endpoints of the CDC interface, instead of printing them
+ * one character at a time on the shell.
+ *
+ * All the messages are frames:
+ * \code
+ *  offset  size  field
+ *  0       1     CDC_XFER_SYNC
+ *  1       1     type (CDC_XFER_xxx)
+ *  2       2     sequence number
+ *  4       2     payload length n (<= CDC_XFER_BLOCK_SIZE)
+ *  6       n     payload
+ *  6+n     2     CRC16-CCITT (x^16 + x^12 + x^5 + 1, initial value 0) of the
+ *                bytes 0 to 5+n
+ * \endcode
+ * The multi-byte fields are little-endian. A frame with a wrong CRC is
+ * dropped. The sequence numbers below are counted modulo 65536, so that a
+ * transfer may have more blocks.
+ *
+ * Requests of the host (only one at a time):
+ * - \ref CDC_XFER_LIST "LIST" [path of a directory ending with '/']: the
+ *   device answers an \ref CDC_XFER_ENTRY "ENTRY" per file and directory
+ *   (sequence numbers from 0), then an \ref CDC_XFER_END "END" whose sequence
+ *   number is the number of entries.
+ * - \ref CDC_XFER_GET "GET" offset (4 bytes), length (4 bytes, 0 up to the end
+ *   of the file), path: the device sends the file data in
+ *   \ref CDC_XFER_DATA "DATA" frames of CDC_XFER_BLOCK_SIZE bytes (the last one
+ *   may be shorter), with sequence numbers from 0, keeping at most
+ *   CDC_XFER_WINDOW of them unacknowledged. The host acknowledges with
+ *   \ref CDC_XFER_ACK "ACK" frames whose sequence number is the next block it
+ *   expects, and asks the device to resend the blocks from a given one with a
+ *   \ref CDC_XFER_NAK "NAK" frame (block missing or received with a wrong
+ *   CRC, or no frame received for a while). Once every block is acknowledged,
+ *   the device sends an "END" frame whose sequence number is the number of
+ *   blocks.
+ * - \ref CDC_XFER_PUT "PUT" path: the device creates or truncates the file and
+ *   answers "ACK" 0. The host sends the data in "DATA" frames with sequence
+ *   numbers from 0 and any window; the device writes the blocks received in
+ *   sequence, acknowledges each of them, and answers a "NAK" with the
+ *   sequence number of the next block it expects to the first block out of
+ *   sequence or with a wrong CRC. The host ends the file with an "END" frame
+ *   whose sequence number is the number of blocks, which the device closes
+ *   and echoes.
+ * - \ref CDC_XFER_ABORT "ABORT" ends the request in progress.
+ *
+ * A request which fails is answered with an \ref CDC_XFER_ERROR "ERROR" frame
+ * holding the FAT status (fs_g_status).
+ *
+ * The paths are relative to the current directory of the explorer navigator
+ * (ID 0) when the request is received. The transfer uses its own navigator
+ * (FS_NAV_ID_CDC_XFER), so the explorer is left alone.
+ *
+ * \note The service runs from the main loop (\ref cdc_xfer_task) and must not
+ *       be called from interrupt handlers. The FAT module shall not be used
+ *       by a USB MSC host meanwhile: see \ref cdc_xfer_abort.
+ *
+ * \{
+ */
+
+#include "compiler.h"
+
+
+//! Size of the file data carried by a frame; the FAT reads and writes the
+//! sectors of the file directly from and to the frame buffers.
+#ifndef CDC_XFER_BLOCK_SIZE
+#define CDC_XFER_BLOCK_SIZE   512
+#endif
+
+//! Maximal number of unacknowledged blocks sent by the device.
+#ifndef CDC_XFER_WINDOW
+#define CDC_XFER_WINDOW       8
+#endif
+
+//! Maximal length of a path, including the NUL character.
+#ifndef CDC_XFER_PATH_SIZE
+#define CDC_XFER_PATH_SIZE    64
+#endif
+
+//! Navigator used by the transfers.
+#ifndef FS_NAV_ID_CDC_XFER
+#define FS_NAV_ID_CDC_XFER    2
+#endif
+
+//! First byte of the frames.
+#define CDC_XFER_SYNC         0xA5
+
+//! Size of the frame header and of the CRC.
+#define CDC_XFER_HEADER_SIZE  6
+#define CDC_XFER_CRC_SIZE     2
+
+/*! \name Frame Types
+ */
+//! @{
+#define CDC_XFER_LIST         0x01  //!< Host: lists a directory.
+#define CDC_XFER_GET          0x02  //!< Host: reads a range of a file.
+#define CDC_XFER_PUT          0x03  //!< Host: writes a file.
+#define CDC_XFER_ABORT        0x04  //!< Host: ends the request in progress.
+#define CDC_XFER_DATA         0x10  //!< File data.
+#define CDC_XFER_END          0x11  //!< End of the request.
+#define CDC_XFER_ENTRY        0x12  //!< Device: size (4 bytes), attributes (1 byte), name.
+#define CDC_XFER_ACK          0x20  //!< Next block expected.
+#define CDC_XFER_NAK          0x21  //!< Resend from this block.
+#define CDC_XFER_ERROR        0x2F  //!< Device: request failed, FAT status (1 byte).
+//! @}
+
+//! Transfer statistics.
+typedef struct
+{
+  //! Frames received with a good CRC.
+  U32 frames_received;
+
+  //! Frames dropped because of their CRC or length.
+  U32 frames_dropped;
+
+  //! Blocks sent, including the ones sent again.
+  U32 blocks_sent;
+
+  //! Blocks sent again after a NAK.
+  U32 blocks_resent;
+
+  //! Blocks written to a file.
+  U32 blocks_written;
+} cdc_xfer_stats_t;
+
+
+/*! \brief Initializes the service.
+ */
+extern void cdc_xfer_init(void);
+
+/*! \brief Receives the host frames and goes on with the request in progress.
+ *
+ * Sends at most one block per call, so the main loop keeps running during a
+ * transfer.
+ */
+extern void cdc_xfer_task(void);
+
+/*! \brief Ends the request in progress and closes its file.
+ *
+ * Shall be called before the FAT module is left (e.g. \ref nav_exit).
+ */
+extern void cdc_xfer_abort(void);
+
+/*! \brief Tells if a request is in progress.
+ */
+extern bool cdc_xfer_is_busy(void);
+
+/*! \brief Gets the transfer statistics.
+ *
+ * \param stats Pointer to the location where to store the statistics.
+ */
+extern void cdc_xfer_get_stats(cdc_xfer_stats_t *stats);
+
+/**
+ * \}
+ */
+
+#endif  // _CDC_XFER_H_
@@ -0,0 +1,216 @@
+/*****************************************************************************
+ *
+ * \file
+ *
+ * \brief Clock profiles: switching between OSC0 and PLL0 at run time.
+ *
+ * Copyright (c) 2009 Atmel Corporation. All rights reserved.
+ *
+ * \asf_license_start
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. The name of Atmel may not be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * 4. This software may only be redistributed and used in connection with an
+ *    Atmel microcontroller product.
+ *
+ * THIS SOFTWARE IS PROVIDED BY ATMEL "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT ARE
+ * EXPRESSLY AND SPECIFICALLY DISCLAIMED. IN NO EVENT SHALL ATMEL BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * \asf_license_stop
+ *
+ ******************************************************************************/
+
+
+
+
+#include "compiler.h"
+#include "board.h"
+#include "sysclk.h"
+#include "flashc.h"
+#include "clock_profile.h"
+
+
+//! Largest division of the main clock by a power of 2 (2^8).
+#define CLOCK_PROFILE_MAX_SHIFT   8
+
+
+//! Settings of the profiles.
+static clock_profile_setting_t clock_profile_settings[CLOCK_PROFILE_NB];
+
+//! Current profile.
+static clock_profile_t clock_profile_current;
+
+//! Registered driver callbacks.
+static clock_profile_callback_t clock_profile_clients[CLOCK_PROFILE_NB_CLIENTS];
+static unsigned int clock_profile_nb_clients;
+
+
+bool clock_profile_compute(unsigned long osc0_hz, unsigned long cpu_hz,
+                           unsigned long pba_hz,
+                           clock_profile_setting_t *setting)
+{
+  unsigned long main_hz = 0, pll_hz;
+  unsigned int mul, div, shift;
+
+  setting->cpu_hz = 0;
+  setting->pll_mul = 0;
+  setting->pll_div = 0;
+
+  // OSC0, divided down to the CPU frequency. The main clocks which the PBA
+  // prescaler cannot bring down to the PBA frequency are skipped.
+  for (shift = 0; shift <= CLOCK_PROFILE_MAX_SHIFT; shift++)
+  {
+    if ((osc0_hz >> CLOCK_PROFILE_MAX_SHIFT) > pba_hz) break;
+    if ((osc0_hz >> shift) <= cpu_hz)
+    {
+      main_hz = osc0_hz;
+      setting->cpu_hz = osc0_hz >> shift;
+      setting->cpu_shift = shift;
+      break;
+    }
+  }
+
+  // PLL0, if it gives a higher CPU frequency; among the settings giving the
+  // same one, the highest PLL frequency has the lowest jitter.
+  for (mul = 3; mul <= 16; mul++)
+  {
+    for (div = 1; div <= 15; div++)
+    {
+      if ((osc0_hz * mul) % div) continue;
+      pll_hz = osc0_hz * mul / div;
+      // Below 80 MHz, the VCO runs at twice the output frequency, doubling
+      // the multiplier.
+      if (pll_hz < PLL_MIN_HZ || pll_hz > PLL_MAX_HZ ||
+          (pll_hz < 2 * PLL_MIN_HZ && mul > 8) ||
+          (pll_hz >> CLOCK_PROFILE_MAX_SHIFT) > pba_hz) continue;
+
+      for (shift = 0; shift <= CLOCK_PROFILE_MAX_SHIFT; shift++)
+        if ((pll_hz >> shift) <= cpu_hz) break;
+      if (shift > CLOCK_PROFILE_MAX_SHIFT) continue;
+
+      if ((pll_hz >> shift) > setting->cpu_hz ||
+          ((pll_hz >> shift) == setting->cpu_hz && setting->pll_mul && pll_hz > main_hz))
+      {
+        main_hz = pll_hz;
+        setting->cpu_hz = pll_hz >> shift;
+        setting->pll_mul = mul;
+        setting->pll_div = div;
+        setting->cpu_shift = shift;
+      }
+    }
+  }
+
+  if (!setting->cpu_hz) return false;
+
+  // The PBA clock is not faster than the CPU clock.
+  for (shift = setting->cpu_shift; shift <= CLOCK_PROFILE_MAX_SHIFT; shift++)
+  {
+    if ((main_hz >> shift) <= pba_hz)
+    {
+      setting->pba_hz = main_hz >> shift;
+      setting->pba_shift = shift;
+      return true;
+    }
+  }
+  return false;
+}
+
+
+bool clock_profile_init(void)
+{
+  clock_profile_setting_t *low_power = &clock_profile_settings[CLOCK_PROFILE_LOW_POWER];
+  clock_profile_setting_t *high_speed = &clock_profile_settings[CLOCK_PROFILE_HIGH_SPEED];
+
+  low_power->cpu_hz = BOARD_OSC0_HZ;
+  low_power->pba_hz = BOARD_OSC0_HZ;
+  low_power->pll_mul = 0;
+  low_power->pll_div = 0;
+  low_power->cpu_shift = 0;
+  low_power->pba_shift = 0;
+  clock_profile_current = CLOCK_PROFILE_LOW_POWER;
+  clock_profile_nb_clients = 0;
+
+  if (!clock_profile_compute(BOARD_OSC0_HZ, CLOCK_PROFILE_HIGH_SPEED_CPU_HZ,
+                             CLOCK_PROFILE_HIGH_SPEED_PBA_HZ, high_speed))
+  {
+    *high_speed = *low_power;
+    return false;
+  }
+  return true;
+}
+
+
+bool clock_profile_register(clock_profile_callback_t callback)
+{
+  if (clock_profile_nb_clients >= CLOCK_PROFILE_NB_CLIENTS) return false;
+  clock_profile_clients[clock_profile_nb_clients++] = callback;
+  return true;
+}
+
+
+void clock_profile_set(clock_profile_t profile)
+{
+  const clock_profile_setting_t *current = &clock_profile_settings[clock_profile_current];
+  const clock_profile_setting_t *setting = &clock_profile_settings[profile];
+  struct pll_config pll_config;
+  unsigned int i;
+
+  if (profile == clock_profile_current) return;
+
+  for (i = 0; i < clock_profile_nb_clients; i++)
+    clock_profile_clients[i](CLOCK_PROFILE_PRE_CHANGE, current->cpu_hz, current->pba_hz);
+
+  // Run from OSC0, undivided, while PLL0 is set up. The flash wait state of
+  // both profiles fits this frequency.
+  sysclk_set_source(SYSCLK_SRC_OSC0);
+  sysclk_set_prescalers(0, 0, 0);
+  pll_disable(0);
+  flash_set_bus_freq(setting->cpu_hz);
+
+  if (setting->pll_mul)
+  {
+    pll_config_init(&pll_config, PLL_SRC_OSC0, setting->pll_div, setting->pll_mul);
+    pll_enable(&pll_config, 0);
+    while (!pll_is_locked(0));
+  }
+  sysclk_set_prescalers(setting->cpu_shift, setting->pba_shift, setting->cpu_shift);
+  if (setting->pll_mul)
+    sysclk_set_source(SYSCLK_SRC_PLL0);
+
+  clock_profile_current = profile;
+
+  for (i = clock_profile_nb_clients; i--; )
+    clock_profile_clients[i](CLOCK_PROFILE_POST_CHANGE, setting->cpu_hz, setting->pba_hz);
+}
+
+
+clock_profile_t clock_profile_get(void)
+{
+  return clock_profile_current;
+}
+
+
+const clock_profile_setting_t *clock_profile_get_setting(clock_profile_t profile)
+{
+  return &clock_profile_settings[profile];
+}
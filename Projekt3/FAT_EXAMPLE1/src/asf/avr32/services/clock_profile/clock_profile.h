@@ -0,0 +1,182 @@
+/*****************************************************************************
+ *
+ * \file
+ *
+ * \brief Clock profiles: switching between OSC0 and PLL0 at run time.
+ *
+ * Copyright (c) 2009 Atmel Corporation. All rights reserved.
+ *
+ * \asf_license_start
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. The name of Atmel may not be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * 4. This software may only be redistributed and used in connection with an
+ *    Atmel microcontroller product.
+ *
+ * THIS SOFTWARE IS PROVIDED BY ATMEL "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT ARE
+ * EXPRESSLY AND SPECIFICALLY DISCLAIMED. IN NO EVENT SHALL ATMEL BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * \asf_license_stop
+ *
+ ******************************************************************************/
+
+
+
+
+#ifndef _CLOCK_PROFILE_H_
+#define _CLOCK_PROFILE_H_
+
+/**
+ * \defgroup group_avr32_services_clock_profile Clock profiles
+ *
+ * Moves the main clock between a low-power profile, OSC0 undivided, and a
+ * high-speed profile derived from PLL0 (CLOCK_PROFILE_HIGH_SPEED_CPU_HZ and
+ * CLOCK_PROFILE_HIGH_SPEED_PBA_HZ, conf_clock_profile.h). The flash wait
+ * state follows the CPU frequency.
+ *
+ * The drivers deriving divisors from the CPU or PBA frequency (USART baud
+ * rates, SPI and TWI clocks, TC periods, delays) register a callback, called
+ * before the change to let them finish their transfers and after the change
+ * to derive their divisors again.
+ *
+ * \ref clock_profile_compute does not access the hardware, so that the
+ * settings derived for a profile can be checked on their own.
+ *
+ * \{
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "conf_clock_profile.h"
+
+
+#ifndef CLOCK_PROFILE_NB_CLIENTS
+#define CLOCK_PROFILE_NB_CLIENTS          8
+#endif
+
+
+//! Clock profiles.
+typedef enum
+{
+  CLOCK_PROFILE_LOW_POWER,    //!< OSC0, undivided.
+  CLOCK_PROFILE_HIGH_SPEED,   //!< PLL0, see conf_clock_profile.h.
+  CLOCK_PROFILE_NB
+} clock_profile_t;
+
+//! Events notified to the registered drivers.
+typedef enum
+{
+  CLOCK_PROFILE_PRE_CHANGE,   //!< The frequencies are about to change.
+  CLOCK_PROFILE_POST_CHANGE   //!< The frequencies have changed.
+} clock_profile_event_t;
+
+//! Clock settings of a profile.
+typedef struct
+{
+  unsigned long cpu_hz;       //!< CPU, HSB and PBB frequency.
+  unsigned long pba_hz;       //!< PBA frequency.
+  uint8_t pll_mul;            //!< PLL0 output = fOSC0 * pll_mul / pll_div; 0 to run from OSC0.
+  uint8_t pll_div;
+  uint8_t cpu_shift;          //!< CPU clock = main clock / 2^cpu_shift.
+  uint8_t pba_shift;          //!< PBA clock = main clock / 2^pba_shift.
+} clock_profile_setting_t;
+
+/*! \brief Driver callback.
+ *
+ * \param event   \ref CLOCK_PROFILE_PRE_CHANGE or \ref CLOCK_PROFILE_POST_CHANGE.
+ * \param cpu_hz  CPU frequency, current one before the change, new one after.
+ * \param pba_hz  PBA frequency, current one before the change, new one after.
+ */
+typedef void (*clock_profile_callback_t)(clock_profile_event_t event,
+                                         unsigned long cpu_hz,
+                                         unsigned long pba_hz);
+
+
+/*! \brief Derives the clock settings giving the highest CPU frequency not
+ *         above \a cpu_hz, then the highest PBA frequency not above \a pba_hz.
+ *
+ * Below fOSC0, OSC0 is divided; above, PLL0 runs between 80 and 240 MHz and
+ * its output, possibly divided by 2, is divided down to the CPU clock. The
+ * main clocks faster than 256 times \a pba_hz are not used.
+ *
+ * \param osc0_hz   OSC0 frequency.
+ * \param cpu_hz    Highest CPU frequency.
+ * \param pba_hz    Highest PBA frequency.
+ * \param setting   Pointer to the settings derived.
+ *
+ * \return Whether the frequencies can be reached.
+ */
+extern bool clock_profile_compute(unsigned long osc0_hz, unsigned long cpu_hz,
+                                  unsigned long pba_hz,
+                                  clock_profile_setting_t *setting);
+
+/*! \brief Initializes the service and derives the settings of the profiles.
+ *
+ * \pre The main clock runs from OSC0, undivided (low-power profile).
+ *
+ * \return Whether the high-speed profile can be reached; if not, it is the
+ *         same as the low-power one.
+ */
+extern bool clock_profile_init(void);
+
+/*! \brief Registers a driver callback.
+ *
+ * \param callback  Callback.
+ *
+ * \return Whether there was room for it (CLOCK_PROFILE_NB_CLIENTS).
+ */
+extern bool clock_profile_register(clock_profile_callback_t callback);
+
+/*! \brief Switches to a profile.
+ *
+ * The registered callbacks are called in their registration order before the
+ * change, and in the reverse order after it. To be called from the main loop,
+ * while the drivers are idle.
+ *
+ * \param profile   Profile.
+ */
+extern void clock_profile_set(clock_profile_t profile);
+
+/*! \brief Gets the current profile.
+ */
+extern clock_profile_t clock_profile_get(void);
+
+/*! \brief Gets the settings of a profile.
+ *
+ * \param profile   Profile.
+ */
+extern const clock_profile_setting_t *clock_profile_get_setting(clock_profile_t profile);
+
+/*! \brief Gets the CPU frequency of the current profile.
+ */
+#define clock_profile_get_cpu_hz()  (clock_profile_get_setting(clock_profile_get())->cpu_hz)
+
+/*! \brief Gets the PBA frequency of the current profile.
+ */
+#define clock_profile_get_pba_hz()  (clock_profile_get_setting(clock_profile_get())->pba_hz)
+
+/**
+ * \}
+ */
+
+#endif  // _CLOCK_PROFILE_H_
@@ -52,6 +52,7 @@
 #include "fat.h"
 #include LIB_MEM
 #include LIB_CTRLACCESS
+#include "trace.h"
 
 
 //_____ D E F I N I T I O N S ______________________________________________
@@ -136,6 +137,17 @@ bool  fat_check_device( void )
          fat_cache_reset();
       }
       fat_cache_clusterlist_reset();
+#if (FS_MULTI_PARTITION == true)
+      // The partition table may have changed with the media
+      if( fs_g_nav.u8_lun == fs_g_partition.u8_lun )
+      {
+         fat_cache_partition_reset();
+      }
+#endif
+#if (FS_LEVEL_FEATURES > FSFEATURE_READ) && (FS_DISCARD != FS_DISCARD_NONE)
+      // The freed clusters may not belong to the new media
+      fat_discard_reset( fs_g_nav.u8_lun );
+#endif
 
       fs_g_status = FS_ERR_HW;                     // By default HW error
       if( CTRL_BUSY == status )
@@ -303,42 +315,111 @@ uint8_t    fat_get_nbpartition( void )
 {
    if( !fat_check_device() )
       return 0;
+   if( !fat_read_partition_table() )
+      return 0;
+   return fs_g_partition.u8_nb_partition;
+}
+
+
+//! This function reads the partition table of current drive in the partition table cache
+//!
+//! @return    false in case of error, see global value "fs_g_status" for more detail
+//! @return    true otherwise
+//!
+//! @verbatim
+//! Global variables used
+//! IN :
+//!   fs_g_nav.u8_lun            Indicate the drive to read
+//! OUT:
+//!   fs_g_partition             Partition table of drive
+//! If the first sector of drive is a PBR (no MBR),
+//! then the drive contains only one partition which starts at sector 0. <br>
+//! The cache is kept until a media change or a new partition table is written,
+//! so the following mounts don't reread the MBR.
+//! @endverbatim
+//!
+bool  fat_read_partition_table( void )
+{
+   uint8_t u8_i;
+   uint8_t u8_type;
+   uint32_t u32_tmp;
+
+   if( fs_g_nav.u8_lun == fs_g_partition.u8_lun )
+      return true;   // The partition table of drive is already in cache
+
+   fs_g_partition.u8_nb_partition = 0;
 
-#warning this routine contains bug, rework it
    // Read the first sector of drive
    fs_gu32_addrsector = 0;
    if( !fat_cache_read_sector( true ))
       return false;
 
-   // Check PBR or MBR signature
+   // Check PBR/MBR signature
    if ( (fs_g_sector[510] != FS_BR_SIGNATURE_LOW  )
-   &&   (fs_g_sector[511] != FS_BR_SIGNATURE_HIGH ) )
+   ||   (fs_g_sector[511] != FS_BR_SIGNATURE_HIGH ) )
    {
-      // No MBR
-      // The sector, is it a PBR ?
-      if ( (fs_g_sector[0] == 0xEB) &&          // PBR Byte 0
-           (fs_g_sector[2] == 0x90) &&          // PBR Byte 2
-           ((fs_g_sector[21] & 0xF0) == 0xF0) ) // PBR Byte 21 : Media byte
+      fs_g_status = FS_ERR_NO_FORMAT;
+      return false;
+   }
+
+   // Search all partitions supported in MBR
+   for( u8_i=0 ; u8_i!=FS_MBR_NB_PARTITION ; u8_i++ )
+   {
+      u8_type = fs_g_sector[FS_MBR_OFFSET_PART_ENTRY(u8_i)+4];
+      if ( ((fs_g_sector[FS_MBR_OFFSET_PART_ENTRY(u8_i)+0] == FS_PART_BOOTABLE             )||
+            (fs_g_sector[FS_MBR_OFFSET_PART_ENTRY(u8_i)+0] == FS_PART_NO_BOOTABLE          )  )
+      &&   ((u8_type == FS_PART_TYPE_FAT12           )||
+            (u8_type == FS_PART_TYPE_FAT16_INF32M    )||
+            (u8_type == FS_PART_TYPE_FAT16_SUP32M    )||
+            (u8_type == FS_PART_TYPE_FAT16_SUP32M_BIS)||
+            (u8_type == FS_PART_TYPE_FAT32           )||
+            (u8_type == FS_PART_TYPE_FAT32_BIS       )) )
       {
-         return 1;   // No MBR but PBR exist then only one partition
-      } else {
-         return 0;   // No MBR and no PBR then no partition found
+         // Partition found -> Get partition position (unit sector) at offset 8 and size at offset 12
+         fs_g_partition.u8_entry[ fs_g_partition.u8_nb_partition ] = u8_i;
+         LSB0(u32_tmp) = fs_g_sector[FS_MBR_OFFSET_PART_ENTRY(u8_i)+8];
+         LSB1(u32_tmp) = fs_g_sector[FS_MBR_OFFSET_PART_ENTRY(u8_i)+9];
+         LSB2(u32_tmp) = fs_g_sector[FS_MBR_OFFSET_PART_ENTRY(u8_i)+10];
+         LSB3(u32_tmp) = fs_g_sector[FS_MBR_OFFSET_PART_ENTRY(u8_i)+11];
+         fs_g_partition.u32_start[ fs_g_partition.u8_nb_partition ] = u32_tmp * mem_sector_size( fs_g_nav.u8_lun );
+         LSB0(u32_tmp) = fs_g_sector[FS_MBR_OFFSET_PART_ENTRY(u8_i)+12];
+         LSB1(u32_tmp) = fs_g_sector[FS_MBR_OFFSET_PART_ENTRY(u8_i)+13];
+         LSB2(u32_tmp) = fs_g_sector[FS_MBR_OFFSET_PART_ENTRY(u8_i)+14];
+         LSB3(u32_tmp) = fs_g_sector[FS_MBR_OFFSET_PART_ENTRY(u8_i)+15];
+         fs_g_partition.u32_size[ fs_g_partition.u8_nb_partition ] = u32_tmp * mem_sector_size( fs_g_nav.u8_lun );
+         fs_g_partition.u8_nb_partition++;
       }
    }
 
-   number_part = 0;
-   while( 1 )
+   if( 0 == fs_g_partition.u8_nb_partition )
    {
-      // The first sector must be a MBR, then check the partition entry in the MBR
-      if ( ((fs_g_sector[FS_MBR_OFFSET_PART_ENTRY(number_part)+0] != FS_PARTITION_ACTIVE) &&
-            (fs_g_sector[FS_MBR_OFFSET_PART_ENTRY(number_part)+0] != 0x00))
-      ||    (fs_g_sector[FS_MBR_OFFSET_PART_ENTRY(number_part)+4] == 0x00) )
+      // No MBR found then check PBR
+      if( Fat_sector_is_PBR() )
       {
-         break;
+         // No MBR but PBR exist then only one partition on all disk space
+         if( CTRL_GOOD != mem_read_capacity( fs_g_nav.u8_lun , &u32_tmp ))
+         {
+            fs_g_status = FS_ERR_HW;
+            return false;
+         }
+         fs_g_partition.u8_entry[0]  = 0xFF;
+         fs_g_partition.u32_start[0] = 0;
+         fs_g_partition.u32_size[0]  = u32_tmp+1;
+         fs_g_partition.u8_nb_partition = 1;
       }
-      number_part++;
    }
-   return number_part;
+
+   // Valid partition table cache
+   fs_g_partition.u8_lun = fs_g_nav.u8_lun;
+   return true;
+}
+
+
+//! This function resets the partition table cache
+//!
+void  fat_cache_partition_reset( void )
+{
+   fs_g_partition.u8_lun = FS_BUF_SECTOR_EMPTY;
 }
 #endif
 
@@ -368,6 +449,7 @@ bool  fat_cluster_list( uint8_t opt_action, bool b_for_file )
 {
    _MEM_TYPE_FAST_ uint32_t u32_tmp;
    _MEM_TYPE_FAST_ uint8_t u8_cluster_status;
+   Trace_function(TRACE_FAT_CLUSTER_LIST);
 
    fs_g_status = FS_ERR_FS;      // By default system error
 
@@ -548,6 +630,12 @@ bool  fat_cluster_list( uint8_t opt_action, bool b_for_file )
             {
                fs_g_cluster.u32_val = FS_CLUST_VAL_EOL;  // End of cluster list allocated
             }
+#if (FS_DISCARD != FS_DISCARD_NONE)
+            else
+            {
+               fat_discard_cluster();                    // The cluster is freed
+            }
+#endif
             if( !fat_cluster_val( FS_CLUST_VAL_WRITE ))
                return false;
             fs_g_cluster.u32_val = fs_g_seg.u32_addr;    // Resotre the next cluster
@@ -924,6 +1012,9 @@ void  fat_cache_clusterlist_update_finish( void )
 {
    uint8_t u8_cluster_offset = fs_g_cache_clusterlist[fs_g_u8_current_cache].u32_start % fs_g_nav.u8_BPB_SecPerClus;
    fs_g_cache_clusterlist[fs_g_u8_current_cache].u8_lun       = fs_g_nav.u8_lun;          // valid cache
+#if (FS_MULTI_PARTITION == true)
+   fs_g_cache_clusterlist[fs_g_u8_current_cache].u8_partition = fs_g_nav.u8_partition;
+#endif
    fs_g_cache_clusterlist[fs_g_u8_current_cache].u32_start   -= u8_cluster_offset;
    fs_g_cache_clusterlist[fs_g_u8_current_cache].u32_addr     = fs_g_seg.u32_addr - u8_cluster_offset;
    fs_g_cache_clusterlist[fs_g_u8_current_cache].u32_size     = fs_g_seg.u32_size_or_pos + u8_cluster_offset;
@@ -967,7 +1058,11 @@ bool  fat_cache_clusterlist_update_read( bool b_for_file )
    for( u8_i=0; u8_i<(FS_NB_CACHE_CLUSLIST*2); u8_i++ )
    {
       if( (fs_g_cache_clusterlist[u8_i].b_cache_file == b_for_file)
-      &&  (fs_g_cache_clusterlist[u8_i].u8_lun == fs_g_nav.u8_lun ) )
+      &&  (fs_g_cache_clusterlist[u8_i].u8_lun == fs_g_nav.u8_lun )
+#if (FS_MULTI_PARTITION == true)
+      &&  (fs_g_cache_clusterlist[u8_i].u8_partition == fs_g_nav.u8_partition )
+#endif
+      )
       {
          if( fs_g_cache_clusterlist[u8_i].u32_cluster == fs_g_cluster.u32_pos )
          {
@@ -1041,6 +1136,9 @@ bool  fat_read_file( uint8_t mode )
    if(FS_CLUST_ACT_ONE  == mode)
    {
       if( (fs_g_sectorcache.u8_lun                 == fs_g_nav.u8_lun )
+#if (FS_MULTI_PARTITION == true)
+      &&  (fs_g_sectorcache.u8_partition           == fs_g_nav.u8_partition )
+#endif
       &&  (fs_g_sectorcache.u32_clusterlist_start  == fs_g_nav_entry.u32_cluster )
       &&  (fs_g_sectorcache.u32_clusterlist_pos    == u32_sector_pos ) )
       {
@@ -1199,6 +1297,9 @@ bool  fat_read_dir( void )
    u32_cluster_pos = fs_g_nav_fast.u16_entry_pos_sel_file >> (FS_512B_SHIFT_BIT - FS_SHIFT_B_TO_FILE_ENTRY);
 
    if( (fs_g_sectorcache.u8_lun                 == fs_g_nav.u8_lun )
+#if (FS_MULTI_PARTITION == true)
+   &&  (fs_g_sectorcache.u8_partition           == fs_g_nav.u8_partition )
+#endif
    &&  (fs_g_sectorcache.u32_clusterlist_start  == fs_g_nav.u32_cluster_sel_dir )
    &&  (fs_g_sectorcache.u32_clusterlist_pos    == u32_cluster_pos ) )
    {
@@ -1792,10 +1893,20 @@ PTR_CACHE fat_get_ptr_entry( void )
 //!
 bool  fat_cache_read_sector( bool b_load )
 {
+   Trace_function(TRACE_FAT_CACHE_READ_SECTOR);
+
    // Check if the sector asked is the same in cache
    if( (fs_g_sectorcache.u8_lun     == fs_g_nav.u8_lun )
    &&  (fs_g_sectorcache.u32_addr   == fs_gu32_addrsector ) )
    {
+#if (FS_MULTI_PARTITION == true)
+      if( fs_g_sectorcache.u8_partition != fs_g_nav.u8_partition )
+      {
+         // The cluster list informations of cache are relative at the partition which has loaded the sector
+         fs_g_sectorcache.u8_partition          = fs_g_nav.u8_partition;
+         fs_g_sectorcache.u32_clusterlist_start = 0xFFFFFFFF;
+      }
+#endif
       return true;
    }
 
@@ -1819,6 +1930,9 @@ bool  fat_cache_read_sector( bool b_load )
    }
    // Valid sector cache
    fs_g_sectorcache.u8_lun = fs_g_nav.u8_lun;
+#if (FS_MULTI_PARTITION == true)
+   fs_g_sectorcache.u8_partition = fs_g_nav.u8_partition;
+#endif
    return true;
 }
 
@@ -114,7 +114,9 @@
 //**** Definitions corresponding at the FAT norm ****
 
 //! Position (unit byte) in the MBR of a partition entry
-#define  FS_MBR_OFFSET_PART_ENTRY( num )  ((uint16_t)((uint16_t)(0x1BE)+(0x10 * num)))  // Partition entry num (0 to 4)
+#define  FS_MBR_OFFSET_PART_ENTRY( num )  ((uint16_t)((uint16_t)(0x1BE)+(0x10 * num)))  // Partition entry num (0 to 3)
+//! Number of partition entries in the MBR
+#define  FS_MBR_NB_PARTITION        4
 
 
 //! \name Macro to access at fields in BPB sector (only used in fat_mount() function)
@@ -185,6 +187,9 @@
 #define  FS_BOOT_SIGN               0x29     // Boot signature
 //! @}
 
+//! Macro to check if the sector cache contains a PBR (jump boot flag and media byte)
+#define  Fat_sector_is_PBR()        ( (fs_g_sector[0] == 0xEB) && (fs_g_sector[2] == 0x90) && ((fs_g_sector[21] & 0xF0) == 0xF0) )
+
 
 //! \name Maximum of FAT cluster
 //! @{
@@ -277,7 +282,7 @@ typedef struct
 {
    uint8_t    u8_lun;                       //!< Number of logical driver
 #if (FS_MULTI_PARTITION == true)
-   uint8_t    u8_partition;                 //!< Number of partition - 1 (0 or 1)
+   uint8_t    u8_partition;                 //!< Number of partition - 1 (0 to FS_MBR_NB_PARTITION-1)
 #endif
    uint8_t    u8_BPB_SecPerClus;            //!< Cluster size (unit 512B)
    // The pointers start at beginning of the memory, and unit = 512B
@@ -342,6 +347,9 @@ typedef struct {
    bool  b_cache_file;                 //!< Signal a cluster cache from file cluster list or directory cluster list
    uint8_t    u8_level_use;                 //!< Cache level, 0 for the last used and up to FS_NB_CACHE_CLUSLIST-1 for the old access (ignore if FS_NB_CACHE_CLUSLIST=1)
    uint8_t    u8_lun;                       //!< LUN of cluster list
+#if (FS_MULTI_PARTITION == true)
+   uint8_t    u8_partition;                 //!< Partition of cluster list
+#endif
    uint32_t   u32_cluster;                  //!< First cluster of cluster list
    uint32_t   u32_start;                    //!< Start position in the cluster list (unit 512B)
    uint32_t   u32_addr;                     //!< Address corresponding at the position "start" in cluster list
@@ -352,6 +360,9 @@ typedef struct {
 //! Struture to store the information about sector cache (=last sector read or write on disk)
 typedef struct {
    uint8_t    u8_lun;                       //!< LUN of sector
+#if (FS_MULTI_PARTITION == true)
+   uint8_t    u8_partition;                 //!< Partition of navigator which has loaded the sector
+#endif
    uint32_t   u32_addr;                     //!< Sector address (unit 512B)
    uint8_t    u8_dirty;                     //!< Cache status
                                        //!< if the sector is a sector from a cluster list THEN
@@ -360,6 +371,28 @@ typedef struct {
 } Fs_sector_cache;
 
 
+#if (FS_MULTI_PARTITION == true)
+//! Struture to store the partition table of a drive (geometry read from MBR at mount)
+typedef struct {
+   uint8_t    u8_lun;                       //!< LUN of partition table (FS_BUF_SECTOR_EMPTY if the cache is not valid)
+   uint8_t    u8_nb_partition;              //!< Number of FAT partitions found on drive
+   uint8_t    u8_entry[FS_MBR_NB_PARTITION];   //!< Position of partition entry in MBR (0xFF if the drive hasn't MBR)
+   uint32_t   u32_start[FS_MBR_NB_PARTITION];  //!< Partition address (unit 512B)
+   uint32_t   u32_size[FS_MBR_NB_PARTITION];   //!< Partition size (unit 512B)
+} Fs_partition_table;
+#endif
+
+
+#if (FS_LEVEL_FEATURES > FSFEATURE_READ) && (FS_DISCARD != FS_DISCARD_NONE)
+//! Struture to store a range of freed sectors waiting to be discarded
+typedef struct {
+   uint8_t    u8_lun;                       //!< LUN of the range
+   uint32_t   u32_addr;                     //!< First sector of the range (unit 512B)
+   uint32_t   u32_size;                     //!< Size of the range (unit 512B)
+} Fs_discard_range;
+#endif
+
+
 //**** Definition of value used by the STRUCTURES of communication
 
 //! \name FAT type ID, used in "Fs_management_fast.u8_type_fat"
@@ -427,6 +460,19 @@ _GLOBEXT_   _MEM_TYPE_SLOW_   uint32_t                  fs_gu32_addrsector;
 typedef uint8_t  _MEM_TYPE_SLOW_   * PTR_CACHE;
 //!}@
 
+#if (FS_MULTI_PARTITION == true)
+//! Partition table cache, shared by all navigators
+_GLOBEXT_   _MEM_TYPE_SLOW_   Fs_partition_table   fs_g_partition;
+#endif
+
+#if (FS_LEVEL_FEATURES > FSFEATURE_READ) && (FS_DISCARD != FS_DISCARD_NONE)
+//! \name Variables used to store the freed clusters waiting to be discarded
+//! @{
+_GLOBEXT_   _MEM_TYPE_SLOW_   Fs_discard_range     fs_g_discard[ FS_NB_DISCARD ];
+_GLOBEXT_   _MEM_TYPE_SLOW_   uint8_t              fs_g_u8_nb_discard;     //!< Number of ranges used in fs_g_discard
+//! @}
+#endif
+
 
 
 
@@ -447,12 +493,28 @@ bool        fat_check_is_file             ( void );
 //! This function returns the number of partition present on selected drive
 uint8_t          fat_get_nbpartition           ( void );
 
+#if (FS_MULTI_PARTITION == true)
+//! \name Functions to manage the partition table cache
+//! @{
+bool        fat_read_partition_table      ( void );
+void        fat_cache_partition_reset     ( void );
+//! @}
+#endif
+
 //! This function mounts a partition
 bool        fat_mount                     ( void );
 
 //! This function formats the drive
 bool        fat_format                    ( uint8_t u8_fat_type );
 
+#if (FS_MULTI_PARTITION == true)
+//! This function formats the selected partition without change the partition table
+bool        fat_format_partition          ( uint8_t u8_fat_type );
+
+//! This function writes a new partition table on the drive
+bool        fat_create_partitions         ( uint8_t u8_nb_partition , const uint32_t _MEM_TYPE_SLOW_ *a_u32_size );
+#endif
+
 //! This function reads or writes a serial number
 bool        fat_serialnumber              ( bool b_action , uint8_t _MEM_TYPE_SLOW_ *a_u8_sn );
 
@@ -480,6 +542,16 @@ bool        fat_update_fat2               ( void );
 //! @}
 
 
+#if (FS_LEVEL_FEATURES > FSFEATURE_READ) && (FS_DISCARD != FS_DISCARD_NONE)
+//! \name Functions to discard the freed clusters
+//! @{
+void        fat_discard_cluster           ( void );
+bool        fat_discard_flush             ( void );
+void        fat_discard_reset             ( uint8_t u8_lun );
+//! @}
+#endif
+
+
 //! \name Functions to read or to write a file or a directory
 //! @{
 bool        fat_read_file                 ( uint8_t mode );
@@ -57,10 +57,21 @@
 
 //_____ D E C L A R A T I O N S ____________________________________________
 
-bool  fat_select_filesystem               ( uint8_t u8_fat_type , bool b_MBR );
+//! \name Disk geometry used to translate the sector addresses in CHS (MBR and PBR)
+//! @{
+#define  FS_CHS_SECTOR_PER_TRACK    0x3F     //!< Maximum number of sectors per track (6 bits)
+#define  FS_CHS_NB_HEAD             0xFF     //!< Maximum number of heads (8 bits)
+#define  FS_CHS_MAX_CYLINDER        1023     //!< Maximum cylinder (10 bits), larger addresses are saturated
+//! @}
+
+bool  fat_select_filesystem               ( uint8_t u8_fat_type );
 bool  fat_write_MBR                       ( void );
-bool  fat_write_PBR                       ( bool b_MBR );
-bool  fat_clean_zone                      ( bool b_MBR );
+void  fat_write_MBR_entry                 ( uint8_t u8_entry );
+void  fat_write_MBR_chs                   ( uint16_t u16_offset , uint32_t u32_lba );
+uint32_t   fat_align_erase_block               ( uint32_t u32_addr );
+bool  fat_write_filesystem                ( void );
+bool  fat_write_PBR                       ( void );
+bool  fat_clean_zone                      ( void );
 bool  fat_initialize_fat                  ( void );
 
 
@@ -101,6 +112,8 @@ bool  fat_garbage_collector_entry         ( void );
 //!   fs_g_nav                   update structure
 //! If the FS_MULTI_PARTITION option is disabled
 //! then the mount routine selects the first partition supported by file system. <br>
+//! If the FS_MULTI_PARTITION option is enabled
+//! then the partition position is taken in the partition table cache (see fat_read_partition_table()). <br>
 //! @endverbatim
 //!
 bool  fat_mount( void )
@@ -122,6 +135,36 @@ bool  fat_mount( void )
    if( !fat_check_device() )
       return false;
 
+#if (FS_MULTI_PARTITION == true)
+   // Get the partition position from the partition table of drive
+   if( !fat_read_partition_table() )
+      return false;
+   if( fs_g_nav.u8_partition >= fs_g_partition.u8_nb_partition )
+   {
+      fs_g_status = FS_ERR_NO_PART;
+      return false;
+   }
+   fs_gu32_addrsector = fs_g_partition.u32_start[ fs_g_nav.u8_partition ];
+
+   // Read the PBR of partition
+   if( !fat_cache_read_sector( true ))
+      return false;
+
+   // Check PBR signature
+   if ( (fs_g_sector[510] != FS_BR_SIGNATURE_LOW  )
+   ||   (fs_g_sector[511] != FS_BR_SIGNATURE_HIGH ) )
+   {
+      fs_g_status = FS_ERR_NO_FORMAT;
+      return false;
+   }
+
+   //** Check a PBR structure
+   if( !Fat_sector_is_PBR() )
+   {
+      fs_g_status = FS_ERR_NO_PART;
+      return false;
+   }
+#else
    while( 1 )  // Search a valid partition
    {
       // Read one sector
@@ -140,10 +183,7 @@ bool  fat_mount( void )
       {
          //** first sector then check a MBR structure
          // Search the first partition supported
-#if (FS_MULTI_PARTITION == true)
-         u16_tmp=0;  // Init to "no valid partition found"
-#endif
-         for( u8_tmp=0 ; u8_tmp!=4 ; u8_tmp++ )
+         for( u8_tmp=0 ; u8_tmp!=FS_MBR_NB_PARTITION ; u8_tmp++ )
          {
             // The first sector must be a MBR, then check the partition entry in the MBR
             if ( ((fs_g_sector[FS_MBR_OFFSET_PART_ENTRY(u8_tmp)+0] == FS_PART_BOOTABLE             )||
@@ -156,16 +196,10 @@ bool  fat_mount( void )
                   (fs_g_sector[FS_MBR_OFFSET_PART_ENTRY(u8_tmp)+4] == FS_PART_TYPE_FAT32_BIS       )) )
             {
                // A valid partition is found
-#if (FS_MULTI_PARTITION == true)
-               if( u16_tmp == fs_g_nav.u8_partition )
-                  break;   // The selected partition is valid
-               u16_tmp++;
-#else
                break;
-#endif
             }
          }
-         if( u8_tmp != 4 )
+         if( u8_tmp != FS_MBR_NB_PARTITION )
          {
             // Partition found -> Get partition position (unit sector) at offset 8
             LSB0(fs_gu32_addrsector) = fs_g_sector[FS_MBR_OFFSET_PART_ENTRY(u8_tmp)+8];
@@ -175,22 +209,11 @@ bool  fat_mount( void )
             fs_gu32_addrsector *= mem_sector_size( fs_g_nav.u8_lun );
             continue;   // Go to check PBR of partition
          }
-
          // No MBR found then check PBR
-#if (FS_MULTI_PARTITION == true)
-         // The device don't have mutli partition, but only one
-         if ( 0 != fs_g_nav.u8_partition )
-         {
-            fs_g_status = FS_ERR_NO_PART;
-            return false;
-         }
-#endif
       }
 
       //** Check a PBR structure
-      if ( (fs_g_sector[0] == 0xEB) &&          // PBR Byte 0
-           (fs_g_sector[2] == 0x90) &&          // PBR Byte 2
-           ((fs_g_sector[21] & 0xF0) == 0xF0) ) // PBR Byte 21 : Media byte
+      if( Fat_sector_is_PBR() )
       {
          break;   // valid PBR found
       }
@@ -198,6 +221,7 @@ bool  fat_mount( void )
       fs_g_status = FS_ERR_NO_PART;
       return false;
    }
+#endif  // FS_MULTI_PARTITION
 
    fs_g_status = FS_ERR_NO_SUPPORT_PART;  // by default partition no supported
 
@@ -312,8 +336,11 @@ bool  fat_mount( void )
 
 #if (FSFEATURE_WRITE_COMPLET == (FS_LEVEL_FEATURES & FSFEATURE_WRITE_COMPLET) )
 
-//! \name Global variable to optimize the footprint of format routines
-_MEM_TYPE_SLOW_   uint32_t fs_s_u32_size_partition;
+//! \name Global variables to optimize the footprint of format routines
+//! @{
+_MEM_TYPE_SLOW_   uint32_t fs_s_u32_size_partition;   //!< Size of partition to format (unit 512B)
+_MEM_TYPE_SLOW_   uint32_t fs_s_u32_addr_partition;   //!< Address of partition to format, i.e. PBR address (unit 512B)
+//! @}
 
 //! This function formats the current drive
 //!
@@ -333,33 +360,46 @@ _MEM_TYPE_SLOW_   uint32_t fs_s_u32_size_partition;
 //!
 //! This routine can't format a multi-partiton, if the disk contains a multi-partition area
 //! then the multi-partition will be erased and replaced by a single partition on all disk space.
+//! With a MBR, the partition starts on the erase block boundary of the memory (see mem_erase_block_size())
+//! if the disk is large enough, to avoid read-modify-write cycles inside the memory.
 //! @endverbatim
 //!
 bool  fat_format( uint8_t u8_fat_type )
 {
    bool b_MBR;
+   uint32_t u32_nb_sector;
+
 #if (FS_MULTI_PARTITION == true)
-#error NOT SUPPORTED
    fs_g_nav.u8_partition = 0;
+   // The partition table will be rewritten
+   fat_cache_partition_reset();
 #endif
 
-
    // Get drive capacity (= last LBA)
-   mem_read_capacity( fs_g_nav.u8_lun , &fs_s_u32_size_partition );
+   if( CTRL_GOOD != mem_read_capacity( fs_g_nav.u8_lun , &u32_nb_sector ))
+   {
+      fs_g_status = FS_ERR_HW;
+      return false;
+   }
+   u32_nb_sector++;
 
    if( u8_fat_type & FS_FORMAT_NOMBR_FLAG )
    {
       b_MBR = false;
       u8_fat_type &= ~FS_FORMAT_NOMBR_FLAG;
-      // partition size = disk size = last LBA + 1
-      fs_s_u32_size_partition++;
+      // partition size = disk size
+      fs_s_u32_addr_partition = 0;
    }else{
       b_MBR = true;
-      // partition size = size disk -1 = last LBA
+      // partition starts after the MBR, or on the first erase block if it costs less than 1/16 of disk space
+      fs_s_u32_addr_partition = fat_align_erase_block( 1 );
+      if( (fs_s_u32_addr_partition * 16) > u32_nb_sector )
+         fs_s_u32_addr_partition = 1;
    }
+   fs_s_u32_size_partition = u32_nb_sector - fs_s_u32_addr_partition;
 
    // Compute the FAT type for the device
-   if( !fat_select_filesystem( u8_fat_type , b_MBR ))
+   if( !fat_select_filesystem( u8_fat_type ))
       return false;
 
    // Write the MBR sector (first sector)
@@ -367,23 +407,158 @@ bool  fat_format( uint8_t u8_fat_type )
       if( !fat_write_MBR())
          return false;
 
-   // Write the PBR sector
-   if( !fat_write_PBR( b_MBR ))
+   return fat_write_filesystem();
+}
+
+
+#if (FS_MULTI_PARTITION == true)
+//! This function formats the selected partition of current drive
+//!
+//! @param     u8_fat_type          Select the type of format <br>
+//!            FS_FORMAT_DEFAULT,   The file system module choose the better FAT format for the partition space <br>
+//!            FS_FORMAT_FAT,       The FAT12 or FAT16 is used to format the partition, if possible (partition space <2GB) <br>
+//!            FS_FORMAT_FAT32,     The FAT32 is used to format the partition, if possible (partition space >32MB) <br>
+//!
+//! @return    false in case of error, see global value "fs_g_status" for more detail
+//! @return    true otherwise
+//!
+//! @verbatim
+//! Global variables used
+//! IN :
+//! fs_g_nav.u8_lun        indicate the drive to format
+//! fs_g_nav.u8_partition  indicate the partition to format
+//!
+//! The position and the size of the partition are unchanged,
+//! only the partition type is updated in MBR. The other partitions of drive are not modified.
+//! @endverbatim
+//!
+bool  fat_format_partition( uint8_t u8_fat_type )
+{
+   uint8_t u8_entry;
+
+   if( !fat_read_partition_table() )
+      return false;
+   if( fs_g_nav.u8_partition >= fs_g_partition.u8_nb_partition )
+   {
+      fs_g_status = FS_ERR_NO_PART;
       return false;
+   }
+   u8_fat_type &= ~FS_FORMAT_NOMBR_FLAG;
+   u8_entry = fs_g_partition.u8_entry[ fs_g_nav.u8_partition ];
+   if( 0xFF == u8_entry )
+   {
+      // Drive without MBR, then the partition is the full disk space
+      return fat_format( u8_fat_type | FS_FORMAT_NOMBR_FLAG );
+   }
+   fs_s_u32_addr_partition = fs_g_partition.u32_start[ fs_g_nav.u8_partition ];
+   fs_s_u32_size_partition = fs_g_partition.u32_size[  fs_g_nav.u8_partition ];
 
-   // Clear reserved zone, FAT zone, and Root dir zone
-   // Remark: the reserved zone of FAT32 isn't initialized, because BPB_FSInfo is equal to 0
-   if( !fat_clean_zone( b_MBR ))
+   // Compute the FAT type for the partition
+   if( !fat_select_filesystem( u8_fat_type ))
       return false;
 
-   // Initialization of the FAT 1 and 2
-   if( !fat_initialize_fat())
+   // Update the partition entry in MBR with the new partition type
+   fs_gu32_addrsector = 0;
+   if( !fat_cache_read_sector( true ))
       return false;
+   fat_cache_mark_sector_as_dirty();
+   fat_write_MBR_entry( u8_entry );
 
-   return fat_cache_flush();
+   return fat_write_filesystem();
 }
 
 
+//! This function writes a new partition table on the current drive
+//!
+//! @param     u8_nb_partition   number of partitions to create (1 to FS_MBR_NB_PARTITION)
+//! @param     a_u32_size        array with the size of each partition (unit 512B) <br>
+//!                              the size 0 on the last partition means all remaining disk space
+//!
+//! @return    false in case of error, see global value "fs_g_status" for more detail
+//! @return    true otherwise
+//!
+//! @verbatim
+//! Global variables used
+//! IN :
+//! fs_g_nav.u8_lun        indicate the drive to partition
+//!
+//! Each partition starts on an erase block boundary of the memory (see mem_erase_block_size()).
+//! The partitions are NOT formatted, call fat_format_partition() on each partition after this routine.
+//! All data of the drive are lost.
+//! @endverbatim
+//!
+bool  fat_create_partitions( uint8_t u8_nb_partition , const uint32_t _MEM_TYPE_SLOW_ *a_u32_size )
+{
+   uint8_t u8_i;
+   uint32_t u32_nb_sector;
+
+   if( (0 == u8_nb_partition) || (FS_MBR_NB_PARTITION < u8_nb_partition) )
+   {
+      fs_g_status = FS_ERR_NO_PART;
+      return false;
+   }
+
+   // Get drive capacity (= last LBA + 1)
+   if( CTRL_GOOD != mem_read_capacity( fs_g_nav.u8_lun , &u32_nb_sector ))
+   {
+      fs_g_status = FS_ERR_HW;
+      return false;
+   }
+   u32_nb_sector++;
+
+   // The partition table will be rewritten
+   fat_cache_partition_reset();
+
+   // Init and reset the internal cache at the beginning of memory
+   fs_gu32_addrsector = 0;
+   if( !fat_cache_read_sector( false ))
+      return false;
+   fat_cache_clear();
+
+   // MBR signature
+   fs_g_sector[510] = FS_BR_SIGNATURE_LOW;
+   fs_g_sector[511] = FS_BR_SIGNATURE_HIGH;
+
+   fs_s_u32_addr_partition = 1;   // Jump MBR
+   for( u8_i=0; u8_i!=u8_nb_partition; u8_i++ )
+   {
+      fs_s_u32_addr_partition = fat_align_erase_block( fs_s_u32_addr_partition );
+      if( fs_s_u32_addr_partition >= u32_nb_sector )
+      {
+         fs_g_status = FS_ERR_DEVICE_TOO_SMALL;
+         goto fat_create_partitions_fail;
+      }
+      fs_s_u32_size_partition = a_u32_size[u8_i];
+      if( (0 == fs_s_u32_size_partition) && ((u8_nb_partition-1) == u8_i) )
+         fs_s_u32_size_partition = u32_nb_sector - fs_s_u32_addr_partition;   // Last partition on all remaining space
+      if( (0 == fs_s_u32_size_partition)
+      ||  (fs_s_u32_size_partition > (u32_nb_sector - fs_s_u32_addr_partition)) )
+      {
+         fs_g_status = FS_ERR_DEVICE_TOO_SMALL;
+         goto fat_create_partitions_fail;
+      }
+
+      // Check that the partition can be formatted and get its partition type
+      if( !fat_select_filesystem( FS_FORMAT_DEFAULT ))
+         goto fat_create_partitions_fail;
+      fat_write_MBR_entry( u8_i );
+
+      fs_s_u32_addr_partition += fs_s_u32_size_partition;
+   }
+   fs_g_nav_fast.u8_type_fat = FS_TYPE_FAT_UNM;
+
+   // All partitions are valid, then write the MBR
+   fat_cache_mark_sector_as_dirty();
+   return fat_cache_flush();
+
+fat_create_partitions_fail:
+   // The sector cache doesn't contain the MBR of drive
+   fs_g_nav_fast.u8_type_fat = FS_TYPE_FAT_UNM;
+   fat_cache_reset();
+   return false;
+}
+#endif  // FS_MULTI_PARTITION
+
 
 //! \name Struture for the tables format
 typedef struct st_fs_format_table {
@@ -469,16 +644,16 @@ may be to low for FAT32.
 //!            FS_FORMAT_DEFAULT,   The file system module chooses the better FAT format for the drive space <br>
 //!            FS_FORMAT_FAT,       The FAT12 or FAT16 is used to format the drive, if possible (disk space <2GB) <br>
 //!            FS_FORMAT_FAT32,     The FAT32 is used to format the drive, if possible (disk space >32MB) <br>
-//! @param     b_MBR          true, include a MBR on disk
 //!
 //! @return    false in case of error, see global value "fs_g_status" for more detail
 //! @return    true otherwise
 //!
 //! @verbatim
-//! Compute the fat type, fat position and fat size.
+//! Compute the fat type, fat position and fat size
+//! for the partition defined by fs_s_u32_addr_partition and fs_s_u32_size_partition.
 //! @endverbatim
 //!
-bool  fat_select_filesystem( uint8_t u8_fat_type , bool b_MBR )
+bool  fat_select_filesystem( uint8_t u8_fat_type )
 {
    uint8_t u8_i;
    uint8_t u8_tmp = 0;
@@ -524,6 +699,7 @@ bool  fat_select_filesystem( uint8_t u8_fat_type , bool b_MBR )
       u8_i = sizeof(TableFAT32);
       ptr_table = TableFAT32;
    }
+   fs_g_nav.u8_BPB_SecPerClus = 0;
    for(  ; u8_i!=0 ; u8_i-- )
    {
       if( fs_s_u32_size_partition <= ptr_table->u32_disk_size )
@@ -542,10 +718,7 @@ bool  fat_select_filesystem( uint8_t u8_fat_type , bool b_MBR )
 
    //** Compute fat size
    // Compute PBR address
-   if( b_MBR )
-      fs_g_nav.u32_ptr_fat = 1;  // MBR exist
-   else
-      fs_g_nav.u32_ptr_fat = 0;  // no MBR
+   fs_g_nav.u32_ptr_fat = fs_s_u32_addr_partition;
 
    if( Is_fat12 )
    {  // FAT 12
@@ -619,8 +792,6 @@ bool  fat_select_filesystem( uint8_t u8_fat_type , bool b_MBR )
 //!
 bool  fat_write_MBR( void )
 {
-   uint8_t u8_i = 0;
-
    // Init and reset the internal cache at the beginning of memory
    fs_gu32_addrsector = 0;
    if( !fat_cache_read_sector( false ))
@@ -633,11 +804,27 @@ bool  fat_write_MBR( void )
    fs_g_sector[511] = FS_BR_SIGNATURE_HIGH;
 
    // Write the partition entry in the MBR
-   fs_g_sector[FS_MBR_OFFSET_PART_ENTRY(0) +0] = FS_PART_NO_BOOTABLE;   // Active partition
-   // Remark: cylinder and header start to 0, and sector value start to 1
-   //fs_g_sector[FS_MBR_OFFSET_PART_ENTRY(0) +1] = 0;                   // The head (0) where the partition starts
-   fs_g_sector[FS_MBR_OFFSET_PART_ENTRY(0) +2] = 2;                     // The sector (2=next to MBR) and the cylinder (0) where the partition starts
-   //fs_g_sector[FS_MBR_OFFSET_PART_ENTRY(0) +3] = 0;
+   fat_write_MBR_entry( 0 );
+   return true;
+}
+
+
+//! This function writes a partition entry in the MBR stored in sector cache
+//!
+//! @param     u8_entry       position of the partition entry in MBR (0 to FS_MBR_NB_PARTITION-1)
+//!
+//! @verbatim
+//! The partition is defined by fs_s_u32_addr_partition, fs_s_u32_size_partition
+//! and the FAT type computed by fat_select_filesystem().
+//! @endverbatim
+//!
+void  fat_write_MBR_entry( uint8_t u8_entry )
+{
+   uint8_t u8_i = 0;
+
+   fs_g_sector[FS_MBR_OFFSET_PART_ENTRY(u8_entry) +0] = FS_PART_NO_BOOTABLE;   // Active partition
+   // The head, the sector and the cylinder where the partition starts
+   fat_write_MBR_chs( FS_MBR_OFFSET_PART_ENTRY(u8_entry) +1 , fs_s_u32_addr_partition );
 
    // Write patition type
    if( Is_fat32 )
@@ -658,26 +845,93 @@ bool  fat_write_MBR( void )
       u8_i = FS_PART_TYPE_FAT12;
    }
 
-   fs_g_sector[FS_MBR_OFFSET_PART_ENTRY(0) +4] = u8_i;
+   fs_g_sector[FS_MBR_OFFSET_PART_ENTRY(u8_entry) +4] = u8_i;
 
-   // The head where the partitions ends
-   fs_g_sector[FS_MBR_OFFSET_PART_ENTRY(0) +5] = (LSB1(fs_s_u32_size_partition)<<2) + (LSB0(fs_s_u32_size_partition)>>6);
-   // The sector and the cylinder where the partition ends
-   fs_g_sector[FS_MBR_OFFSET_PART_ENTRY(0) +6] = (LSB1(fs_s_u32_size_partition)&0xC0) + (LSB0(fs_s_u32_size_partition)&0x3F);
-   fs_g_sector[FS_MBR_OFFSET_PART_ENTRY(0) +7] = LSB2(fs_s_u32_size_partition);
+   // The head, the sector and the cylinder where the partitions ends
+   fat_write_MBR_chs( FS_MBR_OFFSET_PART_ENTRY(u8_entry) +5 , fs_s_u32_addr_partition + fs_s_u32_size_partition -1 );
 
    // Write partition position (in sectors) at offset 8
-   fs_g_sector[FS_MBR_OFFSET_PART_ENTRY(0)+ 8] = 0x01;
-   //fs_g_sector[FS_MBR_OFFSET_PART_ENTRY(0)+ 9] = 0x00;
-   //fs_g_sector[FS_MBR_OFFSET_PART_ENTRY(0)+10] = 0x00;
-   //fs_g_sector[FS_MBR_OFFSET_PART_ENTRY(0)+11] = 0x00;
-   // Write the number of sector in partition (= size - one sector MBR = last LBA, return by read_capacity)
-   fs_g_sector[FS_MBR_OFFSET_PART_ENTRY(0)+12] = LSB0(fs_s_u32_size_partition);
-   fs_g_sector[FS_MBR_OFFSET_PART_ENTRY(0)+13] = LSB1(fs_s_u32_size_partition);
-   fs_g_sector[FS_MBR_OFFSET_PART_ENTRY(0)+14] = LSB2(fs_s_u32_size_partition);
-   fs_g_sector[FS_MBR_OFFSET_PART_ENTRY(0)+15] = LSB3(fs_s_u32_size_partition);
+   fs_g_sector[FS_MBR_OFFSET_PART_ENTRY(u8_entry)+ 8] = LSB0(fs_s_u32_addr_partition);
+   fs_g_sector[FS_MBR_OFFSET_PART_ENTRY(u8_entry)+ 9] = LSB1(fs_s_u32_addr_partition);
+   fs_g_sector[FS_MBR_OFFSET_PART_ENTRY(u8_entry)+10] = LSB2(fs_s_u32_addr_partition);
+   fs_g_sector[FS_MBR_OFFSET_PART_ENTRY(u8_entry)+11] = LSB3(fs_s_u32_addr_partition);
+   // Write the number of sector in partition
+   fs_g_sector[FS_MBR_OFFSET_PART_ENTRY(u8_entry)+12] = LSB0(fs_s_u32_size_partition);
+   fs_g_sector[FS_MBR_OFFSET_PART_ENTRY(u8_entry)+13] = LSB1(fs_s_u32_size_partition);
+   fs_g_sector[FS_MBR_OFFSET_PART_ENTRY(u8_entry)+14] = LSB2(fs_s_u32_size_partition);
+   fs_g_sector[FS_MBR_OFFSET_PART_ENTRY(u8_entry)+15] = LSB3(fs_s_u32_size_partition);
+}
 
-   return true;
+
+//! This function writes a CHS address in the MBR stored in sector cache
+//!
+//! @param     u16_offset     position of the CHS field in MBR
+//! @param     u32_lba        sector address to translate (the geometry is FS_CHS_NB_HEAD heads of FS_CHS_SECTOR_PER_TRACK sectors, see PBR)
+//!
+void  fat_write_MBR_chs( uint16_t u16_offset , uint32_t u32_lba )
+{
+   uint16_t u16_cylinder;
+   uint8_t  u8_head;
+   uint8_t  u8_sector;
+
+   // Remark: cylinder and header start to 0, and sector value start to 1
+   u16_cylinder = FS_CHS_MAX_CYLINDER;
+   u8_head      = FS_CHS_NB_HEAD -1;
+   u8_sector    = FS_CHS_SECTOR_PER_TRACK;
+   if( u32_lba < ((uint32_t)(FS_CHS_MAX_CYLINDER+1) * FS_CHS_NB_HEAD * FS_CHS_SECTOR_PER_TRACK) )
+   {
+      u16_cylinder = u32_lba / (FS_CHS_NB_HEAD * FS_CHS_SECTOR_PER_TRACK);
+      u8_head      = (u32_lba / FS_CHS_SECTOR_PER_TRACK) % FS_CHS_NB_HEAD;
+      u8_sector    = (u32_lba % FS_CHS_SECTOR_PER_TRACK) +1;
+   }
+   // The head
+   fs_g_sector[u16_offset +0] = u8_head;
+   // The sector (bits 0-5) and the cylinder (bits 6-7 = cylinder bits 8-9)
+   fs_g_sector[u16_offset +1] = (MSB(u16_cylinder)<<6) + u8_sector;
+   fs_g_sector[u16_offset +2] = LSB(u16_cylinder);
+}
+
+
+//! This function aligns a sector address on the erase block boundary of current drive
+//!
+//! @param     u32_addr       sector address (unit 512B)
+//!
+//! @return    the first erase block boundary at or after u32_addr
+//!
+uint32_t   fat_align_erase_block( uint32_t u32_addr )
+{
+   uint16_t u16_erase_block = mem_erase_block_size( fs_g_nav.u8_lun );
+   return ((u32_addr + u16_erase_block -1) / u16_erase_block) * u16_erase_block;
+}
+
+
+//! This function writes the file system structures (PBR, FATs and root directory) of partition
+//!
+//! @return    false in case of error, see global value "fs_g_status" for more detail
+//! @return    true otherwise
+//!
+bool  fat_write_filesystem( void )
+{
+#if (FS_DISCARD != FS_DISCARD_NONE)
+   // The freed clusters of the previous file system must not be discarded after the format
+   if( !fat_discard_flush() )
+      return false;
+#endif
+
+   // Write the PBR sector
+   if( !fat_write_PBR())
+      return false;
+
+   // Clear reserved zone, FAT zone, and Root dir zone
+   // Remark: the reserved zone of FAT32 isn't initialized, because BPB_FSInfo is equal to 0
+   if( !fat_clean_zone())
+      return false;
+
+   // Initialization of the FAT 1 and 2
+   if( !fat_initialize_fat())
+      return false;
+
+   return fat_cache_flush();
 }
 
 //! \name Constante for fat_write_PBR() routine
@@ -694,7 +948,7 @@ _CONST_TYPE_ uint8_t const_header_pbr[] = {
    0,0,
    0x3F,0,                                            // offset 24-25, Sector per track (must be egal to MBR information, also maximum sector per head = 0x3F = 6bits)
    0,0,                                               // offset 26-27, Number of header
-   1                                                  // offset 28-31, Number of hidden setors
+   0                                                  // offset 28-31, Number of hidden setors (see fat_write_PBR())
    };
 _CONST_TYPE_ uint8_t const_tail_pbr[] = {           // offset 36 on FAT 16, offset 64 on FAT 32
    FS_PART_HARD_DISK,                                 // Driver number
@@ -719,20 +973,15 @@ _CONST_TYPE_ uint8_t const_FSI_StrucSig[] = {
 
 //! This function writes the PBR
 //!
-//! @param     b_MBR          true, include a MBR on disk
-//!
 //! @return    false in case of error, see global value "fs_g_status" for more detail
 //! @return    true otherwise
 //!
-bool  fat_write_PBR( bool b_MBR )
+bool  fat_write_PBR( void )
 {
    uint16_t u16_tmp;
 
    //** Init the cache sector with PBR
-   if( b_MBR )
-      fs_gu32_addrsector = 1;
-   else
-      fs_gu32_addrsector = 0;
+   fs_gu32_addrsector = fs_s_u32_addr_partition;
 
    if( !fat_cache_read_sector( false ))
       return false;
@@ -747,8 +996,13 @@ bool  fat_write_PBR( bool b_MBR )
 
    // offset 13-13, Add sector by cluster
    fs_g_sector[13] = fs_g_nav.u8_BPB_SecPerClus;
-   // offset 26-27, Number of header
-   fs_g_sector[26] = (LSB1(fs_s_u32_size_partition)<<2) + (LSB0(fs_s_u32_size_partition)>>6);
+   // offset 26-27, Number of header (must be egal to MBR information, see fat_write_MBR_chs())
+   fs_g_sector[26] = FS_CHS_NB_HEAD;
+   // offset 28-31, Number of hidden sectors (= sectors before the partition)
+   fs_g_sector[28] = LSB0(fs_s_u32_addr_partition);
+   fs_g_sector[29] = LSB1(fs_s_u32_addr_partition);
+   fs_g_sector[30] = LSB2(fs_s_u32_addr_partition);
+   fs_g_sector[31] = LSB3(fs_s_u32_addr_partition);
 
    //** WRITE CONSTANTE & VARIABLE DEPENDING OF FAT16 and FAT32
    // Since offset 36, there are a different structure space for FAT16 and FAT32
@@ -918,12 +1172,10 @@ uint32_t   fat_read_fat32_FSInfo( void )
 
 //! This function cleans the reserved zone, FAT zone, and root dir zone
 //!
-//! @param     b_MBR          true, include a MBR on disk
-//!
 //! @return    false in case of error, see global value "fs_g_status" for more detail
 //! @return    true otherwise
 //!
-bool  fat_clean_zone( bool b_MBR )
+bool  fat_clean_zone( void )
 {
    uint16_t u16_nb_sector_clean, u16_i;
    _MEM_TYPE_SLOW_   uint8_t *ptr;
@@ -935,12 +1187,7 @@ bool  fat_clean_zone( bool b_MBR )
 
    // remark: these zones are stored after the PBR and are continues
    // Start after PBR
-   if( b_MBR )
-   {
-      fs_gu32_addrsector = 2; // Jump MBR and PBR
-   }else{
-      fs_gu32_addrsector = 1; // Jump only a PBR (no MBR create)
-   }
+   fs_gu32_addrsector = fs_s_u32_addr_partition +1;
 
    // Compute reserved zone size and root size
    if( Is_fat32 )
@@ -2114,6 +2361,9 @@ bool  fat_delete_file( bool b_cluster_list )
       fs_g_nav_entry.u32_pos_in_file=0;      // Delete ALL list (start at begining)
       if( !fat_read_file( FS_CLUST_ACT_CLR ))
          return false;
+#if (FS_DISCARD == FS_DISCARD_INLINE)
+      return fat_discard_flush();
+#endif
    }
 
    return true;
@@ -2296,6 +2546,12 @@ bool  fat_allocfreespace( void )
    // If true then use a quick procedure but don't scan all FAT else use a slow proceudre but scan all FAT
    bool b_quick_find = true;
 
+#if (FS_DISCARD != FS_DISCARD_NONE)
+   // The freed clusters must be discarded before they are allocated again
+   if( !fat_discard_flush() )
+      return false;
+#endif
+
    if( Is_fat32 )
    {
       // Clear info about free space
@@ -2498,3 +2754,119 @@ bool  fat_clear_cluster( void )
    return true;
 }
 #endif  // FS_LEVEL_FEATURES
+
+
+#if (FS_LEVEL_FEATURES > FSFEATURE_READ) && (FS_DISCARD != FS_DISCARD_NONE)
+//! This function adds a freed cluster in the list of sectors to discard
+//!
+//! @verbatim
+//! Global variables used
+//! IN :
+//!   fs_g_cluster.u32_pos       Cluster freed
+//! @endverbatim
+//!
+//! @verbatim
+//! The clusters contiguous to a range are merged in this range.
+//! This routine is called during the cluster list walk, so it never discards:
+//! the ranges are discarded once by fat_discard_flush(), after the walk.
+//! If no more range is free, then the smallest range is forgotten (the discard is only an optimization).
+//! @endverbatim
+//!
+void  fat_discard_cluster( void )
+{
+   _MEM_TYPE_FAST_ uint32_t u32_addr;
+   _MEM_TYPE_SLOW_ Fs_discard_range *range;
+   uint8_t u8_i, u8_smallest;
+
+   // Compute the sector address of this cluster
+   u32_addr = ((fs_g_cluster.u32_pos - 2) * fs_g_nav.u8_BPB_SecPerClus)
+            + fs_g_nav.u32_ptr_fat + fs_g_nav.u32_offset_data;
+
+   // Try to extend a range, starting by the last one
+   for( u8_i=fs_g_u8_nb_discard; u8_i!=0; u8_i-- )
+   {
+      range = &fs_g_discard[ u8_i-1 ];
+      if( fs_g_nav.u8_lun != range->u8_lun )
+         continue;
+      if( (range->u32_addr + range->u32_size) == u32_addr )
+      {
+         range->u32_size += fs_g_nav.u8_BPB_SecPerClus;
+         return;
+      }
+      if( (u32_addr + fs_g_nav.u8_BPB_SecPerClus) == range->u32_addr )
+      {
+         range->u32_addr  = u32_addr;
+         range->u32_size += fs_g_nav.u8_BPB_SecPerClus;
+         return;
+      }
+   }
+
+   if( FS_NB_DISCARD == fs_g_u8_nb_discard )
+   {
+      // No free range, then forget the smallest range (the range in progress is kept)
+      u8_smallest = 0;
+      for( u8_i=1; u8_i<(FS_NB_DISCARD-1); u8_i++ )
+      {
+         if( fs_g_discard[u8_i].u32_size < fs_g_discard[u8_smallest].u32_size )
+            u8_smallest = u8_i;
+      }
+      for( u8_i=u8_smallest; u8_i<(FS_NB_DISCARD-1); u8_i++ )
+      {
+         fs_g_discard[u8_i] = fs_g_discard[u8_i+1];
+      }
+      fs_g_u8_nb_discard--;
+   }
+
+   // Start a new range
+   range = &fs_g_discard[ fs_g_u8_nb_discard++ ];
+   range->u8_lun   = fs_g_nav.u8_lun;
+   range->u32_addr = u32_addr;
+   range->u32_size = fs_g_nav.u8_BPB_SecPerClus;
+}
+
+
+//! This function discards the freed clusters on the memories
+//!
+//! @return    false in case of error, see global value "fs_g_status" for more detail
+//! @return    true otherwise
+//!
+//! @verbatim
+//! The sector cache is flushed before, so that the FAT is up to date on the memory when the data are erased.
+//! A memory which doesn't support the discard (see mem_discard()) isn't an error.
+//! @endverbatim
+//!
+bool  fat_discard_flush( void )
+{
+   uint8_t u8_i;
+
+   if( 0 == fs_g_u8_nb_discard )
+      return true;   // Nothing to discard
+
+   if( !fat_cache_flush())
+      return false;
+
+   for( u8_i=0; u8_i!=fs_g_u8_nb_discard; u8_i++ )
+   {
+      mem_discard( fs_g_discard[u8_i].u8_lun , fs_g_discard[u8_i].u32_addr , fs_g_discard[u8_i].u32_size );
+   }
+   fs_g_u8_nb_discard = 0;
+   return true;
+}
+
+
+//! This function forgets the freed clusters of a device
+//!
+//! @param     u8_lun      device (e.g. its media has been changed)
+//!
+void  fat_discard_reset( uint8_t u8_lun )
+{
+   uint8_t u8_i, u8_j;
+
+   for( u8_i=0, u8_j=0; u8_i!=fs_g_u8_nb_discard; u8_i++ )
+   {
+      if( u8_lun != fs_g_discard[u8_i].u8_lun )
+         fs_g_discard[u8_j++] = fs_g_discard[u8_i];
+   }
+   fs_g_u8_nb_discard = u8_j;
+}
+#endif  // FS_LEVEL_FEATURES
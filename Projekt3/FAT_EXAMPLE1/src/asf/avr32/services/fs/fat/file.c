@@ -51,6 +51,7 @@
 #include "navigation.h"
 #include LIB_MEM
 #include LIB_CTRLACCESS
+#include "trace.h"
 
 
 //_____ D E C L A R A T I O N S ____________________________________________
@@ -309,18 +310,15 @@ uint16_t   file_read_buf( uint8_t _MEM_TYPE_SLOW_ *buffer , uint16_t u16_buf_siz
             fs_g_seg.u32_size_or_pos = u16_nb_read_tmp;
          }
 
-         // Directly data tranfert from memory to buffer
-         while( 0 != fs_g_seg.u32_size_or_pos )
+         // Directly data tranfert from memory to buffer, the whole segment at once
+         if( CTRL_GOOD != memory_2_ram_multi( fs_g_nav.u8_lun  , fs_g_seg.u32_addr, u16_nb_read_tmp, buffer))
          {
-            if( CTRL_GOOD != memory_2_ram( fs_g_nav.u8_lun  , fs_g_seg.u32_addr, buffer))
-            {
-               fs_g_status = FS_ERR_HW;
-               return u16_nb_read;
-            }
-            fs_g_seg.u32_size_or_pos--;
-            fs_g_seg.u32_addr++;
-            buffer += FS_512B;
+            fs_g_status = FS_ERR_HW;
+            return u16_nb_read;
          }
+         fs_g_seg.u32_addr += u16_nb_read_tmp;
+         fs_g_seg.u32_size_or_pos = 0;
+         buffer += u16_nb_read_tmp * FS_512B;
          // Translate from sector unit to byte unit
          u16_nb_read_tmp *= FS_512B;
       }
@@ -477,7 +475,11 @@ bool  file_set_eof( void )
    if( !fat_read_file( FS_CLUST_ACT_CLR ))
       return false;
 
+#if (FS_DISCARD == FS_DISCARD_INLINE)
+   return fat_discard_flush();   // Flush the cache then discard the freed clusters
+#else
    return fat_cache_flush();
+#endif
 }
 
 
@@ -494,6 +496,7 @@ uint16_t   file_write_buf( uint8_t _MEM_TYPE_SLOW_ *buffer , uint16_t u16_buf_si
    _MEM_TYPE_FAST_ uint16_t u16_nb_write_tmp;
    _MEM_TYPE_FAST_ uint16_t u16_nb_write;
    _MEM_TYPE_FAST_ uint16_t u16_pos_in_sector;
+   Trace_function(TRACE_FILE_WRITE_BUF);
 
    if( !fat_check_mount_select_open())
       return false;
@@ -75,6 +75,12 @@
 #ifndef  FS_NB_NAVIGATOR
 #  error FS_NB_NAVIGATOR must be defined in conf_explorer.h
 #endif
+#ifndef  FS_DISCARD
+#  define FS_DISCARD          FS_DISCARD_NONE
+#endif
+#ifndef  FS_NB_DISCARD
+#  define FS_NB_DISCARD       4
+#endif
 
 
 //_____ D E F I N I T I O N S ______________________________________________
@@ -179,7 +185,7 @@ typedef UNICODE   _MEM_TYPE_SLOW_ * FS_STR_UNICODE;
 typedef struct {
    uint8_t    u8_lun;                       //!< number of the logical driver
 #if (FS_MULTI_PARTITION == true)
-   uint8_t    u8_partition;                 //!< number of the partition - 1 (0 or 1) (if FS_MULTI_PARTITION == true)
+   uint8_t    u8_partition;                 //!< number of the partition - 1 (0 to 3) (if FS_MULTI_PARTITION == true)
 #endif
    uint32_t   u32_cluster_sel_dir;          //!< first cluster of the directory corresponding at the selected file
    uint16_t   u16_entry_pos_sel_file;       //!< entry offset of selected file in selected directory (unit = FS_SIZE_FILE_ENTRY)
@@ -253,6 +259,14 @@ typedef struct {
 //! @}
 
 
+//! \name Discard modes of the freed clusters (FS_DISCARD)
+//! @{
+#define  FS_DISCARD_NONE               0     //!< The memory is never told about the freed clusters
+#define  FS_DISCARD_INLINE             1     //!< The freed clusters are discarded at the end of the file delete or truncate
+#define  FS_DISCARD_DEFERRED           2     //!< The freed clusters are discarded by nav_discard_flush() (e.g. at idle time) or before the next allocation
+//! @}
+
+
 //! \name Status type for the file system
 typedef  uint8_t                   Fs_status;
 //! \name Global status of file system module (used to return error number)
@@ -301,8 +301,8 @@ long fsaccess_alloc_nav_id( void )
 {
 unsigned int j;
   // get a free nav id
-  // NOTE: we start at FS_NB_RESERVED_NAV, because 2 is usually used as
-  // the navigator for file copy. 0 & 1 may be used independently of the fsaccess module.
+  // NOTE: we start at FS_NB_RESERVED_NAV, because the lower ids are used
+  // independently of the fsaccess module (see the affiliations of conf_explorer.h).
   for (j = FS_NB_RESERVED_NAV ; j < FS_NB_NAVIGATOR ; j++)
   {
     if (!Tst_bits(pvNavUsed, (1 << j)))
@@ -175,6 +175,9 @@ void  nav_reset( void )
 
    fat_cache_reset();
    fat_cache_clusterlist_reset();
+#if (FS_MULTI_PARTITION  ==  true)
+   fat_cache_partition_reset();
+#endif
 
 #if (FS_NB_NAVIGATOR > 1)
    {
@@ -358,7 +361,7 @@ uint8_t    nav_drive_get( void )
 #if (FS_MULTI_PARTITION  ==  true)
    if(0xFF == fs_g_nav.u8_lun)
       return 0xFF;
-   return ((fs_g_nav.u8_lun*4) + fs_g_nav.u8_partition); // Maximum 4 partitions per device
+   return FS_DRIVE_NUMBER( fs_g_nav.u8_lun, fs_g_nav.u8_partition );
 #else
    return (fs_g_nav.u8_lun);
 #endif
@@ -375,7 +378,7 @@ uint8_t    nav_drive_getname( void )
    if(0xFF == fs_g_nav.u8_lun)
       return 'X';
 #if (FS_MULTI_PARTITION  ==  true)
-   return ('A' + (fs_g_nav.u8_lun*4) + fs_g_nav.u8_partition); // Maximum 4 partitions per device
+   return ('A' + FS_DRIVE_NUMBER( fs_g_nav.u8_lun, fs_g_nav.u8_partition ));
 #else
    return ('A' + fs_g_nav.u8_lun);
 #endif
@@ -409,6 +412,45 @@ bool  nav_drive_format( uint8_t u8_fat_type )
       return false;
    return fat_mount();
 }
+
+
+#if (FS_MULTI_PARTITION  ==  true)
+//! This function splits the current drive (=disk) in several partitions and formats them
+//!
+//! @param     u8_nb_partition   number of partitions to create (1 to 4)
+//! @param     a_u32_size        array with the size of each partition (unit 512B) <br>
+//!                              the size 0 on the last partition means all remaining disk space
+//!
+//! @return    false in case of error, see global value "fs_g_status" for more detail
+//! @return    true otherwise
+//!
+//! @verbatim
+//! WARNING: All data of the drive are lost.
+//! Each partition starts on an erase block boundary of the memory.
+//! The FAT type of each partition is chosen by the system, as with FS_FORMAT_DEFAULT.
+//! After this routine, the first partition is mounted.
+//! @endverbatim
+//!
+bool  nav_drive_partition( uint8_t u8_nb_partition , const uint32_t _MEM_TYPE_SLOW_ *a_u32_size )
+{
+   uint8_t u8_i;
+
+   if ( !fat_check_noopen() )
+      return false;
+   if ( !fat_check_nav_access_disk() )
+      return false;
+   if ( !fat_create_partitions( u8_nb_partition , a_u32_size ) )
+      return false;
+   for( u8_i=0; u8_i!=u8_nb_partition; u8_i++ )
+   {
+      fs_g_nav.u8_partition = u8_i;
+      if ( !fat_format_partition( FS_FORMAT_DEFAULT ) )
+         return false;
+   }
+   fs_g_nav.u8_partition = 0;
+   return fat_mount();
+}
+#endif
 #endif  // FS_LEVEL_FEATURES
 
 
@@ -442,14 +484,68 @@ bool  nav_partition_set( uint8_t partition_number )
    if ( !fat_check_noopen() )
       return false;
 
+   if ( FS_MBR_NB_PARTITION <= partition_number )
+   {
+      fs_g_status = FS_ERR_NO_PART;        // The partition number is bad
+      return false;
+   }
+
    // Go to partition
    fs_g_nav.u8_partition = partition_number;
    fs_g_nav_fast.u8_type_fat = FS_TYPE_FAT_UNM;
    return true;
 }
+
+
+#if (FSFEATURE_WRITE_COMPLET == (FS_LEVEL_FEATURES & FSFEATURE_WRITE_COMPLET))
+//! This function formats the selected partition
+//!
+//! @param     u8_fat_type    Select the format type<br>
+//!            FS_FORMAT_DEFAULT, The system chooses the better FAT format <br>
+//!            FS_FORMAT_FAT, The FAT12 or FAT16 is used to format the partition, if possible (partition space <2GB) <br>
+//!            FS_FORMAT_FAT32, The FAT32 is used to format the partition, if possible (partition space >32MB) <br>
+//!
+//! @return    false in case of error, see global value "fs_g_status" for more detail
+//! @return    true otherwise
+//!
+//! @verbatim
+//! The other partitions of the drive are not modified.
+//! @endverbatim
+//!
+bool  nav_partition_format( uint8_t u8_fat_type )
+{
+   if ( !fat_check_noopen() )
+      return false;
+   if ( !fat_check_nav_access_disk() )
+      return false;
+   if ( !fat_format_partition( u8_fat_type ) )
+      return false;
+   return fat_mount();
+}
+#endif  // FS_LEVEL_FEATURES
 #endif
 
 
+#if (FSFEATURE_WRITE == (FS_LEVEL_FEATURES & FSFEATURE_WRITE)) && (FS_DISCARD != FS_DISCARD_NONE)
+//! This function discards the clusters freed by the previous deletes and truncates
+//!
+//! @return    false in case of error, see global value "fs_g_status" for more detail
+//! @return    true otherwise
+//!
+//! @verbatim
+//! The memories are told that the freed clusters don't hold data anymore (see mem_discard()),
+//! this lowers the latency of the next writes on flash memories.
+//! With FS_DISCARD_DEFERRED, call this routine at idle time because the erase may be long.
+//! It is also called automatically before the next cluster allocation.
+//! @endverbatim
+//!
+bool  nav_discard_flush( void )
+{
+   return fat_discard_flush();
+}
+#endif  // FS_LEVEL_FEATURES
+
+
 //! This function mounts the selected partition
 //!
 //! @return  false in case of error, see global value "fs_g_status" for more detail
@@ -1606,15 +1702,25 @@ bool  nav_setcwd( FS_STRING sz_path , bool b_match_case , bool b_create )
    if( (( Is_unicode) && (( ':'  == ((FS_STR_UNICODE)sz_path )[1] ) && (('\\'  == ((FS_STR_UNICODE)sz_path )[2] ) || ('/'  == ((FS_STR_UNICODE)sz_path )[2]))) )
    ||  ((!Is_unicode) && (( ':'  == sz_path [1] ) && (('\\'  == sz_path [2] ) || ('/'  == sz_path [2]))) ) )
    {
+      uint8_t u8_drive;
+
       // Go to the drive
       if( Is_unicode )
       {
-         if( !nav_drive_set( toupper(((FS_STR_UNICODE)sz_path )[0])-'A' ) )
-            goto nav_setcwd_fail;
+         u8_drive = toupper(((FS_STR_UNICODE)sz_path )[0])-'A';
       }else{
-         if( !nav_drive_set( toupper(sz_path [0])-'A' ) )
-            goto nav_setcwd_fail;
+         u8_drive = toupper(sz_path [0])-'A';
       }
+#if (FS_MULTI_PARTITION  ==  true)
+      // The drive letter includes the partition number (see nav_drive_getname())
+      if( !nav_drive_set( u8_drive / FS_MBR_NB_PARTITION ))
+         goto nav_setcwd_fail;
+      if( !nav_partition_set( u8_drive % FS_MBR_NB_PARTITION ))
+         goto nav_setcwd_fail;
+#else
+      if( !nav_drive_set( u8_drive ))
+         goto nav_setcwd_fail;
+#endif
       if( !nav_partition_mount())
          goto nav_setcwd_fail;
       sz_path  += 3*(Is_unicode? 2 : 1 );
@@ -55,6 +55,13 @@
 #define  FS_FIND_PREV      false    //!< move in list to previous file
 //! @}
 
+//! Drive number (drive letter - 'a', see nav_drive_get()) of a partition of a disk
+#if (FS_MULTI_PARTITION  ==  true)
+#  define  FS_DRIVE_NUMBER( u8_lun, u8_partition )   ((u8_lun)*FS_MBR_NB_PARTITION + (u8_partition))
+#else
+#  define  FS_DRIVE_NUMBER( u8_lun, u8_partition )   (u8_lun)
+#endif
+
 
 //**********************************************************************
 //************************ String format select ************************
@@ -221,6 +228,23 @@ uint8_t    nav_drive_getname( void );
 //!
 bool  nav_drive_format( uint8_t u8_fat_type );
 
+//! This function splits the current drive (=disk) in several partitions and formats them
+//!
+//! @param     u8_nb_partition   number of partitions to create (1 to 4)
+//! @param     a_u32_size        array with the size of each partition (unit 512B) <br>
+//!                              the size 0 on the last partition means all remaining disk space
+//!
+//! @return    false in case of error, see global value "fs_g_status" for more detail
+//! @return    true otherwise
+//!
+//! @verbatim
+//! WARNING: All data of the drive are lost.
+//! Each partition starts on an erase block boundary of the memory.
+//! After this routine, the first partition is mounted.
+//! @endverbatim
+//!
+bool  nav_drive_partition( uint8_t u8_nb_partition , const uint32_t _MEM_TYPE_SLOW_ *a_u32_size );
+
 
 //**********************************************************************
 //******************* Partition navigation functions *******************
@@ -241,6 +265,34 @@ uint8_t    nav_partition_nb( void );
 //!
 bool  nav_partition_set( uint8_t partition_number );
 
+//! This function formats the selected partition
+//!
+//! @param     u8_fat_type    Select the format type<br>
+//!            FS_FORMAT_DEFAULT, The system chooses the better FAT format <br>
+//!            FS_FORMAT_FAT, The FAT12 or FAT16 is used to format the partition, if possible (partition space <2GB) <br>
+//!            FS_FORMAT_FAT32, The FAT32 is used to format the partition, if possible (partition space >32MB) <br>
+//!
+//! @return    false in case of error, see global value "fs_g_status" for more detail
+//! @return    true otherwise
+//!
+//! @verbatim
+//! The other partitions of the drive are not modified.
+//! @endverbatim
+//!
+bool  nav_partition_format( uint8_t u8_fat_type );
+
+//! This function discards the clusters freed by the previous deletes and truncates
+//!
+//! @return    false in case of error, see global value "fs_g_status" for more detail
+//! @return    true otherwise
+//!
+//! @verbatim
+//! The memories are told that the freed clusters don't hold data anymore (see mem_discard()).
+//! With FS_DISCARD_DEFERRED, call this routine at idle time because the erase may be long.
+//! @endverbatim
+//!
+bool  nav_discard_flush( void );
+
 //! This function mounts the selected partition
 //!
 //! @return  false in case of error, see global value "fs_g_status" for more detail
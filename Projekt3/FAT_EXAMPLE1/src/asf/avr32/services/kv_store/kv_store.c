@@ -0,0 +1,411 @@
+/*****************************************************************************
+ *
+ * \file
+ *
+ * \brief Log-structured key/value store in the internal flash.
+ *
+ * Copyright (c) 2009 Atmel Corporation. All rights reserved.
+ *
+ * \asf_license_start
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. The name of Atmel may not be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * 4. This software may only be redistributed and used in connection with an
+ *    Atmel microcontroller product.
+ *
+ * THIS SOFTWARE IS PROVIDED BY ATMEL "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT ARE
+ * EXPRESSLY AND SPECIFICALLY DISCLAIMED. IN NO EVENT SHALL ATMEL BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * \asf_license_stop
+ *
+ ******************************************************************************/
+
+
+
+
+#include <string.h>
+#include "compiler.h"
+#include "flashc.h"
+#include "kv_store.h"
+
+
+//! Size of a bank in bytes.
+#define KV_STORE_BANK_SIZE      (KV_STORE_BANK_PAGES * AVR32_FLASHC_PAGE_SIZE)
+
+#if KV_STORE_BANK_SIZE > 0xFFF0
+#  error The banks must be smaller than 64 kB.
+#endif
+
+#if KV_STORE_NB_KEYS >= 0xFFFF || KV_STORE_VALUE_MAX > 0xFFF0
+#  error KV_STORE_NB_KEYS or KV_STORE_VALUE_MAX out of range.
+#endif
+
+#if KV_STORE_FLASH_OFFSET % AVR32_FLASHC_PAGE_SIZE
+#  error KV_STORE_FLASH_OFFSET must be aligned on a flash page.
+#endif
+
+#if KV_STORE_FLASH_OFFSET + 2 * KV_STORE_BANK_SIZE > AVR32_FLASH_SIZE
+#  error The banks must fit in the flash array.
+#endif
+
+#if VIRTUAL_MEM == ENABLE && \
+    KV_STORE_FLASH_OFFSET < VIRTUAL_MEM_FLASH_OFFSET + VIRTUAL_MEM_NB_SECTOR * VIRTUAL_MEM_SECTOR_SIZE && \
+    KV_STORE_FLASH_OFFSET + 2 * KV_STORE_BANK_SIZE > VIRTUAL_MEM_FLASH_OFFSET
+#  error The banks overlap the on-chip virtual memory.
+#endif
+
+//! Bank header: magic number, sequence number and its complement.
+#define KV_STORE_MAGIC          0x4B565331
+#define KV_STORE_HEADER_SIZE    12
+
+//! Record sizes: key and length, value, CRC, padding to 4 bytes.
+#define KV_STORE_RECORD_HEADER_SIZE 4
+#define KV_STORE_CRC_SIZE       2
+#define KV_STORE_RECORD_SIZE(len) \
+  ((KV_STORE_RECORD_HEADER_SIZE + (len) + KV_STORE_CRC_SIZE + 3) & ~3)
+
+//! Index entry of a key without value.
+#define KV_STORE_NO_RECORD      0xFFFF
+
+//! Address of a bank in the flash array.
+#define Kv_store_bank_addr(bank) \
+  ((uint8_t *)(AVR32_FLASH_ADDRESS + KV_STORE_FLASH_OFFSET + (bank) * KV_STORE_BANK_SIZE))
+
+//! Header of a bank.
+typedef struct
+{
+  uint32_t magic;
+  uint32_t sequence;
+  uint32_t sequence_n;
+} kv_store_header_t;
+
+//! Header of a record.
+typedef struct
+{
+  uint16_t key;
+  uint16_t len;
+} kv_store_record_t;
+
+
+static bool kv_store_ready;
+
+//! Active bank (0 or 1) and its sequence number.
+static uint8_t kv_store_bank;
+static uint32_t kv_store_sequence;
+
+//! Offset of the next record in the active bank.
+static uint16_t kv_store_wr;
+
+//! Offset of the last record of each key in the active bank.
+static uint16_t kv_store_index[KV_STORE_NB_KEYS];
+
+static kv_store_stats_t kv_store_stats;
+
+//! CRC16-CCITT of each nibble value.
+static const uint16_t kv_store_crc16_table[16] =
+{
+  0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50A5, 0x60C6, 0x70E7,
+  0x8108, 0x9129, 0xA14A, 0xB16B, 0xC18C, 0xD1AD, 0xE1CE, 0xF1EF
+};
+
+
+/*! \brief Computes the CRC16-CCITT of a buffer.
+ */
+static uint16_t kv_store_crc16(const uint8_t *buf, uint16_t len)
+{
+  uint16_t crc = 0;
+
+  while (len--)
+  {
+    crc = (crc << 4) ^ kv_store_crc16_table[(crc >> 12) ^ (*buf >> 4)];
+    crc = (crc << 4) ^ kv_store_crc16_table[(crc >> 12) ^ (*buf++ & 0x0F)];
+  }
+  return crc;
+}
+
+
+/*! \brief Programs bytes of an erased area of a bank and checks them.
+ */
+static bool kv_store_program(uint8_t *dst, const void *src, uint16_t len)
+{
+  flashc_memcpy(dst, src, len, false);
+  if (flashc_is_lock_error() || flashc_is_programming_error())
+    return false;
+  return !memcmp(dst, src, len);
+}
+
+
+/*! \brief Erases the pages of a bank.
+ */
+static bool kv_store_erase_bank(uint8_t bank)
+{
+  int page = (KV_STORE_FLASH_OFFSET + bank * KV_STORE_BANK_SIZE) / AVR32_FLASHC_PAGE_SIZE;
+  int i;
+
+  for (i = 0; i < KV_STORE_BANK_PAGES; i++)
+  {
+    if (!flashc_erase_page(page + i, true))
+      return false;
+  }
+  return true;
+}
+
+
+/*! \brief Tells if a bank has a valid header, and gets its sequence number.
+ */
+static bool kv_store_bank_valid(uint8_t bank, uint32_t *sequence)
+{
+  kv_store_header_t header;
+
+  memcpy(&header, Kv_store_bank_addr(bank), sizeof(header));
+  *sequence = header.sequence;
+  return header.magic == KV_STORE_MAGIC && header.sequence == ~header.sequence_n;
+}
+
+
+/*! \brief Checks a record of the active bank.
+ *
+ * \param offset  Offset of the record.
+ * \param record  Pointer to the location where to store the record header.
+ *
+ * \return \c true if the record is complete, else \c false.
+ */
+static bool kv_store_record_valid(uint16_t offset, kv_store_record_t *record)
+{
+  const uint8_t *rec = Kv_store_bank_addr(kv_store_bank) + offset;
+  uint16_t crc;
+
+  memcpy(record, rec, sizeof(*record));
+  if (record->key >= KV_STORE_NB_KEYS || record->len > KV_STORE_VALUE_MAX ||
+      offset + KV_STORE_RECORD_SIZE(record->len) > KV_STORE_BANK_SIZE)
+    return false;
+
+  memcpy(&crc, rec + KV_STORE_RECORD_HEADER_SIZE + record->len, sizeof(crc));
+  return crc == kv_store_crc16(rec, KV_STORE_RECORD_HEADER_SIZE + record->len);
+}
+
+
+/*! \brief Builds the RAM index from the records of the active bank.
+ *
+ * \return \c true if the bank is clean, \c false if a write was interrupted
+ *         (the index holds the records before it).
+ */
+static bool kv_store_scan(void)
+{
+  const uint8_t *base = Kv_store_bank_addr(kv_store_bank);
+  kv_store_record_t record;
+  uint16_t offset = KV_STORE_HEADER_SIZE;
+
+  memset(kv_store_index, 0xFF, sizeof(kv_store_index));
+
+  while (offset + KV_STORE_RECORD_HEADER_SIZE <= KV_STORE_BANK_SIZE)
+  {
+    memcpy(&record, base + offset, sizeof(record));
+    if (record.key == 0xFFFF && record.len == 0xFFFF)
+      break;
+    if (!kv_store_record_valid(offset, &record))
+    {
+      kv_store_wr = offset;
+      return false;
+    }
+    kv_store_index[record.key] = (record.len) ? offset : KV_STORE_NO_RECORD;
+    offset += KV_STORE_RECORD_SIZE(record.len);
+  }
+  kv_store_wr = offset;
+
+  // Anything programmed after the last record comes from an interrupted write.
+  for (; offset < KV_STORE_BANK_SIZE; offset++)
+  {
+    if (base[offset] != 0xFF)
+      return false;
+  }
+  return true;
+}
+
+
+bool kv_store_init(void)
+{
+  uint32_t sequence0, sequence1;
+  bool valid0 = kv_store_bank_valid(0, &sequence0);
+  bool valid1 = kv_store_bank_valid(1, &sequence1);
+
+  kv_store_ready = true;
+
+  if (!valid0 && !valid1)
+  {
+    // New store: compacting the empty index into bank 0 creates it.
+    memset(kv_store_index, 0xFF, sizeof(kv_store_index));
+    kv_store_bank = 1;
+    kv_store_sequence = 0;
+    return kv_store_compact();
+  }
+
+  if (valid0 && (!valid1 || (int32_t)(sequence0 - sequence1) > 0))
+  {
+    kv_store_bank = 0;
+    kv_store_sequence = sequence0;
+  }
+  else
+  {
+    kv_store_bank = 1;
+    kv_store_sequence = sequence1;
+  }
+
+  if (!kv_store_scan())
+    return kv_store_compact();
+  return true;
+}
+
+
+int kv_store_read(uint16_t key, void *buf, uint16_t size)
+{
+  const uint8_t *rec;
+  kv_store_record_t record;
+
+  if (key >= KV_STORE_NB_KEYS)
+    return KV_STORE_INVALID_ARGUMENT;
+  if (!kv_store_ready || kv_store_index[key] == KV_STORE_NO_RECORD)
+    return KV_STORE_NOT_FOUND;
+
+  rec = Kv_store_bank_addr(kv_store_bank) + kv_store_index[key];
+  memcpy(&record, rec, sizeof(record));
+  if (record.len > size)
+    return KV_STORE_INVALID_ARGUMENT;
+  memcpy(buf, rec + KV_STORE_RECORD_HEADER_SIZE, record.len);
+  return record.len;
+}
+
+
+bool kv_store_write(uint16_t key, const void *value, uint16_t len)
+{
+  uint32_t buf[KV_STORE_RECORD_SIZE(KV_STORE_VALUE_MAX) / sizeof(uint32_t)];
+  uint8_t *rec = (uint8_t *)buf;
+  kv_store_record_t record;
+  uint16_t size = KV_STORE_RECORD_SIZE(len);
+  uint16_t crc;
+
+  if (!kv_store_ready || key >= KV_STORE_NB_KEYS || len > KV_STORE_VALUE_MAX ||
+      (len && !value))
+    return false;
+
+  // Skip the writes which would not change the value.
+  if (kv_store_index[key] == KV_STORE_NO_RECORD)
+  {
+    if (!len)
+    {
+      kv_store_stats.unchanged++;
+      return true;
+    }
+  }
+  else
+  {
+    const uint8_t *old = Kv_store_bank_addr(kv_store_bank) + kv_store_index[key];
+
+    memcpy(&record, old, sizeof(record));
+    if (record.len == len && !memcmp(old + KV_STORE_RECORD_HEADER_SIZE, value, len))
+    {
+      kv_store_stats.unchanged++;
+      return true;
+    }
+  }
+
+  if (kv_store_wr + size > KV_STORE_BANK_SIZE &&
+      (!kv_store_compact() || kv_store_wr + size > KV_STORE_BANK_SIZE))
+    return false;
+
+  memset(buf, 0xFF, size);
+  record.key = key;
+  record.len = len;
+  memcpy(rec, &record, sizeof(record));
+  memcpy(rec + KV_STORE_RECORD_HEADER_SIZE, value, len);
+  crc = kv_store_crc16(rec, KV_STORE_RECORD_HEADER_SIZE + len);
+  memcpy(rec + KV_STORE_RECORD_HEADER_SIZE + len, &crc, sizeof(crc));
+
+  if (!kv_store_program(Kv_store_bank_addr(kv_store_bank) + kv_store_wr, buf, size))
+  {
+    // The area is not erased anymore: move the records to a clean bank.
+    kv_store_compact();
+    return false;
+  }
+
+  kv_store_index[key] = (len) ? kv_store_wr : KV_STORE_NO_RECORD;
+  kv_store_wr += size;
+  kv_store_stats.writes++;
+  return true;
+}
+
+
+bool kv_store_compact(void)
+{
+  uint32_t buf[KV_STORE_RECORD_SIZE(KV_STORE_VALUE_MAX) / sizeof(uint32_t)];
+  uint16_t index[KV_STORE_NB_KEYS];
+  uint8_t bank = kv_store_bank ^ 1;
+  uint8_t *dst = Kv_store_bank_addr(bank);
+  const uint8_t *src = Kv_store_bank_addr(kv_store_bank);
+  kv_store_record_t record;
+  kv_store_header_t header;
+  uint16_t offset = KV_STORE_HEADER_SIZE;
+  uint16_t size;
+  uint16_t key;
+
+  if (!kv_store_ready || !kv_store_erase_bank(bank))
+    return false;
+
+  // Copy the last record of each key.
+  for (key = 0; key < KV_STORE_NB_KEYS; key++)
+  {
+    index[key] = KV_STORE_NO_RECORD;
+    if (kv_store_index[key] == KV_STORE_NO_RECORD)
+      continue;
+    memcpy(&record, src + kv_store_index[key], sizeof(record));
+    size = KV_STORE_RECORD_SIZE(record.len);
+    memcpy(buf, src + kv_store_index[key], size);
+    if (!kv_store_program(dst + offset, buf, size))
+      return false;
+    index[key] = offset;
+    offset += size;
+  }
+
+  // The header makes the new bank valid: write it last.
+  header.magic = KV_STORE_MAGIC;
+  header.sequence = kv_store_sequence + 1;
+  header.sequence_n = ~header.sequence;
+  if (!kv_store_program(dst, &header, sizeof(header)))
+    return false;
+
+  kv_store_bank = bank;
+  kv_store_sequence = header.sequence;
+  kv_store_wr = offset;
+  memcpy(kv_store_index, index, sizeof(kv_store_index));
+  kv_store_stats.compactions++;
+  return true;
+}
+
+
+void kv_store_get_stats(kv_store_stats_t *stats)
+{
+  *stats = kv_store_stats;
+  stats->used = kv_store_wr;
+  stats->free = KV_STORE_BANK_SIZE - kv_store_wr;
+  stats->sequence = kv_store_sequence;
+}
@@ -0,0 +1,207 @@
+/*****************************************************************************
+ *
+ * \file
+ *
+ * \brief Log-structured key/value store in the internal flash.
+ *
+ * Copyright (c) 2009 Atmel Corporation. All rights reserved.
+ *
+ * \asf_license_start
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. The name of Atmel may not be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * 4. This software may only be redistributed and used in connection with an
+ *    Atmel microcontroller product.
+ *
+ * THIS SOFTWARE IS PROVIDED BY ATMEL "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT ARE
+ * EXPRESSLY AND SPECIFICALLY DISCLAIMED. IN NO EVENT SHALL ATMEL BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * \asf_license_stop
+ *
+ ******************************************************************************/
+
+
+
+
+#ifndef _KV_STORE_H_
+#define _KV_STORE_H_
+
+/**
+ * \defgroup group_avr32_services_kv_store Key/value store in the internal flash
+ *
+ * Small values updated often (counters, current log file index, sampling
+ * settings) are kept out of the FAT, where each update rewrites a directory
+ * entry and FAT sectors. Each update is appended as a record to a bank of
+ * internal flash pages:
+ * \code
+ * offset  size   field
+ *  0       2     key (0 to KV_STORE_NB_KEYS - 1)
+ *  2       2     value length n (<= KV_STORE_VALUE_MAX, 0 for a deleted key)
+ *  4       n     value
+ *  4+n     2     CRC16-CCITT of the bytes 0 to 3+n
+ * \endcode
+ * padded to 4 bytes. A RAM index holds the offset of the last record of each
+ * key, so reads cost a copy from the flash.
+ *
+ * When the bank is full, the last record of each key is copied to the other
+ * bank, which is erased first, then the header of the new bank is written
+ * with a greater sequence number. The bank with the greatest valid sequence
+ * number is used at init, so a power loss at any write leaves either the old
+ * or the new bank complete. A record with a wrong CRC, or data after the last
+ * record (interrupted write), triggers this compaction at init.
+ *
+ * The banks are KV_STORE_BANK_PAGES flash pages each, from
+ * KV_STORE_FLASH_OFFSET, just below the on-chip virtual memory (LUN 0) by
+ * default; the application code must not grow into them. The build fails if
+ * they overlap the virtual memory.
+ *
+ * \note The service is not reentrant and must not be called from interrupt
+ *       handlers: the CPU is stalled while a flash page is programmed.
+ *
+ * \{
+ */
+
+#include "compiler.h"
+#include "conf_access.h"
+#if VIRTUAL_MEM == ENABLE
+#include "virtual_mem.h"
+#endif
+
+
+//! Number of keys.
+#ifndef KV_STORE_NB_KEYS
+#define KV_STORE_NB_KEYS            32
+#endif
+
+//! Maximal size of a value in bytes.
+#ifndef KV_STORE_VALUE_MAX
+#define KV_STORE_VALUE_MAX          64
+#endif
+
+//! Number of flash pages of each bank.
+#ifndef KV_STORE_BANK_PAGES
+#define KV_STORE_BANK_PAGES         4
+#endif
+
+//! End of the flash area available to the banks.
+#if VIRTUAL_MEM == ENABLE
+#define KV_STORE_FLASH_END          VIRTUAL_MEM_FLASH_OFFSET
+#else
+#define KV_STORE_FLASH_END          AVR32_FLASH_SIZE
+#endif
+
+//! Offset of the first bank in the flash array; the second bank follows.
+#ifndef KV_STORE_FLASH_OFFSET
+#define KV_STORE_FLASH_OFFSET       (KV_STORE_FLASH_END - 2 * KV_STORE_BANK_PAGES * AVR32_FLASHC_PAGE_SIZE)
+#endif
+
+//! \name Return values of \ref kv_store_read
+//! @{
+#define KV_STORE_NOT_FOUND          -1  //!< The key has no value.
+#define KV_STORE_INVALID_ARGUMENT   -2  //!< Key out of range or buffer too small.
+//! @}
+
+//! Store statistics.
+typedef struct
+{
+  //! Bytes used by the records in the active bank.
+  uint16_t used;
+
+  //! Bytes left in the active bank.
+  uint16_t free;
+
+  //! Records appended since init.
+  uint32_t writes;
+
+  //! Writes skipped since the value was unchanged.
+  uint32_t unchanged;
+
+  //! Compactions since init.
+  uint32_t compactions;
+
+  //! Sequence number of the active bank, i.e. number of compactions since the
+  //! store was created.
+  uint32_t sequence;
+} kv_store_stats_t;
+
+
+/*! \brief Loads the active bank and builds the RAM index.
+ *
+ * Creates an empty store if no bank is valid, and compacts the active bank
+ * if a write was interrupted.
+ *
+ * \return \c true on success, \c false on a flash error.
+ */
+extern bool kv_store_init(void);
+
+/*! \brief Reads the value of a key.
+ *
+ * \param key   Key.
+ * \param buf   Pointer to the buffer receiving the value.
+ * \param size  Size of the buffer.
+ *
+ * \return Length of the value, \ref KV_STORE_NOT_FOUND or
+ *         \ref KV_STORE_INVALID_ARGUMENT.
+ */
+extern int kv_store_read(uint16_t key, void *buf, uint16_t size);
+
+/*! \brief Writes the value of a key.
+ *
+ * Nothing is written if the value is unchanged. The bank is compacted if it
+ * has no room left for the record.
+ *
+ * \param key   Key.
+ * \param value Pointer to the value.
+ * \param len   Length of the value, up to KV_STORE_VALUE_MAX; \c 0 deletes
+ *              the key.
+ *
+ * \return \c true on success, \c false on an invalid argument, a full store
+ *         or a flash error.
+ */
+extern bool kv_store_write(uint16_t key, const void *value, uint16_t len);
+
+/*! \brief Deletes a key.
+ *
+ * \param key   Key.
+ *
+ * \return \c true on success, else \c false.
+ */
+#define kv_store_delete(key)        kv_store_write((key), NULL, 0)
+
+/*! \brief Copies the last record of each key to the other bank.
+ *
+ * \return \c true on success, \c false on a flash error.
+ */
+extern bool kv_store_compact(void);
+
+/*! \brief Gets the store statistics.
+ *
+ * \param stats Pointer to the location where to store the statistics.
+ */
+extern void kv_store_get_stats(kv_store_stats_t *stats);
+
+/**
+ * \}
+ */
+
+#endif  // _KV_STORE_H_
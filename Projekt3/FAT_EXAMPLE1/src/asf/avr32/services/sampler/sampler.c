@@ -0,0 +1,324 @@
+/*****************************************************************************
+ *
+ * \file
+ *
+ * \brief Periodic sampling paced by a TC channel, with jitter statistics.
+ *
+ * Copyright (c) 2009 Atmel Corporation. All rights reserved.
+ *
+ * \asf_license_start
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. The name of Atmel may not be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * 4. This software may only be redistributed and used in connection with an
+ *    Atmel microcontroller product.
+ *
+ * THIS SOFTWARE IS PROVIDED BY ATMEL "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT ARE
+ * EXPRESSLY AND SPECIFICALLY DISCLAIMED. IN NO EVENT SHALL ATMEL BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * \asf_license_stop
+ *
+ ******************************************************************************/
+
+
+
+
+#include <string.h>
+#include "compiler.h"
+#include "cycle_counter.h"
+#include "intc.h"
+#include "tc.h"
+#include "clock_profile.h"
+#include "sampler.h"
+
+
+#if SAMPLER_RING_SIZE & (SAMPLER_RING_SIZE - 1)
+#  error SAMPLER_RING_SIZE must be a power of 2.
+#endif
+
+#define SAMPLER_RING_MASK       (SAMPLER_RING_SIZE - 1)
+
+
+static volatile avr32_tc_t *sampler_tc;
+static unsigned int sampler_channel;
+static unsigned long sampler_pba_hz;
+static unsigned long sampler_cpu_hz;
+static sampler_acquire_t sampler_acquire;
+
+//! Sampling rate, 0 while stopped.
+static unsigned long sampler_rate_hz;
+
+//! Ring: the head is only written by the producer (interrupt handler), the
+//! tail by the consumer (main loop). Both run freely and wrap at 2^32.
+static sampler_sample_t sampler_ring[SAMPLER_RING_SIZE];
+static volatile uint32_t sampler_head;
+static volatile uint32_t sampler_tail;
+
+//! Timestamp of the previous sample, valid once a sample was taken.
+static uint32_t sampler_prev_timestamp;
+static bool sampler_prev_valid;
+
+static sampler_stats_t sampler_stats;
+static uint32_t sampler_jitter_histogram[SAMPLER_JITTER_BUCKETS];
+
+
+static void sampler_clock_changed(clock_profile_event_t event,
+                                  unsigned long cpu_hz, unsigned long pba_hz);
+
+
+/*! \brief TC interrupt handler.
+ */
+#if __GNUC__
+__attribute__((__interrupt__))
+#elif __ICCAVR32__
+__interrupt
+#endif
+static void sampler_int_handler(void)
+{
+  uint32_t timestamp = Get_sys_count();
+
+  // Acknowledge the RC compare.
+  tc_read_sr(sampler_tc, sampler_channel);
+  sampler_push(timestamp, sampler_acquire());
+}
+
+
+void sampler_init(volatile avr32_tc_t *tc, unsigned int channel,
+                  unsigned int irq, unsigned long pba_hz,
+                  unsigned long cpu_hz)
+{
+  const tc_interrupt_t tc_interrupt =
+  {
+    .cpcs     = 1
+  };
+
+  sampler_tc = tc;
+  sampler_channel = channel;
+  sampler_pba_hz = pba_hz;
+  sampler_cpu_hz = cpu_hz;
+
+  Disable_global_interrupt();
+  INTC_register_interrupt(&sampler_int_handler, irq, AVR32_INTC_INT1);
+  Enable_global_interrupt();
+
+  tc_stop(tc, channel);
+  tc_configure_interrupts(tc, channel, &tc_interrupt);
+
+  clock_profile_register(sampler_clock_changed);
+}
+
+
+/*! \brief Programs the TC period for \a rate_hz at the current PBA frequency
+ *         and starts the TC channel.
+ *
+ * \return \c false if the rate is out of range at this frequency, else
+ *         \c true.
+ */
+static bool sampler_set_rate(unsigned long rate_hz)
+{
+  //! TC clock sources and their fPBA dividers.
+  static const struct
+  {
+    unsigned int tcclks;
+    unsigned int divider;
+  } clocks[] =
+  {
+    {TC_CLOCK_SOURCE_TC2,   2},
+    {TC_CLOCK_SOURCE_TC3,   8},
+    {TC_CLOCK_SOURCE_TC4,  32},
+    {TC_CLOCK_SOURCE_TC5, 128}
+  };
+  tc_waveform_opt_t waveform_opt =
+  {
+    .channel  = sampler_channel,
+    .wavsel   = TC_WAVEFORM_SEL_UP_MODE_RC_TRIGGER
+  };
+  unsigned long rc = 0;
+  unsigned int i;
+
+  // Take the fastest clock for the finest period.
+  for (i = 0; i < sizeof(clocks) / sizeof(clocks[0]); i++)
+  {
+    rc = (sampler_pba_hz / clocks[i].divider + rate_hz / 2) / rate_hz;
+    if (rc <= 0xFFFF) break;
+  }
+  if (i == sizeof(clocks) / sizeof(clocks[0]) || rc < 2) return false;
+
+  sampler_stats.period_cy = (uint64_t)rc * clocks[i].divider * sampler_cpu_hz / sampler_pba_hz;
+  sampler_rate_hz = rate_hz;
+
+  waveform_opt.tcclks = clocks[i].tcclks;
+  tc_init_waveform(sampler_tc, &waveform_opt);
+  tc_write_rc(sampler_tc, sampler_channel, rc);
+  tc_start(sampler_tc, sampler_channel);
+
+  return true;
+}
+
+
+/*! \brief Holds the TC channel during a clock profile change, then derives
+ *         its period again.
+ */
+static void sampler_clock_changed(clock_profile_event_t event,
+                                  unsigned long cpu_hz, unsigned long pba_hz)
+{
+  unsigned long rate_hz = sampler_rate_hz;
+
+  if (event == CLOCK_PROFILE_PRE_CHANGE)
+  {
+    if (rate_hz)
+    {
+      tc_stop(sampler_tc, sampler_channel);
+      tc_read_sr(sampler_tc, sampler_channel);
+    }
+    return;
+  }
+
+  sampler_pba_hz = pba_hz;
+  sampler_cpu_hz = cpu_hz;
+  if (!rate_hz) return;
+
+  // The cycle counter runs at the new CPU frequency: the next interval is
+  // not a jitter sample.
+  sampler_prev_valid = false;
+  if (!sampler_set_rate(rate_hz))
+    sampler_stop();
+}
+
+
+bool sampler_start(unsigned long rate_hz, sampler_acquire_t acquire)
+{
+  if (!rate_hz || !acquire) return false;
+
+  sampler_stop();
+
+  sampler_acquire = acquire;
+  sampler_head = 0;
+  sampler_tail = 0;
+  sampler_prev_valid = false;
+  memset(&sampler_stats, 0, sizeof(sampler_stats));
+  memset(sampler_jitter_histogram, 0, sizeof(sampler_jitter_histogram));
+
+  return sampler_set_rate(rate_hz);
+}
+
+
+void sampler_stop(void)
+{
+  sampler_rate_hz = 0;
+  tc_stop(sampler_tc, sampler_channel);
+  tc_read_sr(sampler_tc, sampler_channel);
+}
+
+
+void sampler_push(uint32_t timestamp, uint32_t value)
+{
+  uint32_t head = sampler_head;
+  int32_t jitter;
+  uint32_t bucket;
+
+  sampler_stats.samples++;
+
+  if (sampler_prev_valid)
+  {
+    jitter = (int32_t)(timestamp - sampler_prev_timestamp - sampler_stats.period_cy);
+    if (sampler_stats.samples == 2 || jitter < sampler_stats.jitter_min)
+      sampler_stats.jitter_min = jitter;
+    if (sampler_stats.samples == 2 || jitter > sampler_stats.jitter_max)
+      sampler_stats.jitter_max = jitter;
+    bucket = ((jitter < 0) ? -jitter : jitter) / SAMPLER_JITTER_BUCKET_CY;
+    sampler_jitter_histogram[min(bucket, SAMPLER_JITTER_BUCKETS - 1)]++;
+  }
+  sampler_prev_timestamp = timestamp;
+  sampler_prev_valid = true;
+
+  if (head - sampler_tail >= SAMPLER_RING_SIZE)
+  {
+    sampler_stats.overruns++;
+    return;
+  }
+  sampler_ring[head & SAMPLER_RING_MASK].timestamp = timestamp;
+  sampler_ring[head & SAMPLER_RING_MASK].value = value;
+  // Publish the sample once written.
+  sampler_head = head + 1;
+}
+
+
+uint32_t sampler_available(void)
+{
+  return sampler_head - sampler_tail;
+}
+
+
+uint32_t sampler_read(sampler_sample_t *samples, uint32_t max)
+{
+  uint32_t tail = sampler_tail;
+  uint32_t n = min(sampler_head - tail, max);
+  uint32_t i;
+
+  for (i = 0; i < n; i++)
+    samples[i] = sampler_ring[(tail + i) & SAMPLER_RING_MASK];
+  // Free the slots once read.
+  sampler_tail = tail + n;
+
+  return n;
+}
+
+
+void sampler_get_stats(sampler_stats_t *stats)
+{
+  bool global_interrupt_enabled = Is_global_interrupt_enabled();
+
+  if (global_interrupt_enabled) Disable_global_interrupt();
+  *stats = sampler_stats;
+  if (global_interrupt_enabled) Enable_global_interrupt();
+}
+
+
+uint32_t sampler_get_jitter_percentile(unsigned int percent)
+{
+  bool global_interrupt_enabled = Is_global_interrupt_enabled();
+  uint32_t histogram[SAMPLER_JITTER_BUCKETS];
+  uint32_t total = 0, target, count = 0;
+  int32_t jitter_min, jitter_max;
+  unsigned int i;
+
+  if (global_interrupt_enabled) Disable_global_interrupt();
+  memcpy(histogram, sampler_jitter_histogram, sizeof(histogram));
+  jitter_min = sampler_stats.jitter_min;
+  jitter_max = sampler_stats.jitter_max;
+  if (global_interrupt_enabled) Enable_global_interrupt();
+
+  for (i = 0; i < SAMPLER_JITTER_BUCKETS; i++)
+    total += histogram[i];
+  if (!total) return 0;
+
+  percent = min(max(percent, 1), 100);
+  target = ((uint64_t)total * percent + 99) / 100;
+  for (i = 0; i < SAMPLER_JITTER_BUCKETS - 1; i++)
+  {
+    count += histogram[i];
+    if (count >= target) return (i + 1) * SAMPLER_JITTER_BUCKET_CY;
+  }
+  return max(-jitter_min, jitter_max);
+}
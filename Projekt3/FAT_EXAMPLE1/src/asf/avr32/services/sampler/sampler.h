@@ -0,0 +1,195 @@
+/*****************************************************************************
+ *
+ * \file
+ *
+ * \brief Periodic sampling paced by a TC channel, with jitter statistics.
+ *
+ * Copyright (c) 2009 Atmel Corporation. All rights reserved.
+ *
+ * \asf_license_start
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. The name of Atmel may not be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * 4. This software may only be redistributed and used in connection with an
+ *    Atmel microcontroller product.
+ *
+ * THIS SOFTWARE IS PROVIDED BY ATMEL "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT ARE
+ * EXPRESSLY AND SPECIFICALLY DISCLAIMED. IN NO EVENT SHALL ATMEL BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * \asf_license_stop
+ *
+ ******************************************************************************/
+
+
+
+
+#ifndef _SAMPLER_H_
+#define _SAMPLER_H_
+
+/**
+ * \defgroup group_avr32_services_sampler Periodic sampling engine
+ *
+ * The samples are acquired from the RC compare interrupt of a TC channel in
+ * waveform mode, so their timing does not depend on the main loop (storage
+ * stalls, shell). Each sample is timestamped with the cycle counter on entry
+ * of the interrupt handler and pushed into a single-producer/single-consumer
+ * ring, drained from the main loop with \ref sampler_read. A sample which
+ * finds the ring full is dropped and counted as an overrun.
+ *
+ * The jitter is the difference between the interval from the previous sample
+ * and the nominal period, in CPU cycles. Its minimum and maximum are kept,
+ * and the absolute values are counted in a histogram of
+ * SAMPLER_JITTER_BUCKETS buckets of SAMPLER_JITTER_BUCKET_CY cycles, from
+ * which \ref sampler_get_jitter_percentile is computed.
+ *
+ * \ref sampler_push holds the ring and statistics logic and does not depend
+ * on the TC, so it may be called by another trigger source.
+ *
+ * The sampler follows the clock profile changes: the TC channel is held
+ * during the change, then its period and the nominal period in CPU cycles are
+ * derived again. Sampling stops if the rate is out of range at the new PBA
+ * frequency.
+ *
+ * \{
+ */
+
+#include "compiler.h"
+#include "tc.h"
+
+
+//! Number of samples of the ring (power of 2).
+#ifndef SAMPLER_RING_SIZE
+#define SAMPLER_RING_SIZE           256
+#endif
+
+//! Number of buckets of the jitter histogram.
+#ifndef SAMPLER_JITTER_BUCKETS
+#define SAMPLER_JITTER_BUCKETS      32
+#endif
+
+//! Width of the jitter histogram buckets in CPU cycles.
+#ifndef SAMPLER_JITTER_BUCKET_CY
+#define SAMPLER_JITTER_BUCKET_CY    16
+#endif
+
+//! Acquisition function, called from the interrupt handler.
+typedef uint32_t (*sampler_acquire_t)(void);
+
+//! Sample.
+typedef struct
+{
+  //! Cycle counter when the sampling interrupt was entered.
+  uint32_t timestamp;
+
+  //! Value returned by the acquisition function.
+  uint32_t value;
+} sampler_sample_t;
+
+//! Sampling statistics.
+typedef struct
+{
+  //! Samples acquired, including the overruns.
+  uint32_t samples;
+
+  //! Samples dropped as the ring was full.
+  uint32_t overruns;
+
+  //! Nominal period in CPU cycles.
+  uint32_t period_cy;
+
+  //! Extreme jitters in CPU cycles.
+  int32_t jitter_min;
+  int32_t jitter_max;
+} sampler_stats_t;
+
+
+/*! \brief Initializes the TC channel pacing the samples.
+ *
+ * Its interrupt handler is registered on level 1, above the shell USART and
+ * the software timers.
+ *
+ * \param tc      Pointer to the TC instance.
+ * \param channel TC channel.
+ * \param irq     IRQ number of the TC channel.
+ * \param pba_hz  PBA frequency.
+ * \param cpu_hz  CPU frequency, i.e. cycle counter frequency.
+ */
+extern void sampler_init(volatile avr32_tc_t *tc, unsigned int channel,
+                         unsigned int irq, unsigned long pba_hz,
+                         unsigned long cpu_hz);
+
+/*! \brief Empties the ring, resets the statistics and starts sampling.
+ *
+ * \param rate_hz Sampling rate, from fPBA / 2^23 to fPBA / 4.
+ * \param acquire Acquisition function.
+ *
+ * \return \c false if the rate is out of range or \a acquire is NULL, else
+ *         \c true.
+ */
+extern bool sampler_start(unsigned long rate_hz, sampler_acquire_t acquire);
+
+/*! \brief Stops sampling. The samples left in the ring can still be read.
+ */
+extern void sampler_stop(void);
+
+/*! \brief Takes a sample: called by the TC interrupt handler.
+ *
+ * \param timestamp Cycle counter at the trigger.
+ * \param value     Sample value.
+ */
+extern void sampler_push(uint32_t timestamp, uint32_t value);
+
+/*! \brief Returns the number of samples waiting in the ring.
+ */
+extern uint32_t sampler_available(void);
+
+/*! \brief Drains samples from the ring.
+ *
+ * \param samples Pointer to the buffer receiving the samples.
+ * \param max     Maximal number of samples to read.
+ *
+ * \return Number of samples read.
+ */
+extern uint32_t sampler_read(sampler_sample_t *samples, uint32_t max);
+
+/*! \brief Gets the sampling statistics.
+ *
+ * \param stats Pointer to the location where to store the statistics.
+ */
+extern void sampler_get_stats(sampler_stats_t *stats);
+
+/*! \brief Returns a percentile of the absolute jitter.
+ *
+ * \param percent Percentile, from 1 to 100.
+ *
+ * \return Upper bound in CPU cycles of the histogram bucket holding the
+ *         percentile, the maximal jitter if it is in the last bucket, or 0
+ *         if no interval was measured.
+ */
+extern uint32_t sampler_get_jitter_percentile(unsigned int percent);
+
+/**
+ * \}
+ */
+
+#endif  // _SAMPLER_H_
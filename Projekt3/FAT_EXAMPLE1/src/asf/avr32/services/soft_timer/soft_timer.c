@@ -0,0 +1,351 @@
+/*****************************************************************************
+ *
+ * \file
+ *
+ * \brief Software timers in a hierarchical timing wheel driven by a TC channel.
+ *
+ * Copyright (c) 2009 Atmel Corporation. All rights reserved.
+ *
+ * \asf_license_start
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. The name of Atmel may not be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * 4. This software may only be redistributed and used in connection with an
+ *    Atmel microcontroller product.
+ *
+ * THIS SOFTWARE IS PROVIDED BY ATMEL "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT ARE
+ * EXPRESSLY AND SPECIFICALLY DISCLAIMED. IN NO EVENT SHALL ATMEL BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * \asf_license_stop
+ *
+ ******************************************************************************/
+
+
+
+
+#include "compiler.h"
+#include "intc.h"
+#include "tc.h"
+#include "soft_timer.h"
+
+
+//! Wheel geometry: SOFT_TIMER_LEVELS levels of 2^SOFT_TIMER_SLOT_BITS slots.
+#define SOFT_TIMER_LEVELS       4
+#define SOFT_TIMER_SLOT_BITS    6
+#define SOFT_TIMER_SLOTS        (1 << SOFT_TIMER_SLOT_BITS)
+#define SOFT_TIMER_SLOT_MASK    (SOFT_TIMER_SLOTS - 1)
+
+//! Longest delay held by the wheel; longer ones are placed again.
+#define SOFT_TIMER_RANGE_MAX    ((1UL << (SOFT_TIMER_LEVELS * SOFT_TIMER_SLOT_BITS)) - 1)
+
+//! Longest delay accepted by \ref soft_timer_start.
+#define SOFT_TIMER_DELAY_MAX    0x7FFFFFFF
+
+//! Slot of a tick at a level.
+#define Soft_timer_slot(tick, level) \
+  (((tick) >> ((level) * SOFT_TIMER_SLOT_BITS)) & SOFT_TIMER_SLOT_MASK)
+
+
+//! TC channel generating the ticks, NULL if the ticks come from elsewhere.
+static volatile avr32_tc_t *soft_timer_tc;
+static unsigned int soft_timer_channel;
+static bool soft_timer_running;
+
+static soft_timer_t *soft_timer_wheel[SOFT_TIMER_LEVELS][SOFT_TIMER_SLOTS];
+
+//! Timers expiring at the tick being processed.
+static soft_timer_t *soft_timer_expired;
+
+//! Next tick to process, i.e. number of ticks processed.
+static volatile uint32_t soft_timer_next;
+
+//! Number of armed timers.
+static uint32_t soft_timer_armed;
+
+//! Deferred timers waiting for \ref soft_timer_task, in expiry order.
+static soft_timer_t *soft_timer_pending;
+static soft_timer_t **soft_timer_pending_tail = &soft_timer_pending;
+
+
+/*! \brief Links a timer at the head of a list.
+ */
+static void soft_timer_link(soft_timer_t *timer, soft_timer_t **list)
+{
+  timer->next = *list;
+  if (timer->next) timer->next->pprev = &timer->next;
+  *list = timer;
+  timer->pprev = list;
+}
+
+
+/*! \brief Unlinks a timer from its list.
+ */
+static void soft_timer_unlink(soft_timer_t *timer)
+{
+  *timer->pprev = timer->next;
+  if (timer->next) timer->next->pprev = timer->pprev;
+  timer->pprev = NULL;
+}
+
+
+/*! \brief Links a timer in the slot of its expiry tick.
+ */
+static void soft_timer_add(soft_timer_t *timer)
+{
+  uint32_t expires = timer->expires;
+  uint32_t delta = expires - soft_timer_next;
+  soft_timer_t **slot;
+
+  if ((int32_t)delta < 0)
+  {
+    // Late: expire at the next tick.
+    slot = &soft_timer_wheel[0][Soft_timer_slot(soft_timer_next, 0)];
+  }
+  else if (delta < 1UL << SOFT_TIMER_SLOT_BITS)
+    slot = &soft_timer_wheel[0][Soft_timer_slot(expires, 0)];
+  else if (delta < 1UL << (2 * SOFT_TIMER_SLOT_BITS))
+    slot = &soft_timer_wheel[1][Soft_timer_slot(expires, 1)];
+  else if (delta < 1UL << (3 * SOFT_TIMER_SLOT_BITS))
+    slot = &soft_timer_wheel[2][Soft_timer_slot(expires, 2)];
+  else
+  {
+    if (delta > SOFT_TIMER_RANGE_MAX) expires = soft_timer_next + SOFT_TIMER_RANGE_MAX;
+    slot = &soft_timer_wheel[3][Soft_timer_slot(expires, 3)];
+  }
+  soft_timer_link(timer, slot);
+}
+
+
+/*! \brief Moves the timers of the current slot of a level to the lower levels.
+ *
+ * \return Index of the slot.
+ */
+static uint32_t soft_timer_cascade(int level)
+{
+  uint32_t index = Soft_timer_slot(soft_timer_next, level);
+  soft_timer_t *timer = soft_timer_wheel[level][index];
+  soft_timer_t *next;
+
+  soft_timer_wheel[level][index] = NULL;
+  while (timer)
+  {
+    next = timer->next;
+    soft_timer_add(timer);
+    timer = next;
+  }
+  return index;
+}
+
+
+/*! \brief TC interrupt handler.
+ */
+#if __GNUC__
+__attribute__((__interrupt__))
+#elif __ICCAVR32__
+__interrupt
+#endif
+static void soft_timer_int_handler(void)
+{
+  // Acknowledge the RC compare.
+  tc_read_sr(soft_timer_tc, soft_timer_channel);
+  soft_timer_tick();
+}
+
+
+void soft_timer_init(volatile avr32_tc_t *tc, unsigned int channel,
+                     unsigned int irq, unsigned long pba_hz)
+{
+  const tc_waveform_opt_t waveform_opt =
+  {
+    .channel  = channel,
+    .wavsel   = TC_WAVEFORM_SEL_UP_MODE_RC_TRIGGER,
+    .tcclks   = TC_CLOCK_SOURCE_TC3   // fPBA / 8
+  };
+  const tc_interrupt_t tc_interrupt =
+  {
+    .cpcs     = 1
+  };
+
+  soft_timer_tc = tc;
+  soft_timer_channel = channel;
+  soft_timer_running = false;
+
+  Disable_global_interrupt();
+  INTC_register_interrupt(&soft_timer_int_handler, irq, AVR32_INTC_INT0);
+  Enable_global_interrupt();
+
+  tc_init_waveform(tc, &waveform_opt);
+  tc_write_rc(tc, channel, (pba_hz / 8 + SOFT_TIMER_TICK_HZ / 2) / SOFT_TIMER_TICK_HZ);
+  tc_configure_interrupts(tc, channel, &tc_interrupt);
+}
+
+
+void soft_timer_set_pba_hz(unsigned long pba_hz)
+{
+  bool global_interrupt_enabled = Is_global_interrupt_enabled();
+
+  if (global_interrupt_enabled) Disable_global_interrupt();
+  tc_write_rc(soft_timer_tc, soft_timer_channel,
+              (pba_hz / 8 + SOFT_TIMER_TICK_HZ / 2) / SOFT_TIMER_TICK_HZ);
+  // The counter may be past the new RC value: restart it.
+  if (soft_timer_running)
+    tc_start(soft_timer_tc, soft_timer_channel);
+  if (global_interrupt_enabled) Enable_global_interrupt();
+}
+
+
+void soft_timer_setup(soft_timer_t *timer, soft_timer_callback_t callback,
+                      void *arg, bool deferred)
+{
+  timer->pprev = NULL;
+  timer->callback = callback;
+  timer->arg = arg;
+  timer->deferred = deferred;
+  timer->queued = false;
+  timer->fired = false;
+}
+
+
+void soft_timer_start(soft_timer_t *timer, uint32_t delay, uint32_t period)
+{
+  bool global_interrupt_enabled = Is_global_interrupt_enabled();
+
+  if (delay > SOFT_TIMER_DELAY_MAX) delay = SOFT_TIMER_DELAY_MAX;
+
+  if (global_interrupt_enabled) Disable_global_interrupt();
+  if (timer->pprev)
+    soft_timer_unlink(timer);
+  else
+    soft_timer_armed++;
+  timer->expires = soft_timer_next + delay;
+  timer->period = period;
+  soft_timer_add(timer);
+
+  // Leave the tickless state.
+  if (soft_timer_tc && !soft_timer_running)
+  {
+    tc_start(soft_timer_tc, soft_timer_channel);
+    soft_timer_running = true;
+  }
+  if (global_interrupt_enabled) Enable_global_interrupt();
+}
+
+
+void soft_timer_stop(soft_timer_t *timer)
+{
+  bool global_interrupt_enabled = Is_global_interrupt_enabled();
+
+  if (global_interrupt_enabled) Disable_global_interrupt();
+  if (timer->pprev)
+  {
+    soft_timer_unlink(timer);
+    soft_timer_armed--;
+  }
+  // A queued timer is skipped by soft_timer_task.
+  timer->fired = false;
+  if (global_interrupt_enabled) Enable_global_interrupt();
+}
+
+
+bool soft_timer_is_active(const soft_timer_t *timer)
+{
+  return timer->pprev != NULL;
+}
+
+
+void soft_timer_task(void)
+{
+  bool global_interrupt_enabled = Is_global_interrupt_enabled();
+  soft_timer_t *timer;
+  bool fired;
+
+  while (soft_timer_pending)
+  {
+    if (global_interrupt_enabled) Disable_global_interrupt();
+    timer = soft_timer_pending;
+    soft_timer_pending = timer->pending_next;
+    if (!soft_timer_pending) soft_timer_pending_tail = &soft_timer_pending;
+    timer->queued = false;
+    fired = timer->fired;
+    timer->fired = false;
+    if (global_interrupt_enabled) Enable_global_interrupt();
+
+    if (fired) timer->callback(timer->arg);
+  }
+}
+
+
+void soft_timer_tick(void)
+{
+  uint32_t index = Soft_timer_slot(soft_timer_next, 0);
+  soft_timer_t *timer;
+
+  // Refill the lowest level when it wraps around.
+  if (!index && !soft_timer_cascade(1) && !soft_timer_cascade(2))
+    soft_timer_cascade(3);
+
+  // Take the slot of this tick: the callbacks may start or stop any timer.
+  soft_timer_expired = soft_timer_wheel[0][index];
+  soft_timer_wheel[0][index] = NULL;
+  if (soft_timer_expired) soft_timer_expired->pprev = &soft_timer_expired;
+  soft_timer_next++;
+
+  while ((timer = soft_timer_expired))
+  {
+    soft_timer_unlink(timer);
+    if (timer->period)
+    {
+      timer->expires += timer->period;
+      soft_timer_add(timer);
+    }
+    else
+      soft_timer_armed--;
+
+    if (!timer->deferred)
+      timer->callback(timer->arg);
+    else
+    {
+      timer->fired = true;
+      if (!timer->queued)
+      {
+        timer->queued = true;
+        timer->pending_next = NULL;
+        *soft_timer_pending_tail = timer;
+        soft_timer_pending_tail = &timer->pending_next;
+      }
+    }
+  }
+
+  // Enter the tickless state.
+  if (soft_timer_tc && !soft_timer_armed)
+  {
+    tc_stop(soft_timer_tc, soft_timer_channel);
+    soft_timer_running = false;
+  }
+}
+
+
+uint32_t soft_timer_get_ticks(void)
+{
+  return soft_timer_next;
+}
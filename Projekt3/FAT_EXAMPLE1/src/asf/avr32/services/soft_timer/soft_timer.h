@@ -0,0 +1,200 @@
+/*****************************************************************************
+ *
+ * \file
+ *
+ * \brief Software timers in a hierarchical timing wheel driven by a TC channel.
+ *
+ * Copyright (c) 2009 Atmel Corporation. All rights reserved.
+ *
+ * \asf_license_start
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. The name of Atmel may not be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * 4. This software may only be redistributed and used in connection with an
+ *    Atmel microcontroller product.
+ *
+ * THIS SOFTWARE IS PROVIDED BY ATMEL "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT ARE
+ * EXPRESSLY AND SPECIFICALLY DISCLAIMED. IN NO EVENT SHALL ATMEL BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * \asf_license_stop
+ *
+ ******************************************************************************/
+
+
+
+
+#ifndef _SOFT_TIMER_H_
+#define _SOFT_TIMER_H_
+
+/**
+ * \defgroup group_avr32_services_soft_timer Software timers
+ *
+ * One-shot and periodic timers counted in ticks of a TC channel, instead of
+ * busy loops such as \ref delay_ms.
+ *
+ * The armed timers are kept in a hierarchical timing wheel: 4 levels of 64
+ * slots covering 2^6, 2^12, 2^18 and 2^24 ticks. A timer is linked in the
+ * slot of its expiry tick at the lowest level covering its delay, so starting
+ * and stopping a timer take constant time; the slots of the upper levels are
+ * moved down one level each time the lower level wraps around. Delays longer
+ * than 2^24 ticks are kept in the last slot and placed again when it is
+ * reached.
+ *
+ * The callback of a timer is called either from the tick interrupt, or from
+ * \ref soft_timer_task in the main loop (deferred timers, e.g. to access the
+ * FAT); expiries of a deferred timer not served yet are merged.
+ *
+ * The TC channel is stopped while no timer is armed: the tick count, which
+ * is only used to measure the delays, does not advance meanwhile.
+ *
+ * \ref soft_timer_tick holds the wheel logic and does not depend on the TC,
+ * so it may be called by another tick source.
+ *
+ * \note The timers are owned by the application and must stay valid (e.g.
+ *       static) while they are armed or waiting for \ref soft_timer_task.
+ *
+ * \{
+ */
+
+#include "compiler.h"
+#include "tc.h"
+
+
+//! Tick frequency in Hz.
+#ifndef SOFT_TIMER_TICK_HZ
+#define SOFT_TIMER_TICK_HZ          1000
+#endif
+
+//! Converts milliseconds to ticks, rounding up.
+#define soft_timer_ms_2_ticks(ms) \
+  (((uint32_t)(ms) * SOFT_TIMER_TICK_HZ + 999) / 1000)
+
+//! Timer callback, called with the argument given to \ref soft_timer_setup.
+typedef void (*soft_timer_callback_t)(void *arg);
+
+//! Software timer. The fields are managed by the service.
+typedef struct soft_timer
+{
+  //! Next timer in the same wheel slot.
+  struct soft_timer *next;
+
+  //! Link to this timer in its wheel slot, NULL if the timer is not armed.
+  struct soft_timer **pprev;
+
+  //! Next deferred timer waiting for \ref soft_timer_task.
+  struct soft_timer *pending_next;
+
+  //! Tick of the next expiry.
+  uint32_t expires;
+
+  //! Period in ticks, 0 for a one-shot timer.
+  uint32_t period;
+
+  soft_timer_callback_t callback;
+  void *arg;
+
+  //! Whether the callback is called from \ref soft_timer_task.
+  bool deferred;
+
+  //! Whether the timer is queued for \ref soft_timer_task.
+  bool queued;
+
+  //! Whether the timer expired since its callback was last called by
+  //! \ref soft_timer_task.
+  volatile bool fired;
+} soft_timer_t;
+
+
+/*! \brief Initializes the service and the TC channel generating the ticks.
+ *
+ * The channel counts fPBA / 8 and is reset at SOFT_TIMER_TICK_HZ. Its
+ * interrupt handler is registered on level 0.
+ *
+ * \param tc      Pointer to the TC instance.
+ * \param channel TC channel.
+ * \param irq     IRQ number of the TC channel.
+ * \param pba_hz  PBA frequency.
+ */
+extern void soft_timer_init(volatile avr32_tc_t *tc, unsigned int channel,
+                            unsigned int irq, unsigned long pba_hz);
+
+/*! \brief Sets the tick period again after a PBA frequency change.
+ *
+ * The tick being counted is restarted.
+ *
+ * \param pba_hz  New PBA frequency.
+ */
+extern void soft_timer_set_pba_hz(unsigned long pba_hz);
+
+/*! \brief Sets the callback of a stopped timer.
+ *
+ * \param timer     Pointer to the timer.
+ * \param callback  Function called at each expiry.
+ * \param arg       Argument given to the callback.
+ * \param deferred  Whether the callback is called from \ref soft_timer_task
+ *                  instead of the tick interrupt.
+ */
+extern void soft_timer_setup(soft_timer_t *timer, soft_timer_callback_t callback,
+                             void *arg, bool deferred);
+
+/*! \brief Arms a timer, stopping it first if needed.
+ *
+ * \param timer   Pointer to the timer.
+ * \param delay   Ticks up to the first expiry (0 expires at the next tick).
+ * \param period  Ticks between the next expiries, 0 for a one-shot timer.
+ */
+extern void soft_timer_start(soft_timer_t *timer, uint32_t delay, uint32_t period);
+
+/*! \brief Disarms a timer; a pending deferred call is cancelled.
+ *
+ * \param timer   Pointer to the timer.
+ */
+extern void soft_timer_stop(soft_timer_t *timer);
+
+/*! \brief Tells if a timer is armed.
+ *
+ * \param timer   Pointer to the timer.
+ */
+extern bool soft_timer_is_active(const soft_timer_t *timer);
+
+/*! \brief Calls the callbacks of the deferred timers which expired.
+ *
+ * To be called from the main loop.
+ */
+extern void soft_timer_task(void);
+
+/*! \brief Advances the wheel by one tick and runs the timers expiring.
+ *
+ * Called by the TC interrupt handler, with the interrupts masked.
+ */
+extern void soft_timer_tick(void);
+
+/*! \brief Returns the number of ticks counted since init.
+ */
+extern uint32_t soft_timer_get_ticks(void);
+
+/**
+ * \}
+ */
+
+#endif  // _SOFT_TIMER_H_
@@ -0,0 +1,209 @@
+/*****************************************************************************
+ *
+ * \file
+ *
+ * \brief Transaction scheduler for the devices sharing an SPI bus.
+ *
+ * Copyright (c) 2009 Atmel Corporation. All rights reserved.
+ *
+ * \asf_license_start
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. The name of Atmel may not be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * 4. This software may only be redistributed and used in connection with an
+ *    Atmel microcontroller product.
+ *
+ * THIS SOFTWARE IS PROVIDED BY ATMEL "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT ARE
+ * EXPRESSLY AND SPECIFICALLY DISCLAIMED. IN NO EVENT SHALL ATMEL BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * \asf_license_stop
+ *
+ ******************************************************************************/
+
+
+#include <string.h>
+#include "compiler.h"
+#include "spi.h"
+#include "spi_bus.h"
+
+
+//! SPI controller shared by the devices.
+static volatile avr32_spi_t *spi_bus_spi;
+
+//! Queue of the transactions waiting to run.
+static spi_bus_trans_t *spi_bus_head;
+static spi_bus_trans_t *spi_bus_tail;
+
+//! Busy state of each device.
+static bool (*spi_bus_busy[SPI_BUS_NB_CHIPS])(void);
+
+//! Set while the scheduler runs transactions.
+static bool spi_bus_running;
+
+static spi_bus_stats_t spi_bus_stats;
+
+
+void spi_bus_init(volatile avr32_spi_t *spi)
+{
+  spi_bus_spi = spi;
+  spi_bus_head = NULL;
+  spi_bus_tail = NULL;
+  spi_bus_running = false;
+  memset(spi_bus_busy, 0, sizeof(spi_bus_busy));
+  memset(&spi_bus_stats, 0, sizeof(spi_bus_stats));
+}
+
+
+bool spi_bus_set_device(uint8_t chip, bool (*busy)(void))
+{
+  if (chip >= SPI_BUS_NB_CHIPS) {
+    return false;
+  }
+
+  spi_bus_busy[chip] = busy;
+
+  return true;
+}
+
+
+void spi_bus_submit(spi_bus_trans_t *trans)
+{
+  trans->next = NULL;
+  trans->status = SPI_OK;
+  trans->done = false;
+
+  if (spi_bus_tail) {
+    spi_bus_tail->next = trans;
+  } else {
+    spi_bus_head = trans;
+  }
+  spi_bus_tail = trans;
+}
+
+
+static void spi_bus_execute(spi_bus_trans_t *trans)
+{
+  spi_status_t status;
+
+  if (trans->run) {
+    status = trans->run(trans);
+  } else {
+    spi_selectChip(spi_bus_spi, trans->chip);
+
+    status = spi_write_buf(spi_bus_spi, trans->cmd, trans->cmd_len);
+    if (status == SPI_OK && trans->len) {
+      status = spi_transfer_buf(spi_bus_spi, trans->tx, trans->rx, trans->len);
+    }
+
+    spi_unselectChip(spi_bus_spi, trans->chip);
+  }
+
+  spi_bus_stats.transactions++;
+  spi_bus_stats.bytes += trans->cmd_len + trans->len;
+
+  trans->status = status;
+}
+
+
+//! Runs the queued transactions, except the ones of the chip \a skip and of
+//! the busy devices. The order of the transactions of each chip is kept.
+static void spi_bus_schedule(int skip)
+{
+  spi_bus_trans_t *trans, *prev = NULL, *next;
+  U32 blocked = 0;
+
+  if (spi_bus_running) {
+    return;
+  }
+  spi_bus_running = true;
+
+  for (trans = spi_bus_head; trans; trans = next) {
+    next = trans->next;
+
+    if (trans->chip >= SPI_BUS_NB_CHIPS) {
+      // Unknown chip: complete the transaction with an error.
+      trans->status = SPI_ERROR_ARGUMENT;
+    } else if (trans->chip == skip || (blocked & (1 << trans->chip)) ||
+               (spi_bus_busy[trans->chip] && spi_bus_busy[trans->chip]())) {
+      // The device is not available: the following transactions to it wait too.
+      blocked |= 1 << trans->chip;
+      spi_bus_stats.deferred++;
+      prev = trans;
+      continue;
+    } else {
+      spi_bus_execute(trans);
+    }
+
+    // Unlink the transaction before the callback may queue a new one.
+    if (prev) {
+      prev->next = next;
+    } else {
+      spi_bus_head = next;
+    }
+    if (spi_bus_tail == trans) {
+      spi_bus_tail = prev;
+    }
+
+    trans->done = true;
+    if (trans->callback) {
+      trans->callback(trans);
+    }
+
+    // A transaction queued by the callback follows prev.
+    next = (prev) ? prev->next : spi_bus_head;
+  }
+
+  spi_bus_running = false;
+}
+
+
+void spi_bus_run(void)
+{
+  spi_bus_schedule(-1);
+}
+
+
+spi_status_t spi_bus_wait(spi_bus_trans_t *trans)
+{
+  while (!trans->done) {
+    spi_bus_schedule(-1);
+  }
+
+  return trans->status;
+}
+
+
+void spi_bus_yield(uint8_t chip)
+{
+  spi_bus_stats.yields++;
+
+  if (spi_bus_head) {
+    spi_bus_schedule(chip);
+  }
+}
+
+
+void spi_bus_get_stats(spi_bus_stats_t *stats)
+{
+  *stats = spi_bus_stats;
+}
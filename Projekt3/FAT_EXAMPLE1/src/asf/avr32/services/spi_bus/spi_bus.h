@@ -0,0 +1,186 @@
+/*****************************************************************************
+ *
+ * \file
+ *
+ * \brief Transaction scheduler for the devices sharing an SPI bus.
+ *
+ * Copyright (c) 2009 Atmel Corporation. All rights reserved.
+ *
+ * \asf_license_start
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. The name of Atmel may not be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * 4. This software may only be redistributed and used in connection with an
+ *    Atmel microcontroller product.
+ *
+ * THIS SOFTWARE IS PROVIDED BY ATMEL "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT ARE
+ * EXPRESSLY AND SPECIFICALLY DISCLAIMED. IN NO EVENT SHALL ATMEL BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * \asf_license_stop
+ *
+ ******************************************************************************/
+
+
+#ifndef _SPI_BUS_H_
+#define _SPI_BUS_H_
+
+/**
+ * \defgroup group_avr32_services_spi_bus SPI bus transaction scheduler
+ *
+ * Several devices (e.g. the SD/MMC card and the AT45DBX data flash on the
+ * EVK1100) share one SPI controller. Their drivers submit transactions, which
+ * run in submission order for each chip select; a transaction to a device
+ * reporting itself busy (data flash page program, SD card block program) is
+ * put off with the following ones to the same device, while the transactions
+ * to the other devices go on. The devices thus work at the same time.
+ *
+ * A transaction is either a command phase and a data phase run with the chip
+ * selected, or a function of the driver running a sequence with responses to
+ * wait for (e.g. an SD/MMC block access), which selects the chip itself.
+ *
+ * The transactions run when a driver waits for one of its own (\ref
+ * spi_bus_wait), from the main loop (\ref spi_bus_run), and while a driver
+ * polls its device outside of a transaction (\ref spi_bus_yield).
+ *
+ * The clock, mode and character length of each device are held by the chip
+ * select register of its NPCS (see \ref spi_setupChipReg), so the SPI
+ * controller applies them by itself when the device is selected.
+ *
+ * \note The scheduler is not reentrant: it must not be used from interrupt
+ *       handlers, and a transaction must not wait for another one.
+ *
+ * \{
+ */
+
+#include "compiler.h"
+#include "spi.h"
+
+
+//! Number of chip selects handled by the scheduler.
+#ifndef SPI_BUS_NB_CHIPS
+#define SPI_BUS_NB_CHIPS  4
+#endif
+
+
+//! SPI bus transaction.
+typedef struct spi_bus_trans
+{
+  //! Next queued transaction (used by the scheduler).
+  struct spi_bus_trans *next;
+
+  //! Chip select of the device.
+  uint8_t chip;
+
+  //! Command phase: bytes sent, the received data is discarded.
+  const void *cmd;
+  size_t cmd_len;
+
+  //! Data phase: bytes sent (0xFF if NULL) and received (discarded if NULL).
+  const void *tx;
+  void *rx;
+  size_t len;
+
+  //! Sequence run instead of the phases, or NULL. It selects and unselects
+  //! the chip itself; \ref tx, \ref rx and \ref len are its own.
+  spi_status_t (*run)(struct spi_bus_trans *trans);
+
+  //! Called after the transaction is done (may submit a new transaction).
+  void (*callback)(struct spi_bus_trans *trans);
+
+  //! Transaction status, valid once \ref done is set.
+  spi_status_t status;
+
+  //! Set by the scheduler once the transaction is done.
+  volatile bool done;
+} spi_bus_trans_t;
+
+//! SPI bus statistics.
+typedef struct
+{
+  //! Transactions run.
+  U32 transactions;
+
+  //! Bytes transferred by the transactions.
+  U32 bytes;
+
+  //! Calls of \ref spi_bus_yield.
+  U32 yields;
+
+  //! Transactions put off because their device was busy.
+  U32 deferred;
+} spi_bus_stats_t;
+
+
+/*! \brief Initializes the scheduler.
+ *
+ * \param spi Base address of the SPI instance shared by the devices.
+ */
+extern void spi_bus_init(volatile avr32_spi_t *spi);
+
+/*! \brief Sets the function telling if a device is busy.
+ *
+ * \param chip  Chip select of the device.
+ * \param busy  Function returning true while the device cannot accept a
+ *              transaction, or NULL if the device is never busy. It is called
+ *              with the SPI bus free and may use it.
+ *
+ * \return \c true if \a chip is handled by the scheduler.
+ */
+extern bool spi_bus_set_device(uint8_t chip, bool (*busy)(void));
+
+/*! \brief Queues a transaction.
+ *
+ * \param trans Transaction, owned by the scheduler until \c done is set.
+ */
+extern void spi_bus_submit(spi_bus_trans_t *trans);
+
+/*! \brief Runs the queued transactions of the devices which are not busy.
+ */
+extern void spi_bus_run(void);
+
+/*! \brief Runs the queued transactions until the given one is done.
+ *
+ * \param trans Queued transaction.
+ *
+ * \return Status of the transaction.
+ */
+extern spi_status_t spi_bus_wait(spi_bus_trans_t *trans);
+
+/*! \brief Runs the queued transactions of the devices other than the calling
+ *         one while it is busy.
+ *
+ * \param chip  Chip select of the busy device, which must be unselected.
+ */
+extern void spi_bus_yield(uint8_t chip);
+
+/*! \brief Gets the bus statistics.
+ *
+ * \param stats Pointer to the location where to store the statistics.
+ */
+extern void spi_bus_get_stats(spi_bus_stats_t *stats);
+
+/**
+ * \}
+ */
+
+#endif  // _SPI_BUS_H_
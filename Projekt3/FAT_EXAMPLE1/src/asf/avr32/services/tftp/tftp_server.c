@@ -0,0 +1,794 @@
+/*****************************************************************************
+ *
+ * \file
+ *
+ * \brief TFTP read server streaming the FAT files over the MACB.
+ *
+ * Copyright (c) 2009 Atmel Corporation. All rights reserved.
+ *
+ * \asf_license_start
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. The name of Atmel may not be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * 4. This software may only be redistributed and used in connection with an
+ *    Atmel microcontroller product.
+ *
+ * THIS SOFTWARE IS PROVIDED BY ATMEL "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT ARE
+ * EXPRESSLY AND SPECIFICALLY DISCLAIMED. IN NO EVENT SHALL ATMEL BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * \asf_license_stop
+ *
+ ******************************************************************************/
+
+
+
+
+#include <string.h>
+#include "compiler.h"
+#include "cycle_counter.h"
+#include "macb.h"
+#include "conf_eth.h"
+#include "file.h"
+#include "navigation.h"
+#include "tftp_server.h"
+
+
+#if TFTP_SERVER_BLKSIZE_MAX > 1468 || TFTP_SERVER_BLKSIZE_MAX % 4
+#  error TFTP_SERVER_BLKSIZE_MAX must be a multiple of 4, up to 1468.
+#endif
+
+//! Sizes of the headers.
+#define TFTP_ETH_HEADER_SIZE    14
+#define TFTP_IP_HEADER_SIZE     20
+#define TFTP_UDP_HEADER_SIZE    8
+#define TFTP_HEADER_SIZE        4
+#define TFTP_HEADERS_SIZE       (TFTP_ETH_HEADER_SIZE + TFTP_IP_HEADER_SIZE + TFTP_UDP_HEADER_SIZE + TFTP_HEADER_SIZE)
+
+//! Offsets of the headers in the frames sent.
+#define TFTP_IP                 TFTP_ETH_HEADER_SIZE
+#define TFTP_UDP                (TFTP_IP + TFTP_IP_HEADER_SIZE)
+#define TFTP_MSG                (TFTP_UDP + TFTP_UDP_HEADER_SIZE)
+
+//! Ethernet types.
+#define TFTP_ETH_TYPE_IP        0x0800
+#define TFTP_ETH_TYPE_ARP       0x0806
+
+//! Size of an ARP packet for IPv4 over Ethernet.
+#define TFTP_ARP_SIZE           28
+
+//! TFTP opcodes.
+#define TFTP_RRQ                1
+#define TFTP_WRQ                2
+#define TFTP_DATA               3
+#define TFTP_ACK                4
+#define TFTP_ERROR              5
+#define TFTP_OACK               6
+
+//! TFTP error codes.
+#define TFTP_ERR_UNDEFINED      0
+#define TFTP_ERR_NOT_FOUND      1
+#define TFTP_ERR_ACCESS         2
+#define TFTP_ERR_ILLEGAL_OP     4
+#define TFTP_ERR_UNKNOWN_TID    5
+
+//! Options granted to the client.
+#define TFTP_OPT_BLKSIZE        0x01
+#define TFTP_OPT_TSIZE          0x02
+#define TFTP_OPT_WINDOWSIZE     0x04
+
+//! Block size without the blksize option.
+#define TFTP_BLKSIZE_DEFAULT    512
+
+//! Size of the buffer receiving the frames (requests and acknowledgments).
+#define TFTP_RX_FRAME_SIZE      256
+
+//! Size of the buffer of the control frames (ARP, OACK, ERROR).
+#define TFTP_CTRL_FRAME_SIZE    (TFTP_HEADERS_SIZE + 96)
+
+//! Transfer state.
+typedef enum
+{
+  TFTP_IDLE,
+  TFTP_OACK_SENT,
+  TFTP_SENDING
+} tftp_state_t;
+
+//! Transfer in progress.
+static tftp_state_t tftp_state;
+
+//! Addresses of the node.
+static const uint8_t tftp_mac[6] =
+{
+  ETHERNET_CONF_ETHADDR0, ETHERNET_CONF_ETHADDR1, ETHERNET_CONF_ETHADDR2,
+  ETHERNET_CONF_ETHADDR3, ETHERNET_CONF_ETHADDR4, ETHERNET_CONF_ETHADDR5
+};
+static const uint8_t tftp_ip[4] =
+{
+  ETHERNET_CONF_IPADDR0, ETHERNET_CONF_IPADDR1, ETHERNET_CONF_IPADDR2, ETHERNET_CONF_IPADDR3
+};
+
+//! Client of the transfer, and port of the server for the transfer.
+static uint8_t tftp_client_mac[6];
+static uint8_t tftp_client_ip[4];
+static uint16_t tftp_client_port;
+static uint16_t tftp_port;
+
+//! Number of transfers started, giving the server ports.
+static uint16_t tftp_tid;
+
+//! Options, block size and window of the transfer.
+static uint8_t tftp_options;
+static uint16_t tftp_blksize;
+static uint16_t tftp_window;
+
+//! File size, number of blocks (the last one is shorter than tftp_blksize,
+//! maybe empty), last block acknowledged, next block to send and last block
+//! read from the file. The blocks are numbered from 1.
+static uint32_t tftp_size;
+static uint32_t tftp_nb_blocks;
+static uint32_t tftp_acked;
+static uint32_t tftp_next;
+static uint32_t tftp_read;
+
+//! Timeout of the acknowledgment, and number of times the window was sent again.
+static unsigned long tftp_cpu_hz;
+static t_cpu_time tftp_timer;
+static uint8_t tftp_retries;
+
+//! Identification of the next IP datagram.
+static uint16_t tftp_ip_id;
+
+//! Window: headers and data of the frame of each block, length of the block,
+//! and flag set while the MACB owns the frame. The block of number n is in the
+//! slot (n - 1) % tftp_window. The headers are padded to keep the slots
+//! word-aligned.
+#if (defined __GNUC__)
+__attribute__((__aligned__(4)))
+#elif (defined __ICCAVR32__)
+#pragma data_alignment = 4
+#endif
+static uint8_t tftp_headers[TFTP_SERVER_WINDOW_MAX][(TFTP_HEADERS_SIZE + 3) & ~3];
+#if (defined __GNUC__)
+__attribute__((__aligned__(4)))
+#elif (defined __ICCAVR32__)
+#pragma data_alignment = 4
+#endif
+static uint8_t tftp_blocks[TFTP_SERVER_WINDOW_MAX][TFTP_SERVER_BLKSIZE_MAX];
+static uint16_t tftp_block_len[TFTP_SERVER_WINDOW_MAX];
+static volatile bool tftp_block_busy[TFTP_SERVER_WINDOW_MAX];
+
+//! Control frame, and flag set while the MACB owns it.
+static uint8_t tftp_ctrl_frame[TFTP_CTRL_FRAME_SIZE];
+static volatile bool tftp_ctrl_busy;
+
+//! Frame received.
+static uint8_t tftp_rx_frame[TFTP_RX_FRAME_SIZE];
+
+static tftp_server_stats_t tftp_stats;
+
+
+static uint16_t tftp_get_be16(const uint8_t *buf)
+{
+  return ((uint16_t)buf[0] << 8) | buf[1];
+}
+
+
+static void tftp_put_be16(uint8_t *buf, uint16_t value)
+{
+  buf[0] = MSB(value);
+  buf[1] = LSB(value);
+}
+
+
+/*! \brief Computes the Internet checksum of a buffer.
+ *
+ * \return 0 for a buffer holding a valid checksum.
+ */
+static uint16_t tftp_ip_checksum(const uint8_t *buf, uint16_t len)
+{
+  uint32_t sum = 0;
+
+  for (; len > 1; buf += 2, len -= 2)
+    sum += tftp_get_be16(buf);
+  if (len)
+    sum += (uint16_t)buf[0] << 8;
+  while (sum >> 16)
+    sum = (sum & 0xFFFF) + (sum >> 16);
+  return ~sum;
+}
+
+
+/*! \brief Compares two strings, ignoring the case of the letters.
+ */
+static bool tftp_strieq(const char *str1, const char *str2)
+{
+  while (*str1 && *str2 && (*str1 | 0x20) == (*str2 | 0x20))
+    str1++, str2++;
+  return !*str1 && !*str2;
+}
+
+
+/*! \brief Converts a decimal string, up to the first non-digit character.
+ */
+static uint32_t tftp_atou(const char *str)
+{
+  uint32_t value = 0;
+
+  while (*str >= '0' && *str <= '9')
+    value = value * 10 + (*str++ - '0');
+  return value;
+}
+
+
+/*! \brief Gets a frame buffer back from the MACB.
+ */
+static void tftp_tx_done(void *busy)
+{
+  *(volatile bool *)busy = false;
+}
+
+
+/*! \brief Fills the Ethernet, IP and UDP headers of a frame.
+ *
+ * \param frame     Frame.
+ * \param udp_len   Length of the UDP payload.
+ * \param dst_mac   Ethernet address of the destination.
+ * \param dst_ip    IP address of the destination.
+ * \param src_port  UDP port of the server.
+ * \param dst_port  UDP port of the destination.
+ */
+static void tftp_build_headers(uint8_t *frame, uint16_t udp_len,
+                               const uint8_t *dst_mac, const uint8_t *dst_ip,
+                               uint16_t src_port, uint16_t dst_port)
+{
+  uint8_t *ip = &frame[TFTP_IP];
+  uint8_t *udp = &frame[TFTP_UDP];
+
+  memcpy(&frame[0], dst_mac, 6);
+  memcpy(&frame[6], tftp_mac, 6);
+  tftp_put_be16(&frame[12], TFTP_ETH_TYPE_IP);
+
+  ip[0] = 0x45;               // IPv4, header of 5 words
+  ip[1] = 0;
+  tftp_put_be16(&ip[2], TFTP_IP_HEADER_SIZE + TFTP_UDP_HEADER_SIZE + udp_len);
+  tftp_put_be16(&ip[4], tftp_ip_id++);
+  tftp_put_be16(&ip[6], 0x4000);  // don't fragment
+  ip[8] = 64;                 // TTL
+  ip[9] = 17;                 // UDP
+  tftp_put_be16(&ip[10], 0);
+  memcpy(&ip[12], tftp_ip, 4);
+  memcpy(&ip[16], dst_ip, 4);
+  tftp_put_be16(&ip[10], tftp_ip_checksum(ip, TFTP_IP_HEADER_SIZE));
+
+  tftp_put_be16(&udp[0], src_port);
+  tftp_put_be16(&udp[2], dst_port);
+  tftp_put_be16(&udp[4], TFTP_UDP_HEADER_SIZE + udp_len);
+  // No UDP checksum: the data blocks are sent without being read by the CPU.
+  tftp_put_be16(&udp[6], 0);
+}
+
+
+/*! \brief Sends the control frame.
+ */
+static void tftp_send_ctrl(uint16_t len)
+{
+  macb_packet_t segment;
+
+  segment.data = tftp_ctrl_frame;
+  segment.len = len;
+  tftp_ctrl_busy = true;
+  if (lMACBSendFrame(&AVR32_MACB, &segment, 1, tftp_tx_done, (void *)&tftp_ctrl_busy) != MACB_TX_SUCCESS)
+    tftp_ctrl_busy = false;
+}
+
+
+/*! \brief Sends an ERROR packet.
+ *
+ * Dropped if the control frame is busy: the peer asks again.
+ */
+static void tftp_send_error(const uint8_t *dst_mac, const uint8_t *dst_ip,
+                            uint16_t src_port, uint16_t dst_port,
+                            uint16_t code, const char *msg)
+{
+  uint8_t *tftp = &tftp_ctrl_frame[TFTP_MSG];
+  uint16_t len = strlen(msg) + 1;
+
+  if (tftp_ctrl_busy)
+    return;
+  tftp_put_be16(&tftp[0], TFTP_ERROR);
+  tftp_put_be16(&tftp[2], code);
+  memcpy(&tftp[4], msg, len);
+  tftp_build_headers(tftp_ctrl_frame, TFTP_HEADER_SIZE + len, dst_mac, dst_ip, src_port, dst_port);
+  tftp_send_ctrl(TFTP_MSG + TFTP_HEADER_SIZE + len);
+}
+
+
+/*! \brief Appends an option and its decimal value to an OACK packet.
+ */
+static uint8_t *tftp_put_option(uint8_t *buf, const char *name, uint32_t value)
+{
+  char digits[10];
+  uint8_t nb = 0;
+
+  strcpy((char *)buf, name);
+  buf += strlen(name) + 1;
+  do
+    digits[nb++] = '0' + value % 10;
+  while (value /= 10);
+  while (nb)
+    *buf++ = digits[--nb];
+  *buf++ = '\0';
+  return buf;
+}
+
+
+/*! \brief Sends the OACK packet of the transfer.
+ *
+ * Dropped if the control frame is busy: sent again on timeout.
+ */
+static void tftp_send_oack(void)
+{
+  uint8_t *tftp = &tftp_ctrl_frame[TFTP_MSG];
+  uint8_t *buf = &tftp[2];
+
+  if (tftp_ctrl_busy)
+    return;
+  tftp_put_be16(&tftp[0], TFTP_OACK);
+  if (tftp_options & TFTP_OPT_BLKSIZE)
+    buf = tftp_put_option(buf, "blksize", tftp_blksize);
+  if (tftp_options & TFTP_OPT_TSIZE)
+    buf = tftp_put_option(buf, "tsize", tftp_size);
+  if (tftp_options & TFTP_OPT_WINDOWSIZE)
+    buf = tftp_put_option(buf, "windowsize", tftp_window);
+  tftp_build_headers(tftp_ctrl_frame, buf - tftp, tftp_client_mac, tftp_client_ip, tftp_port, tftp_client_port);
+  tftp_send_ctrl(buf - tftp_ctrl_frame);
+}
+
+
+/*! \brief Starts the acknowledgment timeout.
+ */
+static void tftp_start_timer(void)
+{
+  cpu_set_timeout(cpu_ms_2_cy(TFTP_SERVER_TIMEOUT_MS, tftp_cpu_hz), &tftp_timer);
+}
+
+
+/*! \brief Ends the transfer in progress, closing its file.
+ *
+ * The transfer navigator shall be selected.
+ */
+static void tftp_end(bool b_done)
+{
+  if (tftp_state == TFTP_IDLE)
+    return;
+  file_close();
+  tftp_state = TFTP_IDLE;
+  if (b_done)
+    tftp_stats.transfers_done++;
+  else
+    tftp_stats.transfers_failed++;
+}
+
+
+/*! \brief Sends a block of the window, reading it from the file the first time.
+ *
+ * \return \c false if the block can not be sent now.
+ */
+static bool tftp_send_block(uint32_t block)
+{
+  uint8_t slot = (block - 1) % tftp_window;
+  uint8_t *headers = tftp_headers[slot];
+  macb_packet_t segments[2];
+  uint16_t len;
+
+  if (tftp_block_busy[slot])
+    return false;
+
+  if (block > tftp_read)
+  {
+    // The FAT reads the block straight into the frame.
+    len = (block < tftp_nb_blocks) ? tftp_blksize : tftp_size - (tftp_nb_blocks - 1) * tftp_blksize;
+    if (len && file_read_buf(tftp_blocks[slot], len) != len)
+    {
+      tftp_send_error(tftp_client_mac, tftp_client_ip, tftp_port, tftp_client_port,
+                      TFTP_ERR_UNDEFINED, "Read error");
+      tftp_end(false);
+      return false;
+    }
+    tftp_block_len[slot] = len;
+    tftp_read = block;
+  }
+  else
+    tftp_stats.blocks_resent++;
+
+  len = tftp_block_len[slot];
+  tftp_put_be16(&headers[TFTP_MSG], TFTP_DATA);
+  tftp_put_be16(&headers[TFTP_MSG + 2], (uint16_t)block);
+  tftp_build_headers(headers, TFTP_HEADER_SIZE + len, tftp_client_mac, tftp_client_ip, tftp_port, tftp_client_port);
+  segments[0].data = headers;
+  segments[0].len = TFTP_HEADERS_SIZE;
+  segments[1].data = tftp_blocks[slot];
+  segments[1].len = len;
+
+  tftp_block_busy[slot] = true;
+  if (lMACBSendFrame(&AVR32_MACB, segments, (len) ? 2 : 1, tftp_tx_done, (void *)&tftp_block_busy[slot]) != MACB_TX_SUCCESS)
+  {
+    tftp_block_busy[slot] = false;
+    return false;
+  }
+  tftp_stats.blocks_sent++;
+  return true;
+}
+
+
+/*! \brief Sends the blocks of the window not sent yet.
+ */
+static void tftp_send_window(void)
+{
+  while (tftp_state == TFTP_SENDING &&
+         tftp_next <= tftp_nb_blocks && tftp_next <= tftp_acked + tftp_window)
+  {
+    if (!tftp_send_block(tftp_next))
+      return;
+    tftp_next++;
+  }
+}
+
+
+/*! \brief Handles an ACK packet of the client.
+ */
+static void tftp_ack(uint16_t block16)
+{
+  uint32_t block;
+
+  if (tftp_state == TFTP_OACK_SENT)
+  {
+    if (block16 != 0)
+      return;
+    tftp_state = TFTP_SENDING;
+  }
+  else
+  {
+    // Extend the block number from the last one acknowledged.
+    block = tftp_acked + (uint16_t)(block16 - (uint16_t)tftp_acked);
+    if (block <= tftp_acked || block >= tftp_next)
+      return;
+    tftp_stats.bytes_sent += (block - tftp_acked) * tftp_blksize;
+    tftp_acked = block;
+    if (tftp_acked == tftp_nb_blocks)
+    {
+      tftp_stats.bytes_sent -= tftp_nb_blocks * tftp_blksize - tftp_size;
+      tftp_end(true);
+      return;
+    }
+    // A block is missing: go on from the first one (RFC 7440).
+    tftp_next = tftp_acked + 1;
+  }
+  tftp_retries = 0;
+  tftp_start_timer();
+}
+
+
+/*! \brief Handles the acknowledgment timeout.
+ */
+static void tftp_timeout(void)
+{
+  if (++tftp_retries > TFTP_SERVER_RETRIES)
+  {
+    tftp_end(false);
+    return;
+  }
+  if (tftp_state == TFTP_OACK_SENT)
+    tftp_send_oack();
+  else
+    tftp_next = tftp_acked + 1;
+  tftp_start_timer();
+}
+
+
+/*! \brief Selects the file of a request.
+ *
+ * The transfer navigator starts from the current directory of the explorer.
+ */
+static bool tftp_setcwd(const char *path)
+{
+  nav_select(0);
+  nav_copy(FS_NAV_ID_TFTP);
+  nav_select(FS_NAV_ID_TFTP);
+  if (strlen(path) >= TFTP_SERVER_PATH_SIZE)
+  {
+    fs_g_status = FS_ERR_NAME_INCORRECT;
+    return false;
+  }
+  return nav_setcwd((FS_STRING)path, true, false);
+}
+
+
+/*! \brief Handles a packet sent to the server port.
+ */
+static void tftp_request(const uint8_t *frame, const uint8_t *ip, uint16_t port,
+                         const uint8_t *msg, uint16_t len)
+{
+  const char *path, *mode, *name, *value, *end;
+  uint32_t size;
+
+  if (len < 2 || msg[len - 1] != '\0')
+  {
+    tftp_stats.frames_dropped++;
+    return;
+  }
+  if (tftp_get_be16(msg) == TFTP_WRQ)
+  {
+    tftp_send_error(&frame[6], &ip[12], TFTP_SERVER_PORT, port, TFTP_ERR_ACCESS, "Read only");
+    return;
+  }
+  if (tftp_get_be16(msg) != TFTP_RRQ)
+  {
+    tftp_send_error(&frame[6], &ip[12], TFTP_SERVER_PORT, port, TFTP_ERR_ILLEGAL_OP, "Illegal operation");
+    return;
+  }
+  if (tftp_state != TFTP_IDLE)
+  {
+    // The client sends its request again while the OACK is lost.
+    if (!memcmp(&ip[12], tftp_client_ip, 4) && port == tftp_client_port)
+      return;
+    tftp_send_error(&frame[6], &ip[12], TFTP_SERVER_PORT, port, TFTP_ERR_UNDEFINED, "Busy");
+    return;
+  }
+
+  end = (const char *)&msg[len];
+  path = (const char *)&msg[2];
+  mode = path + strlen(path) + 1;
+  if (mode >= end || !(tftp_strieq(mode, "octet") || tftp_strieq(mode, "netascii")))
+  {
+    tftp_send_error(&frame[6], &ip[12], TFTP_SERVER_PORT, port, TFTP_ERR_ILLEGAL_OP, "Mode not supported");
+    return;
+  }
+
+  // Options: the unknown ones are ignored.
+  tftp_options = 0;
+  tftp_blksize = TFTP_BLKSIZE_DEFAULT;
+  tftp_window = 1;
+  for (name = mode + strlen(mode) + 1; name < end; name = value + strlen(value) + 1)
+  {
+    value = name + strlen(name) + 1;
+    if (value >= end)
+      break;
+    if (tftp_strieq(name, "blksize") && (size = tftp_atou(value)) >= 8)
+    {
+      tftp_options |= TFTP_OPT_BLKSIZE;
+      tftp_blksize = min(size, TFTP_SERVER_BLKSIZE_MAX);
+    }
+    else if (tftp_strieq(name, "tsize"))
+      tftp_options |= TFTP_OPT_TSIZE;
+    else if (tftp_strieq(name, "windowsize") && (size = tftp_atou(value)) >= 1)
+    {
+      tftp_options |= TFTP_OPT_WINDOWSIZE;
+      tftp_window = min(size, TFTP_SERVER_WINDOW_MAX);
+    }
+  }
+
+  if (!tftp_setcwd(path) || nav_file_isdir() || !file_open(FOPEN_MODE_R))
+  {
+    tftp_send_error(&frame[6], &ip[12], TFTP_SERVER_PORT, port, TFTP_ERR_NOT_FOUND, "File not found");
+    return;
+  }
+
+  memcpy(tftp_client_mac, &frame[6], 6);
+  memcpy(tftp_client_ip, &ip[12], 4);
+  tftp_client_port = port;
+  tftp_port = 49152 + (tftp_tid++ & 0x3FFF);
+  tftp_size = nav_file_lgt();
+  tftp_nb_blocks = tftp_size / tftp_blksize + 1;
+  tftp_acked = 0;
+  tftp_next = 1;
+  tftp_read = 0;
+  tftp_retries = 0;
+  tftp_stats.requests++;
+
+  if (tftp_options)
+  {
+    tftp_state = TFTP_OACK_SENT;
+    tftp_send_oack();
+  }
+  else
+    tftp_state = TFTP_SENDING;
+  tftp_start_timer();
+}
+
+
+/*! \brief Answers an ARP request for the address of the node.
+ */
+static void tftp_arp(const uint8_t *frame, uint16_t len)
+{
+  const uint8_t *arp = &frame[TFTP_ETH_HEADER_SIZE];
+  uint8_t *reply = &tftp_ctrl_frame[TFTP_ETH_HEADER_SIZE];
+
+  if (len < TFTP_ETH_HEADER_SIZE + TFTP_ARP_SIZE ||
+      tftp_get_be16(&arp[0]) != 1 || tftp_get_be16(&arp[2]) != TFTP_ETH_TYPE_IP ||
+      arp[4] != 6 || arp[5] != 4 || tftp_get_be16(&arp[6]) != 1 ||
+      memcmp(&arp[24], tftp_ip, 4))
+  {
+    tftp_stats.frames_dropped++;
+    return;
+  }
+  if (tftp_ctrl_busy)
+    return;
+
+  memcpy(&tftp_ctrl_frame[0], &arp[8], 6);
+  memcpy(&tftp_ctrl_frame[6], tftp_mac, 6);
+  tftp_put_be16(&tftp_ctrl_frame[12], TFTP_ETH_TYPE_ARP);
+  memcpy(&reply[0], &arp[0], 6);
+  tftp_put_be16(&reply[6], 2);          // reply
+  memcpy(&reply[8], tftp_mac, 6);
+  memcpy(&reply[14], tftp_ip, 4);
+  memcpy(&reply[18], &arp[8], 10);      // address of the requester
+  tftp_send_ctrl(TFTP_ETH_HEADER_SIZE + TFTP_ARP_SIZE);
+}
+
+
+/*! \brief Handles a frame received.
+ */
+static void tftp_frame(const uint8_t *frame, uint16_t len)
+{
+  const uint8_t *ip = &frame[TFTP_IP];
+  const uint8_t *udp, *msg;
+  uint16_t ip_header_len, ip_len, udp_len, src_port, dst_port;
+
+  if (len >= TFTP_ETH_HEADER_SIZE && tftp_get_be16(&frame[12]) == TFTP_ETH_TYPE_ARP)
+  {
+    tftp_arp(frame, len);
+    return;
+  }
+
+  // Unfragmented UDP datagrams sent to the node.
+  if (len < TFTP_IP + TFTP_IP_HEADER_SIZE || tftp_get_be16(&frame[12]) != TFTP_ETH_TYPE_IP)
+    goto drop;
+  ip_header_len = (ip[0] & 0x0F) * 4;
+  ip_len = tftp_get_be16(&ip[2]);
+  if ((ip[0] >> 4) != 4 || ip_header_len < TFTP_IP_HEADER_SIZE ||
+      ip_len < ip_header_len + TFTP_UDP_HEADER_SIZE || TFTP_IP + ip_len > len ||
+      (tftp_get_be16(&ip[6]) & 0x3FFF) || ip[9] != 17 ||
+      memcmp(&ip[16], tftp_ip, 4) || tftp_ip_checksum(ip, ip_header_len))
+    goto drop;
+  udp = &ip[ip_header_len];
+  udp_len = tftp_get_be16(&udp[4]);
+  if (udp_len < TFTP_UDP_HEADER_SIZE || udp_len > ip_len - ip_header_len)
+    goto drop;
+  src_port = tftp_get_be16(&udp[0]);
+  dst_port = tftp_get_be16(&udp[2]);
+  msg = &udp[TFTP_UDP_HEADER_SIZE];
+  len = udp_len - TFTP_UDP_HEADER_SIZE;
+
+  if (dst_port == TFTP_SERVER_PORT)
+  {
+    tftp_request(frame, ip, src_port, msg, len);
+    return;
+  }
+  if (tftp_state == TFTP_IDLE || dst_port != tftp_port || len < TFTP_HEADER_SIZE)
+    goto drop;
+  if (memcmp(&ip[12], tftp_client_ip, 4) || src_port != tftp_client_port)
+  {
+    tftp_send_error(&frame[6], &ip[12], dst_port, src_port, TFTP_ERR_UNKNOWN_TID, "Unknown transfer ID");
+    return;
+  }
+  switch (tftp_get_be16(msg))
+  {
+  case TFTP_ACK:
+    tftp_ack(tftp_get_be16(&msg[2]));
+    break;
+  case TFTP_ERROR:
+    // The client gives up (e.g. the OACK does not suit it).
+    tftp_end(false);
+    break;
+  default:
+    tftp_send_error(tftp_client_mac, tftp_client_ip, tftp_port, tftp_client_port,
+                    TFTP_ERR_ILLEGAL_OP, "Illegal operation");
+    tftp_end(false);
+    break;
+  }
+  return;
+
+drop:
+  tftp_stats.frames_dropped++;
+}
+
+
+/*! \brief Gathers a frame received from the MACB and handles it.
+ */
+static void tftp_rx_handler(macb_rx_frame_t *frame)
+{
+  uint16_t len = 0, nb;
+  unsigned int i;
+  bool b_truncated = frame->len > sizeof(tftp_rx_frame);
+
+  // The requests and acknowledgments are small: copy them in one piece.
+  for (i = 0; i < frame->nb_segments && len < sizeof(tftp_rx_frame); i++)
+  {
+    nb = min(frame->segment[i].len, sizeof(tftp_rx_frame) - len);
+    memcpy(&tftp_rx_frame[len], frame->segment[i].data, nb);
+    len += nb;
+  }
+  vMACBRxRelease(frame);
+
+  if (b_truncated)
+    tftp_stats.frames_dropped++;
+  else
+    tftp_frame(tftp_rx_frame, len);
+}
+
+
+void tftp_server_init(unsigned long cpu_hz)
+{
+  uint8_t slot;
+
+  tftp_cpu_hz = cpu_hz;
+  tftp_state = TFTP_IDLE;
+  tftp_ctrl_busy = false;
+  for (slot = 0; slot < TFTP_SERVER_WINDOW_MAX; slot++)
+    tftp_block_busy[slot] = false;
+  memset(&tftp_stats, 0, sizeof(tftp_stats));
+}
+
+
+void tftp_server_task(void)
+{
+  uint8_t nav;
+
+  // Leave the explorer navigator alone.
+  nav = nav_get();
+  nav_select(FS_NAV_ID_TFTP);
+
+  uiMACBRxPoll(TFTP_SERVER_RX_BUDGET, tftp_rx_handler);
+
+  if (tftp_state != TFTP_IDLE && cpu_is_timeout(&tftp_timer))
+    tftp_timeout();
+  tftp_send_window();
+
+  nav_select(nav);
+}
+
+
+void tftp_server_abort(void)
+{
+  uint8_t nav;
+
+  if (tftp_state == TFTP_IDLE)
+    return;
+  nav = nav_get();
+  nav_select(FS_NAV_ID_TFTP);
+  tftp_end(false);
+  nav_select(nav);
+}
+
+
+bool tftp_server_is_busy(void)
+{
+  return tftp_state != TFTP_IDLE;
+}
+
+
+void tftp_server_get_stats(tftp_server_stats_t *stats)
+{
+  *stats = tftp_stats;
+}
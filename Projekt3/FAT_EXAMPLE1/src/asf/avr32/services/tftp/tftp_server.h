@@ -0,0 +1,185 @@
+/*****************************************************************************
+ *
+ * \file
+ *
+ * \brief TFTP read server streaming the FAT files over the MACB.
+ *
+ * Copyright (c) 2009 Atmel Corporation. All rights reserved.
+ *
+ * \asf_license_start
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. The name of Atmel may not be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * 4. This software may only be redistributed and used in connection with an
+ *    Atmel microcontroller product.
+ *
+ * THIS SOFTWARE IS PROVIDED BY ATMEL "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT ARE
+ * EXPRESSLY AND SPECIFICALLY DISCLAIMED. IN NO EVENT SHALL ATMEL BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * \asf_license_stop
+ *
+ ******************************************************************************/
+
+
+
+
+#ifndef _TFTP_SERVER_H_
+#define _TFTP_SERVER_H_
+
+/**
+ * \defgroup group_avr32_services_tftp_server TFTP read server over the MACB
+ *
+ * Minimal UDP/IPv4 node answering ARP requests and TFTP read requests
+ * (RFC 1350), with the blksize (RFC 2348), tsize (RFC 2349) and windowsize
+ * (RFC 7440) options, so that the files of the FAT drives (e.g. the logs) can
+ * be fetched with a stock TFTP client:
+ * \code
+ * tftp -m binary 192.168.0.2 -c get log.txt
+ * curl -o log.txt tftp://192.168.0.2/log.txt --tftp-blksize 1024
+ * \endcode
+ *
+ * The node uses the Ethernet and IP addresses of conf_eth.h. Write requests
+ * are refused, and one read request is served at a time.
+ *
+ * The data blocks are never copied: each block of a window is read by the FAT
+ * into its own buffer, and the MACB sends the frame from two segments, the
+ * Ethernet, IP, UDP and TFTP headers and the block buffer (the UDP checksum
+ * is not used). The blocks of a window are kept until acknowledged, so
+ * sending them again needs no file access.
+ *
+ * The paths are relative to the current directory of the explorer navigator
+ * (ID 0) when the request is received. The transfer uses its own navigator
+ * (FS_NAV_ID_TFTP), so the explorer is left alone.
+ *
+ * \note The service runs from the main loop (\ref tftp_server_task), once the
+ *       MACB is initialized, and must not be called from interrupt handlers.
+ *       It receives the frames with the zero-copy MACB interface, so it shall
+ *       be the only user of the MACB. The FAT module shall not be used by a
+ *       USB MSC host meanwhile: see \ref tftp_server_abort.
+ *
+ * \{
+ */
+
+#include "compiler.h"
+
+
+//! Largest block size granted to the clients (at most 1468 for a 1500-byte
+//! Ethernet MTU); a multiple of the sector size lets the FAT read whole
+//! sectors directly into the block buffers.
+#ifndef TFTP_SERVER_BLKSIZE_MAX
+#define TFTP_SERVER_BLKSIZE_MAX     1024
+#endif
+
+//! Largest window granted to the clients, in blocks.
+#ifndef TFTP_SERVER_WINDOW_MAX
+#define TFTP_SERVER_WINDOW_MAX      4
+#endif
+
+//! Time to wait for an acknowledgment before sending the window again, in ms.
+#ifndef TFTP_SERVER_TIMEOUT_MS
+#define TFTP_SERVER_TIMEOUT_MS      1000
+#endif
+
+//! Number of times a window is sent again before the transfer is dropped.
+#ifndef TFTP_SERVER_RETRIES
+#define TFTP_SERVER_RETRIES         5
+#endif
+
+//! Maximal length of a path, including the NUL character.
+#ifndef TFTP_SERVER_PATH_SIZE
+#define TFTP_SERVER_PATH_SIZE       64
+#endif
+
+//! Maximal number of frames received per call to \ref tftp_server_task.
+#ifndef TFTP_SERVER_RX_BUDGET
+#define TFTP_SERVER_RX_BUDGET       4
+#endif
+
+//! Navigator used by the transfers.
+#ifndef FS_NAV_ID_TFTP
+#define FS_NAV_ID_TFTP              3
+#endif
+
+//! UDP port of the server.
+#define TFTP_SERVER_PORT            69
+
+//! Transfer statistics.
+typedef struct
+{
+  //! Read requests accepted.
+  U32 requests;
+
+  //! Transfers acknowledged up to the last block.
+  U32 transfers_done;
+
+  //! Transfers dropped (timeout, error from the client, abort).
+  U32 transfers_failed;
+
+  //! Blocks sent, including the ones sent again.
+  U32 blocks_sent;
+
+  //! Blocks sent again after a timeout or a partial acknowledgment.
+  U32 blocks_resent;
+
+  //! File bytes acknowledged by the clients.
+  U32 bytes_sent;
+
+  //! Frames received and dropped (not for this node, malformed).
+  U32 frames_dropped;
+} tftp_server_stats_t;
+
+
+/*! \brief Initializes the service.
+ *
+ * \param cpu_hz  CPU frequency, used for the timeouts.
+ */
+extern void tftp_server_init(unsigned long cpu_hz);
+
+/*! \brief Receives the frames and goes on with the transfer in progress.
+ *
+ * Sends at most one window per call, so the main loop keeps running during a
+ * transfer.
+ */
+extern void tftp_server_task(void);
+
+/*! \brief Ends the transfer in progress and closes its file.
+ *
+ * Shall be called before the FAT module is left (e.g. \ref nav_exit).
+ */
+extern void tftp_server_abort(void);
+
+/*! \brief Tells if a transfer is in progress.
+ */
+extern bool tftp_server_is_busy(void);
+
+/*! \brief Gets the transfer statistics.
+ *
+ * \param stats Pointer to the location where to store the statistics.
+ */
+extern void tftp_server_get_stats(tftp_server_stats_t *stats);
+
+/**
+ * \}
+ */
+
+#endif  // _TFTP_SERVER_H_
@@ -0,0 +1,166 @@
+/*****************************************************************************
+ *
+ * \file
+ *
+ * \brief Cycle-accurate enter/exit trace of the storage and driver hot paths.
+ *
+ * Copyright (c) 2009 Atmel Corporation. All rights reserved.
+ *
+ * \asf_license_start
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. The name of Atmel may not be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * 4. This software may only be redistributed and used in connection with an
+ *    Atmel microcontroller product.
+ *
+ * THIS SOFTWARE IS PROVIDED BY ATMEL "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT ARE
+ * EXPRESSLY AND SPECIFICALLY DISCLAIMED. IN NO EVENT SHALL ATMEL BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * \asf_license_stop
+ *
+ ******************************************************************************/
+
+
+
+
+#include "trace.h"
+
+
+#if TRACE_ENABLED == true
+
+#if TRACE_RING_SIZE & (TRACE_RING_SIZE - 1)
+#  error TRACE_RING_SIZE must be a power of 2.
+#endif
+
+
+trace_event_t trace_ring[TRACE_RING_SIZE];
+uint32_t trace_count;
+
+//! Probe names, in the order of trace_probe_t.
+static const char *const trace_probe_names[TRACE_NB_PROBES] =
+{
+  "file_write_buf",
+  "fat_cluster_list",
+  "fat_cache_read_sector",
+  "memory_2_ram",
+  "ram_2_memory",
+  "spi_transfer"
+};
+
+
+/*! \brief Writes a number in hexadecimal, on 8 digits.
+ *
+ * \return Pointer to the character following the number.
+ */
+static char *trace_put_hex(char *p, uint32_t value)
+{
+  int shift;
+
+  for (shift = 28; shift >= 0; shift -= 4)
+    *p++ = "0123456789ABCDEF"[(value >> shift) & 0xF];
+  return p;
+}
+
+
+/*! \brief Writes a number in decimal.
+ *
+ * \return Pointer to the character following the number.
+ */
+static char *trace_put_dec(char *p, uint32_t value)
+{
+  char digits[10];
+  int n = 0;
+
+  do
+  {
+    digits[n++] = '0' + value % 10;
+    value /= 10;
+  } while (value);
+  while (n)
+    *p++ = digits[--n];
+  return p;
+}
+
+
+/*! \brief Writes a string.
+ *
+ * \return Pointer to the character following the string.
+ */
+static char *trace_put_str(char *p, const char *str)
+{
+  while (*str)
+    *p++ = *str++;
+  return p;
+}
+
+
+void trace_reset(void)
+{
+#if defined(__AVR32__) || defined(__ICCAVR32__)
+  bool global_interrupt_enabled = Is_global_interrupt_enabled();
+
+  if (global_interrupt_enabled) Disable_global_interrupt();
+#endif
+  trace_count = 0;
+#if defined(__AVR32__) || defined(__ICCAVR32__)
+  if (global_interrupt_enabled) Enable_global_interrupt();
+#endif
+}
+
+
+void trace_dump(trace_putline_t putline)
+{
+  char line[48];
+  char *p;
+  uint32_t count = trace_count;
+  uint32_t first = (count > TRACE_RING_SIZE) ? count - TRACE_RING_SIZE : 0;
+  trace_event_t event;
+  uint32_t i;
+
+  p = trace_put_str(line, "# trace ");
+  p = trace_put_dec(p, count);
+  *p++ = ' ';
+  p = trace_put_dec(p, first);
+  p = trace_put_str(p, "\r\n");
+  *p = '\0';
+  putline(line);
+
+  for (i = first; i != count; i++)
+  {
+    event = trace_ring[i & (TRACE_RING_SIZE - 1)];
+    // Skip the event if the probes wrapped around the ring meanwhile.
+    if (trace_count - i > TRACE_RING_SIZE)
+      continue;
+
+    p = trace_put_hex(line, event.timestamp);
+    *p++ = ' ';
+    *p++ = (event.exit) ? 'X' : 'E';
+    *p++ = ' ';
+    p = trace_put_str(p, (event.probe < TRACE_NB_PROBES) ? trace_probe_names[event.probe] : "?");
+    p = trace_put_str(p, "\r\n");
+    *p = '\0';
+    putline(line);
+  }
+}
+
+#endif  // TRACE_ENABLED == true
@@ -0,0 +1,204 @@
+/*****************************************************************************
+ *
+ * \file
+ *
+ * \brief Cycle-accurate enter/exit trace of the storage and driver hot paths.
+ *
+ * Copyright (c) 2009 Atmel Corporation. All rights reserved.
+ *
+ * \asf_license_start
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. The name of Atmel may not be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * 4. This software may only be redistributed and used in connection with an
+ *    Atmel microcontroller product.
+ *
+ * THIS SOFTWARE IS PROVIDED BY ATMEL "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT ARE
+ * EXPRESSLY AND SPECIFICALLY DISCLAIMED. IN NO EVENT SHALL ATMEL BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * \asf_license_stop
+ *
+ ******************************************************************************/
+
+
+
+
+#ifndef _TRACE_H_
+#define _TRACE_H_
+
+/**
+ * \defgroup group_avr32_services_trace Enter/exit trace of the hot paths
+ *
+ * Probes placed in the storage and driver hot paths record enter and exit
+ * events, timestamped with the cycle counter (COUNT register), in a RAM ring
+ * keeping the last TRACE_RING_SIZE events. The ring is dumped as text by
+ * \ref trace_dump, one event per line:
+ * \code
+ * # trace <events recorded> <events lost>
+ * <timestamp, 8 hex digits> E|X <probe name>
+ * \endcode
+ * from which a host script can rebuild the call tree (per-probe call counts,
+ * inclusive and exclusive cycles, folded stacks for flame graphs). The
+ * timestamps wrap at 2^32. The events lost were overwritten before the dump;
+ * the ones overwritten during the dump are skipped.
+ *
+ * The probes are compiled in only if TRACE_ENABLED is true (conf_trace.h or
+ * the compiler command line); otherwise they expand to nothing.
+ *
+ * When compiled for the host instead of the AVR32, the timestamps come from
+ * clock_gettime(CLOCK_MONOTONIC), in ns.
+ *
+ * \{
+ */
+
+#include "conf_trace.h"
+
+#if defined(__AVR32__) || defined(__ICCAVR32__)
+#  include "compiler.h"
+#  include "cycle_counter.h"
+#else
+#  include <stdbool.h>
+#  include <stdint.h>
+#  include <time.h>
+#endif
+
+
+//! Probes: keep their names in trace.c in the same order.
+typedef enum
+{
+  TRACE_FILE_WRITE_BUF,
+  TRACE_FAT_CLUSTER_LIST,
+  TRACE_FAT_CACHE_READ_SECTOR,
+  TRACE_MEMORY_2_RAM,
+  TRACE_RAM_2_MEMORY,
+  TRACE_SPI_TRANSFER,
+  TRACE_NB_PROBES
+} trace_probe_t;
+
+//! Trace event.
+typedef struct
+{
+  uint32_t timestamp;
+  uint16_t probe;
+  uint16_t exit;
+} trace_event_t;
+
+//! Output of \ref trace_dump: prints a NUL-terminated line ending with CR LF.
+typedef void (*trace_putline_t)(const char *line);
+
+
+#if TRACE_ENABLED == true
+
+//! Events ring, and number of events recorded since the last reset.
+extern trace_event_t trace_ring[TRACE_RING_SIZE];
+extern uint32_t trace_count;
+
+/*! \brief Returns the current timestamp.
+ */
+static inline uint32_t trace_timestamp(void)
+{
+#if defined(__AVR32__) || defined(__ICCAVR32__)
+  return Get_sys_count();
+#else
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint32_t)ts.tv_sec * 1000000000UL + ts.tv_nsec;
+#endif
+}
+
+/*! \brief Records an event.
+ *
+ * \param probe Probe.
+ * \param exit  \c false for an enter event, \c true for an exit event.
+ */
+static inline void trace_record(trace_probe_t probe, bool exit)
+{
+  uint32_t timestamp = trace_timestamp();
+  trace_event_t *event;
+#if defined(__AVR32__) || defined(__ICCAVR32__)
+  bool global_interrupt_enabled = Is_global_interrupt_enabled();
+
+  if (global_interrupt_enabled) Disable_global_interrupt();
+#endif
+  event = &trace_ring[trace_count++ & (TRACE_RING_SIZE - 1)];
+  event->timestamp = timestamp;
+  event->probe = probe;
+  event->exit = exit;
+#if defined(__AVR32__) || defined(__ICCAVR32__)
+  if (global_interrupt_enabled) Enable_global_interrupt();
+#endif
+}
+
+/*! \brief Records the exit of a scope entered with \ref Trace_function.
+ */
+static inline void trace_scope_exit(const trace_probe_t *probe)
+{
+  trace_record(*probe, true);
+}
+
+//! Records an enter event.
+#define Trace_enter(probe)      trace_record((probe), false)
+
+//! Records an exit event.
+#define Trace_exit(probe)       trace_record((probe), true)
+
+/*! \brief Records an enter event, and the exit event when the enclosing
+ *         function returns, whatever the return statement.
+ *
+ * To be placed after the declarations of a function. With compilers other
+ * than GCC, only the enter event is recorded: use \ref Trace_exit.
+ */
+#if defined(__GNUC__)
+#define Trace_function(probe) \
+  const trace_probe_t trace_scope __attribute__((__cleanup__(trace_scope_exit))) = (probe); \
+  trace_record(trace_scope, false)
+#else
+#define Trace_function(probe)   trace_record((probe), false)
+#endif
+
+/*! \brief Clears the events ring.
+ */
+extern void trace_reset(void);
+
+/*! \brief Prints the events of the ring, oldest first.
+ *
+ * The events recorded during the dump are not printed.
+ *
+ * \param putline Function printing a line.
+ */
+extern void trace_dump(trace_putline_t putline);
+
+#else
+
+#define Trace_enter(probe)
+#define Trace_exit(probe)
+#define Trace_function(probe)
+
+#endif  // TRACE_ENABLED == true
+
+/**
+ * \}
+ */
+
+#endif  // _TRACE_H_
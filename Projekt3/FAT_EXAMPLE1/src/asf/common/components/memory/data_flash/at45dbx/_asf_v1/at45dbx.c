@@ -50,13 +50,38 @@
 
 #if AT45DBX_MEM == ENABLE
 
+#include <string.h>
 #include "compiler.h"
 #include "board.h"
 #include "gpio.h"
 #include "spi.h"
+#include "cycle_counter.h"
 #include "conf_at45dbx.h"
 #include "at45dbx.h"
 
+//! Transfers the sectors read to RAM with the PDCA (may be overridden in conf_at45dbx.h).
+#ifndef AT45DBX_PDCA_READ
+  #define AT45DBX_PDCA_READ     false
+#endif
+
+#if AT45DBX_PDCA_READ == true
+#include "pdca.h"
+#endif
+
+//! Number of status reads between two calls of the busy callback (may be overridden in conf_at45dbx.h).
+#ifndef AT45DBX_BUSY_POLLS
+  #define AT45DBX_BUSY_POLLS    16
+#endif
+
+//! Queues the page programs to the SPI bus scheduler (may be overridden in conf_at45dbx.h).
+#ifndef AT45DBX_SPI_BUS
+  #define AT45DBX_SPI_BUS       false
+#endif
+
+#if AT45DBX_SPI_BUS == true
+#include "spi_bus.h"
+#endif
+
 
 #if AT45DBX_MEM_CNT > 4
   #error AT45DBX_MEM_CNT must not exceed 4
@@ -185,6 +210,12 @@
 //! Bit-mask for byte position within sector in \ref gl_ptr_mem.
 #define AT45DBX_MSK_PTR_SECTOR            ((1 << AT45DBX_SECTOR_BITS) - 1)
 
+//! Number of pages in a block (unit of the Block Erase command).
+#define AT45DBX_BLOCK_PAGES               8
+
+//! Bit-mask for byte position within a DF in \ref gl_ptr_mem.
+#define AT45DBX_MSK_PTR_DF                ((1 << AT45DBX_MEM_SIZE) - 1)
+
 
 /*! \brief Sends a dummy byte through SPI.
  */
@@ -200,6 +231,52 @@ static U32 gl_ptr_mem;
 //! Sector buffer.
 static U8 sector_buf[AT45DBX_SECTOR_SIZE];
 
+//! SRAM buffer filled by the write functions (0 for Buffer 1, 1 for Buffer 2).
+static U8 at45dbx_wr_buf;
+
+//! Boolean indicating whether the filled SRAM buffer holds data not yet programmed.
+static bool at45dbx_wr_pending;
+
+//! Byte address of the page the filled SRAM buffer belongs to.
+static U32 at45dbx_wr_page;
+
+//! Number of sectors still announced by the current write session.
+static U32 at45dbx_wr_nb_sector;
+
+#if AT45DBX_PAGE_SIZE > AT45DBX_SECTOR_SIZE
+//! Bit-mask of the sectors of the filled SRAM buffer holding the page data
+//! (all set when the page has been transferred to the buffer).
+static U8 at45dbx_wr_valid;
+
+//! Byte address at which the current buffer write started.
+static U32 at45dbx_wr_start;
+
+//! Size of the chunks copied by \ref at45dbx_write_fill_page.
+#define AT45DBX_FILL_CHUNK_SIZE           64
+#endif
+
+//! Access statistics.
+static at45dbx_stats_t at45dbx_stats;
+
+//! Function called while waiting for the DF to be ready.
+static void (*at45dbx_busy_callback)(void);
+
+#if AT45DBX_SPI_BUS == true
+//! Page program queued to the SPI bus scheduler: transaction, command bytes
+//! and byte address of the page.
+static spi_bus_trans_t at45dbx_pr_trans;
+static U8 at45dbx_pr_cmd[4];
+static U32 at45dbx_pr_page;
+
+//! Boolean indicating whether the page program has not been sent yet.
+static bool at45dbx_pr_queued;
+
+static bool at45dbx_bus_busy(void);
+#endif
+
+//! Initialization options of the DF SPI channel.
+static spi_options_t at45dbx_spi_options;
+
 
 /*! \name Control Functions
  */
@@ -208,6 +285,34 @@ static U8 sector_buf[AT45DBX_SECTOR_SIZE];
 
 bool at45dbx_init(spi_options_t spiOptions, unsigned int pba_hz)
 {
+  // Keep the SPI options for the PBA clock changes.
+  at45dbx_spi_options = spiOptions;
+  if (!at45dbx_set_pba_hz(pba_hz)) return false;
+
+  // Memory ready.
+  at45dbx_busy = false;
+
+#if AT45DBX_SPI_BUS == true
+  {
+    U8 memidx;
+
+    // The page programs are put off by the scheduler while the DF is busy.
+    at45dbx_pr_queued = false;
+    for (memidx = 0; memidx < AT45DBX_MEM_CNT; memidx++)
+    {
+      if (!spi_bus_set_device(AT45DBX_SPI_FIRST_NPCS + memidx, at45dbx_bus_busy)) return false;
+    }
+  }
+#endif
+
+  return true;
+}
+
+
+bool at45dbx_set_pba_hz(unsigned int pba_hz)
+{
+  spi_options_t spiOptions = at45dbx_spi_options;
+
   // Setup SPI registers according to spiOptions.
   for (spiOptions.reg = AT45DBX_SPI_FIRST_NPCS;
        spiOptions.reg < AT45DBX_SPI_FIRST_NPCS + AT45DBX_MEM_CNT;
@@ -216,9 +321,6 @@ bool at45dbx_init(spi_options_t spiOptions, unsigned int pba_hz)
     if (spi_setupChipReg(AT45DBX_SPI, &spiOptions, pba_hz) != SPI_OK) return false;
   }
 
-  // Memory ready.
-  at45dbx_busy = false;
-
   return true;
 }
 
@@ -272,11 +374,73 @@ bool at45dbx_mem_check(void)
 }
 
 
+U16 at45dbx_get_page_sectors(void)
+{
+#if AT45DBX_PAGE_SIZE > AT45DBX_SECTOR_SIZE
+  return AT45DBX_PAGE_SIZE >> AT45DBX_SECTOR_BITS;
+#else
+  return 1;
+#endif
+}
+
+
+#if AT45DBX_SPI_BUS == true
+/*! \brief Tells the SPI bus scheduler whether the DF of the queued page
+ *         program is still busy.
+ */
+static bool at45dbx_bus_busy(void)
+{
+  U8 chip = AT45DBX_SPI_FIRST_NPCS + (at45dbx_pr_page >> AT45DBX_MEM_SIZE);
+  U16 status;
+
+  if (!at45dbx_busy) return false;
+
+  spi_selectChip(AT45DBX_SPI, chip);
+  spi_write(AT45DBX_SPI, AT45DBX_CMDC_RD_STATUS_REG);
+  spi_write_dummy();
+  spi_read(AT45DBX_SPI, &status);
+  spi_unselectChip(AT45DBX_SPI, chip);
+
+  if ((status & AT45DBX_MSK_BUSY) == AT45DBX_BUSY) return true;
+
+  // Memory ready.
+  at45dbx_busy = false;
+  return false;
+}
+
+
+/*! \brief Called by the SPI bus scheduler once the page program has been
+ *         sent: the DF programs the page.
+ */
+static void at45dbx_program_done(spi_bus_trans_t *trans)
+{
+  at45dbx_pr_queued = false;
+
+  // Memory busy.
+  at45dbx_busy = true;
+}
+
+
+/*! \brief Waits until the queued page program has been sent, before the DF is
+ *         accessed directly again.
+ */
+static void at45dbx_program_sync(void)
+{
+  if (at45dbx_pr_queued) spi_bus_wait(&at45dbx_pr_trans);
+}
+#else
+#define at45dbx_program_sync()
+#endif
+
+
 /*! \brief Waits until the DF is ready.
  */
 static void at45dbx_wait_ready(void)
 {
   U16 status;
+  U16 polls = 0;
+
+  at45dbx_program_sync();
 
   // Select the DF memory gl_ptr_mem points to.
   at45dbx_chipselect_df(gl_ptr_mem >> AT45DBX_MEM_SIZE, true);
@@ -290,17 +454,208 @@ static void at45dbx_wait_ready(void)
     // Send a dummy byte to read the status register.
     spi_write_dummy();
     spi_read(AT45DBX_SPI, &status);
+
+    // Release the SPI bus to the other devices while the DF is busy.
+    if (at45dbx_busy_callback && (status & AT45DBX_MSK_BUSY) == AT45DBX_BUSY &&
+        !(++polls % AT45DBX_BUSY_POLLS))
+    {
+      at45dbx_chipselect_df(gl_ptr_mem >> AT45DBX_MEM_SIZE, false);
+      at45dbx_busy_callback();
+      at45dbx_chipselect_df(gl_ptr_mem >> AT45DBX_MEM_SIZE, true);
+      spi_write(AT45DBX_SPI, AT45DBX_CMDC_RD_STATUS_REG);
+    }
   } while ((status & AT45DBX_MSK_BUSY) == AT45DBX_BUSY);
 
   // Unselect the DF memory gl_ptr_mem points to.
   at45dbx_chipselect_df(gl_ptr_mem >> AT45DBX_MEM_SIZE, false);
 }
 
+/*! \brief Waits until the DF is ready before a write access and updates the
+ *         write statistics.
+ */
+static void at45dbx_write_wait_ready(void)
+{
+  U32 cycles;
+
+  at45dbx_program_sync();
+  if (!at45dbx_busy) return;
+
+  cycles = Get_sys_count();
+  at45dbx_wait_ready();
+  cycles = Get_sys_count() - cycles;
+  at45dbx_busy = false;
+
+  at45dbx_stats.busy_waits++;
+  at45dbx_stats.busy_wait_cycles += cycles;
+  if (cycles > at45dbx_stats.max_wait_cycles) at45dbx_stats.max_wait_cycles = cycles;
+}
+
+
+/*! \brief Sends a command addressing a whole page or block.
+ *
+ * \param cmd   Command opcode.
+ * \param page  Byte address of the page (or of the first page of the block).
+ */
+static void at45dbx_page_cmd(U8 cmd, U32 page)
+{
+  U32 addr;
+
+  // Select the DF memory page points to.
+  at45dbx_chipselect_df(page >> AT45DBX_MEM_SIZE, true);
+
+  spi_write(AT45DBX_SPI, cmd);
+
+  // Send the three address bytes, which comprise:
+  //  - (24 - (AT45DBX_PAGE_ADDR_BITS + AT45DBX_BYTE_ADDR_BITS)) reserved bits;
+  //  - then AT45DBX_PAGE_ADDR_BITS bits specifying the page in main memory;
+  //  - then AT45DBX_BYTE_ADDR_BITS don't care bits.
+  // NOTE: The bits of page above the AT45DBX_MEM_SIZE bits are useless for the local
+  // DF addressing. They are used for DF discrimination when there are several DFs.
+  addr = Rd_bitfield(page, AT45DBX_MSK_PTR_PAGE) << AT45DBX_BYTE_ADDR_BITS;
+  spi_write(AT45DBX_SPI, LSB2W(addr));
+  spi_write(AT45DBX_SPI, LSB1W(addr));
+  spi_write(AT45DBX_SPI, LSB0W(addr));
+
+  // Unselect the DF memory page points to: the operation starts.
+  at45dbx_chipselect_df(page >> AT45DBX_MEM_SIZE, false);
+}
+
+
+#if AT45DBX_PAGE_SIZE > AT45DBX_SECTOR_SIZE
+/*! \brief Copies the sectors of the page not written in the filled SRAM
+ *         buffer from the main memory, when the page has not been transferred
+ *         to the buffer (e.g. a write session ended before the announced
+ *         sectors were all written).
+ */
+static void at45dbx_write_fill_page(void)
+{
+  U8 chunk[AT45DBX_FILL_CHUNK_SIZE];
+  U16 data;
+  U32 addr;
+  U16 offset;
+  U16 i;
+
+  for (offset = 0; offset < AT45DBX_PAGE_SIZE; offset += AT45DBX_FILL_CHUNK_SIZE)
+  {
+    if (at45dbx_wr_valid & (1 << (offset >> AT45DBX_SECTOR_BITS))) continue;
+
+    // A main memory read can only start once the DF is ready.
+    at45dbx_write_wait_ready();
+
+    // Read the chunk from the main memory page.
+    at45dbx_chipselect_df(at45dbx_wr_page >> AT45DBX_MEM_SIZE, true);
+    spi_write(AT45DBX_SPI, AT45DBX_CMDA_RD_ARRAY_LEG);
+    addr = (Rd_bitfield(at45dbx_wr_page, AT45DBX_MSK_PTR_PAGE) << AT45DBX_BYTE_ADDR_BITS) | offset;
+    spi_write(AT45DBX_SPI, LSB2W(addr));
+    spi_write(AT45DBX_SPI, LSB1W(addr));
+    spi_write(AT45DBX_SPI, LSB0W(addr));
+    spi_write_dummy();
+    spi_write_dummy();
+    spi_write_dummy();
+    spi_write_dummy();
+    for (i = 0; i < AT45DBX_FILL_CHUNK_SIZE; i++)
+    {
+      spi_write_dummy();
+      spi_read(AT45DBX_SPI, &data);
+      chunk[i] = data;
+    }
+    at45dbx_chipselect_df(at45dbx_wr_page >> AT45DBX_MEM_SIZE, false);
+
+    // Write it at the same place in the buffer.
+    at45dbx_chipselect_df(at45dbx_wr_page >> AT45DBX_MEM_SIZE, true);
+    spi_write(AT45DBX_SPI, (at45dbx_wr_buf) ? AT45DBX_CMDC_WR_BUF2 : AT45DBX_CMDC_WR_BUF1);
+    addr = offset;
+    spi_write(AT45DBX_SPI, LSB2W(addr));
+    spi_write(AT45DBX_SPI, LSB1W(addr));
+    spi_write(AT45DBX_SPI, LSB0W(addr));
+    spi_write_buf(AT45DBX_SPI, chunk, AT45DBX_FILL_CHUNK_SIZE);
+    at45dbx_chipselect_df(at45dbx_wr_page >> AT45DBX_MEM_SIZE, false);
+
+    at45dbx_stats.page_fills++;
+  }
+}
+#endif
+
+
+void at45dbx_write_flush(void)
+{
+  if (!at45dbx_wr_pending) return;
+  at45dbx_wr_pending = false;
+
+#if AT45DBX_PAGE_SIZE > AT45DBX_SECTOR_SIZE
+  // The sectors not written must keep their content.
+  if (at45dbx_wr_valid != (1 << at45dbx_get_page_sectors()) - 1) at45dbx_write_fill_page();
+#endif
+
+#if AT45DBX_SPI_BUS == true
+  {
+    U32 addr;
+
+    // Queue the Buffer to Main Memory Page Program with Built-in Erase
+    // command: the scheduler sends it once the DF is ready, and runs the
+    // transactions to the other devices meanwhile.
+    at45dbx_program_sync();
+    at45dbx_pr_page = at45dbx_wr_page;
+    addr = Rd_bitfield(at45dbx_wr_page, AT45DBX_MSK_PTR_PAGE) << AT45DBX_BYTE_ADDR_BITS;
+    at45dbx_pr_cmd[0] = (at45dbx_wr_buf) ? AT45DBX_CMDB_PR_BUF2_TO_PAGE_ER :
+                                           AT45DBX_CMDB_PR_BUF1_TO_PAGE_ER;
+    at45dbx_pr_cmd[1] = LSB2W(addr);
+    at45dbx_pr_cmd[2] = LSB1W(addr);
+    at45dbx_pr_cmd[3] = LSB0W(addr);
+    memset(&at45dbx_pr_trans, 0, sizeof(at45dbx_pr_trans));
+    at45dbx_pr_trans.chip = AT45DBX_SPI_FIRST_NPCS + (at45dbx_wr_page >> AT45DBX_MEM_SIZE);
+    at45dbx_pr_trans.cmd = at45dbx_pr_cmd;
+    at45dbx_pr_trans.cmd_len = sizeof(at45dbx_pr_cmd);
+    at45dbx_pr_trans.callback = at45dbx_program_done;
+    at45dbx_pr_queued = true;
+    spi_bus_submit(&at45dbx_pr_trans);
+    spi_bus_run();
+  }
+#else
+  // A buffer to page program can only start once the DF is ready.
+  at45dbx_write_wait_ready();
+
+  // Send the Buffer to Main Memory Page Program with Built-in Erase command.
+  at45dbx_page_cmd((at45dbx_wr_buf) ? AT45DBX_CMDB_PR_BUF2_TO_PAGE_ER :
+                                      AT45DBX_CMDB_PR_BUF1_TO_PAGE_ER,
+                   at45dbx_wr_page);
+
+  // Memory busy.
+  at45dbx_busy = true;
+#endif
+  at45dbx_stats.page_programs++;
+
+  // The next page is filled in the other buffer while this one is programmed.
+  at45dbx_wr_buf ^= 1;
+}
+
+
+void at45dbx_get_stats(at45dbx_stats_t *stats)
+{
+  *stats = at45dbx_stats;
+}
+
+
+void at45dbx_reset_stats(void)
+{
+  memset(&at45dbx_stats, 0, sizeof(at45dbx_stats));
+}
+
+
+void at45dbx_set_busy_callback(void (*callback)(void))
+{
+  at45dbx_busy_callback = callback;
+}
+
 
 bool at45dbx_read_open(U32 sector)
 {
   U32 addr;
 
+  // The main memory must be up to date before it is read.
+  at45dbx_write_flush();
+  at45dbx_program_sync();
+
   // Set the global memory pointer to a byte address.
   gl_ptr_mem = sector << AT45DBX_SECTOR_BITS; // gl_ptr_mem = sector * AT45DBX_SECTOR_SIZE.
 
@@ -311,10 +666,12 @@ bool at45dbx_read_open(U32 sector)
   // Select the DF memory gl_ptr_mem points to.
   at45dbx_chipselect_df(gl_ptr_mem >> AT45DBX_MEM_SIZE, true);
 
-  // Initiate a page read at a given sector.
+  // Initiate a continuous array read at a given sector. The read goes on
+  // across page boundaries until the end of the DF.
 
-  // Send the Main Memory Page Read command.
-  spi_write(AT45DBX_SPI, AT45DBX_CMDA_RD_PAGE);
+  // Send the Continuous Array Read command.
+  spi_write(AT45DBX_SPI, AT45DBX_CMDA_RD_ARRAY_LEG);
+  at45dbx_stats.read_cmds++;
 
   // Send the three address bytes, which comprise:
   //  - (24 - (AT45DBX_PAGE_ADDR_BITS + AT45DBX_BYTE_ADDR_BITS)) reserved bits;
@@ -348,82 +705,245 @@ void at45dbx_read_close(void)
 }
 
 
-bool at45dbx_write_open(U32 sector)
+/*! \brief Opens a buffer write at a given sector of the current write session.
+ *
+ * \param sector  Start sector.
+ *
+ * \retval true Success.
+ * \retval false Failure.
+ */
+static bool at45dbx_write_open_page(U32 sector)
 {
   U32 addr;
 
   // Set the global memory pointer to a byte address.
   gl_ptr_mem = sector << AT45DBX_SECTOR_BITS; // gl_ptr_mem = sector * AT45DBX_SECTOR_SIZE.
 
-  // If the DF memory is busy, wait until it's ready.
-  if (at45dbx_busy) at45dbx_wait_ready();
-  at45dbx_busy = false;
+  if (at45dbx_wr_pending &&
+      at45dbx_wr_page == (gl_ptr_mem & ~AT45DBX_MSK_PTR_BYTE))
+  {
+    // The page is still in the SRAM buffer: the new data is merged to be
+    // programmed by the same page program.
+    at45dbx_stats.coalesced_writes++;
+  }
+  else
+  {
+    // Launch the program of the previous page, it runs while this page is
+    // filled in the other buffer. That buffer is only free once the program
+    // of the page before has ended, i.e. once this one has been sent.
+    at45dbx_write_flush();
+    at45dbx_program_sync();
+    at45dbx_wr_page = gl_ptr_mem & ~AT45DBX_MSK_PTR_BYTE;
+
+#if AT45DBX_PAGE_SIZE > AT45DBX_SECTOR_SIZE
+    // Unless the page is entirely rewritten, transfer its current content to
+    // the buffer. A transfer can only start once the DF is ready. If the
+    // write session ends early, the sectors not written are copied from the
+    // main memory before the page program (see at45dbx_write_fill_page()).
+    at45dbx_wr_valid = 0;
+    if (Rd_bitfield(gl_ptr_mem, AT45DBX_MSK_PTR_BYTE) ||
+        at45dbx_wr_nb_sector < at45dbx_get_page_sectors())
+    {
+      at45dbx_wr_valid = (1 << at45dbx_get_page_sectors()) - 1;
+
+      at45dbx_write_wait_ready();
+
+      // Send the Main Memory Page to Buffer Transfer command.
+      at45dbx_page_cmd((at45dbx_wr_buf) ? AT45DBX_CMDB_XFR_PAGE_TO_BUF2 :
+                                          AT45DBX_CMDB_XFR_PAGE_TO_BUF1,
+                       at45dbx_wr_page);
+
+      // Wait for end of page transfer.
+      at45dbx_busy = true;
+      at45dbx_write_wait_ready();
+      at45dbx_stats.page_loads++;
+    }
+#endif
+
+    at45dbx_wr_pending = true;
+  }
 
 #if AT45DBX_PAGE_SIZE > AT45DBX_SECTOR_SIZE
+  at45dbx_wr_start = gl_ptr_mem;
+#endif
+
   // Select the DF memory gl_ptr_mem points to.
   at45dbx_chipselect_df(gl_ptr_mem >> AT45DBX_MEM_SIZE, true);
 
-  // Transfer the content of the current page to buffer 1.
+  // Initiate a buffer write at a given sector. It is allowed while the DF
+  // programs the other buffer.
 
-  // Send the Main Memory Page to Buffer 1 Transfer command.
-  spi_write(AT45DBX_SPI, AT45DBX_CMDB_XFR_PAGE_TO_BUF1);
+  // Send the Buffer Write command.
+  spi_write(AT45DBX_SPI, (at45dbx_wr_buf) ? AT45DBX_CMDC_WR_BUF2 : AT45DBX_CMDC_WR_BUF1);
 
   // Send the three address bytes, which comprise:
-  //  - (24 - (AT45DBX_PAGE_ADDR_BITS + AT45DBX_BYTE_ADDR_BITS)) reserved bits;
-  //  - then AT45DBX_PAGE_ADDR_BITS bits specifying the page in main memory to be read;
-  //  - then AT45DBX_BYTE_ADDR_BITS don't care bits.
-  // NOTE: The bits of gl_ptr_mem above the AT45DBX_MEM_SIZE bits are useless for the local
-  // DF addressing. They are used for DF discrimination when there are several DFs.
-  addr = Rd_bitfield(gl_ptr_mem, AT45DBX_MSK_PTR_PAGE) << AT45DBX_BYTE_ADDR_BITS;
+  //  - (24 - AT45DBX_BYTE_ADDR_BITS) don't care bits;
+  //  - then AT45DBX_BYTE_ADDR_BITS bits specifying the starting byte address within the buffer.
+  addr = Rd_bitfield(gl_ptr_mem, AT45DBX_MSK_PTR_BYTE);
   spi_write(AT45DBX_SPI, LSB2W(addr));
   spi_write(AT45DBX_SPI, LSB1W(addr));
   spi_write(AT45DBX_SPI, LSB0W(addr));
 
-  // Unselect the DF memory gl_ptr_mem points to.
-  at45dbx_chipselect_df(gl_ptr_mem >> AT45DBX_MEM_SIZE, false);
+  return true;
+}
 
-  // Wait for end of page transfer.
-  at45dbx_wait_ready();
+
+/*! \brief Ends the buffer write and launches the page program if the end of
+ *         the page has been reached.
+ */
+static void at45dbx_write_end_page(void)
+{
+  // Unselect the DF memory the written page belongs to.
+  at45dbx_chipselect_df(at45dbx_wr_page >> AT45DBX_MEM_SIZE, false);
+
+#if AT45DBX_PAGE_SIZE > AT45DBX_SECTOR_SIZE
+  // The buffer write always ends on a sector boundary: the sectors from
+  // at45dbx_wr_start to gl_ptr_mem now hold data.
+  {
+    U32 sector;
+    for (sector = at45dbx_wr_start >> AT45DBX_SECTOR_BITS;
+         sector < (gl_ptr_mem >> AT45DBX_SECTOR_BITS); sector++)
+    {
+      at45dbx_wr_valid |= 1 << (sector & (at45dbx_get_page_sectors() - 1));
+    }
+  }
 #endif
 
-  // Select the DF memory gl_ptr_mem points to.
-  at45dbx_chipselect_df(gl_ptr_mem >> AT45DBX_MEM_SIZE, true);
+  // If end of page reached, the page is complete: program it.
+  if (!Rd_bitfield(gl_ptr_mem, AT45DBX_MSK_PTR_BYTE)) at45dbx_write_flush();
+}
 
-  // Initiate a page write at a given sector.
 
-  // Send the Main Memory Page Program through Buffer 1 command.
-  spi_write(AT45DBX_SPI, AT45DBX_CMDB_PR_PAGE_TH_BUF1);
+bool at45dbx_write_open(U32 sector)
+{
+  return at45dbx_write_open_sectors(sector, 0);
+}
 
-  // Send the three address bytes, which comprise:
-  //  - (24 - (AT45DBX_PAGE_ADDR_BITS + AT45DBX_BYTE_ADDR_BITS)) reserved bits;
-  //  - then AT45DBX_PAGE_ADDR_BITS bits specifying the page in main memory to be written;
-  //  - then AT45DBX_BYTE_ADDR_BITS bits specifying the starting byte address within that page.
-  // NOTE: The bits of gl_ptr_mem above the AT45DBX_MEM_SIZE bits are useless for the local
-  // DF addressing. They are used for DF discrimination when there are several DFs.
-  addr = (Rd_bitfield(gl_ptr_mem, AT45DBX_MSK_PTR_PAGE) << AT45DBX_BYTE_ADDR_BITS) |
-         Rd_bitfield(gl_ptr_mem, AT45DBX_MSK_PTR_BYTE);
-  spi_write(AT45DBX_SPI, LSB2W(addr));
-  spi_write(AT45DBX_SPI, LSB1W(addr));
-  spi_write(AT45DBX_SPI, LSB0W(addr));
 
-  return true;
+bool at45dbx_write_open_sectors(U32 sector, U32 nb_sector)
+{
+  at45dbx_wr_nb_sector = nb_sector;
+  return at45dbx_write_open_page(sector);
 }
 
 
 void at45dbx_write_close(void)
 {
   // While end of logical sector not reached, zero-fill remaining memory bytes.
-  while (Rd_bitfield(gl_ptr_mem, AT45DBX_MSK_PTR_SECTOR))
+  if (at45dbx_wr_pending)
   {
-    spi_write(AT45DBX_SPI, 0x00);
-    gl_ptr_mem++;
+    while (Rd_bitfield(gl_ptr_mem, AT45DBX_MSK_PTR_SECTOR))
+    {
+      spi_write(AT45DBX_SPI, 0x00);
+      gl_ptr_mem++;
+    }
+
+    // The page stays in the SRAM buffer until it is complete or another
+    // page is accessed, so that the next sectors of the page are merged.
+    at45dbx_write_end_page();
   }
+}
 
-  // Unselect the DF memory gl_ptr_mem points to.
-  at45dbx_chipselect_df(gl_ptr_mem >> AT45DBX_MEM_SIZE, false);
 
-  // Memory busy.
-  at45dbx_busy = true;
+bool at45dbx_erase(U32 sector, U32 nb_sector)
+{
+  U32 page, end_page;
+  U8 cmd;
+  U8 nb_page;
+
+  // A page waiting in the SRAM buffer must not be programmed after the erase.
+  at45dbx_write_flush();
+  at45dbx_program_sync();
+
+  // Only the pages entirely inside the sector range are erased.
+  page     = (sector + at45dbx_get_page_sectors() - 1) / at45dbx_get_page_sectors();
+  end_page = (sector + nb_sector) / at45dbx_get_page_sectors();
+
+  while (page < end_page)
+  {
+    // Erase a whole block at once when it is entirely inside the range.
+    if (!(page % AT45DBX_BLOCK_PAGES) && end_page - page >= AT45DBX_BLOCK_PAGES)
+    {
+      cmd = AT45DBX_CMDB_ER_BLOCK;
+      nb_page = AT45DBX_BLOCK_PAGES;
+    }
+    else
+    {
+      cmd = AT45DBX_CMDB_ER_PAGE;
+      nb_page = 1;
+    }
+
+    // Set the global memory pointer to the page byte address.
+    gl_ptr_mem = page << AT45DBX_PAGE_BITS;
+
+    // If the DF memory is busy, wait until it's ready.
+    if (at45dbx_busy) at45dbx_wait_ready();
+
+    // Send the Page Erase or Block Erase command: the erase starts.
+    at45dbx_page_cmd(cmd, gl_ptr_mem);
+
+    // Memory busy.
+    at45dbx_busy = true;
+
+    page += nb_page;
+  }
+
+  return true;
+}
+
+
+bool at45dbx_copy_page(U32 src_page, U32 dst_page)
+{
+  U32 src = src_page << AT45DBX_PAGE_BITS;
+  U32 dst = dst_page << AT45DBX_PAGE_BITS;
+  U16 i;
+
+  // The copy must not be overwritten by a page waiting in the SRAM buffer.
+  at45dbx_write_flush();
+
+  if ((src >> AT45DBX_MEM_SIZE) == (dst >> AT45DBX_MEM_SIZE))
+  {
+    // Both pages are in the same DF: the page goes through the DF SRAM buffer
+    // without being transferred over SPI.
+    at45dbx_write_wait_ready();
+
+    // Send the Main Memory Page to Buffer Transfer command.
+    at45dbx_page_cmd((at45dbx_wr_buf) ? AT45DBX_CMDB_XFR_PAGE_TO_BUF2 :
+                                        AT45DBX_CMDB_XFR_PAGE_TO_BUF1,
+                     src);
+
+    // Wait for end of page transfer.
+    at45dbx_busy = true;
+    at45dbx_write_wait_ready();
+    at45dbx_stats.page_loads++;
+
+    // Send the Buffer to Main Memory Page Program with Built-in Erase command.
+    at45dbx_page_cmd((at45dbx_wr_buf) ? AT45DBX_CMDB_PR_BUF2_TO_PAGE_ER :
+                                        AT45DBX_CMDB_PR_BUF1_TO_PAGE_ER,
+                     dst);
+
+    // Memory busy.
+    at45dbx_busy = true;
+    at45dbx_stats.page_programs++;
+    at45dbx_wr_buf ^= 1;
+  }
+  else
+  {
+    // The pages are in different DFs: copy them sector by sector through RAM.
+    for (i = 0; i < at45dbx_get_page_sectors(); i++)
+    {
+      at45dbx_read_open((src >> AT45DBX_SECTOR_BITS) + i);
+      at45dbx_read_sector_2_ram(sector_buf);
+      at45dbx_read_close();
+
+      at45dbx_write_open_sectors((dst >> AT45DBX_SECTOR_BITS) + i, at45dbx_get_page_sectors() - i);
+      at45dbx_write_sector_from_ram(sector_buf);
+      at45dbx_write_close();
+    }
+    at45dbx_write_flush();
+  }
+
+  return true;
 }
 
 
@@ -442,8 +962,8 @@ U8 at45dbx_read_byte(void)
   // Memory busy.
   if (at45dbx_busy)
   {
-    // Being here, we know that we previously finished a page read.
-    // => We have to access the next page.
+    // Being here, we know that we previously finished a DF read.
+    // => We have to access the next DF.
 
     // Memory ready.
     at45dbx_busy = false;
@@ -458,11 +978,11 @@ U8 at45dbx_read_byte(void)
   spi_read(AT45DBX_SPI, &data);
   gl_ptr_mem++;
 
-  // If end of page reached,
-  if (!Rd_bitfield(gl_ptr_mem, AT45DBX_MSK_PTR_BYTE))
+  // If end of DF reached,
+  if (!(gl_ptr_mem & AT45DBX_MSK_PTR_DF))
   {
-    // unselect the DF memory gl_ptr_mem points to.
-    at45dbx_chipselect_df(gl_ptr_mem >> AT45DBX_MEM_SIZE, false);
+    // unselect the DF memory gl_ptr_mem was pointing to.
+    at45dbx_chipselect_df((gl_ptr_mem - 1) >> AT45DBX_MEM_SIZE, false);
 
     // Memory busy.
     at45dbx_busy = true;
@@ -474,30 +994,23 @@ U8 at45dbx_read_byte(void)
 
 bool at45dbx_write_byte(U8 b)
 {
-  // Memory busy.
-  if (at45dbx_busy)
+  // Page programming launched.
+  if (!at45dbx_wr_pending)
   {
     // Being here, we know that we previously launched a page programming.
     // => We have to access the next page.
 
     // Eventually select the next DF and open the next page.
-    // NOTE: at45dbx_write_open input parameter is a sector.
-    at45dbx_write_open(gl_ptr_mem >> AT45DBX_SECTOR_BITS); // gl_ptr_mem / AT45DBX_SECTOR_SIZE.
+    // NOTE: at45dbx_write_open_page input parameter is a sector.
+    at45dbx_write_open_page(gl_ptr_mem >> AT45DBX_SECTOR_BITS); // gl_ptr_mem / AT45DBX_SECTOR_SIZE.
   }
 
   // Write the next data byte.
   spi_write(AT45DBX_SPI, b);
   gl_ptr_mem++;
 
-  // If end of page reached,
-  if (!Rd_bitfield(gl_ptr_mem, AT45DBX_MSK_PTR_BYTE))
-  {
-    // unselect the DF memory gl_ptr_mem points to in order to program the page.
-    at45dbx_chipselect_df(gl_ptr_mem >> AT45DBX_MEM_SIZE, false);
-
-    // Memory busy.
-    at45dbx_busy = true;
-  }
+  // If end of page reached, program the page.
+  if (!Rd_bitfield(gl_ptr_mem, AT45DBX_MSK_PTR_BYTE)) at45dbx_write_end_page();
 
   return true;
 }
@@ -516,7 +1029,7 @@ bool at45dbx_read_multiple_sector(U16 nb_sector)
   while (nb_sector--)
   {
     // Read the next sector.
-    at45dbx_read_sector_2_ram(sector_buf);
+    if (!at45dbx_read_sector_2_ram(sector_buf)) return false;
     at45dbx_read_multiple_sector_callback(sector_buf);
   }
 
@@ -530,7 +1043,7 @@ bool at45dbx_write_multiple_sector(U16 nb_sector)
   {
     // Write the next sector.
     at45dbx_write_multiple_sector_callback(sector_buf);
-    at45dbx_write_sector_from_ram(sector_buf);
+    if (!at45dbx_write_sector_from_ram(sector_buf)) return false;
   }
 
   return true;
@@ -547,15 +1060,23 @@ bool at45dbx_write_multiple_sector(U16 nb_sector)
 
 bool at45dbx_read_sector_2_ram(void *ram)
 {
-  U8 *_ram = ram;
-  U16 i;
-  U16 data;
+  U32 cycles = Get_sys_count();
+#if AT45DBX_PDCA_READ == true
+  pdca_channel_options_t pdca_options =
+  {
+    .addr          = ram,
+    .size          = AT45DBX_SECTOR_SIZE,
+    .r_addr        = NULL,
+    .r_size        = 0,
+    .transfer_size = PDCA_TRANSFER_SIZE_BYTE
+  };
+#endif
 
   // Memory busy.
   if (at45dbx_busy)
   {
-    // Being here, we know that we previously finished a page read.
-    // => We have to access the next page.
+    // Being here, we know that we previously finished a DF read.
+    // => We have to access the next DF.
 
     // Memory ready.
     at45dbx_busy = false;
@@ -566,69 +1087,82 @@ bool at45dbx_read_sector_2_ram(void *ram)
   }
 
   // Read the next sector.
-  for (i = AT45DBX_SECTOR_SIZE; i; i--)
+#if AT45DBX_PDCA_READ == true
+  // Wait for the end of the command and drop the byte received meanwhile.
+  while (!spi_writeEndCheck(AT45DBX_SPI));
+  (void)AT45DBX_SPI->rdr;
+
+  // The DF ignores the data sent during the read: the sector buffer itself
+  // feeds the transmit channel, which always stays ahead of the receive one.
+  pdca_options.pid = AT45DBX_PDCA_PID_RX;
+  pdca_init_channel(AT45DBX_PDCA_RX_CHANNEL, &pdca_options);
+  pdca_options.pid = AT45DBX_PDCA_PID_TX;
+  pdca_init_channel(AT45DBX_PDCA_TX_CHANNEL, &pdca_options);
+  pdca_enable(AT45DBX_PDCA_RX_CHANNEL);
+  pdca_enable(AT45DBX_PDCA_TX_CHANNEL);
+
+  while (!(pdca_get_transfer_status(AT45DBX_PDCA_RX_CHANNEL) & PDCA_TRANSFER_COMPLETE));
+
+  pdca_disable(AT45DBX_PDCA_TX_CHANNEL);
+  pdca_disable(AT45DBX_PDCA_RX_CHANNEL);
+#else
+  if (spi_read_buf(AT45DBX_SPI, ram, AT45DBX_SECTOR_SIZE, 0xFF) != SPI_OK)
   {
-    // Send a dummy byte to read the next data byte.
-    spi_write_dummy();
-    spi_read(AT45DBX_SPI, &data);
-    *_ram++ = data;
+    // A data byte was lost: restart the array read at this sector.
+    at45dbx_chipselect_df(gl_ptr_mem >> AT45DBX_MEM_SIZE, false);
+    at45dbx_read_open(gl_ptr_mem >> AT45DBX_SECTOR_BITS);
+    if (spi_read_buf(AT45DBX_SPI, ram, AT45DBX_SECTOR_SIZE, 0xFF) != SPI_OK) return false;
   }
+#endif
 
   // Update the memory pointer.
   gl_ptr_mem += AT45DBX_SECTOR_SIZE;
 
-#if AT45DBX_PAGE_SIZE > AT45DBX_SECTOR_SIZE
-  // If end of page reached,
-  if (!Rd_bitfield(gl_ptr_mem, AT45DBX_MSK_PTR_BYTE))
-#endif
+  // If end of DF reached,
+  if (!(gl_ptr_mem & AT45DBX_MSK_PTR_DF))
   {
-    // unselect the DF memory gl_ptr_mem points to.
-    at45dbx_chipselect_df(gl_ptr_mem >> AT45DBX_MEM_SIZE, false);
+    // unselect the DF memory gl_ptr_mem was pointing to.
+    at45dbx_chipselect_df((gl_ptr_mem - 1) >> AT45DBX_MEM_SIZE, false);
 
     // Memory busy.
     at45dbx_busy = true;
   }
 
+  at45dbx_stats.read_bytes += AT45DBX_SECTOR_SIZE;
+  at45dbx_stats.read_cycles += Get_sys_count() - cycles;
+
   return true;
 }
 
 
 bool at45dbx_write_sector_from_ram(const void *ram)
 {
-  const U8 *_ram = ram;
-  U16 i;
 
-  // Memory busy.
-  if (at45dbx_busy)
+  // Page programming launched.
+  if (!at45dbx_wr_pending)
   {
     // Being here, we know that we previously launched a page programming.
     // => We have to access the next page.
 
     // Eventually select the next DF and open the next page.
-    // NOTE: at45dbx_write_open input parameter is a sector.
-    at45dbx_write_open(gl_ptr_mem >> AT45DBX_SECTOR_BITS); // gl_ptr_mem / AT45DBX_SECTOR_SIZE.
+    // NOTE: at45dbx_write_open_page input parameter is a sector.
+    at45dbx_write_open_page(gl_ptr_mem >> AT45DBX_SECTOR_BITS); // gl_ptr_mem / AT45DBX_SECTOR_SIZE.
   }
 
   // Write the next sector.
-  for (i = AT45DBX_SECTOR_SIZE; i; i--)
-  {
-    // Write the next data byte.
-    spi_write(AT45DBX_SPI, *_ram++);
-  }
+  spi_write_buf(AT45DBX_SPI, ram, AT45DBX_SECTOR_SIZE);
 
   // Update the memory pointer.
   gl_ptr_mem += AT45DBX_SECTOR_SIZE;
+  if (at45dbx_wr_nb_sector) at45dbx_wr_nb_sector--;
 
 #if AT45DBX_PAGE_SIZE > AT45DBX_SECTOR_SIZE
   // If end of page reached,
   if (!Rd_bitfield(gl_ptr_mem, AT45DBX_MSK_PTR_BYTE))
 #endif
   {
-    // unselect the DF memory gl_ptr_mem points to in order to program the page.
-    at45dbx_chipselect_df(gl_ptr_mem >> AT45DBX_MEM_SIZE, false);
-
-    // Memory busy.
-    at45dbx_busy = true;
+    // end the buffer write and program the page.
+    at45dbx_write_end_page();
   }
 
   return true;
@@ -86,6 +86,21 @@
 //! Sector size in bytes.
 #define AT45DBX_SECTOR_SIZE     (1 << AT45DBX_SECTOR_BITS)
 
+//! Access statistics, see \ref at45dbx_get_stats.
+typedef struct
+{
+  U32 read_cmds;          //!< Number of read commands issued.
+  U32 read_bytes;         //!< Number of bytes read by sector.
+  U32 read_cycles;        //!< CPU cycles spent reading sectors.
+  U32 page_programs;      //!< Number of buffer to page programs launched.
+  U32 page_loads;         //!< Number of page to buffer transfers (partial page writes).
+  U32 page_fills;         //!< Number of chunks copied to complete a page written partially without transfer.
+  U32 coalesced_writes;   //!< Number of writes merged into a page still in buffer.
+  U32 busy_waits;         //!< Number of times a write had to wait for the DF.
+  U32 busy_wait_cycles;   //!< Total CPU cycles spent waiting for the DF.
+  U32 max_wait_cycles;    //!< Longest single wait (unit: CPU cycles).
+} at45dbx_stats_t;
+
 
 //_____ D E C L A R A T I O N S ____________________________________________
 
@@ -101,9 +116,22 @@
  *
  * \retval true Success.
  * \retval false Failure.
+ *
+ * \note With AT45DBX_SPI_BUS, \ref spi_bus_init must be called first: the DF
+ *       is registered to the SPI bus scheduler here.
  */
 extern bool at45dbx_init(spi_options_t spiOptions, unsigned int pba_hz);
 
+/*! \brief Sets up the SPI channel by which the DF is controlled again after a
+ *         PBA clock change, with the options given to \ref at45dbx_init.
+ *
+ * \param pba_hz      SPI module input clock frequency (PBA clock, Hz).
+ *
+ * \retval true Success.
+ * \retval false Failure.
+ */
+extern bool at45dbx_set_pba_hz(unsigned int pba_hz);
+
 /*! \brief Performs a memory check on all DFs.
  *
  * \retval true Success.
@@ -111,6 +139,15 @@ extern bool at45dbx_init(spi_options_t spiOptions, unsigned int pba_hz);
  */
 extern bool at45dbx_mem_check(void);
 
+/*! \brief Returns the number of sectors held by one DF page.
+ *
+ * A DF page is the smallest programmable and erasable unit, so writes aligned
+ * on this boundary never have to reload the page content first.
+ *
+ * \return Page size (unit: sector).
+ */
+extern U16 at45dbx_get_page_sectors(void);
+
 /*! \brief Opens a DF memory in read mode at a given sector.
  *
  * \param sector  Start sector.
@@ -119,6 +156,9 @@ extern bool at45dbx_mem_check(void);
  * \retval false Failure.
  *
  * \note Sector may be page-unaligned (depending on the DF page size).
+ *
+ * \note A single Continuous Array Read command serves all the following
+ *       sectors up to the end of the DF, across page boundaries.
  */
 extern bool at45dbx_read_open(U32 sector);
 
@@ -138,13 +178,89 @@ extern void at45dbx_read_close(void);
  * \note If \ref AT45DBX_PAGE_SIZE > \ref AT45DBX_SECTOR_SIZE, page content is
  *       first loaded in buffer to then be partially updated by write byte or
  *       write sector functions.
+ *
+ * \note The two DF SRAM buffers are used alternately: a complete page is
+ *       programmed from one buffer while the next page is filled in the other.
  */
 extern bool at45dbx_write_open(U32 sector);
 
-/*! \brief Fills the end of the current logical sector and launches page programming.
+/*! \brief Opens a DF memory in write mode for a known number of sectors.
+ *
+ * \param sector     Start sector.
+ * \param nb_sector  Number of sectors that will be written.
+ *
+ * \retval true Success.
+ * \retval false Failure.
+ *
+ * \note Pages entirely covered by the announced range are not loaded in
+ *       buffer before being written. If fewer sectors are written, the others
+ *       are copied from the main memory page before it is programmed.
+ */
+extern bool at45dbx_write_open_sectors(U32 sector, U32 nb_sector);
+
+/*! \brief Fills the end of the current logical sector and launches page
+ *         programming if the end of the page is reached.
+ *
+ * \note An incomplete page stays in the DF SRAM buffer so that following
+ *       writes to the same page are programmed at once. It is programmed by
+ *       \ref at45dbx_write_flush, by a read, or by a write to another page.
  */
 extern void at45dbx_write_close(void);
 
+/*! \brief Launches the programming of the page waiting in the DF SRAM buffer,
+ *         if any.
+ *
+ * \note With AT45DBX_SPI_BUS, the program command is queued to the SPI bus
+ *       scheduler and sent once the DF is ready, without waiting here.
+ */
+extern void at45dbx_write_flush(void);
+
+/*! \brief Gets the access statistics.
+ *
+ * \param stats  Pointer to the structure receiving the statistics.
+ *
+ * \note The read throughput is read_bytes * CPU frequency / read_cycles.
+ */
+extern void at45dbx_get_stats(at45dbx_stats_t *stats);
+
+/*! \brief Clears the access statistics.
+ */
+extern void at45dbx_reset_stats(void);
+
+/*! \brief Sets the function called while waiting for the DF to be ready.
+ *
+ * \param callback  Function called every AT45DBX_BUSY_POLLS status reads with
+ *                  the DF unselected, or NULL. It must not access the DF.
+ */
+extern void at45dbx_set_busy_callback(void (*callback)(void));
+
+/*! \brief Erases the DF pages included in a sector range.
+ *
+ * \param sector     Start sector.
+ * \param nb_sector  Number of sectors.
+ *
+ * \retval true Success.
+ * \retval false Failure.
+ *
+ * \note Pages only partially covered by the range are left untouched. Aligned
+ *       groups of \ref AT45DBX_BLOCK_PAGES pages are erased with one Block
+ *       Erase command. The last erase is still running on return.
+ */
+extern bool at45dbx_erase(U32 sector, U32 nb_sector);
+
+/*! \brief Copies a DF page to another page.
+ *
+ * \param src_page  Index of the page to copy.
+ * \param dst_page  Index of the page to program.
+ *
+ * \retval true Success.
+ * \retval false Failure.
+ *
+ * \note Within a DF, the page goes through a DF SRAM buffer without any SPI
+ *       data transfer. The program is still running on return.
+ */
+extern bool at45dbx_copy_page(U32 src_page, U32 dst_page);
+
 //! @}
 
 
@@ -248,6 +364,9 @@ extern void at45dbx_write_multiple_sector_callback(void *psector);
  *
  * \note First call must be preceded by a call to the \ref at45dbx_read_open
  *       function.
+ *
+ * \note If \ref AT45DBX_PDCA_READ is \c true, the sector is transferred by the
+ *       PDCA.
  */
 extern bool at45dbx_read_sector_2_ram(void *ram);
 
@@ -0,0 +1,912 @@
+/*****************************************************************************
+ *
+ * \file
+ *
+ * \brief Flash translation layer for the AT45DBX data flash controller.
+ *
+ * Copyright (c) 2009 Atmel Corporation. All rights reserved.
+ *
+ * \asf_license_start
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. The name of Atmel may not be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * 4. This software may only be redistributed and used in connection with an
+ *    Atmel microcontroller product.
+ *
+ * THIS SOFTWARE IS PROVIDED BY ATMEL "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT ARE
+ * EXPRESSLY AND SPECIFICALLY DISCLAIMED. IN NO EVENT SHALL ATMEL BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * \asf_license_stop
+ *
+ ******************************************************************************/
+
+
+//_____  I N C L U D E S ___________________________________________________
+
+#include "conf_access.h"
+
+
+#if AT45DBX_MEM == ENABLE
+
+#include <string.h>
+#include "compiler.h"
+#include "conf_at45dbx.h"
+#include "at45dbx.h"
+#include "at45dbx_ftl.h"
+
+#if AT45DBX_FTL == true
+
+
+//_____ M A C R O S ________________________________________________________
+
+/*! \name FTL Geometry
+ *
+ * Logical sectors are grouped in logical blocks of \ref AT45DBX_FTL_BLOCK_PAGES
+ * DF pages, each one mapped to a physical block. The pages written to a
+ * logical block are appended to a log block, which is merged with the data
+ * block once full. The last blocks of the DF hold the mapping checkpoints.
+ */
+//! @{
+
+#if AT45DBX_MEM_SIZE == AT45DBX_8MB
+  #define AT45DBX_FTL_PAGE_SECTORS  2   //!< Number of sectors in a DF page.
+#else
+  #define AT45DBX_FTL_PAGE_SECTORS  1   //!< Number of sectors in a DF page.
+#endif
+
+//! Number of pages in a block (unit of the Block Erase command).
+#define AT45DBX_FTL_BLOCK_PAGES     8
+
+//! Number of sectors in a block.
+#define AT45DBX_FTL_BLOCK_SECTORS   (AT45DBX_FTL_BLOCK_PAGES * AT45DBX_FTL_PAGE_SECTORS)
+
+//! Number of physical blocks.
+#define AT45DBX_FTL_NB_PBLK         ((AT45DBX_MEM_CNT << (AT45DBX_MEM_SIZE - AT45DBX_SECTOR_BITS)) / AT45DBX_FTL_BLOCK_SECTORS)
+
+//! Upper bound of the checkpoint size in bytes.
+#define AT45DBX_FTL_CP_SIZE         (16 + 4 * AT45DBX_FTL_NB_PBLK + AT45DBX_FTL_NB_LOG * (5 + AT45DBX_FTL_BLOCK_PAGES))
+
+//! Number of blocks in a checkpoint slot.
+#define AT45DBX_FTL_CP_BLOCKS       ((AT45DBX_FTL_CP_SIZE + (AT45DBX_FTL_BLOCK_SECTORS << AT45DBX_SECTOR_BITS) - 1) / \
+                                     (AT45DBX_FTL_BLOCK_SECTORS << AT45DBX_SECTOR_BITS))
+
+//! First physical block of the checkpoint slots.
+#define AT45DBX_FTL_FIRST_CP        (AT45DBX_FTL_NB_PBLK - AT45DBX_FTL_CP_SLOTS * AT45DBX_FTL_CP_BLOCKS)
+
+//! Number of pages in a checkpoint.
+#define AT45DBX_FTL_CP_PAGES        ((AT45DBX_FTL_CP_SIZE + (AT45DBX_FTL_PAGE_SECTORS << AT45DBX_SECTOR_BITS) - 1) / \
+                                     (AT45DBX_FTL_PAGE_SECTORS << AT45DBX_SECTOR_BITS))
+
+//! Number of checkpoint positions in the checkpoint slots. The checkpoints are
+//! written in turn at each position, so that all the pages of the slots wear
+//! evenly.
+#define AT45DBX_FTL_CP_NB_POS       ((AT45DBX_FTL_CP_SLOTS * AT45DBX_FTL_CP_BLOCKS * AT45DBX_FTL_BLOCK_PAGES) / \
+                                     AT45DBX_FTL_CP_PAGES)
+
+//! Number of logical blocks.
+#define AT45DBX_FTL_NB_LBLK         (AT45DBX_FTL_FIRST_CP - AT45DBX_FTL_NB_LOG - AT45DBX_FTL_NB_SPARE)
+
+//! @}
+
+#define AT45DBX_FTL_MAGIC           0x46544C31  //!< Checkpoint signature ("FTL1").
+#define AT45DBX_FTL_NONE            0xFFFF      //!< No block.
+#define AT45DBX_FTL_NO_PAGE         0xFF        //!< No page in a log block.
+#define AT45DBX_FTL_NO_LPAGE        0xFFFFFFFF  //!< No logical page in the page buffer.
+
+#if AT45DBX_FTL_NB_PBLK > AT45DBX_FTL_NONE
+  #error AT45DBX_FTL: too many blocks for 16-bit block indexes
+#endif
+
+#if AT45DBX_FTL_CP_SLOTS < 2
+  #error AT45DBX_FTL_CP_SLOTS must be at least 2 to keep a valid checkpoint while writing the next one
+#endif
+
+#if AT45DBX_FTL_CP_NB_POS > 0xFF
+  #error AT45DBX_FTL: too many checkpoint positions for 8-bit indexes
+#endif
+
+
+//_____ D E F I N I T I O N S ______________________________________________
+
+//! Log block descriptor.
+typedef struct
+{
+  U16 lblk;                               //!< Logical block, AT45DBX_FTL_NONE if the descriptor is free.
+  U16 pblk;                               //!< Physical block receiving the pages.
+  U8  nb_used;                            //!< Number of pages written in the log block.
+  U8  page[AT45DBX_FTL_BLOCK_PAGES];      //!< Log page holding each logical page, or AT45DBX_FTL_NO_PAGE.
+  U32 age;                                //!< Time of the last write, for the LRU choice (not saved).
+} at45dbx_ftl_log_t;
+
+//! Boolean indicating whether the mapping is loaded.
+static bool at45dbx_ftl_mounted;
+
+//! Physical block of each logical block, or AT45DBX_FTL_NONE.
+static U16 at45dbx_ftl_map[AT45DBX_FTL_NB_LBLK];
+
+//! Erase count of each physical block.
+static U16 at45dbx_ftl_erase_cnt[AT45DBX_FTL_NB_PBLK];
+
+//! Bit-field of the physical blocks used as data or log blocks.
+static U8 at45dbx_ftl_used[(AT45DBX_FTL_NB_PBLK + 7) / 8];
+
+//! Bit-field of the physical blocks released since the last checkpoint.
+static U8 at45dbx_ftl_released[(AT45DBX_FTL_NB_PBLK + 7) / 8];
+
+//! Log blocks.
+static at45dbx_ftl_log_t at45dbx_ftl_log[AT45DBX_FTL_NB_LOG];
+
+//! Sequence number of the last checkpoint.
+static U32 at45dbx_ftl_seq;
+
+//! Time base of the log block ages.
+static U32 at45dbx_ftl_age;
+
+//! Number of mapping changes since the last checkpoint.
+static U32 at45dbx_ftl_cp_changes;
+
+//! Logical page held by the page buffer, or AT45DBX_FTL_NO_LPAGE.
+static U32 at45dbx_ftl_lpage;
+
+//! Boolean indicating whether the page buffer holds data not yet written.
+static bool at45dbx_ftl_page_dirty;
+
+//! Page buffer.
+static U8 at45dbx_ftl_page_buf[AT45DBX_FTL_PAGE_SECTORS * AT45DBX_SECTOR_SIZE];
+
+//! Checksum of the checkpoint being written or read.
+static U32 at45dbx_ftl_sum;
+
+//! Statistics.
+static at45dbx_ftl_stats_t at45dbx_ftl_stats;
+
+
+/*! \name Block Management
+ */
+//! @{
+
+
+static bool at45dbx_ftl_bit_get(const U8 *bits, U16 n)
+{
+  return (bits[n >> 3] & (1 << (n & 7))) != 0;
+}
+
+
+static void at45dbx_ftl_bit_set(U8 *bits, U16 n, bool value)
+{
+  if (value) bits[n >> 3] |= 1 << (n & 7);
+  else       bits[n >> 3] &= ~(1 << (n & 7));
+}
+
+
+/*! \brief Returns the first sector of a page of a physical block.
+ */
+static U32 at45dbx_ftl_sector(U16 pblk, U8 page)
+{
+  return ((U32)pblk * AT45DBX_FTL_BLOCK_PAGES + page) * AT45DBX_FTL_PAGE_SECTORS;
+}
+
+
+/*! \brief Returns the index of a page of a physical block.
+ */
+static U32 at45dbx_ftl_page(U16 pblk, U8 page)
+{
+  return (U32)pblk * AT45DBX_FTL_BLOCK_PAGES + page;
+}
+
+
+/*! \brief Tells whether a physical block can be allocated.
+ */
+static bool at45dbx_ftl_is_free(U16 pblk)
+{
+  return !at45dbx_ftl_bit_get(at45dbx_ftl_used, pblk) &&
+         !at45dbx_ftl_bit_get(at45dbx_ftl_released, pblk);
+}
+
+
+/*! \brief Marks a free physical block as used.
+ */
+static void at45dbx_ftl_take(U16 pblk)
+{
+  // Each page of the block is erased again when it is programmed.
+  if (at45dbx_ftl_erase_cnt[pblk] != 0xFFFF) at45dbx_ftl_erase_cnt[pblk]++;
+  at45dbx_ftl_bit_set(at45dbx_ftl_used, pblk, true);
+}
+
+
+/*! \brief Releases a physical block.
+ *
+ * The block keeps its content until the next checkpoint, which the last
+ * checkpoint may still refer to.
+ */
+static void at45dbx_ftl_release(U16 pblk)
+{
+  at45dbx_ftl_bit_set(at45dbx_ftl_used, pblk, false);
+  at45dbx_ftl_bit_set(at45dbx_ftl_released, pblk, true);
+  at45dbx_ftl_cp_changes++;
+}
+
+
+static bool at45dbx_ftl_checkpoint(void);
+
+
+/*! \brief Allocates the free physical block with the lowest erase count.
+ *
+ * \return Physical block, or AT45DBX_FTL_NONE if no block is free.
+ */
+static U16 at45dbx_ftl_alloc(void)
+{
+  U16 pblk, best = AT45DBX_FTL_NONE;
+
+  for (pblk = 0; pblk < AT45DBX_FTL_FIRST_CP; pblk++)
+  {
+    if (at45dbx_ftl_is_free(pblk) &&
+        (best == AT45DBX_FTL_NONE || at45dbx_ftl_erase_cnt[pblk] < at45dbx_ftl_erase_cnt[best]))
+      best = pblk;
+  }
+
+  if (best == AT45DBX_FTL_NONE)
+  {
+    // Only released blocks are left: a checkpoint makes them reusable.
+    if (!at45dbx_ftl_checkpoint()) return AT45DBX_FTL_NONE;
+    for (pblk = 0; pblk < AT45DBX_FTL_FIRST_CP; pblk++)
+    {
+      if (at45dbx_ftl_is_free(pblk) &&
+          (best == AT45DBX_FTL_NONE || at45dbx_ftl_erase_cnt[pblk] < at45dbx_ftl_erase_cnt[best]))
+        best = pblk;
+    }
+    if (best == AT45DBX_FTL_NONE) return AT45DBX_FTL_NONE;
+  }
+
+  at45dbx_ftl_take(best);
+  return best;
+}
+
+
+//! @}
+
+
+/*! \name Log Blocks
+ */
+//! @{
+
+
+/*! \brief Returns the log block of a logical block, or NULL if it has none.
+ */
+static at45dbx_ftl_log_t *at45dbx_ftl_find_log(U16 lblk)
+{
+  U8 i;
+
+  for (i = 0; i < AT45DBX_FTL_NB_LOG; i++)
+  {
+    if (at45dbx_ftl_log[i].lblk == lblk) return &at45dbx_ftl_log[i];
+  }
+  return NULL;
+}
+
+
+/*! \brief Merges a log block with its data block.
+ *
+ * If the log block holds all the pages in order, it becomes the data block.
+ * Otherwise the valid pages of both blocks are copied to a new data block.
+ *
+ * \retval true Success.
+ * \retval false Failure.
+ */
+static bool at45dbx_ftl_merge(at45dbx_ftl_log_t *log)
+{
+  U16 data = at45dbx_ftl_map[log->lblk];
+  U16 pblk;
+  U8 i;
+
+  for (i = 0; i < AT45DBX_FTL_BLOCK_PAGES && log->page[i] == i; i++);
+
+  if (i == AT45DBX_FTL_BLOCK_PAGES)
+  {
+    // Switch merge: nothing to copy.
+    pblk = log->pblk;
+    at45dbx_ftl_stats.switches++;
+  }
+  else
+  {
+    pblk = at45dbx_ftl_alloc();
+    if (pblk == AT45DBX_FTL_NONE) return false;
+
+    for (i = 0; i < AT45DBX_FTL_BLOCK_PAGES; i++)
+    {
+      if (log->page[i] != AT45DBX_FTL_NO_PAGE)
+      {
+        at45dbx_copy_page(at45dbx_ftl_page(log->pblk, log->page[i]), at45dbx_ftl_page(pblk, i));
+        at45dbx_ftl_stats.page_programs++;
+      }
+      else if (data != AT45DBX_FTL_NONE)
+      {
+        at45dbx_copy_page(at45dbx_ftl_page(data, i), at45dbx_ftl_page(pblk, i));
+        at45dbx_ftl_stats.page_programs++;
+      }
+      else
+      {
+        // Page never written: it must read as erased.
+        at45dbx_erase(at45dbx_ftl_sector(pblk, i), AT45DBX_FTL_PAGE_SECTORS);
+      }
+    }
+
+    at45dbx_ftl_release(log->pblk);
+    at45dbx_ftl_stats.merges++;
+  }
+
+  if (data != AT45DBX_FTL_NONE) at45dbx_ftl_release(data);
+  at45dbx_ftl_map[log->lblk] = pblk;
+  log->lblk = AT45DBX_FTL_NONE;
+  at45dbx_ftl_cp_changes++;
+
+  return true;
+}
+
+
+/*! \brief Returns the log block of a logical block, allocating one if needed.
+ *
+ * \return Log block, or NULL on failure.
+ */
+static at45dbx_ftl_log_t *at45dbx_ftl_get_log(U16 lblk)
+{
+  at45dbx_ftl_log_t *log, *lru = NULL;
+  U8 i;
+
+  log = at45dbx_ftl_find_log(lblk);
+  if (log) return log;
+
+  for (i = 0; i < AT45DBX_FTL_NB_LOG; i++)
+  {
+    if (at45dbx_ftl_log[i].lblk == AT45DBX_FTL_NONE)
+    {
+      log = &at45dbx_ftl_log[i];
+      break;
+    }
+    if (!lru || at45dbx_ftl_log[i].age < lru->age) lru = &at45dbx_ftl_log[i];
+  }
+
+  if (!log)
+  {
+    // All log blocks are busy: merge the least recently written one.
+    if (!at45dbx_ftl_merge(lru)) return NULL;
+    log = lru;
+  }
+
+  log->pblk = at45dbx_ftl_alloc();
+  if (log->pblk == AT45DBX_FTL_NONE) return NULL;
+  log->lblk = lblk;
+  log->nb_used = 0;
+  memset(log->page, AT45DBX_FTL_NO_PAGE, sizeof(log->page));
+  log->age = at45dbx_ftl_age;
+
+  return log;
+}
+
+
+/*! \brief Locates the current copy of a logical page.
+ *
+ * \param lpage   Logical page.
+ * \param sector  Pointer to the first sector of the physical page.
+ *
+ * \return \c true if the page is mapped, else \c false.
+ */
+static bool at45dbx_ftl_locate(U32 lpage, U32 *sector)
+{
+  U16 lblk = lpage / AT45DBX_FTL_BLOCK_PAGES;
+  U8 off = lpage % AT45DBX_FTL_BLOCK_PAGES;
+  at45dbx_ftl_log_t *log = at45dbx_ftl_find_log(lblk);
+
+  if (log && log->page[off] != AT45DBX_FTL_NO_PAGE)
+  {
+    *sector = at45dbx_ftl_sector(log->pblk, log->page[off]);
+    return true;
+  }
+  if (at45dbx_ftl_map[lblk] != AT45DBX_FTL_NONE)
+  {
+    *sector = at45dbx_ftl_sector(at45dbx_ftl_map[lblk], off);
+    return true;
+  }
+  return false;
+}
+
+
+/*! \brief Appends the page buffer to the log block of its logical block.
+ *
+ * \retval true Success.
+ * \retval false Failure.
+ */
+static bool at45dbx_ftl_commit(void)
+{
+  U16 lblk;
+  U8 i;
+  at45dbx_ftl_log_t *log;
+
+  if (!at45dbx_ftl_page_dirty) return true;
+
+  lblk = at45dbx_ftl_lpage / AT45DBX_FTL_BLOCK_PAGES;
+  log = at45dbx_ftl_get_log(lblk);
+  if (!log) return false;
+
+  if (log->nb_used == AT45DBX_FTL_BLOCK_PAGES)
+  {
+    // Log block full: merge it and start a new one.
+    if (!at45dbx_ftl_merge(log)) return false;
+    log = at45dbx_ftl_get_log(lblk);
+    if (!log) return false;
+  }
+
+  // The whole page is written: the DF does not reload it first.
+  at45dbx_write_open_sectors(at45dbx_ftl_sector(log->pblk, log->nb_used), AT45DBX_FTL_PAGE_SECTORS);
+  for (i = 0; i < AT45DBX_FTL_PAGE_SECTORS; i++)
+  {
+    at45dbx_write_sector_from_ram(&at45dbx_ftl_page_buf[i * AT45DBX_SECTOR_SIZE]);
+  }
+  at45dbx_write_close();
+
+  log->page[at45dbx_ftl_lpage % AT45DBX_FTL_BLOCK_PAGES] = log->nb_used++;
+  log->age = ++at45dbx_ftl_age;
+
+  at45dbx_ftl_page_dirty = false;
+  at45dbx_ftl_cp_changes++;
+  at45dbx_ftl_stats.host_writes++;
+  at45dbx_ftl_stats.page_programs++;
+
+  return true;
+}
+
+
+/*! \brief Loads a logical page in the page buffer.
+ *
+ * \retval true Success.
+ * \retval false Failure.
+ */
+static bool at45dbx_ftl_load(U32 lpage)
+{
+  U32 sector;
+  U8 i;
+
+  if (!at45dbx_ftl_commit()) return false;
+
+  if (at45dbx_ftl_locate(lpage, &sector))
+  {
+    at45dbx_read_open(sector);
+    for (i = 0; i < AT45DBX_FTL_PAGE_SECTORS; i++)
+    {
+      if (!at45dbx_read_sector_2_ram(&at45dbx_ftl_page_buf[i * AT45DBX_SECTOR_SIZE]))
+      {
+        // The page buffer holds no page.
+        at45dbx_read_close();
+        at45dbx_ftl_lpage = AT45DBX_FTL_NO_LPAGE;
+        return false;
+      }
+    }
+    at45dbx_read_close();
+  }
+  else
+  {
+    memset(at45dbx_ftl_page_buf, 0xFF, sizeof(at45dbx_ftl_page_buf));
+  }
+
+  at45dbx_ftl_lpage = lpage;
+  return true;
+}
+
+
+/*! \brief Moves the coldest data block to the most worn free block when their
+ *         erase counts differ by more than \ref AT45DBX_FTL_WL_THRESHOLD.
+ *
+ * The released block, little worn, is then allocated first.
+ */
+static void at45dbx_ftl_wear_level(void)
+{
+  U16 lblk, cold = AT45DBX_FTL_NONE;
+  U16 pblk, worn = AT45DBX_FTL_NONE;
+  U8 i;
+
+  for (lblk = 0; lblk < AT45DBX_FTL_NB_LBLK; lblk++)
+  {
+    if (at45dbx_ftl_map[lblk] != AT45DBX_FTL_NONE && !at45dbx_ftl_find_log(lblk) &&
+        (cold == AT45DBX_FTL_NONE ||
+         at45dbx_ftl_erase_cnt[at45dbx_ftl_map[lblk]] < at45dbx_ftl_erase_cnt[at45dbx_ftl_map[cold]]))
+      cold = lblk;
+  }
+
+  for (pblk = 0; pblk < AT45DBX_FTL_FIRST_CP; pblk++)
+  {
+    if (at45dbx_ftl_is_free(pblk) &&
+        (worn == AT45DBX_FTL_NONE || at45dbx_ftl_erase_cnt[pblk] > at45dbx_ftl_erase_cnt[worn]))
+      worn = pblk;
+  }
+
+  if (cold == AT45DBX_FTL_NONE || worn == AT45DBX_FTL_NONE ||
+      at45dbx_ftl_erase_cnt[worn] <= at45dbx_ftl_erase_cnt[at45dbx_ftl_map[cold]] + AT45DBX_FTL_WL_THRESHOLD)
+    return;
+
+  at45dbx_ftl_take(worn);
+  for (i = 0; i < AT45DBX_FTL_BLOCK_PAGES; i++)
+  {
+    at45dbx_copy_page(at45dbx_ftl_page(at45dbx_ftl_map[cold], i), at45dbx_ftl_page(worn, i));
+  }
+  at45dbx_ftl_release(at45dbx_ftl_map[cold]);
+  at45dbx_ftl_map[cold] = worn;
+
+  at45dbx_ftl_stats.wl_moves++;
+  at45dbx_ftl_stats.page_programs += AT45DBX_FTL_BLOCK_PAGES;
+}
+
+
+//! @}
+
+
+/*! \name Checkpoints
+ *
+ * A checkpoint holds a header, the block map, the erase counts, the log block
+ * descriptors and a checksum. Checkpoints are written in turn at each
+ * position of the \ref AT45DBX_FTL_CP_SLOTS slots; the valid one with the highest sequence
+ * number is loaded at mount.
+ */
+//! @{
+
+
+/*! \brief Returns the first sector of a checkpoint position.
+ */
+static U32 at45dbx_ftl_cp_sector(U8 pos)
+{
+  return at45dbx_ftl_sector(AT45DBX_FTL_FIRST_CP, 0) + (U32)pos * AT45DBX_FTL_CP_PAGES * AT45DBX_FTL_PAGE_SECTORS;
+}
+
+
+/*! \brief Writes checkpoint bytes and updates the checksum.
+ */
+static void at45dbx_ftl_put(const void *data, U16 size)
+{
+  const U8 *_data = data;
+
+  while (size--)
+  {
+    at45dbx_ftl_sum = ((at45dbx_ftl_sum << 1) | (at45dbx_ftl_sum >> 31)) + *_data;
+    at45dbx_write_byte(*_data++);
+  }
+}
+
+
+/*! \brief Reads checkpoint bytes and updates the checksum.
+ *
+ * \param data  Pointer to the destination, or NULL to only update the checksum.
+ * \param size  Number of bytes.
+ */
+static void at45dbx_ftl_get(void *data, U16 size)
+{
+  U8 *_data = data;
+  U8 b;
+
+  while (size--)
+  {
+    b = at45dbx_read_byte();
+    at45dbx_ftl_sum = ((at45dbx_ftl_sum << 1) | (at45dbx_ftl_sum >> 31)) + b;
+    if (_data) *_data++ = b;
+  }
+}
+
+
+static bool at45dbx_ftl_checkpoint(void)
+{
+  U32 magic = AT45DBX_FTL_MAGIC;
+  U32 seq = at45dbx_ftl_seq + 1;
+  U32 sum;
+  U16 nb_lblk = AT45DBX_FTL_NB_LBLK;
+  U16 nb_log = AT45DBX_FTL_NB_LOG;
+  U8 i;
+
+  at45dbx_write_open_sectors(at45dbx_ftl_cp_sector(seq % AT45DBX_FTL_CP_NB_POS),
+                             AT45DBX_FTL_CP_PAGES * AT45DBX_FTL_PAGE_SECTORS);
+  at45dbx_ftl_sum = 0;
+  at45dbx_ftl_put(&magic, sizeof(magic));
+  at45dbx_ftl_put(&seq, sizeof(seq));
+  at45dbx_ftl_put(&nb_lblk, sizeof(nb_lblk));
+  at45dbx_ftl_put(&nb_log, sizeof(nb_log));
+  at45dbx_ftl_put(at45dbx_ftl_map, sizeof(at45dbx_ftl_map));
+  at45dbx_ftl_put(at45dbx_ftl_erase_cnt, sizeof(at45dbx_ftl_erase_cnt));
+  for (i = 0; i < AT45DBX_FTL_NB_LOG; i++)
+  {
+    at45dbx_ftl_put(&at45dbx_ftl_log[i].lblk, sizeof(at45dbx_ftl_log[i].lblk));
+    at45dbx_ftl_put(&at45dbx_ftl_log[i].pblk, sizeof(at45dbx_ftl_log[i].pblk));
+    at45dbx_ftl_put(&at45dbx_ftl_log[i].nb_used, sizeof(at45dbx_ftl_log[i].nb_used));
+    at45dbx_ftl_put(at45dbx_ftl_log[i].page, sizeof(at45dbx_ftl_log[i].page));
+  }
+  sum = at45dbx_ftl_sum;
+  at45dbx_ftl_put(&sum, sizeof(sum));
+  at45dbx_write_close();
+  at45dbx_write_flush();
+
+  // The released blocks are not referred to by the checkpoint anymore.
+  memset(at45dbx_ftl_released, 0, sizeof(at45dbx_ftl_released));
+  at45dbx_ftl_seq = seq;
+  at45dbx_ftl_cp_changes = 0;
+  at45dbx_ftl_stats.checkpoints++;
+
+  return true;
+}
+
+
+/*! \brief Reads a checkpoint.
+ *
+ * \param pos    Checkpoint position.
+ * \param apply  \c true to load the mapping, \c false to only check the checkpoint.
+ * \param seq    Pointer to the sequence number of the checkpoint.
+ *
+ * \return \c true if the checkpoint is valid, else \c false.
+ */
+static bool at45dbx_ftl_read_cp(U8 pos, bool apply, U32 *seq)
+{
+  U32 magic, sum, cp_sum;
+  U16 nb_lblk, nb_log;
+  U8 i;
+
+  at45dbx_read_open(at45dbx_ftl_cp_sector(pos));
+  at45dbx_ftl_sum = 0;
+  at45dbx_ftl_get(&magic, sizeof(magic));
+  at45dbx_ftl_get(seq, sizeof(*seq));
+  at45dbx_ftl_get(&nb_lblk, sizeof(nb_lblk));
+  at45dbx_ftl_get(&nb_log, sizeof(nb_log));
+  if (magic != AT45DBX_FTL_MAGIC || nb_lblk != AT45DBX_FTL_NB_LBLK || nb_log != AT45DBX_FTL_NB_LOG)
+  {
+    at45dbx_read_close();
+    return false;
+  }
+
+  at45dbx_ftl_get((apply) ? at45dbx_ftl_map : NULL, sizeof(at45dbx_ftl_map));
+  at45dbx_ftl_get((apply) ? at45dbx_ftl_erase_cnt : NULL, sizeof(at45dbx_ftl_erase_cnt));
+  for (i = 0; i < AT45DBX_FTL_NB_LOG; i++)
+  {
+    at45dbx_ftl_get((apply) ? &at45dbx_ftl_log[i].lblk : NULL, sizeof(at45dbx_ftl_log[i].lblk));
+    at45dbx_ftl_get((apply) ? &at45dbx_ftl_log[i].pblk : NULL, sizeof(at45dbx_ftl_log[i].pblk));
+    at45dbx_ftl_get((apply) ? &at45dbx_ftl_log[i].nb_used : NULL, sizeof(at45dbx_ftl_log[i].nb_used));
+    at45dbx_ftl_get((apply) ? at45dbx_ftl_log[i].page : NULL, sizeof(at45dbx_ftl_log[i].page));
+  }
+  sum = at45dbx_ftl_sum;
+  at45dbx_ftl_get(&cp_sum, sizeof(cp_sum));
+  at45dbx_read_close();
+
+  return sum == cp_sum;
+}
+
+
+//! @}
+
+
+/*! \name FTL Interface
+ */
+//! @{
+
+
+bool at45dbx_ftl_mount(void)
+{
+  U32 seq, best_seq = 0;
+  U16 n;
+  U8 slot, best = AT45DBX_FTL_CP_NB_POS;
+
+  at45dbx_ftl_mounted = false;
+
+  // The geometry of the FTL must match the one of the driver.
+  if (at45dbx_get_page_sectors() != AT45DBX_FTL_PAGE_SECTORS) return false;
+
+  for (slot = 0; slot < AT45DBX_FTL_CP_NB_POS; slot++)
+  {
+    if (at45dbx_ftl_read_cp(slot, false, &seq) &&
+        (best == AT45DBX_FTL_CP_NB_POS || seq > best_seq))
+    {
+      best = slot;
+      best_seq = seq;
+    }
+  }
+
+  if (best != AT45DBX_FTL_CP_NB_POS)
+  {
+    if (!at45dbx_ftl_read_cp(best, true, &at45dbx_ftl_seq)) return false;
+    at45dbx_ftl_cp_changes = 0;
+  }
+  else
+  {
+    // No mapping yet: keep the content written without the FTL.
+    for (n = 0; n < AT45DBX_FTL_NB_LBLK; n++) at45dbx_ftl_map[n] = n;
+    memset(at45dbx_ftl_erase_cnt, 0, sizeof(at45dbx_ftl_erase_cnt));
+    for (slot = 0; slot < AT45DBX_FTL_NB_LOG; slot++) at45dbx_ftl_log[slot].lblk = AT45DBX_FTL_NONE;
+    at45dbx_ftl_seq = 0;
+    at45dbx_ftl_cp_changes = AT45DBX_FTL_CP_MIN_CHANGES;
+  }
+
+  // Rebuild the used blocks from the mapping.
+  memset(at45dbx_ftl_used, 0, sizeof(at45dbx_ftl_used));
+  memset(at45dbx_ftl_released, 0, sizeof(at45dbx_ftl_released));
+  for (n = 0; n < AT45DBX_FTL_NB_LBLK; n++)
+  {
+    if (at45dbx_ftl_map[n] != AT45DBX_FTL_NONE) at45dbx_ftl_bit_set(at45dbx_ftl_used, at45dbx_ftl_map[n], true);
+  }
+  for (slot = 0; slot < AT45DBX_FTL_NB_LOG; slot++)
+  {
+    at45dbx_ftl_log[slot].age = 0;
+    if (at45dbx_ftl_log[slot].lblk != AT45DBX_FTL_NONE)
+      at45dbx_ftl_bit_set(at45dbx_ftl_used, at45dbx_ftl_log[slot].pblk, true);
+  }
+
+  at45dbx_ftl_lpage = AT45DBX_FTL_NO_LPAGE;
+  at45dbx_ftl_page_dirty = false;
+  at45dbx_ftl_age = 0;
+  at45dbx_ftl_mounted = true;
+
+  return true;
+}
+
+
+bool at45dbx_ftl_is_mounted(void)
+{
+  return at45dbx_ftl_mounted;
+}
+
+
+U32 at45dbx_ftl_get_nb_sector(void)
+{
+  return (U32)AT45DBX_FTL_NB_LBLK * AT45DBX_FTL_BLOCK_SECTORS;
+}
+
+
+bool at45dbx_ftl_read_sector(U32 sector, void *ram)
+{
+  U32 lpage = sector / AT45DBX_FTL_PAGE_SECTORS;
+  U32 phys;
+  bool status;
+
+  if (!at45dbx_ftl_mounted || sector >= at45dbx_ftl_get_nb_sector()) return false;
+
+  if (lpage == at45dbx_ftl_lpage)
+  {
+    memcpy(ram, &at45dbx_ftl_page_buf[(sector % AT45DBX_FTL_PAGE_SECTORS) * AT45DBX_SECTOR_SIZE],
+           AT45DBX_SECTOR_SIZE);
+    return true;
+  }
+
+  if (!at45dbx_ftl_locate(lpage, &phys))
+  {
+    memset(ram, 0xFF, AT45DBX_SECTOR_SIZE);
+    return true;
+  }
+
+  at45dbx_read_open(phys + sector % AT45DBX_FTL_PAGE_SECTORS);
+  status = at45dbx_read_sector_2_ram(ram);
+  at45dbx_read_close();
+
+  return status;
+}
+
+
+bool at45dbx_ftl_write_sector(U32 sector, const void *ram)
+{
+  U32 lpage = sector / AT45DBX_FTL_PAGE_SECTORS;
+
+  if (!at45dbx_ftl_mounted || sector >= at45dbx_ftl_get_nb_sector()) return false;
+
+  if (lpage != at45dbx_ftl_lpage && !at45dbx_ftl_load(lpage)) return false;
+
+  memcpy(&at45dbx_ftl_page_buf[(sector % AT45DBX_FTL_PAGE_SECTORS) * AT45DBX_SECTOR_SIZE], ram,
+         AT45DBX_SECTOR_SIZE);
+  at45dbx_ftl_page_dirty = true;
+
+  return true;
+}
+
+
+bool at45dbx_ftl_discard(U32 sector, U32 nb_sector)
+{
+  U32 lblk = (sector + AT45DBX_FTL_BLOCK_SECTORS - 1) / AT45DBX_FTL_BLOCK_SECTORS;
+  U32 end = (sector + nb_sector) / AT45DBX_FTL_BLOCK_SECTORS;
+  at45dbx_ftl_log_t *log;
+
+  if (!at45dbx_ftl_mounted || sector + nb_sector > at45dbx_ftl_get_nb_sector()) return false;
+
+  for (; lblk < end; lblk++)
+  {
+    if (at45dbx_ftl_lpage != AT45DBX_FTL_NO_LPAGE && at45dbx_ftl_lpage / AT45DBX_FTL_BLOCK_PAGES == lblk)
+    {
+      at45dbx_ftl_lpage = AT45DBX_FTL_NO_LPAGE;
+      at45dbx_ftl_page_dirty = false;
+    }
+
+    log = at45dbx_ftl_find_log(lblk);
+    if (log)
+    {
+      at45dbx_ftl_release(log->pblk);
+      log->lblk = AT45DBX_FTL_NONE;
+    }
+
+    if (at45dbx_ftl_map[lblk] != AT45DBX_FTL_NONE)
+    {
+      at45dbx_ftl_release(at45dbx_ftl_map[lblk]);
+      at45dbx_ftl_map[lblk] = AT45DBX_FTL_NONE;
+    }
+  }
+
+  return true;
+}
+
+
+bool at45dbx_ftl_sync(void)
+{
+  if (!at45dbx_ftl_mounted) return false;
+
+  if (!at45dbx_ftl_commit()) return false;
+
+  return (at45dbx_ftl_cp_changes) ? at45dbx_ftl_checkpoint() : true;
+}
+
+
+void at45dbx_ftl_idle(void)
+{
+  U8 i;
+
+  // No page to write and too few changes for a checkpoint.
+  if (!at45dbx_ftl_mounted ||
+      (!at45dbx_ftl_page_dirty && at45dbx_ftl_cp_changes < AT45DBX_FTL_CP_MIN_CHANGES)) return;
+
+  // Merge a full log block now rather than on its next write.
+  for (i = 0; i < AT45DBX_FTL_NB_LOG; i++)
+  {
+    if (at45dbx_ftl_log[i].lblk != AT45DBX_FTL_NONE &&
+        at45dbx_ftl_log[i].nb_used == AT45DBX_FTL_BLOCK_PAGES)
+    {
+      at45dbx_ftl_merge(&at45dbx_ftl_log[i]);
+      break;
+    }
+  }
+
+  at45dbx_ftl_wear_level();
+
+  // A checkpoint rewrites the whole mapping: it is only worth it once enough
+  // changes are gathered. at45dbx_ftl_sync bounds the time between two.
+  if (!at45dbx_ftl_commit()) return;
+  if (at45dbx_ftl_cp_changes >= AT45DBX_FTL_CP_MIN_CHANGES) at45dbx_ftl_checkpoint();
+}
+
+
+void at45dbx_ftl_get_stats(at45dbx_ftl_stats_t *stats)
+{
+  U16 pblk;
+
+  *stats = at45dbx_ftl_stats;
+  stats->min_erase = 0xFFFF;
+  stats->max_erase = 0;
+  for (pblk = 0; pblk < AT45DBX_FTL_FIRST_CP; pblk++)
+  {
+    if (at45dbx_ftl_erase_cnt[pblk] < stats->min_erase) stats->min_erase = at45dbx_ftl_erase_cnt[pblk];
+    if (at45dbx_ftl_erase_cnt[pblk] > stats->max_erase) stats->max_erase = at45dbx_ftl_erase_cnt[pblk];
+  }
+}
+
+
+//! @}
+
+
+#endif  // AT45DBX_FTL == true
+
+#endif  // AT45DBX_MEM == ENABLE
@@ -0,0 +1,201 @@
+/*****************************************************************************
+ *
+ * \file
+ *
+ * \brief Flash translation layer for the AT45DBX data flash controller.
+ *
+ * Copyright (c) 2009 Atmel Corporation. All rights reserved.
+ *
+ * \asf_license_start
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. The name of Atmel may not be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * 4. This software may only be redistributed and used in connection with an
+ *    Atmel microcontroller product.
+ *
+ * THIS SOFTWARE IS PROVIDED BY ATMEL "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT ARE
+ * EXPRESSLY AND SPECIFICALLY DISCLAIMED. IN NO EVENT SHALL ATMEL BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * \asf_license_stop
+ *
+ ******************************************************************************/
+
+
+#ifndef _AT45DBX_FTL_H_
+#define _AT45DBX_FTL_H_
+
+
+#include "conf_access.h"
+
+#if AT45DBX_MEM == DISABLE
+  #error at45dbx_ftl.h is #included although AT45DBX_MEM is disabled
+#endif
+
+
+//_____ D E F I N I T I O N S ______________________________________________
+
+/*! \name Default FTL Configuration
+ *
+ * These values may be overridden in conf_at45dbx.h.
+ */
+//! @{
+
+//! Enables the flash translation layer between CTRL_ACCESS and the DF driver.
+#ifndef AT45DBX_FTL
+  #define AT45DBX_FTL               false
+#endif
+
+//! Number of log blocks receiving the page writes out of place.
+#ifndef AT45DBX_FTL_NB_LOG
+  #define AT45DBX_FTL_NB_LOG        4
+#endif
+
+//! Number of spare blocks kept free for merges and wear leveling.
+#ifndef AT45DBX_FTL_NB_SPARE
+  #define AT45DBX_FTL_NB_SPARE      16
+#endif
+
+//! Number of checkpoint slots saving the mapping. The checkpoints rotate
+//! over all the pages of the slots.
+#ifndef AT45DBX_FTL_CP_SLOTS
+  #define AT45DBX_FTL_CP_SLOTS      4
+#endif
+
+//! Number of mapping changes after which \ref at45dbx_ftl_idle writes a
+//! checkpoint.
+#ifndef AT45DBX_FTL_CP_MIN_CHANGES
+  #define AT45DBX_FTL_CP_MIN_CHANGES  64
+#endif
+
+//! Erase count gap above which a cold block is moved to a worn free block.
+#ifndef AT45DBX_FTL_WL_THRESHOLD
+  #define AT45DBX_FTL_WL_THRESHOLD  64
+#endif
+
+//! @}
+
+//! FTL statistics, see \ref at45dbx_ftl_get_stats.
+typedef struct
+{
+  U32 host_writes;        //!< Number of pages written by the host.
+  U32 page_programs;      //!< Number of pages programmed in flash (host writes, merges and moves).
+  U32 merges;             //!< Number of log blocks merged with their data block.
+  U32 switches;           //!< Number of log blocks turned into data blocks without copy.
+  U32 wl_moves;           //!< Number of cold blocks moved by static wear leveling.
+  U32 checkpoints;        //!< Number of mapping checkpoints written.
+  U16 min_erase;          //!< Lowest block erase count.
+  U16 max_erase;          //!< Highest block erase count.
+} at45dbx_ftl_stats_t;
+
+
+//_____ D E C L A R A T I O N S ____________________________________________
+
+/*! \brief Loads the mapping from the last valid checkpoint.
+ *
+ * If no valid checkpoint is found, each logical block is mapped to the
+ * physical block with the same index, so that the content written without
+ * the FTL is kept.
+ *
+ * \retval true Success.
+ * \retval false Failure.
+ */
+extern bool at45dbx_ftl_mount(void);
+
+/*! \brief Tells whether the mapping is loaded.
+ *
+ * \return \c true if \ref at45dbx_ftl_mount succeeded, else \c false.
+ */
+extern bool at45dbx_ftl_is_mounted(void);
+
+/*! \brief Returns the number of logical sectors.
+ *
+ * \return Number of logical sectors.
+ */
+extern U32 at45dbx_ftl_get_nb_sector(void);
+
+/*! \brief Reads a logical sector.
+ *
+ * \param sector  Logical sector.
+ * \param ram     Pointer to RAM buffer to write.
+ *
+ * \retval true Success.
+ * \retval false Failure.
+ *
+ * \note A sector never written reads as 0xFF.
+ */
+extern bool at45dbx_ftl_read_sector(U32 sector, void *ram);
+
+/*! \brief Writes a logical sector.
+ *
+ * \param sector  Logical sector.
+ * \param ram     Pointer to RAM buffer to read.
+ *
+ * \retval true Success.
+ * \retval false Failure.
+ *
+ * \note The sectors of a DF page are gathered in RAM and the page is
+ *       appended to the log block of its logical block when another page is
+ *       written or on \ref at45dbx_ftl_sync.
+ */
+extern bool at45dbx_ftl_write_sector(U32 sector, const void *ram);
+
+/*! \brief Unmaps the logical blocks entirely inside a sector range.
+ *
+ * \param sector     First logical sector.
+ * \param nb_sector  Number of sectors.
+ *
+ * \retval true Success.
+ * \retval false Failure.
+ */
+extern bool at45dbx_ftl_discard(U32 sector, U32 nb_sector);
+
+/*! \brief Writes the page gathered in RAM and checkpoints the mapping.
+ *
+ * \retval true Success.
+ * \retval false Failure.
+ *
+ * \note The data written since the last checkpoint is lost on power loss,
+ *       but the mapping always rolls back to a consistent state: the blocks
+ *       released by merges are only reused after the next checkpoint.
+ */
+extern bool at45dbx_ftl_sync(void);
+
+/*! \brief Performs background garbage collection and wear leveling.
+ *
+ * Merges one full log block, moves one cold block if the erase counts drift
+ * apart by more than \ref AT45DBX_FTL_WL_THRESHOLD, writes the page gathered
+ * in RAM, then checkpoints the mapping if at least
+ * \ref AT45DBX_FTL_CP_MIN_CHANGES changes are pending.
+ * Should be called when the memory is idle; \ref at45dbx_ftl_sync should be
+ * called periodically to bound the changes lost on power loss.
+ */
+extern void at45dbx_ftl_idle(void);
+
+/*! \brief Gets the FTL statistics.
+ *
+ * \param stats  Pointer to the structure receiving the statistics.
+ */
+extern void at45dbx_ftl_get_stats(at45dbx_ftl_stats_t *stats);
+
+
+#endif  // _AT45DBX_FTL_H_
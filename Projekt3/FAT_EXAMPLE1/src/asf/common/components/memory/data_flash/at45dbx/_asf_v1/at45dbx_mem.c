@@ -50,9 +50,20 @@
 
 #include "conf_at45dbx.h"
 #include "at45dbx.h"
+#include "at45dbx_ftl.h"
 #include "at45dbx_mem.h"
 
 
+//_____ M A C R O S ________________________________________________________
+
+//! Number of sectors seen through CTRL_ACCESS.
+#if AT45DBX_FTL == true
+  #define AT45DBX_MEM_NB_SECTOR   at45dbx_ftl_get_nb_sector()
+#else
+  #define AT45DBX_MEM_NB_SECTOR   (AT45DBX_MEM_CNT << (AT45DBX_MEM_SIZE - AT45DBX_SECTOR_BITS))
+#endif
+
+
 //_____ D E F I N I T I O N S ______________________________________________
 
 /*! \name Control Interface
@@ -62,13 +73,20 @@
 
 Ctrl_status at45dbx_test_unit_ready(void)
 {
-  return (at45dbx_mem_check() == true) ? CTRL_GOOD : CTRL_NO_PRESENT;
+  if (at45dbx_mem_check() != true) return CTRL_NO_PRESENT;
+
+#if AT45DBX_FTL == true
+  // Load the mapping on first access.
+  if (!at45dbx_ftl_is_mounted() && !at45dbx_ftl_mount()) return CTRL_FAIL;
+#endif
+
+  return CTRL_GOOD;
 }
 
 
 Ctrl_status at45dbx_read_capacity(U32 *u32_nb_sector)
 {
-  *u32_nb_sector = (AT45DBX_MEM_CNT << (AT45DBX_MEM_SIZE - AT45DBX_SECTOR_BITS)) - 1;
+  *u32_nb_sector = AT45DBX_MEM_NB_SECTOR - 1;
 
   return CTRL_GOOD;
 }
@@ -86,13 +104,38 @@ bool at45dbx_removal(void)
 }
 
 
+U16 at45dbx_erase_block_size(void)
+{
+  return at45dbx_get_page_sectors();
+}
+
+
+Ctrl_status at45dbx_discard(U32 addr, U32 nb_sector)
+{
+  if (addr + nb_sector > AT45DBX_MEM_NB_SECTOR) return CTRL_FAIL;
+
+#if AT45DBX_FTL == true
+  return (at45dbx_ftl_discard(addr, nb_sector) == true) ? CTRL_GOOD : CTRL_FAIL;
+#else
+  return (at45dbx_erase(addr, nb_sector) == true) ? CTRL_GOOD : CTRL_FAIL;
+#endif
+}
+
+
 //! @}
 
 
 #if ACCESS_USB == true
 
+#include "conf_usb.h"
+#ifdef USB_DEVICE_VENDOR_ID
+  // USB Device Stack V2
+#include "udi_msc.h"
+#else
+  // USB Device Stack V1
 #include "usb_drv.h"
 #include "scsi_decoder.h"
+#endif
 
 
 /*! \name MEM <-> USB Interface
@@ -102,11 +145,26 @@ bool at45dbx_removal(void)
 
 Ctrl_status at45dbx_usb_read_10(U32 addr, U16 nb_sector)
 {
-  if (addr + nb_sector > AT45DBX_MEM_CNT << (AT45DBX_MEM_SIZE - AT45DBX_SECTOR_BITS)) return CTRL_FAIL;
+#if AT45DBX_FTL == true
+  U8 sector[AT45DBX_SECTOR_SIZE];
+#else
+  bool status;
+#endif
+
+  if (addr + nb_sector > AT45DBX_MEM_NB_SECTOR) return CTRL_FAIL;
 
-  at45dbx_read_open(addr);
-  at45dbx_read_multiple_sector(nb_sector);
+#if AT45DBX_FTL == true
+  while (nb_sector--)
+  {
+    if (!at45dbx_ftl_read_sector(addr++, sector)) return CTRL_FAIL;
+    at45dbx_read_multiple_sector_callback(sector);
+  }
+#else
+  if (!at45dbx_read_open(addr)) return CTRL_FAIL;
+  status = at45dbx_read_multiple_sector(nb_sector);
   at45dbx_read_close();
+  if (!status) return CTRL_FAIL;
+#endif
 
   return CTRL_GOOD;
 }
@@ -114,6 +172,11 @@ Ctrl_status at45dbx_usb_read_10(U32 addr, U16 nb_sector)
 
 void at45dbx_read_multiple_sector_callback(const void *psector)
 {
+#ifdef USB_DEVICE_VENDOR_ID
+  // USB Device Stack V2
+  udi_msc_trans_block(true, (uint8_t *)psector, AT45DBX_SECTOR_SIZE, NULL);
+#else
+  // USB Device Stack V1
   U16 data_to_transfer = AT45DBX_SECTOR_SIZE;
 
   // Transfer read sector to the USB interface.
@@ -130,16 +193,32 @@ void at45dbx_read_multiple_sector_callback(const void *psector)
                                              data_to_transfer, &psector);
     Usb_ack_in_ready_send(g_scsi_ep_ms_in);
   }
+#endif
 }
 
 
 Ctrl_status at45dbx_usb_write_10(U32 addr, U16 nb_sector)
 {
-  if (addr + nb_sector > AT45DBX_MEM_CNT << (AT45DBX_MEM_SIZE - AT45DBX_SECTOR_BITS)) return CTRL_FAIL;
+#if AT45DBX_FTL == true
+  U8 sector[AT45DBX_SECTOR_SIZE];
+#else
+  bool status;
+#endif
 
-  at45dbx_write_open(addr);
-  at45dbx_write_multiple_sector(nb_sector);
+  if (addr + nb_sector > AT45DBX_MEM_NB_SECTOR) return CTRL_FAIL;
+
+#if AT45DBX_FTL == true
+  while (nb_sector--)
+  {
+    at45dbx_write_multiple_sector_callback(sector);
+    if (!at45dbx_ftl_write_sector(addr++, sector)) return CTRL_FAIL;
+  }
+#else
+  if (!at45dbx_write_open_sectors(addr, nb_sector)) return CTRL_FAIL;
+  status = at45dbx_write_multiple_sector(nb_sector);
   at45dbx_write_close();
+  if (!status) return CTRL_FAIL;
+#endif
 
   return CTRL_GOOD;
 }
@@ -147,6 +226,11 @@ Ctrl_status at45dbx_usb_write_10(U32 addr, U16 nb_sector)
 
 void at45dbx_write_multiple_sector_callback(void *psector)
 {
+#ifdef USB_DEVICE_VENDOR_ID
+  // USB Device Stack V2
+  udi_msc_trans_block(false, (uint8_t *)psector, AT45DBX_SECTOR_SIZE, NULL);
+#else
+  // USB Device Stack V1
   U16 data_to_transfer = AT45DBX_SECTOR_SIZE;
 
   // Transfer sector to write from the USB interface.
@@ -163,6 +247,7 @@ void at45dbx_write_multiple_sector_callback(void *psector)
                                             data_to_transfer, &psector);
     Usb_ack_out_received_free(g_scsi_ep_ms_out);
   }
+#endif
 }
 
 
@@ -180,11 +265,20 @@ void at45dbx_write_multiple_sector_callback(void *psector)
 
 Ctrl_status at45dbx_df_2_ram(U32 addr, void *ram)
 {
-  if (addr + 1 > AT45DBX_MEM_CNT << (AT45DBX_MEM_SIZE - AT45DBX_SECTOR_BITS)) return CTRL_FAIL;
+#if AT45DBX_FTL != true
+  bool status;
+#endif
+
+  if (addr + 1 > AT45DBX_MEM_NB_SECTOR) return CTRL_FAIL;
 
-  at45dbx_read_open(addr);
-  at45dbx_read_sector_2_ram(ram);
+#if AT45DBX_FTL == true
+  if (!at45dbx_ftl_read_sector(addr, ram)) return CTRL_FAIL;
+#else
+  if (!at45dbx_read_open(addr)) return CTRL_FAIL;
+  status = at45dbx_read_sector_2_ram(ram);
   at45dbx_read_close();
+  if (!status) return CTRL_FAIL;
+#endif
 
   return CTRL_GOOD;
 }
@@ -192,11 +286,47 @@ Ctrl_status at45dbx_df_2_ram(U32 addr, void *ram)
 
 Ctrl_status at45dbx_ram_2_df(U32 addr, const void *ram)
 {
-  if (addr + 1 > AT45DBX_MEM_CNT << (AT45DBX_MEM_SIZE - AT45DBX_SECTOR_BITS)) return CTRL_FAIL;
+  if (addr + 1 > AT45DBX_MEM_NB_SECTOR) return CTRL_FAIL;
 
+#if AT45DBX_FTL == true
+  if (!at45dbx_ftl_write_sector(addr, ram)) return CTRL_FAIL;
+#else
   at45dbx_write_open(addr);
   at45dbx_write_sector_from_ram(ram);
   at45dbx_write_close();
+#endif
+
+  return CTRL_GOOD;
+}
+
+
+Ctrl_status at45dbx_df_2_ram_multi(U32 addr, U16 nb_sector, void *ram)
+{
+  U8 *_ram = ram;
+#if AT45DBX_FTL != true
+  bool status = true;
+#endif
+
+  if (addr + nb_sector > AT45DBX_MEM_NB_SECTOR) return CTRL_FAIL;
+
+#if AT45DBX_FTL == true
+  while (nb_sector--)
+  {
+    if (!at45dbx_ftl_read_sector(addr++, _ram)) return CTRL_FAIL;
+    _ram += AT45DBX_SECTOR_SIZE;
+  }
+#else
+  // A single read command streams all the sectors; it stops on a failed
+  // sector.
+  if (!at45dbx_read_open(addr)) return CTRL_FAIL;
+  while (status && nb_sector--)
+  {
+    status = at45dbx_read_sector_2_ram(_ram);
+    _ram += AT45DBX_SECTOR_SIZE;
+  }
+  at45dbx_read_close();
+  if (!status) return CTRL_FAIL;
+#endif
 
   return CTRL_GOOD;
 }
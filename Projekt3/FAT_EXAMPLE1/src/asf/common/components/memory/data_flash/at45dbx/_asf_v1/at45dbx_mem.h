@@ -96,6 +96,23 @@ extern bool at45dbx_wr_protect(void);
  */
 extern bool at45dbx_removal(void);
 
+/*! \brief Returns the erase block size of the memory.
+ *
+ * \return Erase block size (unit: 512 bytes), i.e. one DF page.
+ */
+extern U16 at45dbx_erase_block_size(void);
+
+/*! \brief Tells the memory that a sector range does not hold data anymore.
+ *
+ * \param addr      Address of first memory sector to discard.
+ * \param nb_sector Number of sectors to discard.
+ *
+ * \return Status.
+ *
+ * \note Only the DF pages entirely inside the range are erased.
+ */
+extern Ctrl_status at45dbx_discard(U32 addr, U32 nb_sector);
+
 //! @}
 
 
@@ -152,6 +169,16 @@ extern Ctrl_status at45dbx_df_2_ram(U32 addr, void *ram);
  */
 extern Ctrl_status at45dbx_ram_2_df(U32 addr, const void *ram);
 
+/*! \brief Copies consecutive data sectors from the memory to RAM.
+ *
+ * \param addr       Address of first memory sector to read.
+ * \param nb_sector  Number of sectors to read.
+ * \param ram        Pointer to RAM buffer to write.
+ *
+ * \return Status.
+ */
+extern Ctrl_status at45dbx_df_2_ram_multi(U32 addr, U16 nb_sector, void *ram);
+
 //! @}
 
 #endif
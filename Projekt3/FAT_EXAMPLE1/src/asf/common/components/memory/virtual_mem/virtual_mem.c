@@ -0,0 +1,448 @@
+/*****************************************************************************
+ *
+ * \file
+ *
+ * \brief CTRL_ACCESS interface for a virtual memory held in on-chip flash.
+ *
+ * Copyright (c) 2009 Atmel Corporation. All rights reserved.
+ *
+ * \asf_license_start
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. The name of Atmel may not be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * 4. This software may only be redistributed and used in connection with an
+ *    Atmel microcontroller product.
+ *
+ * THIS SOFTWARE IS PROVIDED BY ATMEL "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT ARE
+ * EXPRESSLY AND SPECIFICALLY DISCLAIMED. IN NO EVENT SHALL ATMEL BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * \asf_license_stop
+ *
+ ******************************************************************************/
+
+
+//_____  I N C L U D E S ___________________________________________________
+
+#include "conf_access.h"
+
+
+#if VIRTUAL_MEM == ENABLE
+
+#include <string.h>
+#include "flashc.h"
+#include "virtual_mem.h"
+
+
+//_____ M A C R O S ________________________________________________________
+
+#if AVR32_FLASHC_PAGE_SIZE % VIRTUAL_MEM_SECTOR_SIZE
+  #error The flash page size must be a multiple of the virtual memory sector size
+#endif
+
+#if VIRTUAL_MEM_FLASH_OFFSET % AVR32_FLASHC_PAGE_SIZE
+  #error VIRTUAL_MEM_FLASH_OFFSET must be aligned on a flash page
+#endif
+
+//! First flash page of the virtual memory.
+#define VIRTUAL_MEM_FIRST_PAGE    (VIRTUAL_MEM_FLASH_OFFSET / AVR32_FLASHC_PAGE_SIZE)
+
+//! Number of double-words in a flash page.
+#define VIRTUAL_MEM_PAGE_DWORDS   (AVR32_FLASHC_PAGE_SIZE / sizeof(U64))
+
+//! Address of a memory page in the flash array.
+#define Virtual_mem_page_addr(page) \
+  ((volatile U64 *)(AVR32_FLASH_ADDRESS + VIRTUAL_MEM_FLASH_OFFSET + (page) * AVR32_FLASHC_PAGE_SIZE))
+
+
+//_____ D E F I N I T I O N S ______________________________________________
+
+//! Copy of the cached page, with the sectors written since it was loaded.
+static Union64 virtual_cache[VIRTUAL_MEM_PAGE_DWORDS];
+
+//! Index of the cached page, \c VIRTUAL_MEM_NB_PAGE if none.
+static U32 virtual_cache_page = VIRTUAL_MEM_NB_PAGE;
+
+//! Whether the cached page differs from the flash array.
+static bool virtual_cache_dirty = false;
+
+//! Erase count of each page since reset.
+static U16 virtual_erase_count[VIRTUAL_MEM_NB_PAGE];
+
+//! Write statistics.
+static virtual_mem_stats_t virtual_stats;
+
+
+/*! \brief Programs the cached page into the flash array.
+ *
+ * The page is compared with the flash array first: nothing is programmed if
+ * they match, and the page is only erased if a bit must be set.
+ *
+ * \return \c true if the flash array holds the cached page, else \c false.
+ */
+static bool virtual_cache_write_back(void)
+{
+  volatile U64 *flash = Virtual_mem_page_addr(virtual_cache_page);
+  int page_number = VIRTUAL_MEM_FIRST_PAGE + virtual_cache_page;
+  bool same = true, erase = false, error = false;
+  U64 old;
+  U32 i;
+
+  // Always clear, although an error occurs.
+  virtual_cache_dirty = false;
+
+  for (i = 0; i < VIRTUAL_MEM_PAGE_DWORDS; i++)
+  {
+    old = flash[i];
+    if (old != virtual_cache[i].u64) same = false;
+    // Programming can only clear bits.
+    if ((old & virtual_cache[i].u64) != virtual_cache[i].u64) erase = true;
+  }
+  if (same)
+  {
+    virtual_stats.unchanged++;
+    return true;
+  }
+
+  // Fill the page buffer: it is written through the flash array addresses.
+  flashc_clear_page_buffer();
+  for (i = 0; i < VIRTUAL_MEM_PAGE_DWORDS; i++)
+    flash[i] = virtual_cache[i].u64;
+
+  if (erase)
+  {
+    flashc_erase_page(page_number, false);
+    error = flashc_is_lock_error() || flashc_is_programming_error();
+    virtual_stats.page_erases++;
+    if (++virtual_erase_count[virtual_cache_page] > virtual_stats.erase_max)
+      virtual_stats.erase_max = virtual_erase_count[virtual_cache_page];
+  }
+  flashc_write_page(page_number);
+  error |= flashc_is_lock_error() || flashc_is_programming_error();
+  virtual_stats.page_writes++;
+
+  return !error && !memcmp((const void *)flash, virtual_cache, AVR32_FLASHC_PAGE_SIZE);
+}
+
+
+/*! \brief Loads a page into the cache, writing back the previous one.
+ *
+ * \param page  Page index in the memory.
+ *
+ * \return \c true on success, else \c false.
+ */
+static bool virtual_cache_load(U32 page)
+{
+  if (page == virtual_cache_page) return true;
+  if (virtual_cache_dirty && !virtual_cache_write_back()) return false;
+
+  memcpy(virtual_cache, (const void *)Virtual_mem_page_addr(page), AVR32_FLASHC_PAGE_SIZE);
+  virtual_cache_page = page;
+
+  return true;
+}
+
+
+/*! \brief Returns the current data of a sector.
+ *
+ * \param addr  Sector address.
+ *
+ * \return Pointer to the sector in the cache if its page is cached, else in the
+ *         flash array.
+ */
+static const void *virtual_sector_data(U32 addr)
+{
+  U32 page = addr / VIRTUAL_MEM_PAGE_SECTORS;
+  U32 offset = (addr % VIRTUAL_MEM_PAGE_SECTORS) * VIRTUAL_MEM_SECTOR_SIZE;
+
+  if (page == virtual_cache_page) return (const U8 *)virtual_cache + offset;
+
+  return (const U8 *)Virtual_mem_page_addr(page) + offset;
+}
+
+
+/*! \brief Writes a sector into the cache.
+ *
+ * \param addr  Sector address.
+ * \param ram   Pointer to the sector data.
+ *
+ * \return \c true on success, else \c false.
+ */
+static bool virtual_sector_write(U32 addr, const void *ram)
+{
+  U32 page = addr / VIRTUAL_MEM_PAGE_SECTORS;
+
+  if (!virtual_cache_load(page)) return false;
+
+  virtual_stats.sector_writes++;
+  if (virtual_cache_dirty) virtual_stats.coalesced++;
+  memcpy((U8 *)virtual_cache + (addr % VIRTUAL_MEM_PAGE_SECTORS) * VIRTUAL_MEM_SECTOR_SIZE,
+         ram, VIRTUAL_MEM_SECTOR_SIZE);
+  virtual_cache_dirty = true;
+
+  return true;
+}
+
+
+/*! \name Control Interface
+ */
+//! @{
+
+
+Ctrl_status virtual_test_unit_ready(void)
+{
+  if (VIRTUAL_MEM_FLASH_OFFSET + VIRTUAL_MEM_NB_SECTOR * VIRTUAL_MEM_SECTOR_SIZE >
+      flashc_get_flash_size()) return CTRL_NO_PRESENT;
+
+  return CTRL_GOOD;
+}
+
+
+Ctrl_status virtual_read_capacity(U32 *u32_nb_sector)
+{
+  *u32_nb_sector = VIRTUAL_MEM_NB_SECTOR - 1;
+
+  return CTRL_GOOD;
+}
+
+
+bool virtual_wr_protect(void)
+{
+  unsigned int region;
+
+  for (region = flashc_get_page_region(VIRTUAL_MEM_FIRST_PAGE);
+       region <= flashc_get_page_region(VIRTUAL_MEM_FIRST_PAGE + VIRTUAL_MEM_NB_PAGE - 1);
+       region++)
+  {
+    if (flashc_is_region_locked(region)) return true;
+  }
+
+  return false;
+}
+
+
+bool virtual_removal(void)
+{
+  return false;
+}
+
+
+U16 virtual_erase_block_size(void)
+{
+  return VIRTUAL_MEM_PAGE_SECTORS;
+}
+
+
+//! @}
+
+
+/*! \name Write Cache
+ */
+//! @{
+
+
+Ctrl_status virtual_mem_flush(void)
+{
+  if (!virtual_cache_dirty) return CTRL_GOOD;
+
+  return (virtual_cache_write_back() == true) ? CTRL_GOOD : CTRL_FAIL;
+}
+
+
+void virtual_mem_get_stats(virtual_mem_stats_t *stats)
+{
+  *stats = virtual_stats;
+}
+
+
+U16 virtual_mem_get_erase_count(U32 page)
+{
+  return (page < VIRTUAL_MEM_NB_PAGE) ? virtual_erase_count[page] : 0;
+}
+
+
+//! @}
+
+
+#if ACCESS_USB == true
+
+#include "conf_usb.h"
+#ifdef USB_DEVICE_VENDOR_ID
+  // USB Device Stack V2
+#include "udi_msc.h"
+#else
+  // USB Device Stack V1
+#include "usb_drv.h"
+#include "scsi_decoder.h"
+#endif
+
+
+/*! \name MEM <-> USB Interface
+ */
+//! @{
+
+
+/*! \brief Sends a sector to the USB interface.
+ *
+ * \param psector Pointer to the sector data.
+ */
+static void virtual_usb_send_sector(const void *psector)
+{
+#ifdef USB_DEVICE_VENDOR_ID
+  // USB Device Stack V2
+  udi_msc_trans_block(true, (uint8_t *)psector, VIRTUAL_MEM_SECTOR_SIZE, NULL);
+#else
+  // USB Device Stack V1
+  U16 data_to_transfer = VIRTUAL_MEM_SECTOR_SIZE;
+
+  while (data_to_transfer)
+  {
+    while (!Is_usb_in_ready(g_scsi_ep_ms_in))
+    {
+      if(!Is_usb_endpoint_enabled(g_scsi_ep_ms_in))
+         return; // USB Reset
+    }
+
+    Usb_reset_endpoint_fifo_access(g_scsi_ep_ms_in);
+    data_to_transfer = usb_write_ep_txpacket(g_scsi_ep_ms_in, psector,
+                                             data_to_transfer, &psector);
+    Usb_ack_in_ready_send(g_scsi_ep_ms_in);
+  }
+#endif
+}
+
+
+/*! \brief Receives a sector from the USB interface.
+ *
+ * \param psector Pointer to the sector buffer.
+ */
+static void virtual_usb_receive_sector(void *psector)
+{
+#ifdef USB_DEVICE_VENDOR_ID
+  // USB Device Stack V2
+  udi_msc_trans_block(false, (uint8_t *)psector, VIRTUAL_MEM_SECTOR_SIZE, NULL);
+#else
+  // USB Device Stack V1
+  U16 data_to_transfer = VIRTUAL_MEM_SECTOR_SIZE;
+
+  while (data_to_transfer)
+  {
+    while (!Is_usb_out_received(g_scsi_ep_ms_out))
+    {
+      if(!Is_usb_endpoint_enabled(g_scsi_ep_ms_out))
+         return; // USB Reset
+    }
+
+    Usb_reset_endpoint_fifo_access(g_scsi_ep_ms_out);
+    data_to_transfer = usb_read_ep_rxpacket(g_scsi_ep_ms_out, psector,
+                                            data_to_transfer, &psector);
+    Usb_ack_out_received_free(g_scsi_ep_ms_out);
+  }
+#endif
+}
+
+
+Ctrl_status virtual_usb_read_10(U32 addr, U16 nb_sector)
+{
+  U8 sector[VIRTUAL_MEM_SECTOR_SIZE];
+
+  if (addr + nb_sector > VIRTUAL_MEM_NB_SECTOR) return CTRL_FAIL;
+
+  while (nb_sector--)
+  {
+    // The USB transfer is done from RAM.
+    memcpy(sector, virtual_sector_data(addr++), VIRTUAL_MEM_SECTOR_SIZE);
+    virtual_usb_send_sector(sector);
+  }
+
+  return CTRL_GOOD;
+}
+
+
+Ctrl_status virtual_usb_write_10(U32 addr, U16 nb_sector)
+{
+  U8 sector[VIRTUAL_MEM_SECTOR_SIZE];
+
+  if (addr + nb_sector > VIRTUAL_MEM_NB_SECTOR) return CTRL_FAIL;
+
+  while (nb_sector--)
+  {
+    virtual_usb_receive_sector(sector);
+    if (!virtual_sector_write(addr++, sector)) return CTRL_FAIL;
+  }
+
+  return CTRL_GOOD;
+}
+
+
+//! @}
+
+#endif  // ACCESS_USB == true
+
+
+#if ACCESS_MEM_TO_RAM == true
+
+/*! \name MEM <-> RAM Interface
+ */
+//! @{
+
+
+Ctrl_status virtual_mem_2_ram(U32 addr, void *ram)
+{
+  if (addr + 1 > VIRTUAL_MEM_NB_SECTOR) return CTRL_FAIL;
+
+  memcpy(ram, virtual_sector_data(addr), VIRTUAL_MEM_SECTOR_SIZE);
+
+  return CTRL_GOOD;
+}
+
+
+Ctrl_status virtual_ram_2_mem(U32 addr, const void *ram)
+{
+  if (addr + 1 > VIRTUAL_MEM_NB_SECTOR) return CTRL_FAIL;
+
+  return (virtual_sector_write(addr, ram) == true) ? CTRL_GOOD : CTRL_FAIL;
+}
+
+
+Ctrl_status virtual_mem_2_ram_multi(U32 addr, U16 nb_sector, void *ram)
+{
+  U8 *_ram = ram;
+
+  if (addr + nb_sector > VIRTUAL_MEM_NB_SECTOR) return CTRL_FAIL;
+
+  while (nb_sector--)
+  {
+    memcpy(_ram, virtual_sector_data(addr++), VIRTUAL_MEM_SECTOR_SIZE);
+    _ram += VIRTUAL_MEM_SECTOR_SIZE;
+  }
+
+  return CTRL_GOOD;
+}
+
+
+//! @}
+
+#endif  // ACCESS_MEM_TO_RAM == true
+
+
+#endif  // VIRTUAL_MEM == ENABLE
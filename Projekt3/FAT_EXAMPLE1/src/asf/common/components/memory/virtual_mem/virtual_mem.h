@@ -0,0 +1,242 @@
+/*****************************************************************************
+ *
+ * \file
+ *
+ * \brief CTRL_ACCESS interface for a virtual memory held in on-chip flash.
+ *
+ * Copyright (c) 2009 Atmel Corporation. All rights reserved.
+ *
+ * \asf_license_start
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. The name of Atmel may not be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * 4. This software may only be redistributed and used in connection with an
+ *    Atmel microcontroller product.
+ *
+ * THIS SOFTWARE IS PROVIDED BY ATMEL "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT ARE
+ * EXPRESSLY AND SPECIFICALLY DISCLAIMED. IN NO EVENT SHALL ATMEL BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * \asf_license_stop
+ *
+ ******************************************************************************/
+
+
+#ifndef _VIRTUAL_MEM_H_
+#define _VIRTUAL_MEM_H_
+
+
+#include "conf_access.h"
+
+#if VIRTUAL_MEM == DISABLE
+  #error virtual_mem.h is #included although VIRTUAL_MEM is disabled
+#endif
+
+
+#include "ctrl_access.h"
+#include "conf_virtual_mem.h"
+
+
+//_____ D E F I N I T I O N S ______________________________________________
+
+//! Size of a virtual memory sector in bytes.
+#define VIRTUAL_MEM_SECTOR_SIZE     512
+
+//! Number of sectors of the virtual memory.
+#ifndef VIRTUAL_MEM_NB_SECTOR
+  #define VIRTUAL_MEM_NB_SECTOR     128
+#endif
+
+//! Offset of the virtual memory in the flash array; must be page aligned.
+#ifndef VIRTUAL_MEM_FLASH_OFFSET
+  #define VIRTUAL_MEM_FLASH_OFFSET  (AVR32_FLASH_SIZE - VIRTUAL_MEM_NB_SECTOR * VIRTUAL_MEM_SECTOR_SIZE)
+#endif
+
+//! Number of sectors in a flash page.
+#define VIRTUAL_MEM_PAGE_SECTORS    (AVR32_FLASHC_PAGE_SIZE / VIRTUAL_MEM_SECTOR_SIZE)
+
+//! Number of flash pages holding the virtual memory.
+#define VIRTUAL_MEM_NB_PAGE         (VIRTUAL_MEM_NB_SECTOR * VIRTUAL_MEM_SECTOR_SIZE / AVR32_FLASHC_PAGE_SIZE)
+
+//! Virtual memory write statistics, counted since reset.
+typedef struct
+{
+  U32 sector_writes;  //!< Sectors written through CTRL_ACCESS.
+  U32 coalesced;      //!< Sector writes merged into a page already waiting in the cache.
+  U32 page_writes;    //!< Flash page programs.
+  U32 page_erases;    //!< Flash page erases.
+  U32 unchanged;      //!< Cached pages not programmed as the flash already held them.
+  U16 erase_max;      //!< Highest erase count of a page.
+} virtual_mem_stats_t;
+
+
+//_____ D E C L A R A T I O N S ____________________________________________
+
+/*! \name Control Interface
+ */
+//! @{
+
+/*! \brief Tests the memory state and initializes the memory if required.
+ *
+ * The TEST UNIT READY SCSI primary command allows an application client to poll
+ * a LUN until it is ready without having to allocate memory for returned data.
+ *
+ * This command may be used to check the media status of LUNs with removable
+ * media.
+ *
+ * \return Status.
+ */
+extern Ctrl_status virtual_test_unit_ready(void);
+
+/*! \brief Returns the address of the last valid sector in the memory.
+ *
+ * \param u32_nb_sector Pointer to the address of the last valid sector.
+ *
+ * \return Status.
+ */
+extern Ctrl_status virtual_read_capacity(U32 *u32_nb_sector);
+
+/*! \brief Returns the write-protection state of the memory.
+ *
+ * \return \c true if a flash lock region overlapping the memory is locked,
+ *         else \c false.
+ */
+extern bool virtual_wr_protect(void);
+
+/*! \brief Tells whether the memory is removable.
+ *
+ * \return \c true if the memory is removable, else \c false.
+ */
+extern bool virtual_removal(void);
+
+/*! \brief Returns the erase block size of the memory.
+ *
+ * \return Erase block size (unit: 512 bytes), i.e. one flash page.
+ */
+extern U16 virtual_erase_block_size(void);
+
+//! @}
+
+
+/*! \name Write Cache
+ *
+ * Sector writes are gathered in a one-page cache: all the updates made to the
+ * sectors of a flash page until the page changes or the cache is flushed cost
+ * a single page program, and the page is only erased if a bit must go from 0
+ * to 1.
+ */
+//! @{
+
+/*! \brief Programs the cached page into the flash array if it was modified.
+ *
+ * \return Status.
+ *
+ * \note To be called when the memory is idle, e.g. after each FAT command.
+ */
+extern Ctrl_status virtual_mem_flush(void);
+
+/*! \brief Gets the write statistics of the memory.
+ *
+ * \param stats Pointer to the statistics to fill.
+ */
+extern void virtual_mem_get_stats(virtual_mem_stats_t *stats);
+
+/*! \brief Returns the number of erases of a memory page since reset.
+ *
+ * \param page  Page index in the memory, \c 0 to \c VIRTUAL_MEM_NB_PAGE - 1.
+ *
+ * \return Erase count of the page.
+ */
+extern U16 virtual_mem_get_erase_count(U32 page);
+
+//! @}
+
+
+#if ACCESS_USB == true
+
+/*! \name MEM <-> USB Interface
+ */
+//! @{
+
+/*! \brief Tranfers data from the memory to USB.
+ *
+ * \param addr      Address of first memory sector to read.
+ * \param nb_sector Number of sectors to transfer.
+ *
+ * \return Status.
+ */
+extern Ctrl_status virtual_usb_read_10(U32 addr, U16 nb_sector);
+
+/*! \brief Tranfers data from USB to the memory.
+ *
+ * \param addr      Address of first memory sector to write.
+ * \param nb_sector Number of sectors to transfer.
+ *
+ * \return Status.
+ */
+extern Ctrl_status virtual_usb_write_10(U32 addr, U16 nb_sector);
+
+//! @}
+
+#endif
+
+
+#if ACCESS_MEM_TO_RAM == true
+
+/*! \name MEM <-> RAM Interface
+ */
+//! @{
+
+/*! \brief Copies 1 data sector from the memory to RAM.
+ *
+ * \param addr  Address of first memory sector to read.
+ * \param ram   Pointer to RAM buffer to write.
+ *
+ * \return Status.
+ */
+extern Ctrl_status virtual_mem_2_ram(U32 addr, void *ram);
+
+/*! \brief Copies 1 data sector from RAM to the memory.
+ *
+ * \param addr  Address of first memory sector to write.
+ * \param ram   Pointer to RAM buffer to read.
+ *
+ * \return Status.
+ */
+extern Ctrl_status virtual_ram_2_mem(U32 addr, const void *ram);
+
+/*! \brief Copies consecutive data sectors from the memory to RAM.
+ *
+ * \param addr       Address of first memory sector to read.
+ * \param nb_sector  Number of sectors to read.
+ * \param ram        Pointer to RAM buffer to write.
+ *
+ * \return Status.
+ */
+extern Ctrl_status virtual_mem_2_ram_multi(U32 addr, U16 nb_sector, void *ram);
+
+//! @}
+
+#endif
+
+
+#endif  // _VIRTUAL_MEM_H_
@@ -61,6 +61,7 @@
 #include "semphr.h"
 #endif
 #include "ctrl_access.h"
+#include "trace.h"
 
 
 //_____ D E F I N I T I O N S ______________________________________________
@@ -109,6 +110,85 @@ static xSemaphoreHandle ctrl_access_semphr = NULL;
 
 #if MAX_LUN
 
+/*! \name Optional LUN Interfaces
+ *
+ * Default values of the optional LUN interfaces not configured in conf_access.h.
+ */
+//! @{
+#if LUN_0 == ENABLE && !defined(Lun_0_erase_block_size)
+  #define Lun_0_erase_block_size   NULL
+#endif
+#if LUN_0 == ENABLE && !defined(Lun_0_discard)
+  #define Lun_0_discard            NULL
+#endif
+#if LUN_0 == ENABLE && !defined(Lun_0_mem_2_ram_multi)
+  #define Lun_0_mem_2_ram_multi    NULL
+#endif
+#if LUN_1 == ENABLE && !defined(Lun_1_erase_block_size)
+  #define Lun_1_erase_block_size   NULL
+#endif
+#if LUN_1 == ENABLE && !defined(Lun_1_discard)
+  #define Lun_1_discard            NULL
+#endif
+#if LUN_1 == ENABLE && !defined(Lun_1_mem_2_ram_multi)
+  #define Lun_1_mem_2_ram_multi    NULL
+#endif
+#if LUN_2 == ENABLE && !defined(Lun_2_erase_block_size)
+  #define Lun_2_erase_block_size   NULL
+#endif
+#if LUN_2 == ENABLE && !defined(Lun_2_discard)
+  #define Lun_2_discard            NULL
+#endif
+#if LUN_2 == ENABLE && !defined(Lun_2_mem_2_ram_multi)
+  #define Lun_2_mem_2_ram_multi    NULL
+#endif
+#if LUN_3 == ENABLE && !defined(Lun_3_erase_block_size)
+  #define Lun_3_erase_block_size   NULL
+#endif
+#if LUN_3 == ENABLE && !defined(Lun_3_discard)
+  #define Lun_3_discard            NULL
+#endif
+#if LUN_3 == ENABLE && !defined(Lun_3_mem_2_ram_multi)
+  #define Lun_3_mem_2_ram_multi    NULL
+#endif
+#if LUN_4 == ENABLE && !defined(Lun_4_erase_block_size)
+  #define Lun_4_erase_block_size   NULL
+#endif
+#if LUN_4 == ENABLE && !defined(Lun_4_discard)
+  #define Lun_4_discard            NULL
+#endif
+#if LUN_4 == ENABLE && !defined(Lun_4_mem_2_ram_multi)
+  #define Lun_4_mem_2_ram_multi    NULL
+#endif
+#if LUN_5 == ENABLE && !defined(Lun_5_erase_block_size)
+  #define Lun_5_erase_block_size   NULL
+#endif
+#if LUN_5 == ENABLE && !defined(Lun_5_discard)
+  #define Lun_5_discard            NULL
+#endif
+#if LUN_5 == ENABLE && !defined(Lun_5_mem_2_ram_multi)
+  #define Lun_5_mem_2_ram_multi    NULL
+#endif
+#if LUN_6 == ENABLE && !defined(Lun_6_erase_block_size)
+  #define Lun_6_erase_block_size   NULL
+#endif
+#if LUN_6 == ENABLE && !defined(Lun_6_discard)
+  #define Lun_6_discard            NULL
+#endif
+#if LUN_6 == ENABLE && !defined(Lun_6_mem_2_ram_multi)
+  #define Lun_6_mem_2_ram_multi    NULL
+#endif
+#if LUN_7 == ENABLE && !defined(Lun_7_erase_block_size)
+  #define Lun_7_erase_block_size   NULL
+#endif
+#if LUN_7 == ENABLE && !defined(Lun_7_discard)
+  #define Lun_7_discard            NULL
+#endif
+#if LUN_7 == ENABLE && !defined(Lun_7_mem_2_ram_multi)
+  #define Lun_7_mem_2_ram_multi    NULL
+#endif
+//! @}
+
 /*! \brief Initializes an entry of the LUN descriptor table.
  *
  * \param lun Logical Unit Number.
@@ -126,6 +206,9 @@ static xSemaphoreHandle ctrl_access_semphr = NULL;
     TPASTE3(Lun_, lun, _usb_write_10),\
     TPASTE3(Lun_, lun, _mem_2_ram),\
     TPASTE3(Lun_, lun, _ram_2_mem),\
+    TPASTE3(Lun_, lun, _mem_2_ram_multi),\
+    TPASTE3(Lun_, lun, _erase_block_size),\
+    TPASTE3(Lun_, lun, _discard),\
     TPASTE3(LUN_, lun, _NAME)\
   }
 #elif ACCESS_USB == true
@@ -137,6 +220,8 @@ static xSemaphoreHandle ctrl_access_semphr = NULL;
     TPASTE3(Lun_, lun, _removal),\
     TPASTE3(Lun_, lun, _usb_read_10),\
     TPASTE3(Lun_, lun, _usb_write_10),\
+    TPASTE3(Lun_, lun, _erase_block_size),\
+    TPASTE3(Lun_, lun, _discard),\
     TPASTE3(LUN_, lun, _NAME)\
   }
 #elif ACCESS_MEM_TO_RAM == true
@@ -148,6 +233,9 @@ static xSemaphoreHandle ctrl_access_semphr = NULL;
     TPASTE3(Lun_, lun, _removal),\
     TPASTE3(Lun_, lun, _mem_2_ram),\
     TPASTE3(Lun_, lun, _ram_2_mem),\
+    TPASTE3(Lun_, lun, _mem_2_ram_multi),\
+    TPASTE3(Lun_, lun, _erase_block_size),\
+    TPASTE3(Lun_, lun, _discard),\
     TPASTE3(LUN_, lun, _NAME)\
   }
 #else
@@ -157,6 +245,8 @@ static xSemaphoreHandle ctrl_access_semphr = NULL;
     TPASTE3(Lun_, lun, _read_capacity),\
     TPASTE3(Lun_, lun, _wr_protect),\
     TPASTE3(Lun_, lun, _removal),\
+    TPASTE3(Lun_, lun, _erase_block_size),\
+    TPASTE3(Lun_, lun, _discard),\
     TPASTE3(LUN_, lun, _NAME)\
   }
 #endif
@@ -175,7 +265,10 @@ static const struct
 #if ACCESS_MEM_TO_RAM == true
   Ctrl_status (*mem_2_ram)(U32, void *);
   Ctrl_status (*ram_2_mem)(U32, const void *);
+  Ctrl_status (*mem_2_ram_multi)(U32, U16, void *);
 #endif
+  U16 (*erase_block_size)(void);
+  Ctrl_status (*discard)(U32, U32);
   const char *name;
 } lun_desc[MAX_LUN] =
 {
@@ -347,6 +440,44 @@ U8 mem_sector_size(U8 lun)
 }
 
 
+U16 mem_erase_block_size(U8 lun)
+{
+  U16 erase_block_size;
+
+  if (!Ctrl_access_lock()) return 1;
+
+  erase_block_size =
+#if MAX_LUN
+                   (lun < MAX_LUN && lun_desc[lun].erase_block_size) ?
+                     lun_desc[lun].erase_block_size() :
+#endif
+                     1;
+
+  Ctrl_access_unlock();
+
+  return (erase_block_size) ? erase_block_size : 1;
+}
+
+
+Ctrl_status mem_discard(U8 lun, U32 addr, U32 nb_sector)
+{
+  Ctrl_status status;
+
+  if (!Ctrl_access_lock()) return CTRL_FAIL;
+
+  status =
+#if MAX_LUN
+           (lun < MAX_LUN && lun_desc[lun].discard) ?
+             lun_desc[lun].discard(addr, nb_sector) :
+#endif
+             CTRL_FAIL;
+
+  Ctrl_access_unlock();
+
+  return status;
+}
+
+
 bool mem_wr_protect(U8 lun)
 {
   bool wr_protect;
@@ -470,6 +601,7 @@ Ctrl_status usb_2_memory(U8 lun, U32 addr, U16 nb_sector)
 Ctrl_status memory_2_ram(U8 lun, U32 addr, void *ram)
 {
   Ctrl_status status;
+  Trace_function(TRACE_MEMORY_2_RAM);
 
   if (!Ctrl_access_lock()) return CTRL_FAIL;
 
@@ -494,6 +626,7 @@ Ctrl_status memory_2_ram(U8 lun, U32 addr, void *ram)
 Ctrl_status ram_2_memory(U8 lun, U32 addr, const void *ram)
 {
   Ctrl_status status;
+  Trace_function(TRACE_RAM_2_MEMORY);
 
   if (!Ctrl_access_lock()) return CTRL_FAIL;
 
@@ -515,6 +648,46 @@ Ctrl_status ram_2_memory(U8 lun, U32 addr, const void *ram)
 }
 
 
+Ctrl_status memory_2_ram_multi(U8 lun, U32 addr, U16 nb_sector, void *ram)
+{
+  Ctrl_status status = CTRL_GOOD;
+  U8 *_ram = ram;
+
+  if (!Ctrl_access_lock()) return CTRL_FAIL;
+
+  memory_start_read_action(nb_sector);
+#if MAX_LUN
+  if (lun < MAX_LUN && lun_desc[lun].mem_2_ram_multi)
+  {
+    status = lun_desc[lun].mem_2_ram_multi(addr, nb_sector, ram);
+  }
+  else
+#endif
+  {
+    // The memory has no multi-sector read: read the sectors one by one.
+    while (status == CTRL_GOOD && nb_sector--)
+    {
+      status =
+#if MAX_LUN
+               (lun < MAX_LUN) ? lun_desc[lun].mem_2_ram(addr, _ram) :
+#endif
+#if LUN_USB == ENABLE
+                                 Lun_usb_mem_2_ram(addr, _ram);
+#else
+                                 CTRL_FAIL;
+#endif
+      addr++;
+      _ram += 512;
+    }
+  }
+  memory_stop_read_action();
+
+  Ctrl_access_unlock();
+
+  return status;
+}
+
+
 //! @}
 
 #endif  // ACCESS_MEM_TO_RAM == true
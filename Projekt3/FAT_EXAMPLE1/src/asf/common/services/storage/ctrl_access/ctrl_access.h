@@ -229,6 +229,37 @@ extern Ctrl_status mem_read_capacity(U8 lun, U32 *u32_nb_sector);
  */
 extern U8 mem_sector_size(U8 lun);
 
+/*! \brief Returns the size of the erase block of the memory.
+ *
+ * Writes which do not fill whole erase blocks force the memory to perform a
+ * read-modify-write cycle internally, so the file system aligns its
+ * structures on this boundary.
+ *
+ * \param lun Logical Unit Number.
+ *
+ * \return Erase block size (unit: 512 bytes), 1 if unknown.
+ *
+ * \note Optional LUN interface: define \c Lun_X_erase_block_size in
+ *       conf_access.h to provide it.
+ */
+extern U16 mem_erase_block_size(U8 lun);
+
+/*! \brief Tells the memory that a sector range does not hold data anymore.
+ *
+ * The memory may erase the range to lower the cost of its next writes, so
+ * the content of discarded sectors is undefined afterwards.
+ *
+ * \param lun        Logical Unit Number.
+ * \param addr       Address of first memory sector to discard.
+ * \param nb_sector  Number of sectors to discard.
+ *
+ * \return Status, \ref CTRL_FAIL if the memory does not support discard.
+ *
+ * \note Optional LUN interface: define \c Lun_X_discard in conf_access.h to
+ *       provide it.
+ */
+extern Ctrl_status mem_discard(U8 lun, U32 addr, U32 nb_sector);
+
 /*! \brief Returns the write-protection state of the memory.
  *
  * \param lun Logical Unit Number.
@@ -316,6 +347,21 @@ extern Ctrl_status memory_2_ram(U8 lun, U32 addr, void *ram);
  */
 extern Ctrl_status ram_2_memory(U8 lun, U32 addr, const void *ram);
 
+/*! \brief Copies consecutive data sectors from the memory to RAM.
+ *
+ * \param lun        Logical Unit Number.
+ * \param addr       Address of first memory sector to read.
+ * \param nb_sector  Number of sectors to read.
+ * \param ram        Pointer to RAM buffer to write.
+ *
+ * \return Status.
+ *
+ * \note Optional LUN interface: define \c Lun_X_mem_2_ram_multi in
+ *       conf_access.h to read all the sectors with a single memory command.
+ *       Otherwise the sectors are read one by one.
+ */
+extern Ctrl_status memory_2_ram_multi(U8 lun, U32 addr, U16 nb_sector, void *ram);
+
 //! @}
 
 #endif  // ACCESS_MEM_TO_RAM == true
@@ -65,6 +65,12 @@
 #  endif
 #endif
 
+//! Number of TX buffer slots, each holding either a copy buffer of
+//! UDI_CDC_TX_BUFFERS bytes or a buffer written by reference
+#ifndef UDI_CDC_TX_NB_BUFFERS
+#  define UDI_CDC_TX_NB_BUFFERS  2
+#endif
+
 #if UDI_CDC_PORT_NB == 1
 # define PORT 0
 #else
@@ -358,6 +364,24 @@ static void udi_cdc_data_sent_common(uint8_t port, udd_ep_status_t status, iram_
  */
 static void udi_cdc_tx_send(uint8_t port);
 
+/**
+ * \brief Drops the TX buffers queued and releases the ones written by reference
+ *
+ * \param port       Communication port number to manage
+ */
+static void udi_cdc_tx_flush(uint8_t port);
+
+/**
+ * \brief Copies data in the free TX buffers
+ *
+ * \param port       Communication port number to manage
+ * \param buf        Data to copy
+ * \param size       Number of bytes to copy
+ *
+ * \return the number of bytes remaining (no free TX buffer)
+ */
+static iram_size_t udi_cdc_tx_copy(uint8_t port, const uint8_t *buf, iram_size_t size);
+
 #if UDI_CDC_PORT_NB == 1
 bool udi_cdc_multi_is_rx_ready(uint8_t port);
 #endif
@@ -409,7 +433,8 @@ static volatile bool udi_cdc_running[UDI_CDC_PORT_NB];
 
 /**
  * \name Variables to manage RX/TX transfer requests
- * Two buffers for each sense are used to optimize the speed.
+ * Two buffers for RX and a ring of UDI_CDC_TX_NB_BUFFERS buffers for TX
+ * are used to optimize the speed.
  */
 //@{
 
@@ -445,18 +470,30 @@ static const udd_callback_trans_t udi_cdc_data_received_callbacks[] = {
 //! Define a transfer halted
 #define  UDI_CDC_TRANS_HALTED    2
 
-//! Buffer to send data
-COMPILER_WORD_ALIGNED static uint8_t udi_cdc_tx_buf[UDI_CDC_PORT_NB][2][UDI_CDC_TX_BUFFERS];
-//! Data available in TX buffers
-static uint16_t udi_cdc_tx_buf_nb[UDI_CDC_PORT_NB][2];
-//! Give current TX buffer used (tx0 if 0, tx1 if 1)
-static volatile uint8_t udi_cdc_tx_buf_sel[UDI_CDC_PORT_NB];
+//! TX buffer slot
+typedef struct {
+	//! Data to send: copy buffer of the slot or buffer written by reference
+	const uint8_t *buf;
+	//! Number of bytes to send
+	iram_size_t nb;
+	//! Release callback of a buffer written by reference, else NULL
+	udi_cdc_tx_callback_t callback;
+} udi_cdc_tx_slot_t;
+
+//! Copy buffers of the TX slots
+COMPILER_WORD_ALIGNED static uint8_t udi_cdc_tx_buf[UDI_CDC_PORT_NB][UDI_CDC_TX_NB_BUFFERS][UDI_CDC_TX_BUFFERS];
+//! Ring of TX slots
+static udi_cdc_tx_slot_t udi_cdc_tx_ring[UDI_CDC_PORT_NB][UDI_CDC_TX_NB_BUFFERS];
+//! Oldest slot queued, the one sent when a transfer is on-going
+static volatile uint8_t udi_cdc_tx_ring_tail[UDI_CDC_PORT_NB];
+//! Number of slots queued
+static volatile uint8_t udi_cdc_tx_ring_nb[UDI_CDC_PORT_NB];
+//! Signal that the newest slot is a copy buffer still filled
+static volatile bool udi_cdc_tx_fill_open[UDI_CDC_PORT_NB];
 //! Value of SOF during last TX transfer
 static uint16_t udi_cdc_tx_sof_num[UDI_CDC_PORT_NB];
 //! Signal a transfer on-going
 static volatile bool udi_cdc_tx_trans_ongoing[UDI_CDC_PORT_NB];
-//! Signal that both buffer content data to send
-static volatile bool udi_cdc_tx_both_buf_to_send[UDI_CDC_PORT_NB];
 static const uint8_t UDI_CDC_DATA_EP_INS[]={
 	UDI_CDC_DATA_EP_IN,
 #if UDI_CDC_PORT_NB > 1
@@ -530,11 +567,8 @@ bool udi_cdc_comm_enable_3(void)
 static bool udi_cdc_data_enable_common(uint8_t port)
 {
 	// Initialize TX management
+	udi_cdc_tx_flush(PORT);
 	udi_cdc_tx_trans_ongoing[PORT] = false;
-	udi_cdc_tx_both_buf_to_send[PORT] = false;
-	udi_cdc_tx_buf_sel[PORT] = 0;
-	udi_cdc_tx_buf_nb[PORT][0] = 0;
-	udi_cdc_tx_buf_nb[PORT][1] = 0;
 	udi_cdc_tx_sof_num[PORT] = 0;
 	udi_cdc_tx_send(PORT);
 
@@ -911,67 +945,149 @@ static void udi_cdc_data_sent_3(udd_ep_status_t status, iram_size_t n)
 
 static void udi_cdc_data_sent_common(uint8_t port, udd_ep_status_t status, iram_size_t n)
 {
+	udi_cdc_tx_slot_t *slot;
+
 	if (UDD_EP_TRANSFER_OK != status) {
 		// Abort transfer
+		udi_cdc_tx_flush(PORT);
 		return;
 	}
-	udi_cdc_tx_buf_nb[PORT][(udi_cdc_tx_buf_sel[PORT]==0)?1:0] = 0;
-	udi_cdc_tx_both_buf_to_send[PORT] = false;
+	// Release the slot sent
+	slot = &udi_cdc_tx_ring[PORT][udi_cdc_tx_ring_tail[PORT]];
+	if (slot->callback != NULL) {
+		slot->callback(slot->buf, true);
+	}
+	udi_cdc_tx_ring_tail[PORT] = (udi_cdc_tx_ring_tail[PORT] + 1)
+			% UDI_CDC_TX_NB_BUFFERS;
+	udi_cdc_tx_ring_nb[PORT]--;
 	udi_cdc_tx_trans_ongoing[PORT] = false;
 	udi_cdc_tx_send(PORT);
 }
 
 
+static uint16_t udi_cdc_tx_get_sof_num(void)
+{
+	if (udd_is_high_speed()) {
+		return udd_get_micro_frame_number();
+	}
+	return udd_get_frame_number();
+}
+
+
 static void udi_cdc_tx_send(uint8_t port)
 {
 	irqflags_t flags;
-	uint8_t buf_sel_trans;
-	bool b_short_packet;
+	udi_cdc_tx_slot_t *slot;
+	bool b_last;
 
-	if (udi_cdc_tx_trans_ongoing[PORT]) {
-		return; // Already on going or wait next SOF to send next data
+	flags = cpu_irq_save(); // to protect the TX ring
+	if (udi_cdc_tx_trans_ongoing[PORT] || !udi_cdc_tx_ring_nb[PORT]) {
+		cpu_irq_restore(flags);
+		return; // Already on going or nothing to send
 	}
-	if (udd_is_high_speed()) {
-		if (udi_cdc_tx_sof_num[PORT] == udd_get_micro_frame_number()) {
-			return; // Wait next SOF to send next data
-		}
-	}else{
-		if (udi_cdc_tx_sof_num[PORT] == udd_get_frame_number()) {
+	slot = &udi_cdc_tx_ring[PORT][udi_cdc_tx_ring_tail[PORT]];
+	b_last = (1 == udi_cdc_tx_ring_nb[PORT]);
+	if (b_last && udi_cdc_tx_fill_open[PORT]) {
+		// Copy buffer still filled by the application:
+		// send a partial buffer once per SOF only, to gather the small writes.
+		if ((slot->nb != UDI_CDC_TX_BUFFERS)
+				&& (udi_cdc_tx_sof_num[PORT] == udi_cdc_tx_get_sof_num())) {
+			cpu_irq_restore(flags);
 			return; // Wait next SOF to send next data
 		}
-	}
-
-	flags = cpu_irq_save(); // to protect udi_cdc_tx_buf_sel
-	buf_sel_trans = udi_cdc_tx_buf_sel[PORT];
-	if (!udi_cdc_tx_both_buf_to_send[PORT]) {
-		// Send current Buffer
-		// and switch the current buffer
-		udi_cdc_tx_buf_sel[PORT] = (buf_sel_trans==0)?1:0;
-	}else{
-		// Send the other Buffer
-		// and no switch the current buffer
-		buf_sel_trans = (buf_sel_trans==0)?1:0;
+		udi_cdc_tx_fill_open[PORT] = false;
 	}
 	udi_cdc_tx_trans_ongoing[PORT] = true;
 	cpu_irq_restore(flags);
-	
-	b_short_packet = (udi_cdc_tx_buf_nb[PORT][buf_sel_trans] != UDI_CDC_TX_BUFFERS);
-	if (b_short_packet) {
-		if (udd_is_high_speed()) {
-			udi_cdc_tx_sof_num[PORT] = udd_get_micro_frame_number();
-		}else{
-			udi_cdc_tx_sof_num[PORT] = udd_get_frame_number();
-		}
+
+	// The last data queued ends with a short packet,
+	// or a ZLP when it is a multiple of the endpoint size,
+	// else the host may wait for more data before completing its read.
+	if (b_last) {
+		udi_cdc_tx_sof_num[PORT] = udi_cdc_tx_get_sof_num();
 	}else{
 		udi_cdc_tx_sof_num[PORT] = 0; // Force next transfer without wait SOF
 	}
 
-	// Send the buffer with enable of short packet
-	udd_ep_run( UDI_CDC_DATA_EP_INS[PORT],
-			b_short_packet,
-			udi_cdc_tx_buf[PORT][buf_sel_trans],
-			udi_cdc_tx_buf_nb[PORT][buf_sel_trans],
-			udi_cdc_data_sents[PORT]);
+	if (!udd_ep_run( UDI_CDC_DATA_EP_INS[PORT],
+			b_last,
+			(uint8_t *) slot->buf,
+			slot->nb,
+			udi_cdc_data_sents[PORT])) {
+		// Endpoint halted or disabled, retry at next SOF
+		udi_cdc_tx_trans_ongoing[PORT] = false;
+	}
+}
+
+
+static void udi_cdc_tx_flush(uint8_t port)
+{
+	irqflags_t flags;
+	udi_cdc_tx_slot_t *slot;
+
+	flags = cpu_irq_save(); // to protect the TX ring
+	while (udi_cdc_tx_ring_nb[PORT]) {
+		slot = &udi_cdc_tx_ring[PORT][udi_cdc_tx_ring_tail[PORT]];
+		udi_cdc_tx_ring_tail[PORT] = (udi_cdc_tx_ring_tail[PORT] + 1)
+				% UDI_CDC_TX_NB_BUFFERS;
+		udi_cdc_tx_ring_nb[PORT]--;
+		if (slot->callback != NULL) {
+			slot->callback(slot->buf, false);
+		}
+	}
+	udi_cdc_tx_ring_tail[PORT] = 0;
+	udi_cdc_tx_fill_open[PORT] = false;
+	udi_cdc_tx_trans_ongoing[PORT] = false;
+	cpu_irq_restore(flags);
+}
+
+
+static iram_size_t udi_cdc_tx_copy(uint8_t port, const uint8_t *buf, iram_size_t size)
+{
+	irqflags_t flags;
+	udi_cdc_tx_slot_t *slot;
+	uint8_t slot_sel;
+	iram_size_t copy_nb;
+
+	while (size) {
+		flags = cpu_irq_save(); // to protect the TX ring
+		slot_sel = (udi_cdc_tx_ring_tail[PORT] + udi_cdc_tx_ring_nb[PORT])
+				% UDI_CDC_TX_NB_BUFFERS;
+		if (udi_cdc_tx_fill_open[PORT]) {
+			// Fill the newest slot
+			slot_sel = (slot_sel + UDI_CDC_TX_NB_BUFFERS - 1)
+					% UDI_CDC_TX_NB_BUFFERS;
+		} else if (udi_cdc_tx_ring_nb[PORT] < UDI_CDC_TX_NB_BUFFERS) {
+			// Open a new slot
+			udi_cdc_tx_ring[PORT][slot_sel].buf = udi_cdc_tx_buf[PORT][slot_sel];
+			udi_cdc_tx_ring[PORT][slot_sel].nb = 0;
+			udi_cdc_tx_ring[PORT][slot_sel].callback = NULL;
+			udi_cdc_tx_ring_nb[PORT]++;
+			udi_cdc_tx_fill_open[PORT] = true;
+		} else {
+			cpu_irq_restore(flags);
+			break; // No free slot
+		}
+		slot = &udi_cdc_tx_ring[PORT][slot_sel];
+		copy_nb = UDI_CDC_TX_BUFFERS - slot->nb;
+		if (copy_nb > size) {
+			copy_nb = size;
+		}
+		memcpy(&udi_cdc_tx_buf[PORT][slot_sel][slot->nb], buf, copy_nb);
+		slot->nb += copy_nb;
+		if (slot->nb == UDI_CDC_TX_BUFFERS) {
+			// Slot full, send it without waiting the SOF
+			udi_cdc_tx_fill_open[PORT] = false;
+		}
+		cpu_irq_restore(flags);
+		buf += copy_nb;
+		size -= copy_nb;
+	}
+	if ((udi_cdc_tx_ring_nb[PORT] > 1) || !udi_cdc_tx_fill_open[PORT]) {
+		// A full buffer is waiting
+		udi_cdc_tx_send(PORT);
+	}
+	return size;
 }
 
 
@@ -1126,21 +1242,7 @@ iram_size_t udi_cdc_read_buf(int* buf, iram_size_t size)
 
 bool udi_cdc_multi_is_tx_ready(uint8_t port)
 {
-	irqflags_t flags;
-	if (udi_cdc_tx_buf_nb[PORT][udi_cdc_tx_buf_sel[PORT]]!=UDI_CDC_TX_BUFFERS) {
-		return true;
-	}
-	if (!udi_cdc_tx_both_buf_to_send[PORT]) {
-		flags = cpu_irq_save(); // to protect udi_cdc_tx_buf_sel
-		if (!udi_cdc_tx_trans_ongoing[PORT]) {
-			// No transfer on-going
-			// then use the other buffer to store data
-			udi_cdc_tx_both_buf_to_send[PORT] = true;
-			udi_cdc_tx_buf_sel[PORT] = (udi_cdc_tx_buf_sel[PORT]==0)?1:0;
-		}
-	  	cpu_irq_restore(flags);
-	}
-	return (udi_cdc_tx_buf_nb[PORT][udi_cdc_tx_buf_sel[PORT]]!=UDI_CDC_TX_BUFFERS);
+	return (udi_cdc_multi_get_free_tx_buffer(PORT) != 0);
 }
 
 bool udi_cdc_is_tx_ready(void)
@@ -1148,29 +1250,45 @@ bool udi_cdc_is_tx_ready(void)
 	return udi_cdc_multi_is_tx_ready(0);
 }
 
-int udi_cdc_multi_putc(uint8_t port, int value)
+iram_size_t udi_cdc_multi_get_free_tx_buffer(uint8_t port)
 {
 	irqflags_t flags;
+	iram_size_t free_nb;
+
+	flags = cpu_irq_save(); // to protect the TX ring
+	free_nb = (UDI_CDC_TX_NB_BUFFERS - udi_cdc_tx_ring_nb[PORT])
+			* UDI_CDC_TX_BUFFERS;
+	if (udi_cdc_tx_fill_open[PORT]) {
+		free_nb += UDI_CDC_TX_BUFFERS - udi_cdc_tx_ring[PORT][
+				(udi_cdc_tx_ring_tail[PORT] + udi_cdc_tx_ring_nb[PORT] - 1)
+				% UDI_CDC_TX_NB_BUFFERS].nb;
+	}
+	cpu_irq_restore(flags);
+	return free_nb;
+}
+
+iram_size_t udi_cdc_get_free_tx_buffer(void)
+{
+	return udi_cdc_multi_get_free_tx_buffer(0);
+}
+
+int udi_cdc_multi_putc(uint8_t port, int value)
+{
 	bool b_databit_9;
-	uint8_t buf_sel;
+	uint8_t byte;
 
 	b_databit_9 = (9 == udi_cdc_line_coding[PORT].bDataBits);
 
 udi_cdc_putc_process_one_byte:
-	// Check avaliable space
-	if (!udi_cdc_multi_is_tx_ready(PORT)) {
+	// Write value when space is available
+	byte = value;
+	if (udi_cdc_tx_copy(PORT, &byte, 1)) {
 		if (!udi_cdc_running[PORT]) {
 			return false;
 		}
 		goto udi_cdc_putc_process_one_byte;
 	}
 
-	// Write value
-	flags = cpu_irq_save();
-	buf_sel = udi_cdc_tx_buf_sel[PORT];
-	udi_cdc_tx_buf[PORT][buf_sel][udi_cdc_tx_buf_nb[PORT][buf_sel]++] = value;
-	cpu_irq_restore(flags);
-
 	if (b_databit_9) {
 		// Send MSB
 		b_databit_9 = false;
@@ -1187,10 +1305,7 @@ int udi_cdc_putc(int value)
 
 iram_size_t udi_cdc_multi_write_buf(uint8_t port, const int* buf, iram_size_t size)
 {
-	irqflags_t flags;
-	uint8_t buf_sel;
-	uint16_t buf_nb;
-	iram_size_t copy_nb;
+	iram_size_t remain_nb;
 	uint8_t *ptr_buf = (uint8_t *)buf;
 
 	if (9 == udi_cdc_line_coding[PORT].bDataBits) {
@@ -1198,31 +1313,18 @@ iram_size_t udi_cdc_multi_write_buf(uint8_t port, const int* buf, iram_size_t si
 	}
 
 udi_cdc_write_buf_loop_wait:
-	// Check avaliable space
-	if (!udi_cdc_multi_is_tx_ready(PORT)) {
-		if (!udi_cdc_running[PORT]) {
-			return size;
-		}
-		goto udi_cdc_write_buf_loop_wait;
-	}
-
-	// Write values
-	flags = cpu_irq_save();
-	buf_sel = udi_cdc_tx_buf_sel[PORT];
-	buf_nb = udi_cdc_tx_buf_nb[PORT][buf_sel];
-	copy_nb = UDI_CDC_TX_BUFFERS - buf_nb;
-	if (copy_nb>size) {
-		copy_nb = size;
-	}
-	memcpy(&udi_cdc_tx_buf[PORT][buf_sel][buf_nb], ptr_buf, copy_nb);
-	udi_cdc_tx_buf_nb[PORT][buf_sel] = buf_nb + copy_nb;
-	cpu_irq_restore(flags);
+	// Write values in the free space
+	remain_nb = udi_cdc_tx_copy(PORT, ptr_buf, size);
 
 	// Update buffer pointer
-	ptr_buf = ptr_buf + copy_nb;
-	size -= copy_nb;
+	ptr_buf = ptr_buf + (size - remain_nb);
+	size = remain_nb;
 
 	if (size) {
+		// Wait for free space
+		if (!udi_cdc_running[PORT]) {
+			return size;
+		}
 		goto udi_cdc_write_buf_loop_wait;
 	}
 
@@ -1234,4 +1336,49 @@ iram_size_t udi_cdc_write_buf(const int* buf, iram_size_t size)
 	return udi_cdc_multi_write_buf(0, buf, size);
 }
 
+iram_size_t udi_cdc_multi_try_write_buf(uint8_t port, const void* buf, iram_size_t size)
+{
+	return udi_cdc_tx_copy(PORT, (const uint8_t *)buf, size);
+}
+
+iram_size_t udi_cdc_try_write_buf(const void* buf, iram_size_t size)
+{
+	return udi_cdc_multi_try_write_buf(0, buf, size);
+}
+
+bool udi_cdc_multi_write_buf_ref(uint8_t port, const void* buf, iram_size_t size,
+		udi_cdc_tx_callback_t callback)
+{
+	irqflags_t flags;
+	uint8_t slot_sel;
+
+	if (!size || !udi_cdc_running[PORT]) {
+		return false;
+	}
+
+	flags = cpu_irq_save(); // to protect the TX ring
+	if (udi_cdc_tx_ring_nb[PORT] == UDI_CDC_TX_NB_BUFFERS) {
+		cpu_irq_restore(flags);
+		return false; // No free slot
+	}
+	// Queue the buffer after the data copied before
+	slot_sel = (udi_cdc_tx_ring_tail[PORT] + udi_cdc_tx_ring_nb[PORT])
+			% UDI_CDC_TX_NB_BUFFERS;
+	udi_cdc_tx_ring[PORT][slot_sel].buf = buf;
+	udi_cdc_tx_ring[PORT][slot_sel].nb = size;
+	udi_cdc_tx_ring[PORT][slot_sel].callback = callback;
+	udi_cdc_tx_ring_nb[PORT]++;
+	udi_cdc_tx_fill_open[PORT] = false;
+	cpu_irq_restore(flags);
+
+	udi_cdc_tx_send(PORT);
+	return true;
+}
+
+bool udi_cdc_write_buf_ref(const void* buf, iram_size_t size,
+		udi_cdc_tx_callback_t callback)
+{
+	return udi_cdc_multi_write_buf_ref(0, buf, size, callback);
+}
+
 //@}
@@ -333,6 +333,17 @@ extern UDC_DESC_STORAGE udi_api_t udi_api_cdc_data_2;
 extern UDC_DESC_STORAGE udi_api_t udi_api_cdc_comm_3;
 extern UDC_DESC_STORAGE udi_api_t udi_api_cdc_data_3;
 
+/**
+ * \brief Release of a buffer written by reference
+ *
+ * Called from the USB interrupt once the buffer has been sent, or dropped
+ * because the CDC interface was disabled; the buffer may then be reused.
+ *
+ * \param buf       Buffer given to udi_cdc_write_buf_ref()
+ * \param b_sent    true if the buffer was sent, false if it was dropped
+ */
+typedef void (*udi_cdc_tx_callback_t)(const void *buf, bool b_sent);
+
 /**
  * \name Interface for application
  *
@@ -421,6 +432,41 @@ int udi_cdc_putc(int value);
  * \return the number of data remaining
  */
 iram_size_t udi_cdc_write_buf(const int* buf, iram_size_t size);
+
+/**
+ * \brief Gets the number of bytes which can be written without waiting
+ *
+ * \return the number of bytes accepted by udi_cdc_try_write_buf()
+ */
+iram_size_t udi_cdc_get_free_tx_buffer(void);
+
+/**
+ * \brief Writes a RAM buffer on CDC line without waiting
+ *
+ * Copies the bytes which fit in the free TX buffers.
+ *
+ * \param buf       Values to write
+ * \param size      Number of value to write
+ *
+ * \return the number of data remaining (not written)
+ */
+iram_size_t udi_cdc_try_write_buf(const void* buf, iram_size_t size);
+
+/**
+ * \brief Writes a RAM buffer on CDC line by reference, without copy
+ *
+ * The buffer takes a TX buffer slot and is sent by the USB endpoint
+ * directly, after the data written before. It shall not be modified
+ * until \a callback is called.
+ *
+ * \param buf       Values to write
+ * \param size      Number of value to write (not 0)
+ * \param callback  Called when the buffer is released, or NULL
+ *
+ * \return \c 1 if the buffer is queued, \c 0 if no TX buffer slot is free.
+ */
+bool udi_cdc_write_buf_ref(const void* buf, iram_size_t size,
+		udi_cdc_tx_callback_t callback);
 //@}
 
 
@@ -529,6 +575,45 @@ int udi_cdc_multi_putc(uint8_t port, int value);
  * \return the number of data remaining
  */
 iram_size_t udi_cdc_multi_write_buf(uint8_t port, const int* buf, iram_size_t size);
+
+/**
+ * \brief Gets the number of bytes which can be written without waiting
+ *
+ * \param port       Communication port number to manage
+ *
+ * \return the number of bytes accepted by udi_cdc_multi_try_write_buf()
+ */
+iram_size_t udi_cdc_multi_get_free_tx_buffer(uint8_t port);
+
+/**
+ * \brief Writes a RAM buffer on CDC line without waiting
+ *
+ * Copies the bytes which fit in the free TX buffers.
+ *
+ * \param port       Communication port number to manage
+ * \param buf       Values to write
+ * \param size      Number of value to write
+ *
+ * \return the number of data remaining (not written)
+ */
+iram_size_t udi_cdc_multi_try_write_buf(uint8_t port, const void* buf, iram_size_t size);
+
+/**
+ * \brief Writes a RAM buffer on CDC line by reference, without copy
+ *
+ * The buffer takes a TX buffer slot and is sent by the USB endpoint
+ * directly, after the data written before. It shall not be modified
+ * until \a callback is called.
+ *
+ * \param port       Communication port number to manage
+ * \param buf       Values to write
+ * \param size      Number of value to write (not 0)
+ * \param callback  Called when the buffer is released, or NULL
+ *
+ * \return \c 1 if the buffer is queued, \c 0 if no TX buffer slot is free.
+ */
+bool udi_cdc_multi_write_buf_ref(uint8_t port, const void* buf, iram_size_t size,
+		udi_cdc_tx_callback_t callback);
 //@}
 
 //@}
@@ -44,6 +44,9 @@
 #include "udc_desc.h"
 #include "udi_cdc.h"
 
+// A composite device defines its descriptors in udi_composite_desc.c
+#ifndef UDI_COMPOSITE_DESC_T
+
 
 /**
  * \ingroup udi_cdc_group
@@ -242,3 +245,5 @@ UDC_DESC_STORAGE udc_config_t udc_config = {
 //@}
 /**INDENT-ON**/
 //@}
+
+#endif // UDI_COMPOSITE_DESC_T
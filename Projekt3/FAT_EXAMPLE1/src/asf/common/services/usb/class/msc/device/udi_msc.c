@@ -0,0 +1,1115 @@
+/**
+ * \file
+ *
+ * \brief USB Device Mass Storage Class (MSC) interface.
+ *
+ * Copyright (c) 2009-2012 Atmel Corporation. All rights reserved.
+ *
+ * \asf_license_start
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. The name of Atmel may not be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * 4. This software may only be redistributed and used in connection with an
+ *    Atmel microcontroller product.
+ *
+ * THIS SOFTWARE IS PROVIDED BY ATMEL "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT ARE
+ * EXPRESSLY AND SPECIFICALLY DISCLAIMED. IN NO EVENT SHALL ATMEL BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * \asf_license_stop
+ *
+ */
+
+#include "conf_usb.h"
+#include "usb_protocol.h"
+#include "usb_protocol_msc.h"
+#include "spc_protocol.h"
+#include "sbc_protocol.h"
+#include "udd.h"
+#include "udc.h"
+#include "udi_msc.h"
+#include "ctrl_access.h"
+#include <string.h>
+
+#ifndef UDI_MSC_NOTIFY_TRANS_EXT
+#  define UDI_MSC_NOTIFY_TRANS_EXT()
+#endif
+
+//! Size of the blocks streamed through the internal buffers
+#ifndef UDI_MSC_BLOCK_SIZE
+#  define UDI_MSC_BLOCK_SIZE     512
+#endif
+
+/**
+ * \addtogroup udi_msc_group
+ *
+ * @{
+ */
+
+/**
+ * \name Interface for UDC
+ */
+//@{
+
+bool udi_msc_enable(void);
+void udi_msc_disable(void);
+bool udi_msc_setup(void);
+uint8_t udi_msc_getsetting(void);
+
+//! Global structure which contains standard UDI API for UDC
+UDC_DESC_STORAGE udi_api_t udi_api_msc = {
+	.enable = udi_msc_enable,
+	.disable = udi_msc_disable,
+	.setup = udi_msc_setup,
+	.getsetting = udi_msc_getsetting,
+	.sof_notify = NULL,
+};
+//@}
+
+
+/**
+ * \name Internal variables
+ */
+//@{
+
+//! Status of the MSC interface
+static volatile bool udi_msc_b_enabled;
+
+//! Number of the last LUN, returned by GET MAX LUN request
+static uint8_t udi_msc_nb_lun;
+
+//! LUNs ejected by the host through START STOP UNIT (one bit per LUN)
+static volatile uint8_t udi_msc_lun_ejected;
+
+//! Sense data reported to the next REQUEST SENSE command
+static struct scsi_request_sense_data udi_msc_sense;
+
+//! Signals an invalid CBW, the endpoints stay halted until a Bulk-Only reset
+static bool udi_msc_b_cbw_invalid;
+
+//! Signals a CBW waiting to be processed by udi_msc_process_trans()
+static volatile bool udi_msc_b_trans_req;
+
+//! Signals a reset (Bulk-Only reset, USB reset or disable) during a command
+static volatile bool udi_msc_b_reset_trans;
+
+//! Structure to receive a CBW packet
+COMPILER_WORD_ALIGNED static struct usb_msc_cbw udi_msc_cbw;
+
+//! Structure to send a CSW packet
+COMPILER_WORD_ALIGNED static struct usb_msc_csw udi_msc_csw =
+		{.dCSWSignature = CPU_TO_LE32(USB_CSW_SIGNATURE) };
+//@}
+
+
+/**
+ * \name Variables to stream the blocks of READ10 and WRITE10
+ *
+ * The blocks are exchanged with the endpoints through two buffers, so the
+ * memory accesses the next block while the current one is on the USB line.
+ * The first buffer is also used to build the responses of other commands.
+ */
+//@{
+
+//! Ping-pong buffers
+COMPILER_WORD_ALIGNED static uint8_t udi_msc_buf[2][UDI_MSC_BLOCK_SIZE];
+
+//! Buffer used by the next block
+static uint8_t udi_msc_buf_sel;
+
+//! A transfer has been started and is not yet accounted in the residue
+static bool udi_msc_b_trans_queued;
+
+//! The transfer started is on the USB line
+static volatile bool udi_msc_b_trans_ongoing;
+
+//! The transfer started has been aborted
+static volatile bool udi_msc_b_trans_abort;
+
+//! Number of bytes transfered by the transfer started
+static volatile iram_size_t udi_msc_trans_nb;
+
+//! Number of bytes of the current command not yet started on the USB line
+static uint32_t udi_msc_trans_left;
+//@}
+
+
+/**
+ * \name Internal routines
+ */
+//@{
+
+/**
+ * \name Routines to process CBW packet
+ */
+//@{
+
+/**
+ * \brief Starts the reception of a CBW packet
+ */
+static void udi_msc_cbw_wait(void);
+
+/**
+ * \brief Callback called after the CBW reception
+ *
+ * \param status     UDD_EP_TRANSFER_OK, if transfer is finished
+ * \param status     UDD_EP_TRANSFER_ABORT, if transfer is aborted
+ * \param nb_received number of data transfered
+ */
+static void udi_msc_cbw_received(udd_ep_status_t status,
+		iram_size_t nb_received);
+
+/**
+ * \brief Halts the OUT endpoint after an invalid CBW,
+ * and halts it again until a Bulk-Only reset
+ */
+static void udi_msc_cbw_invalid(void);
+
+/**
+ * \brief Halts the IN endpoint after an invalid CBW,
+ * and halts it again until a Bulk-Only reset
+ */
+static void udi_msc_csw_invalid(void);
+
+/**
+ * \brief Checks the length and the direction of the data phase
+ * requested by the SCSI command against the CBW
+ *
+ * If it does not match, then the command fails and the CSW is sent.
+ *
+ * \param alloc_len  Data length requested by the SCSI command
+ * \param dir_flag   Data direction requested by the SCSI command
+ *
+ * \return \c 1 if the CBW is compatible with the SCSI command
+ */
+static bool udi_msc_cbw_validate(uint32_t alloc_len, uint8_t dir_flag);
+//@}
+
+
+/**
+ * \name Routines to process small data packet
+ */
+//@{
+
+/**
+ * \brief Sends a small response of a SCSI command
+ *
+ * \param buffer     Buffer on Internal RAM to send
+ * \param buf_size   Size of buffer to send
+ */
+static void udi_msc_data_send(uint8_t * buffer, uint8_t buf_size);
+
+/**
+ * \brief Callback called after the response transfer
+ *
+ * \param status     UDD_EP_TRANSFER_OK, if transfer finish
+ * \param status     UDD_EP_TRANSFER_ABORT, if transfer aborted
+ * \param nb_sent    number of data transfered
+ */
+static void udi_msc_data_sent(udd_ep_status_t status, iram_size_t nb_sent);
+//@}
+
+
+/**
+ * \name Routines to process CSW packet
+ */
+//@{
+
+/**
+ * \brief Halts the data endpoint if the residue is not null,
+ * then sends the CSW
+ */
+static void udi_msc_csw_process(void);
+
+/**
+ * \brief Sends the CSW, or waits the end of the halt of IN endpoint
+ */
+static void udi_msc_csw_send(void);
+
+/**
+ * \brief Callback called after the CSW transfer
+ *
+ * \param status     UDD_EP_TRANSFER_OK, if transfer is finished
+ * \param status     UDD_EP_TRANSFER_ABORT, if transfer is aborted
+ * \param nb_sent    number of data transfered
+ */
+static void udi_msc_csw_sent(udd_ep_status_t status, iram_size_t nb_sent);
+//@}
+
+
+/**
+ * \name Routines manage sense data
+ */
+//@{
+
+/**
+ * \brief Resets the sense data
+ */
+static void udi_msc_clear_sense(void);
+
+/**
+ * \brief Updates the sense data and the CSW status for a failed command
+ *
+ * \param sense_key  Sense key
+ * \param add_sense  Additional Sense Code and qualifier
+ * \param lba        LBA corresponding at error
+ */
+static void udi_msc_sense_fail(uint8_t sense_key, uint16_t add_sense,
+		uint32_t lba);
+
+/**
+ * \brief Updates the sense data and the CSW status for a passed command
+ */
+static void udi_msc_sense_pass(void);
+
+/**
+ * \brief Updates the sense data from the status returned by ctrl_access
+ *
+ * \param status     Status of memory access
+ * \param lba        LBA corresponding at error
+ */
+static void udi_msc_sense_status(Ctrl_status status, uint32_t lba);
+
+/**
+ * \brief Updates the sense data for a command not supported
+ */
+static void udi_msc_sense_fail_cdb_invalid(void);
+//@}
+
+
+/**
+ * \name Routines manage SCSI Commands
+ */
+//@{
+
+/**
+ * \brief Tells if the LUN of the current CBW has been ejected by the host
+ *
+ * \return \c 1 if the LUN is ejected, the sense data is then updated.
+ */
+static bool udi_msc_lun_is_ejected(void);
+
+//! \brief Process SPC Request Sense command
+static void udi_msc_spc_requestsense(void);
+
+//! \brief Process SPC Inquiry command
+static void udi_msc_spc_inquiry(void);
+
+/**
+ * \brief Process SPC Mode Sense command
+ *
+ * \param b_sense10  Sense10 SCSI command, if true
+ */
+static void udi_msc_spc_mode_sense(bool b_sense10);
+
+//! \brief Process SPC Test Unit Ready command
+static void udi_msc_spc_test_unit_ready(void);
+
+//! \brief Process SBC Read Capacity command
+static void udi_msc_sbc_read_capacity(void);
+
+//! \brief Process SBC Start Stop Unit command
+static void udi_msc_sbc_start_stop(void);
+
+/**
+ * \brief Process SBC READ10 or WRITE10 command
+ *
+ * \param b_read     Memory to USB, if true
+ */
+static void udi_msc_sbc_trans(bool b_read);
+//@}
+
+
+/**
+ * \name Routines to stream the blocks
+ */
+//@{
+
+/**
+ * \brief Starts a block transfer on a data endpoint
+ *
+ * \param b_read     Memory to USB (IN endpoint), if true
+ * \param buf        Buffer on Internal RAM to send or fill
+ * \param size       Size of the block
+ *
+ * \return \c 1 if the transfer is started.
+ */
+static bool udi_msc_trans_start(bool b_read, uint8_t * buf,
+		iram_size_t size);
+
+/**
+ * \brief Waits the end of the transfer started and updates the residue
+ *
+ * \return \c 1 if no transfer is on going or if it is finished without error.
+ */
+static bool udi_msc_trans_wait(void);
+
+/**
+ * \brief Callback called at the end of a block transfer
+ *
+ * \param status     UDD_EP_TRANSFER_OK, if transfer is finished
+ * \param status     UDD_EP_TRANSFER_ABORT, if transfer is aborted
+ * \param n          number of data transfered
+ */
+static void udi_msc_trans_ack(udd_ep_status_t status, iram_size_t n);
+//@}
+
+//@}
+
+
+bool udi_msc_enable(void)
+{
+	udi_msc_b_trans_req = false;
+	udi_msc_b_cbw_invalid = false;
+	udi_msc_b_reset_trans = false;
+	udi_msc_lun_ejected = 0;
+	udi_msc_nb_lun = get_nb_lun();
+	if (0 == udi_msc_nb_lun) {
+		return false; // No LUN to export
+	}
+	udi_msc_nb_lun--;
+	udi_msc_clear_sense();
+	if (!UDI_MSC_ENABLE_EXT()) {
+		return false;
+	}
+	udi_msc_b_enabled = true;
+	// Start MSC process by CBW reception
+	udi_msc_cbw_wait();
+	return true;
+}
+
+
+void udi_msc_disable(void)
+{
+	udi_msc_b_enabled = false;
+	udi_msc_b_trans_req = false;
+	udi_msc_b_reset_trans = true;
+	UDI_MSC_DISABLE_EXT();
+}
+
+
+bool udi_msc_setup(void)
+{
+	if (Udd_setup_is_in()) {
+		// Requests Interface GET
+		if (Udd_setup_type() == USB_REQ_TYPE_CLASS) {
+			// Requests Class Interface Get
+			switch (udd_g_ctrlreq.req.bRequest) {
+			case USB_REQ_MSC_GET_MAX_LUN:
+				// Give the number of memories available
+				if (1 != udd_g_ctrlreq.req.wLength)
+					return false; // Error for USB host
+				if (0 != udd_g_ctrlreq.req.wValue)
+					return false;
+				udd_g_ctrlreq.payload = &udi_msc_nb_lun;
+				udd_g_ctrlreq.payload_size = 1;
+				return true;
+			}
+		}
+	}
+	if (Udd_setup_is_out()) {
+		// Requests Interface SET
+		if (Udd_setup_type() == USB_REQ_TYPE_CLASS) {
+			// Requests Class Interface Set
+			switch (udd_g_ctrlreq.req.bRequest) {
+			case USB_REQ_MSC_BULK_RESET:
+				// Reset MSC interface
+				if (0 != udd_g_ctrlreq.req.wLength)
+					return false;
+				if (0 != udd_g_ctrlreq.req.wValue)
+					return false;
+				udi_msc_b_cbw_invalid = false;
+				udi_msc_b_trans_req = false;
+				udi_msc_b_reset_trans = true;
+				// Abort all tasks (transfer or clear stall wait) on endpoints
+				udd_ep_abort(UDI_MSC_EP_OUT);
+				udd_ep_abort(UDI_MSC_EP_IN);
+				// Restart by CBW wait
+				udi_msc_cbw_wait();
+				return true;
+			}
+		}
+	}
+	return false;	// Not supported request
+}
+
+
+uint8_t udi_msc_getsetting(void)
+{
+	return 0;	// MSC don't have multiple alternate setting
+}
+
+
+bool udi_msc_is_mounted(void)
+{
+	return udi_msc_b_enabled
+			&& (udi_msc_lun_ejected != (uint8_t) ((2u << udi_msc_nb_lun) - 1));
+}
+
+
+// ------------------------
+//------- Routines to process CBW packet
+
+static void udi_msc_cbw_invalid(void)
+{
+	if (!udi_msc_b_cbw_invalid)
+		return;	// Don't re-stall endpoint if error reseted by setup
+	udd_ep_set_halt(UDI_MSC_EP_OUT);
+	// If stall cleared then re-stall it. Only Setup MSC Reset can clear it
+	udd_ep_wait_stall_clear(UDI_MSC_EP_OUT, udi_msc_cbw_invalid);
+}
+
+
+static void udi_msc_csw_invalid(void)
+{
+	if (!udi_msc_b_cbw_invalid)
+		return;	// Don't re-stall endpoint if error reseted by setup
+	udd_ep_set_halt(UDI_MSC_EP_IN);
+	// If stall cleared then re-stall it. Only Setup MSC Reset can clear it
+	udd_ep_wait_stall_clear(UDI_MSC_EP_IN, udi_msc_csw_invalid);
+}
+
+
+static void udi_msc_cbw_wait(void)
+{
+	// Register buffer and callback on OUT endpoint
+	if (!udd_ep_run(UDI_MSC_EP_OUT, true,
+					(uint8_t *) & udi_msc_cbw,
+					sizeof(udi_msc_cbw),
+					udi_msc_cbw_received)) {
+		// If endpoint not available (halted), then wait a clear of halt
+		udd_ep_wait_stall_clear(UDI_MSC_EP_OUT, udi_msc_cbw_wait);
+	}
+}
+
+
+static void udi_msc_cbw_received(udd_ep_status_t status,
+		iram_size_t nb_received)
+{
+	// Check status of transfer
+	if (UDD_EP_TRANSFER_OK != status) {
+		// Transfer aborted
+		// Now wait MSC setup reset to relaunch CBW reception
+		return;
+	}
+	// Check CBW integrity:
+	// transfer status/CBW length/CBW signature
+	if ((sizeof(udi_msc_cbw) != nb_received)
+			|| (udi_msc_cbw.dCBWSignature !=
+					CPU_TO_LE32(USB_CBW_SIGNATURE))) {
+		// (5.2.1) Devices receiving a CBW with an invalid signature should stall
+		// further traffic on the Bulk In pipe, and either stall further traffic
+		// or accept and discard further traffic on the Bulk Out pipe, until
+		// reset recovery.
+		udi_msc_b_cbw_invalid = true;
+		udi_msc_cbw_invalid();
+		udi_msc_csw_invalid();
+		return;
+	}
+	// Check LUN asked
+	udi_msc_cbw.bCBWLUN &= USB_CBW_LUN_MASK;
+	// Prepare CSW residue field with the size requested
+	udi_msc_csw.dCSWDataResidue =
+			le32_to_cpu(udi_msc_cbw.dCBWDataTransferLength);
+	// Prepare CSW tag field
+	udi_msc_csw.dCSWTag = udi_msc_cbw.dCBWTag;
+	if (udi_msc_cbw.bCBWLUN > udi_msc_nb_lun) {
+		// Bad LUN, then stop command process
+		udi_msc_sense_fail_cdb_invalid();
+		udi_msc_csw_process();
+		return;
+	}
+	// The memories are only accessed from the application context
+	udi_msc_b_trans_req = true;
+	UDI_MSC_NOTIFY_TRANS_EXT();
+}
+
+
+static bool udi_msc_cbw_validate(uint32_t alloc_len, uint8_t dir_flag)
+{
+	/*
+	 * The following cases should result in a phase error:
+	 *  - Case  2: Hn < Di
+	 *  - Case  3: Hn < Do
+	 *  - Case  7: Hi < Di
+	 *  - Case  8: Hi <> Do
+	 *  - Case 10: Ho <> Di
+	 *  - Case 13: Ho < Do
+	 */
+	if (((udi_msc_cbw.bmCBWFlags ^ dir_flag) & USB_CBW_DIRECTION_IN)
+			|| (udi_msc_csw.dCSWDataResidue < alloc_len)) {
+		udi_msc_sense_fail_cdb_invalid();
+		udi_msc_csw_process();
+		return false;
+	}
+
+	/*
+	 * The following cases should result in a stall and nonzero
+	 * residue:
+	 *  - Case  4: Hi > Dn
+	 *  - Case  5: Hi > Di
+	 *  - Case  9: Ho > Dn
+	 *  - Case 11: Ho > Do
+	 */
+	return true;
+}
+
+
+// ------------------------
+//------- Routines to process small data packet
+
+static void udi_msc_data_send(uint8_t * buffer, uint8_t buf_size)
+{
+	if (0 == buf_size) {
+		// Allocation length null, then no data phase
+		udi_msc_csw_process();
+		return;
+	}
+	// Sends data on IN endpoint
+	if (!udd_ep_run(UDI_MSC_EP_IN, false,
+					buffer, buf_size, udi_msc_data_sent)) {
+		// If endpoint not available, then exit process command
+		udi_msc_sense_fail(SCSI_SK_HARDWARE_ERROR,
+				SCSI_ASC_INTERNAL_TARGET_FAILURE, 0);
+		udi_msc_csw_process();
+	}
+}
+
+
+static void udi_msc_data_sent(udd_ep_status_t status, iram_size_t nb_sent)
+{
+	if (UDD_EP_TRANSFER_OK != status) {
+		// Error protocol
+		// Now wait MSC setup reset to relaunch CBW reception
+		return;
+	}
+	// Update sense data
+	udi_msc_sense_pass();
+	// Update CSW
+	udi_msc_csw.dCSWDataResidue -= nb_sent;
+	udi_msc_csw_process();
+}
+
+
+// ------------------------
+//------- Routines to process CSW packet
+
+static void udi_msc_csw_process(void)
+{
+	if (0 != udi_msc_csw.dCSWDataResidue) {
+		// Residue not NULL
+		// then STALL next request from USB host on corresponding endpoint
+		if (udi_msc_cbw.bmCBWFlags & USB_CBW_DIRECTION_IN)
+			udd_ep_set_halt(UDI_MSC_EP_IN);
+		else
+			udd_ep_set_halt(UDI_MSC_EP_OUT);
+	}
+	// Prepare and send CSW
+	udi_msc_csw.dCSWDataResidue = cpu_to_le32(udi_msc_csw.dCSWDataResidue);
+	udi_msc_csw_send();
+}
+
+
+static void udi_msc_csw_send(void)
+{
+	if (!udd_ep_run(UDI_MSC_EP_IN, false,
+					(uint8_t *) & udi_msc_csw,
+					sizeof(udi_msc_csw),
+					udi_msc_csw_sent)) {
+		// If endpoint not available (halted), then wait a clear of halt
+		udd_ep_wait_stall_clear(UDI_MSC_EP_IN, udi_msc_csw_send);
+	}
+}
+
+
+static void udi_msc_csw_sent(udd_ep_status_t status, iram_size_t nb_sent)
+{
+	if (UDD_EP_TRANSFER_OK != status) {
+		// Transfer aborted
+		// Now wait MSC setup reset to relaunch CBW reception
+		return;
+	}
+	// CSW is sent or not and in all case, restart process
+	udi_msc_cbw_wait();
+}
+
+
+// ------------------------
+//------- Routines manage sense data
+
+static void udi_msc_clear_sense(void)
+{
+	memset((uint8_t *) & udi_msc_sense, 0, sizeof(struct scsi_request_sense_data));
+	udi_msc_sense.valid_reponse_code = SCSI_SENSE_VALID | SCSI_SENSE_CURRENT;
+	udi_msc_sense.AddSenseLen = sizeof(struct scsi_request_sense_data) - 8;
+}
+
+
+static void udi_msc_sense_fail(uint8_t sense_key, uint16_t add_sense,
+		uint32_t lba)
+{
+	udi_msc_clear_sense();
+	udi_msc_csw.bCSWStatus = USB_CSW_STATUS_FAIL;
+	udi_msc_sense.sense_flag_key = sense_key;
+	udi_msc_sense.information[0] = lba >> 24;
+	udi_msc_sense.information[1] = lba >> 16;
+	udi_msc_sense.information[2] = lba >> 8;
+	udi_msc_sense.information[3] = lba;
+	udi_msc_sense.AddSenseCode = add_sense >> 8;
+	udi_msc_sense.AddSnsCodeQlfr = add_sense;
+}
+
+
+static void udi_msc_sense_pass(void)
+{
+	udi_msc_clear_sense();
+	udi_msc_csw.bCSWStatus = USB_CSW_STATUS_PASS;
+}
+
+
+static void udi_msc_sense_status(Ctrl_status status, uint32_t lba)
+{
+	switch (status) {
+	case CTRL_GOOD:
+		udi_msc_sense_pass();
+		break;
+	case CTRL_BUSY:
+		udi_msc_sense_fail(SCSI_SK_UNIT_ATTENTION,
+				SCSI_ASC_NOT_READY_TO_READY_CHANGE, 0);
+		break;
+	case CTRL_NO_PRESENT:
+		udi_msc_sense_fail(SCSI_SK_NOT_READY,
+				SCSI_ASC_MEDIUM_NOT_PRESENT, 0);
+		break;
+	case CTRL_FAIL:
+	default:
+		udi_msc_sense_fail(SCSI_SK_HARDWARE_ERROR,
+				SCSI_ASC_NO_ADDITIONAL_SENSE_INFO, lba);
+		break;
+	}
+}
+
+
+static void udi_msc_sense_fail_cdb_invalid(void)
+{
+	udi_msc_sense_fail(SCSI_SK_ILLEGAL_REQUEST,
+			SCSI_ASC_INVALID_FIELD_IN_CDB, 0);
+}
+
+
+// ------------------------
+//------- Routines manage SCSI Commands
+
+bool udi_msc_process_trans(void)
+{
+	if (!udi_msc_b_trans_req)
+		return false;	// No command to process
+	udi_msc_b_trans_req = false;
+	udi_msc_b_reset_trans = false;
+
+	// Decode opcode
+	switch (udi_msc_cbw.CDB[0]) {
+	case SPC_REQUEST_SENSE:
+		udi_msc_spc_requestsense();
+		break;
+
+	case SPC_INQUIRY:
+		udi_msc_spc_inquiry();
+		break;
+
+	case SPC_MODE_SENSE6:
+		udi_msc_spc_mode_sense(false);
+		break;
+	case SPC_MODE_SENSE10:
+		udi_msc_spc_mode_sense(true);
+		break;
+
+	case SPC_TEST_UNIT_READY:
+		udi_msc_spc_test_unit_ready();
+		break;
+
+	case SBC_READ_CAPACITY10:
+		udi_msc_sbc_read_capacity();
+		break;
+
+	case SBC_START_STOP_UNIT:
+		udi_msc_sbc_start_stop();
+		break;
+
+	// Accepts request to suppress medium removal
+	// and commands without action on memories
+	case SPC_PREVENT_ALLOW_MEDIUM_REMOVAL:
+	case SBC_VERIFY10:
+	case SBC_SYNCHRONIZE_CACHE10:
+		udi_msc_sense_pass();
+		udi_msc_csw_process();
+		break;
+
+	case SBC_READ10:
+		udi_msc_sbc_trans(true);
+		break;
+
+	case SBC_WRITE10:
+		udi_msc_sbc_trans(false);
+		break;
+
+	default:
+		udi_msc_sense_fail(SCSI_SK_ILLEGAL_REQUEST,
+				SCSI_ASC_INVALID_COMMAND_OPERATION_CODE, 0);
+		udi_msc_csw_process();
+		break;
+	}
+	return true;
+}
+
+
+static bool udi_msc_lun_is_ejected(void)
+{
+	if (!(udi_msc_lun_ejected & (1 << udi_msc_cbw.bCBWLUN)))
+		return false;
+	udi_msc_sense_fail(SCSI_SK_NOT_READY, SCSI_ASC_MEDIUM_NOT_PRESENT, 0);
+	return true;
+}
+
+
+static void udi_msc_spc_requestsense(void)
+{
+	uint8_t length = udi_msc_cbw.CDB[4];
+
+	// Can't send more than sense data length
+	if (length > sizeof(udi_msc_sense))
+		length = sizeof(udi_msc_sense);
+
+	if (!udi_msc_cbw_validate(length, USB_CBW_DIRECTION_IN))
+		return;
+	// The sense data is reported once, the next command updates it
+	memcpy(udi_msc_buf[0], &udi_msc_sense, length);
+	udi_msc_data_send(udi_msc_buf[0], length);
+}
+
+
+static void udi_msc_spc_inquiry(void)
+{
+	static const struct scsi_inquiry_data udi_msc_inquiry_data = {
+		.pq_pdt = SCSI_INQ_PQ_CONNECTED | SCSI_INQ_DT_DIR_ACCESS,
+		.flags1 = SCSI_INQ_RMB,
+		.version = SCSI_INQ_VER_SPC,
+		.flags3 = SCSI_INQ_RSP_SPC2,
+		.addl_len = SCSI_INQ_ADDL_LEN(sizeof(struct scsi_inquiry_data)),
+		.vendor_id = {UDI_MSC_GLOBAL_VENDOR_ID},
+		.product_rev = {UDI_MSC_GLOBAL_PRODUCT_VERSION},
+	};
+	struct scsi_inquiry_data *inquiry = (struct scsi_inquiry_data *)
+			udi_msc_buf[0];
+	const char *ptr_mem;
+	uint8_t length, i;
+
+	length = udi_msc_cbw.CDB[4];
+
+	// Can't send more than inquiry data length
+	if (length > sizeof(struct scsi_inquiry_data))
+		length = sizeof(struct scsi_inquiry_data);
+
+	if (!udi_msc_cbw_validate(length, USB_CBW_DIRECTION_IN))
+		return;
+	if ((0 != (udi_msc_cbw.CDB[1] & (SCSI_INQ_REQ_EVPD | SCSI_INQ_REQ_CMDT)))
+			|| (0 != udi_msc_cbw.CDB[2])) {
+		// CMDT and EPVD bits are not at 0
+		// PAGE or OPERATION CODE fields are not empty
+		//  = No standard inquiry asked
+		udi_msc_sense_fail_cdb_invalid(); // Command is unsupported
+		udi_msc_csw_process();
+		return;
+	}
+
+	memcpy(inquiry, &udi_msc_inquiry_data, sizeof(struct scsi_inquiry_data));
+
+	// Product identification is the LUN name, without the quotes
+	ptr_mem = mem_name(udi_msc_cbw.bCBWLUN);
+	i = 0;
+	if (NULL != ptr_mem) {
+		if ('"' == *ptr_mem)
+			ptr_mem++;
+		for (; i < sizeof(inquiry->product_id); i++) {
+			if (('\0' == ptr_mem[i]) || ('"' == ptr_mem[i]))
+				break;
+			inquiry->product_id[i] = ptr_mem[i];
+		}
+	}
+	// Padding with spaces
+	for (; i < sizeof(inquiry->product_id); i++)
+		inquiry->product_id[i] = ' ';
+
+	udi_msc_data_send((uint8_t *) inquiry, length);
+}
+
+
+static void udi_msc_spc_mode_sense(bool b_sense10)
+{
+	struct scsi_mode_param_header6 *header6 =
+			(struct scsi_mode_param_header6 *) udi_msc_buf[0];
+	struct scsi_mode_param_header10 *header10 =
+			(struct scsi_mode_param_header10 *) udi_msc_buf[0];
+	uint16_t request_lgt;
+	uint8_t length, wp;
+
+	// Only the mode parameter header is returned, no mode page is supported
+	if (b_sense10) {
+		request_lgt = ((uint16_t) udi_msc_cbw.CDB[7] << 8)
+				| udi_msc_cbw.CDB[8];
+		length = sizeof(struct scsi_mode_param_header10);
+	} else {
+		request_lgt = udi_msc_cbw.CDB[4];
+		length = sizeof(struct scsi_mode_param_header6);
+	}
+	if (length > request_lgt)
+		length = request_lgt;
+
+	if (!udi_msc_cbw_validate(length, USB_CBW_DIRECTION_IN))
+		return;
+
+	// Fill mode parameter header with the write protection status
+	wp = mem_wr_protect(udi_msc_cbw.bCBWLUN) ? SCSI_MS_SBC_WP : 0;
+	memset(udi_msc_buf[0], 0, sizeof(struct scsi_mode_param_header10));
+	if (b_sense10) {
+		header10->mode_data_length = cpu_to_be16(
+				sizeof(struct scsi_mode_param_header10) - 2);
+		header10->device_specific_parameter = wp;
+	} else {
+		header6->mode_data_length =
+				sizeof(struct scsi_mode_param_header6) - 1;
+		header6->device_specific_parameter = wp;
+	}
+	udi_msc_data_send(udi_msc_buf[0], length);
+}
+
+
+static void udi_msc_spc_test_unit_ready(void)
+{
+	if (!udi_msc_lun_is_ejected()) {
+		udi_msc_sense_status(mem_test_unit_ready(udi_msc_cbw.bCBWLUN), 0);
+	}
+	udi_msc_csw_process();
+}
+
+
+static void udi_msc_sbc_read_capacity(void)
+{
+	struct sbc_read_capacity10_data *capacity =
+			(struct sbc_read_capacity10_data *) udi_msc_buf[0];
+	Ctrl_status status;
+	uint32_t last_lba;
+
+	if (!udi_msc_cbw_validate(sizeof(struct sbc_read_capacity10_data),
+					USB_CBW_DIRECTION_IN))
+		return;
+
+	if (udi_msc_lun_is_ejected()) {
+		udi_msc_csw_process();
+		return;
+	}
+	status = mem_read_capacity(udi_msc_cbw.bCBWLUN, &last_lba);
+	if (CTRL_GOOD != status) {
+		udi_msc_sense_status(status, 0);
+		udi_msc_csw_process();
+		return;
+	}
+	capacity->max_lba = cpu_to_be32(last_lba);
+	capacity->block_len = cpu_to_be32((uint32_t)
+			mem_sector_size(udi_msc_cbw.bCBWLUN) * 512);
+	udi_msc_data_send((uint8_t *) capacity,
+			sizeof(struct sbc_read_capacity10_data));
+}
+
+
+static void udi_msc_sbc_start_stop(void)
+{
+	uint8_t lun_mask = 1 << udi_msc_cbw.bCBWLUN;
+
+	// Only the load/eject request is managed, the memories are always started
+	if (udi_msc_cbw.CDB[4] & SBC_START_STOP_LOEJ) {
+		if (udi_msc_cbw.CDB[4] & SBC_START_STOP_START)
+			udi_msc_lun_ejected &= ~lun_mask;
+		else
+			udi_msc_lun_ejected |= lun_mask;
+	}
+	udi_msc_sense_pass();
+	udi_msc_csw_process();
+}
+
+
+static void udi_msc_sbc_trans(bool b_read)
+{
+	uint32_t addr, trans_size;
+	uint16_t nb_block;
+	Ctrl_status status;
+
+	// Read/Write command fields (address and number of block)
+	addr = ((uint32_t) udi_msc_cbw.CDB[2] << 24)
+			| ((uint32_t) udi_msc_cbw.CDB[3] << 16)
+			| ((uint32_t) udi_msc_cbw.CDB[4] << 8)
+			| udi_msc_cbw.CDB[5];
+	nb_block = ((uint16_t) udi_msc_cbw.CDB[7] << 8) | udi_msc_cbw.CDB[8];
+
+	// Compute number of byte to transfer and valid it
+	trans_size = (uint32_t) nb_block * UDI_MSC_BLOCK_SIZE;
+	if (!udi_msc_cbw_validate(trans_size,
+					(b_read) ? USB_CBW_DIRECTION_IN :
+					USB_CBW_DIRECTION_OUT))
+		return;
+
+	if (udi_msc_lun_is_ejected()) {
+		udi_msc_csw_process();
+		return;
+	}
+	if (!b_read && mem_wr_protect(udi_msc_cbw.bCBWLUN)) {
+		udi_msc_sense_fail(SCSI_SK_DATA_PROTECT,
+				SCSI_ASC_WRITE_PROTECTED, 0);
+		udi_msc_csw_process();
+		return;
+	}
+
+	// Stream the blocks between the memory and the USB line
+	udi_msc_buf_sel = 0;
+	udi_msc_b_trans_queued = false;
+	udi_msc_trans_left = trans_size;
+	if (b_read) {
+		status = memory_2_usb(udi_msc_cbw.bCBWLUN, addr, nb_block);
+	} else {
+		status = usb_2_memory(udi_msc_cbw.bCBWLUN, addr, nb_block);
+	}
+	// Wait the last block sent or a block received in advance
+	udi_msc_trans_wait();
+
+	if (udi_msc_b_reset_trans) {
+		// Reset or disable during the transfer, then no CSW to send
+		udi_msc_b_reset_trans = false;
+		return;
+	}
+
+	if (CTRL_FAIL == status) {
+		udi_msc_sense_fail(SCSI_SK_MEDIUM_ERROR, (b_read) ?
+				SCSI_ASC_UNRECOVERED_READ_ERROR :
+				SCSI_ASC_WRITE_ERROR, addr);
+	} else {
+		udi_msc_sense_status(status, addr);
+	}
+	udi_msc_csw_process();
+}
+
+
+// ------------------------
+//------- Routines to stream the blocks
+
+static bool udi_msc_trans_start(bool b_read, uint8_t * buf,
+		iram_size_t size)
+{
+	udi_msc_b_trans_abort = false;
+	udi_msc_b_trans_ongoing = true;
+	if (!udd_ep_run((b_read) ? UDI_MSC_EP_IN : UDI_MSC_EP_OUT, false,
+					buf, size, udi_msc_trans_ack)) {
+		udi_msc_b_trans_ongoing = false;
+		return false;
+	}
+	udi_msc_b_trans_queued = true;
+	udi_msc_trans_left -= size;
+	return true;
+}
+
+
+static bool udi_msc_trans_wait(void)
+{
+	if (!udi_msc_b_trans_queued)
+		return true;
+	while (udi_msc_b_trans_ongoing);
+	udi_msc_b_trans_queued = false;
+	if (udi_msc_b_trans_abort)
+		return false;
+	udi_msc_csw.dCSWDataResidue -= udi_msc_trans_nb;
+	return true;
+}
+
+
+static void udi_msc_trans_ack(udd_ep_status_t status, iram_size_t n)
+{
+	// Update variables to signal the end of transfer
+	udi_msc_b_trans_abort = (UDD_EP_TRANSFER_OK != status);
+	udi_msc_trans_nb = n;
+	udi_msc_b_trans_ongoing = false;
+}
+
+
+bool udi_msc_trans_block(bool b_read, uint8_t * block, iram_size_t block_size,
+		void (*callback) (udd_ep_status_t status, iram_size_t n))
+{
+	uint8_t *buf;
+
+	if (!udi_msc_b_enabled || udi_msc_b_reset_trans)
+		return false;
+
+	if ((NULL != callback) || (block_size > UDI_MSC_BLOCK_SIZE)) {
+		// No streaming, the block is transfered from the memory buffer
+		if (!udi_msc_trans_wait())
+			return false;
+		if (NULL == callback) {
+			return udi_msc_trans_start(b_read, block, block_size)
+					&& udi_msc_trans_wait();
+		}
+		if (!udd_ep_run((b_read) ? UDI_MSC_EP_IN : UDI_MSC_EP_OUT,
+						false, block, block_size, callback))
+			return false;
+		udi_msc_csw.dCSWDataResidue -= block_size;
+		udi_msc_trans_left -= block_size;
+		return true;
+	}
+
+	buf = udi_msc_buf[udi_msc_buf_sel];
+	if (b_read) {
+		// The memory reuses its buffer while this copy is sent
+		memcpy(buf, block, block_size);
+		if (!udi_msc_trans_wait())
+			return false;
+		if (!udi_msc_trans_start(true, buf, block_size))
+			return false;
+		udi_msc_buf_sel ^= 1;
+		return true;
+	}
+
+	// The block has been received in advance
+	// if the memory has programmed the previous one
+	if (!udi_msc_b_trans_queued) {
+		if (!udi_msc_trans_start(false, buf, block_size))
+			return false;
+	}
+	if (!udi_msc_trans_wait())
+		return false;
+	udi_msc_buf_sel ^= 1;
+	// Receive the next block of the command while this one is programmed
+	if (udi_msc_trans_left >= block_size) {
+		udi_msc_trans_start(false, udi_msc_buf[udi_msc_buf_sel],
+				block_size);
+	}
+	memcpy(block, buf, block_size);
+	return true;
+}
+
+//@}
@@ -0,0 +1,93 @@
+/**
+ * \file
+ *
+ * \brief SCSI Block Commands (SBC) definitions
+ *
+ * Copyright (c) 2009 Atmel Corporation. All rights reserved.
+ *
+ * \asf_license_start
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. The name of Atmel may not be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * 4. This software may only be redistributed and used in connection with an
+ *    Atmel microcontroller product.
+ *
+ * THIS SOFTWARE IS PROVIDED BY ATMEL "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT ARE
+ * EXPRESSLY AND SPECIFICALLY DISCLAIMED. IN NO EVENT SHALL ATMEL BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * \asf_license_stop
+ *
+ */
+#ifndef _SBC_PROTOCOL_H_
+#define _SBC_PROTOCOL_H_
+
+#include "compiler.h"
+
+/**
+ * \ingroup usb_msc_protocol
+ * \defgroup usb_sbc_protocol SCSI Block Commands protocol definitions
+ *
+ * @{
+ */
+
+//! \name SCSI commands defined by SBC-2
+//@{
+#define  SBC_FORMAT_UNIT             0x04
+#define  SBC_READ6                   0x08
+#define  SBC_WRITE6                  0x0A
+#define  SBC_START_STOP_UNIT         0x1B
+#define  SBC_READ_FORMAT_CAPACITIES  0x23
+#define  SBC_READ_CAPACITY10         0x25
+#define  SBC_READ10                  0x28
+#define  SBC_WRITE10                 0x2A
+#define  SBC_VERIFY10                0x2F
+#define  SBC_SYNCHRONIZE_CACHE10     0x35
+//@}
+
+//! \name START STOP UNIT parameters (CDB byte 4)
+//@{
+#define  SBC_START_STOP_START        0x01	//!< Make the medium ready
+#define  SBC_START_STOP_LOEJ         0x02	//!< Load/eject the medium
+//@}
+
+//! \name Mode page codes defined by SBC-2
+//@{
+#define  SCSI_MS_MODE_RW_ERR_RECOV   0x01	//!< Read-Write Error Recovery mode page
+#define  SCSI_MS_MODE_CACHING        0x08	//!< Caching mode page
+//@}
+
+COMPILER_PACK_SET(1);
+
+/**
+ * \brief SBC-2 READ CAPACITY (10) parameter data
+ */
+struct sbc_read_capacity10_data {
+	be32_t max_lba;	//!< LBA of last logical block
+	be32_t block_len;	//!< Number of bytes in the last logical block
+};
+
+COMPILER_PACK_RESET();
+
+//@}
+
+#endif // _SBC_PROTOCOL_H_
@@ -0,0 +1,196 @@
+/**
+ * \file
+ *
+ * \brief SCSI Primary Commands (SPC) definitions
+ *
+ * Copyright (c) 2009 Atmel Corporation. All rights reserved.
+ *
+ * \asf_license_start
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. The name of Atmel may not be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * 4. This software may only be redistributed and used in connection with an
+ *    Atmel microcontroller product.
+ *
+ * THIS SOFTWARE IS PROVIDED BY ATMEL "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT ARE
+ * EXPRESSLY AND SPECIFICALLY DISCLAIMED. IN NO EVENT SHALL ATMEL BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * \asf_license_stop
+ *
+ */
+#ifndef _SPC_PROTOCOL_H_
+#define _SPC_PROTOCOL_H_
+
+#include "compiler.h"
+
+/**
+ * \ingroup usb_msc_protocol
+ * \defgroup usb_spc_protocol SCSI Primary Commands protocol definitions
+ *
+ * @{
+ */
+
+//! \name SCSI commands defined by SPC-2
+//@{
+#define  SPC_TEST_UNIT_READY              0x00
+#define  SPC_REQUEST_SENSE                0x03
+#define  SPC_INQUIRY                      0x12
+#define  SPC_MODE_SELECT6                 0x15
+#define  SPC_MODE_SENSE6                  0x1A
+#define  SPC_SEND_DIAGNOSTIC              0x1D
+#define  SPC_PREVENT_ALLOW_MEDIUM_REMOVAL 0x1E
+#define  SPC_MODE_SENSE10                 0x5A
+#define  SPC_REPORT_LUNS                  0xA0
+//@}
+
+//! \brief May be set in byte 0 of the INQUIRY CDB
+//@{
+//! Enable Vital Product Data
+#define  SCSI_INQ_REQ_EVPD   0x01
+//! Command Support Data specified by the PAGE OR OPERATION CODE field
+#define  SCSI_INQ_REQ_CMDT   0x02
+//@}
+
+COMPILER_PACK_SET(1);
+
+/**
+ * \brief SCSI Standard Inquiry data structure
+ */
+struct scsi_inquiry_data {
+	uint8_t pq_pdt;	//!< Peripheral Qual / Peripheral Dev Type
+#define  SCSI_INQ_PQ_CONNECTED   0x00	//!< Peripheral connected
+#define  SCSI_INQ_PQ_NOT_CONN    0x20	//!< Peripheral not connected
+#define  SCSI_INQ_PQ_NOT_SUPP    0x60	//!< Peripheral not supported
+#define  SCSI_INQ_DT_DIR_ACCESS  0x00	//!< Direct Access (SBC)
+	uint8_t flags1;	//!< Flags (byte 1)
+#define  SCSI_INQ_RMB            0x80	//!< Removable Medium
+	uint8_t version;	//!< Version
+#define  SCSI_INQ_VER_NOT        0x00	//!< No standards conformance
+#define  SCSI_INQ_VER_SPC        0x03	//!< SCSI Primary Commands
+#define  SCSI_INQ_VER_SPC2       0x04	//!< SCSI Primary Commands - 2
+	uint8_t flags3;	//!< Flags (byte 3)
+#define  SCSI_INQ_RSP_SPC2       0x02	//!< SPC-2 response format
+	uint8_t addl_len;	//!< Additional Length (n-4)
+#define  SCSI_INQ_ADDL_LEN(tot)  ((tot)-5)	//!< Total length is \a tot
+	uint8_t flags5;	//!< Flags (byte 5)
+	uint8_t flags6;	//!< Flags (byte 6)
+	uint8_t flags7;	//!< Flags (byte 7)
+	uint8_t vendor_id[8];	//!< T10 Vendor Identification
+	uint8_t product_id[16];	//!< Product Identification
+	uint8_t product_rev[4];	//!< Product Revision Level
+};
+
+
+/**
+ * \brief Fixed format sense data
+ */
+struct scsi_request_sense_data {
+	uint8_t valid_reponse_code;	//!< Valid bit / response code
+#define  SCSI_SENSE_VALID              0x80	//!< Indicates the INFORMATION field contains valid information
+#define  SCSI_SENSE_RESPONSE_CODE_MASK 0x7F
+#define  SCSI_SENSE_CURRENT            0x70	//!< Response code 70h (current errors)
+#define  SCSI_SENSE_DEFERRED           0x71
+	uint8_t obsolete;
+	uint8_t sense_flag_key;	//!< Sense Key
+#define  SCSI_SENSE_KEY(x)             (x)	//!< Sense Key
+	uint8_t information[4];
+	uint8_t AddSenseLen;	//!< Additional Sense Length (n-7)
+	uint8_t CmdSpecificInfo[4];	//!< Command-Specific Information
+	uint8_t AddSenseCode;	//!< Additional Sense Code
+	uint8_t AddSnsCodeQlfr;	//!< Additional Sense Code Qualifier
+	uint8_t FldReplUnitCode;	//!< Field Replaceable Unit Code
+	uint8_t SenseKeySpec[3];	//!< Sense Key Specific
+};
+
+/**
+ * \brief Mode parameter header (MODE SENSE 6)
+ */
+struct scsi_mode_param_header6 {
+	uint8_t mode_data_length;	//!< Number of bytes following
+	uint8_t medium_type;	//!< Medium Type
+	uint8_t device_specific_parameter;	//!< Defined by command set
+	uint8_t block_descriptor_length;	//!< Length of block descriptors
+};
+
+/**
+ * \brief Mode parameter header (MODE SENSE 10)
+ */
+struct scsi_mode_param_header10 {
+	be16_t mode_data_length;	//!< Number of bytes following
+	uint8_t medium_type;	//!< Medium Type
+	uint8_t device_specific_parameter;	//!< Defined by command set
+	uint8_t flags4;	//!< LONGLBA in bit 0
+	uint8_t reserved;
+	be16_t block_descriptor_length;	//!< Length of block descriptors
+};
+
+COMPILER_PACK_RESET();
+
+/**
+ * \name Sense keys
+ */
+//@{
+#define  SCSI_SK_NO_SENSE              0x0
+#define  SCSI_SK_RECOVERED_ERROR       0x1
+#define  SCSI_SK_NOT_READY             0x2
+#define  SCSI_SK_MEDIUM_ERROR          0x3
+#define  SCSI_SK_HARDWARE_ERROR        0x4
+#define  SCSI_SK_ILLEGAL_REQUEST       0x5
+#define  SCSI_SK_UNIT_ATTENTION        0x6
+#define  SCSI_SK_DATA_PROTECT          0x7
+#define  SCSI_SK_BLANK_CHECK           0x8
+#define  SCSI_SK_VENDOR_SPECIFIC       0x9
+#define  SCSI_SK_COPY_ABORTED          0xA
+#define  SCSI_SK_ABORTED_COMMAND       0xB
+#define  SCSI_SK_VOLUME_OVERFLOW       0xD
+#define  SCSI_SK_MISCOMPARE            0xE
+//@}
+
+/**
+ * \name Additional sense code and qualifier, (ASC << 8) | ASCQ
+ */
+//@{
+#define  SCSI_ASC_NO_ADDITIONAL_SENSE_INFO          0x0000
+#define  SCSI_ASC_LU_NOT_READY_REBUILD_IN_PROGRESS  0x0405
+#define  SCSI_ASC_WRITE_ERROR                       0x0C00
+#define  SCSI_ASC_UNRECOVERED_READ_ERROR            0x1100
+#define  SCSI_ASC_INVALID_COMMAND_OPERATION_CODE    0x2000
+#define  SCSI_ASC_LBA_OUT_OF_RANGE                  0x2100
+#define  SCSI_ASC_INVALID_FIELD_IN_CDB              0x2400
+#define  SCSI_ASC_WRITE_PROTECTED                   0x2700
+#define  SCSI_ASC_NOT_READY_TO_READY_CHANGE         0x2800
+#define  SCSI_ASC_MEDIUM_NOT_PRESENT                0x3A00
+#define  SCSI_ASC_INTERNAL_TARGET_FAILURE           0x4400
+//@}
+
+/**
+ * \name Mode page codes
+ */
+//@{
+#define  SCSI_MS_MODE_ALL                 0x3F	//!< All mode pages
+#define  SCSI_MS_SBC_WP                   0x80	//!< Write protected (device specific parameter)
+//@}
+
+//@}
+
+#endif // _SPC_PROTOCOL_H_
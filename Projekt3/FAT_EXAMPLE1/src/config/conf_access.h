@@ -54,7 +54,7 @@
 /*! \name Activation of Logical Unit Numbers
  */
 //! @{
-#define LUN_0                DISABLE  //!< On-Chip Virtual Memory.
+#define LUN_0                ENABLE   //!< On-Chip Virtual Memory.
 #define LUN_1                ENABLE   //!< AT45DBX Data Flash.
 #define LUN_2                ENABLE  //!< SD/MMC Card over SPI.
 #define LUN_3                DISABLE
@@ -79,6 +79,8 @@
 #define Lun_0_usb_write_10                      virtual_usb_write_10
 #define Lun_0_mem_2_ram                         virtual_mem_2_ram
 #define Lun_0_ram_2_mem                         virtual_ram_2_mem
+#define Lun_0_erase_block_size                  virtual_erase_block_size
+#define Lun_0_mem_2_ram_multi                   virtual_mem_2_ram_multi
 #define LUN_0_NAME                              "\"On-Chip Virtual Memory\""
 //! @}
 
@@ -96,6 +98,9 @@
 #define Lun_1_usb_write_10                      at45dbx_usb_write_10
 #define Lun_1_mem_2_ram                         at45dbx_df_2_ram
 #define Lun_1_ram_2_mem                         at45dbx_ram_2_df
+#define Lun_1_erase_block_size                  at45dbx_erase_block_size
+#define Lun_1_discard                           at45dbx_discard
+#define Lun_1_mem_2_ram_multi                   at45dbx_df_2_ram_multi
 #define LUN_1_NAME                              "\"AT45DBX Data Flash\""
 //! @}
 
@@ -113,6 +118,8 @@
 #define Lun_2_usb_write_10                      sd_mmc_spi_usb_write_10
 #define Lun_2_mem_2_ram                         sd_mmc_spi_mem_2_ram
 #define Lun_2_ram_2_mem                         sd_mmc_spi_ram_2_mem
+#define Lun_2_erase_block_size                  sd_mmc_spi_erase_block_size
+#define Lun_2_discard                           sd_mmc_spi_discard
 #define LUN_2_NAME                              "\"SD/MMC Card over SPI\""
 //! @}
 
@@ -168,7 +175,7 @@
 /*! \name Activation of Interface Features
  */
 //! @{
-#define ACCESS_USB           false //!< MEM <-> USB interface.
+#define ACCESS_USB           true  //!< MEM <-> USB interface.
 #define ACCESS_MEM_TO_RAM    true  //!< MEM <-> RAM interface.
 #define ACCESS_STREAM        true  //!< Streaming MEM <-> MEM interface.
 #define ACCESS_STREAM_RECORD false //!< Streaming MEM <-> MEM interface in record mode.
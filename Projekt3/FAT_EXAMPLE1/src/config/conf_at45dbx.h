@@ -75,5 +75,29 @@
 //! Number of bits in each SPI transfer.
 #define AT45DBX_SPI_BITS            8
 
+//! Transfers the sectors read to RAM with the PDCA.
+#define AT45DBX_PDCA_READ           true
+
+//! Queues the page programs to the SPI bus scheduler (spi_bus.h), so that
+//! they are sent once the DF is ready without holding the caller.
+#define AT45DBX_SPI_BUS             true
+
+//! PDCA channels and peripheral identifiers of the DF SPI module.
+#define AT45DBX_PDCA_RX_CHANNEL     0
+#define AT45DBX_PDCA_TX_CHANNEL     1
+#define AT45DBX_PDCA_PID_RX         AVR32_PDCA_PID_SPI1_RX
+#define AT45DBX_PDCA_PID_TX         AVR32_PDCA_PID_SPI1_TX
+
+//! Enables the flash translation layer (log blocks, wear leveling) between
+//! CTRL_ACCESS and the DF driver. The capacity is reduced by the log, spare
+//! and checkpoint blocks, so the memory must be formatted again.
+#define AT45DBX_FTL                 false
+
+//! Number of FTL log blocks.
+#define AT45DBX_FTL_NB_LOG          4
+
+//! Number of FTL spare blocks.
+#define AT45DBX_FTL_NB_SPARE        16
+
 
 #endif  // _CONF_AT45DBX_H_
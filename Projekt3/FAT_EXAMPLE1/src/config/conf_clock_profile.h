@@ -0,0 +1,65 @@
+/*****************************************************************************
+ *
+ * \file
+ *
+ * \brief Clock profiles configuration.
+ *
+ * Copyright (c) 2009 Atmel Corporation. All rights reserved.
+ *
+ * \asf_license_start
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. The name of Atmel may not be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * 4. This software may only be redistributed and used in connection with an
+ *    Atmel microcontroller product.
+ *
+ * THIS SOFTWARE IS PROVIDED BY ATMEL "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT ARE
+ * EXPRESSLY AND SPECIFICALLY DISCLAIMED. IN NO EVENT SHALL ATMEL BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * \asf_license_stop
+ *
+ ******************************************************************************/
+
+
+#ifndef _CONF_CLOCK_PROFILE_H_
+#define _CONF_CLOCK_PROFILE_H_
+
+
+//_____ D E F I N I T I O N S ______________________________________________
+
+/*! \name High-Speed Profile
+ *
+ * PLL0 output from OSC0, divided down to the CPU (also HSB and PBB) and PBA
+ * clocks. Within the limits of the part: 66 MHz for the CPU and PBA clocks,
+ * one flash wait state above 33 MHz.
+ */
+//! @{
+#define CLOCK_PROFILE_HIGH_SPEED_CPU_HZ   66000000
+#define CLOCK_PROFILE_HIGH_SPEED_PBA_HZ   33000000
+//! @}
+
+//! Maximal number of drivers notified of the clock changes.
+#define CLOCK_PROFILE_NB_CLIENTS          8
+
+
+#endif  // _CONF_CLOCK_PROFILE_H_
@@ -66,7 +66,7 @@
 #define FS_UNICODE            false
 
 //! The navigator may support only the first partition (\c false), or multiple partitions (\c true).
-#define FS_MULTI_PARTITION    false
+#define FS_MULTI_PARTITION    true
 
 //! Maximal number of characters in file path.
 #define MAX_FILE_PATH_LENGTH  30
@@ -82,6 +82,16 @@
 //!  - \c FSFEATURE_ALL:            All functions.
 #define FS_LEVEL_FEATURES     (FSFEATURE_READ | FSFEATURE_WRITE_COMPLET)
 
+//! Discard of the freed clusters (file delete or truncate), to lower the write latency of flash memories.
+//! Select among:
+//!  - \c FS_DISCARD_NONE:      The memory is never told about the freed clusters.
+//!  - \c FS_DISCARD_INLINE:    The freed clusters are discarded at the end of nav_file_del() or file_set_eof().
+//!  - \c FS_DISCARD_DEFERRED:  The freed clusters are discarded by nav_discard_flush() (e.g. at idle time).
+#define FS_DISCARD            FS_DISCARD_DEFERRED
+
+//! Number of freed cluster ranges waiting to be discarded (used by \c FS_DISCARD_DEFERRED and \c FS_DISCARD_INLINE).
+#define FS_NB_DISCARD         4
+
 //! Number of caches used to store a cluster list of files (interesting in case of many `open file').
 //! In player mode, 1 is OK (shall be > 0).
 #define FS_NB_CACHE_CLUSLIST  1
@@ -90,7 +100,8 @@
 #define FS_NB_NAVIGATOR       10
 
 //! Number of reserved navigators (ids from \c 0 to <tt>(FS_NB_RESERVED_NAVIGATOR - 1)</tt>).
-#define FS_NB_RESERVED_NAV    0
+//! The navigators of the affiliations below are reserved, so that fsaccess never hands them out.
+#define FS_NB_RESERVED_NAV    4
 
 /*! \name Navigator Affiliations
  *
@@ -103,6 +114,12 @@
 //! The explorer uses the navigator ID 1 to open the `copy file' and the ID 0 to open the `paste file'.
 #define FS_NAV_ID_COPYFILE    1
 
+//! The file transfers over the USB CDC interface use the navigator ID 2.
+#define FS_NAV_ID_CDC_XFER    2
+
+//! The TFTP server uses the navigator ID 3.
+#define FS_NAV_ID_TFTP        3
+
 //! @}
 
 /*! \name Playlist Configuration
@@ -56,12 +56,34 @@
 
 //_____ D E F I N I T I O N S ______________________________________________
 
-//! SPI master speed in Hz.
-#define SD_MMC_SPI_MASTER_SPEED     12000000
+//! Maximum SPI master speed in Hz allowed by the board wiring. The speed used
+//! is the lowest of this one and the TRAN_SPEED of the card.
+#define SD_MMC_SPI_MASTER_SPEED     25000000
+
+//! Switch SD 2.0 cards to high-speed mode (CMD6) before negotiating the speed.
+#define SD_MMC_SPI_HIGH_SPEED       false
+
+//! Check the CRC of the commands and data blocks (CMD59), to run faster
+//! clocks safely on long connections.
+#define SD_MMC_SPI_CRC              false
+
+//! Number of times a failed block read or write is issued again.
+#define SD_MMC_SPI_RETRIES          1
+
+//! Number of consecutive transfer errors before lowering the SPI clock.
+#define SD_MMC_SPI_LINK_ERRORS      3
+
+//! Number of busy polls between two calls of the busy callback
+//! (see sd_mmc_spi_set_busy_callback()).
+#define SD_MMC_SPI_BUSY_POLLS       64
 
 //! Number of bits in each SPI transfer.
 #define SD_MMC_SPI_BITS             8
 
+//! Run the block transfers through the SPI bus scheduler (spi_bus.h), put off
+//! while the card programs the last written block.
+#define SD_MMC_SPI_BUS              true
+
 
 #if !defined(SD_MMC_SPI)
 //! Set SD_MMC_SPI, default SPI register address if this is a user board
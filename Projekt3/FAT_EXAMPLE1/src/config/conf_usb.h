@@ -44,16 +44,14 @@
 
 #include "compiler.h"
 
-#warning You must refill the following definitions with a correct values
-
 /**
  * USB Device Configuration
  * @{
  */
 
 //! Device definition (mandatory)
-#define  USB_DEVICE_VENDOR_ID             0x0000
-#define  USB_DEVICE_PRODUCT_ID            0x0000
+#define  USB_DEVICE_VENDOR_ID             USB_VID_ATMEL
+#define  USB_DEVICE_PRODUCT_ID            USB_PID_ATMEL_UC3_CDC_MSC
 #define  USB_DEVICE_MAJOR_VERSION         1
 #define  USB_DEVICE_MINOR_VERSION         0
 #define  USB_DEVICE_POWER                 100 // Consumption on Vbus line (mA)
@@ -124,12 +122,82 @@
 //! to reduce CDC buffers size
 #define  UDI_CDC_LOW_RATE
 
+//! Number of TX buffers, each one holding written data or a buffer
+//! written by reference (see udi_cdc_write_buf_ref())
+#define  UDI_CDC_TX_NB_BUFFERS            4
+
 //! Default configuration of communication port
 #define  UDI_CDC_DEFAULT_RATE             115200
 #define  UDI_CDC_DEFAULT_STOPBITS         CDC_STOP_BITS_1
 #define  UDI_CDC_DEFAULT_PARITY           CDC_PAR_NONE
 #define  UDI_CDC_DEFAULT_DATABITS         8
+
+//! Endpoints' numbers used by CDC interface
+#define  UDI_CDC_DATA_EP_IN               (1 | USB_EP_DIR_IN)  // TX
+#define  UDI_CDC_DATA_EP_OUT              (2 | USB_EP_DIR_OUT) // RX
+#define  UDI_CDC_COMM_EP                  (3 | USB_EP_DIR_IN)  // Notify endpoint
+
+//! Interface numbers used by CDC interface
+#define  UDI_CDC_COMM_IFACE_NUMBER        0
+#define  UDI_CDC_DATA_IFACE_NUMBER        1
 //@}
+
+/**
+ * Configuration of MSC interface
+ * @{
+ */
+//! Vendor name and Product version of MSC interface
+#define UDI_MSC_GLOBAL_VENDOR_ID            \
+   'A', 'T', 'M', 'E', 'L', ' ', ' ', ' '
+#define UDI_MSC_GLOBAL_PRODUCT_VERSION            \
+   '1', '.', '0', '0'
+
+//! Interface callback definition
+#define  UDI_MSC_ENABLE_EXT()             true
+#define  UDI_MSC_DISABLE_EXT()
+//! A SCSI command is waiting for udi_msc_process_trans() in the main loop
+#define  UDI_MSC_NOTIFY_TRANS_EXT()
+
+//! Endpoints' numbers used by MSC interface
+#define  UDI_MSC_EP_IN                    (4 | USB_EP_DIR_IN)
+#define  UDI_MSC_EP_OUT                   (5 | USB_EP_DIR_OUT)
+
+//! Interface number used by MSC interface
+#define  UDI_MSC_IFACE_NUMBER             2
+//@}
+//@}
+
+
+/**
+ * Description of Composite Device
+ * @{
+ */
+//! USB Interfaces descriptor structure
+#define UDI_COMPOSITE_DESC_T \
+	usb_iad_desc_t      udi_cdc_iad; \
+	udi_cdc_comm_desc_t udi_cdc_comm; \
+	udi_cdc_data_desc_t udi_cdc_data; \
+	udi_msc_desc_t      udi_msc
+
+//! USB Interfaces descriptor value for Full Speed
+#define UDI_COMPOSITE_DESC_FS \
+	.udi_cdc_iad               = UDI_CDC_IAD_DESC, \
+	.udi_cdc_comm              = UDI_CDC_COMM_DESC, \
+	.udi_cdc_data              = UDI_CDC_DATA_DESC_FS, \
+	.udi_msc                   = UDI_MSC_DESC_FS
+
+//! USB Interfaces descriptor value for High Speed
+#define UDI_COMPOSITE_DESC_HS \
+	.udi_cdc_iad               = UDI_CDC_IAD_DESC, \
+	.udi_cdc_comm              = UDI_CDC_COMM_DESC, \
+	.udi_cdc_data              = UDI_CDC_DATA_DESC_HS, \
+	.udi_msc                   = UDI_MSC_DESC_HS
+
+//! USB Interface APIs
+#define UDI_COMPOSITE_API \
+	&udi_api_cdc_comm, \
+	&udi_api_cdc_data, \
+	&udi_api_msc
 //@}
 
 
@@ -137,9 +205,18 @@
  * USB Device Driver Configuration
  * @{
  */
+//! Control endpoint size
+#define  USB_DEVICE_EP_CTRL_SIZE          64
+
+//! Number of interfaces for this device
+#define  USB_DEVICE_NB_INTERFACE          3
+
+//! Total endpoint used by all interfaces
+#define  USB_DEVICE_MAX_EP                5
 //@}
 
 //! The includes of classes and other headers must be done at the end of this file to avoid compile error
-#include "udi_cdc_conf.h"
+#include "udi_cdc.h"
+#include "udi_msc.h"
 
 #endif // _CONF_USB_H_
@@ -69,6 +69,8 @@
  * <li>format drivename(a, b...): Format the selected disk (erase all data on it)</li>
  * <li>format32 drivename(a, b...): Force to format the selected disk in FAT32 (erase all data on it) [only possible if disk size allow it]</li>
  * <li>mv src dst: move file or directory</li>
+ * <li>part: list the partitions of the current disk (FS_MULTI_PARTITION only)</li>
+ * <li>mkpart drivename sizeKB: split the selected disk in two partitions, the first one of sizeKB kBytes (erase all data on it, FS_MULTI_PARTITION only)</li>
  * <li>help: Display command helper</li>
  * </ul>
  * </p>
@@ -76,6 +78,9 @@
  * Example to copy-paste a file: Bookmark the destination location directory using the command "mark". Then go to the source location of the wanted copied file. (the destination directory should be different from the source directory)
  * Type "cp thefileiwanttocopy.txt". Go back to the destination location, type "ls", you should see the copied file now.
  *
+ * With FS_MULTI_PARTITION, each disk owns 4 drive letters, one per MBR partition:
+ * a: to d: are the partitions of the first disk, e: to h: the partitions of the second disk...
+ *
  * More information is available in the \subpage FileSystem section.
  *
  * \section files Main Files
@@ -94,7 +99,10 @@
  * \section cfgfiles Configuration Files
  * - conf_access.h: memory control configuration file for this example
  * - conf_at45dbx.h: dataflash AT45DB memory configuration file for this example
+ * - conf_virtual_mem.h: on-chip flash virtual memory (first drive) configuration file
  * - conf_explorer.h: FAT explorer configuration for this example
+ * - conf_clock_profile.h: CPU and PBA frequencies of the high-speed clock profile
+ * - conf_trace.h: enter/exit trace of the storage hot paths ("trace" command)
  *
  * \section compinfo Compilation Info
  * This software was written for the GNU GCC for AVR32 and IAR Systems compiler
@@ -106,7 +114,7 @@
  * - EVK1100, EVK1101, EVK1105 or UC3C_EK evaluation kit
  *
  * \section setupinfo Setup Information
- * <BR>CPU speed: <i> 12 MHz </i>
+ * <BR>CPU speed: <i> 66 MHz, 12 MHz while the shell is idle </i>
  * - Connect USART1 (on EVK1100 or EVK1101) to a PC serial port via a standard
  *   RS232 DB9 cable, or USART0 (on EVK1105 or UC3C_EK) abstracted with a USB CDC
  *   connection to a PC.
@@ -121,6 +129,7 @@
 //_____  I N C L U D E S ___________________________________________________
 
 #include <string.h>
+#include <stdlib.h>
 #include "compiler.h"
 #include "preprocessor.h"
 #include "board.h"
@@ -131,6 +140,14 @@
 #include "usart.h"
 #include "spi.h"
 #include "conf_at45dbx.h"
+#include "at45dbx.h"
+#include "at45dbx_ftl.h"
+#include "virtual_mem.h"
+#include "kv_store.h"
+#include "tc.h"
+#include "soft_timer.h"
+#include "clock_profile.h"
+#include "trace.h"
 #include "fat.h"
 #include "file.h"
 #include "navigation.h"
@@ -141,6 +158,14 @@
 #include "ctrl_access.h"
 #include "fsaccess.h"
 #include "delay.h"
+#include "spi_bus.h"
+#include "udc.h"
+#include "udi_msc.h"
+#include "cdc_xfer.h"
+#ifdef EXTPHY_MACB
+#include "macb.h"
+#include "tftp_server.h"
+#endif
 
 //_____ M A C R O S ________________________________________________________
 
@@ -149,6 +174,7 @@
 //! @{
 #if BOARD == EVK1100
 #  define SHL_USART               (&AVR32_USART1)
+#  define SHL_USART_IRQ           AVR32_USART1_IRQ
 #  define SHL_USART_RX_PIN        AVR32_USART1_RXD_0_0_PIN
 #  define SHL_USART_RX_FUNCTION   AVR32_USART1_RXD_0_0_FUNCTION
 #  define SHL_USART_TX_PIN        AVR32_USART1_TXD_0_0_PIN
@@ -156,6 +182,7 @@
 #  define SHL_USART_BAUDRATE      57600
 #elif BOARD == EVK1101
 #  define SHL_USART               (&AVR32_USART1)
+#  define SHL_USART_IRQ           AVR32_USART1_IRQ
 #  define SHL_USART_RX_PIN        AVR32_USART1_RXD_0_0_PIN
 #  define SHL_USART_RX_FUNCTION   AVR32_USART1_RXD_0_0_FUNCTION
 #  define SHL_USART_TX_PIN        AVR32_USART1_TXD_0_0_PIN
@@ -163,6 +190,7 @@
 #  define SHL_USART_BAUDRATE      57600
 #elif BOARD == EVK1104
 #  define SHL_USART               (&AVR32_USART1)
+#  define SHL_USART_IRQ           AVR32_USART1_IRQ
 #  define SHL_USART_RX_PIN        AVR32_USART1_RXD_0_0_PIN
 #  define SHL_USART_RX_FUNCTION   AVR32_USART1_RXD_0_0_FUNCTION
 #  define SHL_USART_TX_PIN        AVR32_USART1_TXD_0_0_PIN
@@ -170,6 +198,7 @@
 #  define SHL_USART_BAUDRATE      57600
 #elif BOARD == EVK1105
 #  define SHL_USART               (&AVR32_USART0)
+#  define SHL_USART_IRQ           AVR32_USART0_IRQ
 #  define SHL_USART_RX_PIN        AVR32_USART0_RXD_0_0_PIN
 #  define SHL_USART_RX_FUNCTION   AVR32_USART0_RXD_0_0_FUNCTION
 #  define SHL_USART_TX_PIN        AVR32_USART0_TXD_0_0_PIN
@@ -177,6 +206,7 @@
 #  define SHL_USART_BAUDRATE      57600
 #elif BOARD == UC3C_EK
 #  define SHL_USART               (&AVR32_USART2)
+#  define SHL_USART_IRQ           AVR32_USART2_IRQ
 #  define SHL_USART_RX_PIN        AVR32_USART2_RXD_0_1_PIN
 #  define SHL_USART_RX_FUNCTION   AVR32_USART2_RXD_0_1_FUNCTION
 #  define SHL_USART_TX_PIN        AVR32_USART2_TXD_0_1_PIN
@@ -184,6 +214,7 @@
 #  define SHL_USART_BAUDRATE      57600
 #elif BOARD == UC3L_EK
 #  define SHL_USART               (&AVR32_USART3)
+#  define SHL_USART_IRQ           AVR32_USART3_IRQ
 #  define SHL_USART_RX_PIN        AVR32_USART3_RXD_0_0_PIN
 #  define SHL_USART_RX_FUNCTION   AVR32_USART3_RXD_0_0_FUNCTION
 #  define SHL_USART_TX_PIN        AVR32_USART3_TXD_0_0_PIN
@@ -192,6 +223,7 @@
 #endif
 
 #if !defined(SHL_USART)             || \
+    !defined(SHL_USART_IRQ)         || \
     !defined(SHL_USART_RX_PIN)      || \
     !defined(SHL_USART_RX_FUNCTION) || \
     !defined(SHL_USART_TX_PIN)      || \
@@ -199,8 +231,33 @@
     !defined(SHL_USART_BAUDRATE)
 #  error The USART configuration to use in this example on your board is missing.
 #endif
+
+//! Size of the shell USART TX and RX rings.
+#define SHL_USART_TX_RING_SIZE    1024
+#define SHL_USART_RX_RING_SIZE    64
 //! @}
 
+/*! \name Software Timer Configuration
+ */
+//! @{
+#define SOFT_TIMER_TC             (&AVR32_TC)
+#define SOFT_TIMER_TC_CHANNEL     0
+#define SOFT_TIMER_TC_IRQ         AVR32_TC_IRQ0
+
+//! Half period of the logging LED blink; a character is logged each period.
+#define LOG_BLINK_MS              250
+
+//! Time without shell input after which the clock drops to the low-power
+//! profile (0: never).
+#define CLOCK_IDLE_MS             2000
+
+//! Longest time between two checkpoints of the DF FTL mapping.
+#define FTL_SYNC_MS               30000
+//! @}
+
+//! Drive letter of the logging test files: first partition of the SD/MMC card.
+#define LOG_DRIVE                 ('a' + FS_DRIVE_NUMBER(LUN_ID_SD_MMC_SPI_MEM, 0))
+
 #  define EXAMPLE_TARGET_PBACLK_FREQ_HZ FOSC0  // PBA clock target frequency, in Hz
 /*! The max log file size. */
 #define DATALOG_LOGFILE_MAXSIZE         20480
@@ -247,6 +304,10 @@ static pcl_freq_param_t pcl_dfll_freq_param =
 #define CMD_FORMAT            0x10
 #define CMD_FAT               0x11
 #define CMD_FORMAT32          0x12
+#define CMD_PART              0x13
+#define CMD_MKPART            0x14
+#define CMD_TFTP              0x15
+#define CMD_TRACE             0x16
 //! @}
 
 /*! \name Special Char Values
@@ -288,6 +349,10 @@ static pcl_freq_param_t pcl_dfll_freq_param =
 #define STR_FORMAT            "format"
 #define STR_FORMAT32          "format32"
 #define STR_FAT               "fat"
+#define STR_PART              "part"
+#define STR_MKPART            "mkpart"
+#define STR_TFTP              "tftp"
+#define STR_TRACE             "trace"
 //! @}
 
 /*! \name String Messages
@@ -305,6 +370,12 @@ static pcl_freq_param_t pcl_dfll_freq_param =
 #define MSG_ER_UNKNOWN_FILE   "Unknown file\r\n"
 #define MSG_ER_MV             "Error during move\r\n"
 #define MSG_ER_FORMAT         "Format fails\r\n"
+#define MSG_ER_USB_OWNED      "Drives in use by the USB host, eject them first\r\n"
+#define MSG_ER_TFTP           "Ethernet initialization fails\r\n"
+#define MSG_TFTP_LINK         "Waiting for the Ethernet link...\r\n"
+#define MSG_TFTP_STARTED      "TFTP server started\r\n"
+#define MSG_USB_OWNED         "\r\nDrives handed over to the USB host\r\n"
+#define MSG_USB_RELEASED      "\r\nDrives released by the USB host\r\n"
 #define MSG_APPEND_WELCOME    "\r\nSimple text editor, enter char to append, ^q to exit and save\r\n"
 #define MSG_HELP              "Commands summary\r\n" \
                               " a:, b:... goto selected drive               mount disk(a, b...)\r\n" \
@@ -316,11 +387,26 @@ static pcl_freq_param_t pcl_dfll_freq_param =
                               " cp filename: copy filename to bookmark      fat: get FAT type for current drive\r\n" \
                               " rm filename: erase file or EMPTY directory  format drivename, with drivename: a, b...\r\n" \
                               " mv src dst: move file or directory          format32 drivename, with drivename: a, b...\r\n" \
+                              MSG_HELP_PART \
+                              MSG_HELP_TFTP \
+                              MSG_HELP_TRACE \
                               " help\r\n"
+#if (FS_MULTI_PARTITION == true)
+#define MSG_HELP_PART         " part: list partitions of current disk       mkpart drivename sizeKB: make 2 partitions\r\n"
+#else
+#define MSG_HELP_PART         ""
+#endif
+#ifdef EXTPHY_MACB
+#define MSG_HELP_TFTP         " tftp: serve the files over Ethernet (TFTP read requests)\r\n"
+#else
+#define MSG_HELP_TFTP         ""
+#endif
+#if TRACE_ENABLED == true
+#define MSG_HELP_TRACE        " trace: dump and clear the enter/exit trace of the storage hot paths\r\n"
+#else
+#define MSG_HELP_TRACE        ""
+#endif
 //! @}
-#define PBA_HZ                FOSC0
-#define CP_CPU_SPEED  (60000000)
-#define CP_PBA_SPEED  (15000000)
 
 //_____ D E C L A R A T I O N S ____________________________________________
 //! flag for a command presence
@@ -342,6 +428,26 @@ static char par_str2[MAX_FILE_PATH_LENGTH];
 //! buffer for command line
 static char str_buff[MAX_FILE_PATH_LENGTH];
 
+//! The USB host has the drives mounted through the MSC interface.
+static bool usb_owns_drives;
+
+//! Timer of the logging test, and the next character logged.
+static soft_timer_t log_timer;
+static char log_char = 48;
+
+//! Timer dropping the clock to the low-power profile when the shell is idle.
+static soft_timer_t idle_timer;
+
+#if AT45DBX_FTL == true
+//! Timer checkpointing the DF FTL mapping.
+static soft_timer_t ftl_sync_timer;
+#endif
+
+#ifdef EXTPHY_MACB
+//! The MACB is initialized and the TFTP server runs.
+static bool tftp_started;
+#endif
+
 
 //_____ D E F I N I T I O N S ______________________________________________
 
@@ -390,6 +496,16 @@ static void fat_example_parse_cmd(void)
     else if (!strcmp(cmd_str, STR_HELP    )) cmd_type = CMD_HELP;
     else if (!strcmp(cmd_str, STR_FORMAT  )) cmd_type = CMD_FORMAT;
     else if (!strcmp(cmd_str, STR_FORMAT32)) cmd_type = CMD_FORMAT32;
+#if (FS_MULTI_PARTITION == true)
+    else if (!strcmp(cmd_str, STR_PART    )) cmd_type = CMD_PART;
+    else if (!strcmp(cmd_str, STR_MKPART  )) cmd_type = CMD_MKPART;
+#endif
+#ifdef EXTPHY_MACB
+    else if (!strcmp(cmd_str, STR_TFTP    )) cmd_type = CMD_TFTP;
+#endif
+#if TRACE_ENABLED == true
+    else if (!strcmp(cmd_str, STR_TRACE   )) cmd_type = CMD_TRACE;
+#endif
     else
     {
       // error : command not found
@@ -460,6 +576,18 @@ static void fat_example_parse_cmd(void)
 }
 
 
+/*! \brief Restores the high-speed clock profile on shell input and restarts
+ *         the idle timer.
+ */
+static void fat_example_clock_activity(void)
+{
+#if CLOCK_IDLE_MS
+  clock_profile_set(CLOCK_PROFILE_HIGH_SPEED);
+  soft_timer_start(&idle_timer, soft_timer_ms_2_ticks(CLOCK_IDLE_MS), 0);
+#endif
+}
+
+
 /*! \brief Gets the full command line on RS232 input to be interpreted.
  * The cmd_str variable is built with the user inputs.
  */
@@ -471,6 +599,7 @@ static void fat_example_build_cmd(void)
   usart_reset_status(SHL_USART);
   if (usart_read_char(SHL_USART, &c) == USART_SUCCESS)
   {
+    fat_example_clock_activity();
     switch (c)
     {
     case CR:
@@ -546,6 +675,66 @@ static void fat_example_append_file(void)
 }
 
 
+/*! \brief Selects a drive from its number (drive letter - 'a').
+ *
+ * With FS_MULTI_PARTITION, the drive number encodes the disk and the
+ * partition on this disk (see nav_drive_getname()).
+ *
+ * \return true if the drive exists, false otherwise.
+ */
+static bool fat_example_select_drive(uint8_t drive)
+{
+#if (FS_MULTI_PARTITION == true)
+  if (!nav_drive_set(drive / FS_MBR_NB_PARTITION))
+    return false;
+  return nav_partition_set(drive % FS_MBR_NB_PARTITION);
+#else
+  return nav_drive_set(drive);
+#endif
+}
+
+
+/*! \brief Formats the selected drive.
+ *
+ * With FS_MULTI_PARTITION, only the selected partition is formatted when the
+ * disk holds a partition table; the whole disk is formatted otherwise.
+ *
+ * \return true if the format succeeds, false otherwise.
+ */
+static bool fat_example_format(uint8_t fat_type)
+{
+#if (FS_MULTI_PARTITION == true)
+  // Keep the partition table of a partitioned disk.
+  if (nav_partition_format(fat_type))
+    return true;
+  // Only the first drive letter of a disk may reformat the whole disk.
+  if (nav_drive_get() % FS_MBR_NB_PARTITION)
+    return false;
+#endif
+  return nav_drive_format(fat_type);
+}
+
+
+//! Shell USART rings: the shell output and the print functions don't wait
+//! for the characters to be sent.
+static usart_ring_t shl_usart_ring;
+static uint8_t shl_usart_tx_buf[SHL_USART_TX_RING_SIZE];
+static uint8_t shl_usart_rx_buf[SHL_USART_RX_RING_SIZE];
+
+
+/*! \brief Interrupt handler of the shell USART.
+ */
+#if __GNUC__
+__attribute__((__interrupt__))
+#elif __ICCAVR32__
+__interrupt
+#endif
+static void shl_usart_int_handler(void)
+{
+  usart_ring_interrupt(&shl_usart_ring);
+}
+
+
 /*! \brief Sets up USART for shell.
  *
  * \param pba_hz The current module frequency.
@@ -575,6 +764,27 @@ static void init_shl_rs232(long pba_hz)
 
   // Initialize it in RS232 mode.
   usart_init_rs232(SHL_USART, &SHL_USART_OPTIONS, pba_hz);
+
+  // Send and receive through the interrupt-driven rings.
+  INTC_register_interrupt(&shl_usart_int_handler, SHL_USART_IRQ, AVR32_INTC_INT0);
+  usart_ring_init(&shl_usart_ring, SHL_USART,
+                  shl_usart_tx_buf, sizeof(shl_usart_tx_buf),
+                  shl_usart_rx_buf, sizeof(shl_usart_rx_buf));
+}
+
+
+/*! \brief Sends the characters queued for the shell before a clock profile
+ *         change, then sets the baud rate again.
+ */
+static void shl_usart_clock_changed(clock_profile_event_t event,
+                                    unsigned long cpu_hz, unsigned long pba_hz)
+{
+  if (event == CLOCK_PROFILE_PRE_CHANGE)
+  {
+    while (usart_ring_tx_pending(&shl_usart_ring) || !usart_tx_empty(SHL_USART));
+    return;
+  }
+  usart_set_rs232_baudrate(SHL_USART, SHL_USART_BAUDRATE, pba_hz);
 }
 
 
@@ -622,8 +832,8 @@ static void init_shl_rs232(long pba_hz)
 		 spi_enable(AT45DBX_SPI);
 	 }
 
-	 // Initialize data flash with SPI clock Osc0.
-	 at45dbx_init(spiOptions, CP_PBA_SPEED);
+	 // Initialize data flash with the SPI clock of the current profile.
+	 at45dbx_init(spiOptions, clock_profile_get_pba_hz());
  }
 
 
@@ -666,8 +876,136 @@ static void sd_mmc_resources_init(void)
 		spi_enable(SD_MMC_SPI);
 	}
 
-	// Initialize SD/MMC with SPI clock Osc0.
-	sd_mmc_spi_init(spiOptions, CP_PBA_SPEED);
+	// Initialize SD/MMC with the SPI clock of the current profile.
+	sd_mmc_spi_init(spiOptions, clock_profile_get_pba_hz());
+}
+
+
+/*! \brief Derives the SPI clocks of the AT45DBX and of the SD/MMC card again
+ *         after a clock profile change.
+ */
+static void spi_clock_changed(clock_profile_event_t event,
+                              unsigned long cpu_hz, unsigned long pba_hz)
+{
+	if (event != CLOCK_PROFILE_POST_CHANGE)
+		return;
+	at45dbx_set_pba_hz(pba_hz);
+	sd_mmc_spi_set_pba_hz(pba_hz);
+}
+
+
+/*! \brief Runs the queued SPI bus transactions to the other devices while
+ *         the SD/MMC card is busy.
+ */
+static void sd_mmc_busy_yield(void)
+{
+	spi_bus_yield(SD_MMC_SPI_NPCS);
+}
+
+
+/*! \brief Runs the queued SPI bus transactions to the other devices while
+ *         the data flash is busy.
+ */
+static void at45dbx_busy_yield(void)
+{
+	spi_bus_yield(AT45DBX_SPI_FIRST_NPCS);
+}
+
+
+/*! \brief Hands the drives over to the USB host, or takes them back.
+ *
+ * The FAT module and the USB host must not both write a volume: the files are
+ * closed and the FAT cache is flushed before the first SCSI command is served,
+ * and the navigators are reset when the host ejects the drives or leaves, as
+ * the host may have changed the FAT.
+ */
+static void fat_example_usb_ownership(void)
+{
+	if (udi_msc_is_mounted() == usb_owns_drives)
+		return;
+	if (!usb_owns_drives)
+	{
+#if (FS_DISCARD == FS_DISCARD_DEFERRED)
+		nav_discard_flush();
+#endif
+		cdc_xfer_abort();
+#ifdef EXTPHY_MACB
+		tftp_server_abort();
+#endif
+		nav_exit();
+		usb_owns_drives = true;
+		print(SHL_USART, MSG_USB_OWNED);
+	}
+	else
+	{
+		nav_reset();
+		// Mount the default drive at next "ls".
+		first_ls = true;
+		usb_owns_drives = false;
+		print(SHL_USART, MSG_USB_RELEASED);
+	}
+	print(SHL_USART, MSG_PROMPT);
+}
+
+
+#ifdef EXTPHY_MACB
+/*! \brief Initializes the MACB and the TFTP server.
+ *
+ * Waits for the Ethernet link.
+ */
+static bool fat_example_tftp_start(void)
+{
+  static const gpio_map_t MACB_GPIO_MAP =
+  {
+    {EXTPHY_MACB_MDC_PIN,     EXTPHY_MACB_MDC_FUNCTION   },
+    {EXTPHY_MACB_MDIO_PIN,    EXTPHY_MACB_MDIO_FUNCTION  },
+    {EXTPHY_MACB_RXD_0_PIN,   EXTPHY_MACB_RXD_0_FUNCTION },
+    {EXTPHY_MACB_TXD_0_PIN,   EXTPHY_MACB_TXD_0_FUNCTION },
+    {EXTPHY_MACB_RXD_1_PIN,   EXTPHY_MACB_RXD_1_FUNCTION },
+    {EXTPHY_MACB_TXD_1_PIN,   EXTPHY_MACB_TXD_1_FUNCTION },
+    {EXTPHY_MACB_TX_EN_PIN,   EXTPHY_MACB_TX_EN_FUNCTION },
+    {EXTPHY_MACB_RX_ER_PIN,   EXTPHY_MACB_RX_ER_FUNCTION },
+    {EXTPHY_MACB_RX_DV_PIN,   EXTPHY_MACB_RX_DV_FUNCTION },
+    {EXTPHY_MACB_TX_CLK_PIN,  EXTPHY_MACB_TX_CLK_FUNCTION}
+  };
+
+  // Assign GPIO to MACB.
+  gpio_enable_module(MACB_GPIO_MAP, sizeof(MACB_GPIO_MAP) / sizeof(MACB_GPIO_MAP[0]));
+
+  if (!xMACBInit(EXTPHY_MACB))
+    return false;
+  tftp_server_init(clock_profile_get_cpu_hz());
+  return true;
+}
+#endif
+
+
+#if TRACE_ENABLED == true
+/*! \brief Prints a line of the trace dump on the shell.
+ */
+static void fat_example_trace_putline(const char *line)
+{
+  print(SHL_USART, line);
+}
+#endif
+
+
+/*! \brief Builds the path of a logging test file on LOG_DRIVE.
+ *
+ * \param name File name, in the root directory of the drive.
+ *
+ * \return The path, in a buffer overwritten by the next call.
+ */
+static const char *log_path(const char *name)
+{
+  static char path[MAX_FILE_PATH_LENGTH];
+
+  path[0] = LOG_DRIVE;
+  path[1] = ':';
+  path[2] = '/';
+  strncpy(&path[3], name, sizeof(path) - 4);
+  path[sizeof(path) - 1] = '\0';
+  return path;
 }
 
 
@@ -722,8 +1060,8 @@ int fd, fd2;
 int pom, size,i;
 char * pcDataToWrite = NULL;
 
-fd=  Openfile_append("b:/t.txt");
-fd2=  Openfile_append("b:/a.txt");
+fd=  Openfile_append(log_path("t.txt"));
+fd2=  Openfile_append(log_path("a.txt"));
 
 write( fd, "RRRR", 4 ) ;
 write( fd2,"GGGG", 4 ) ;
@@ -731,7 +1069,7 @@ write( fd2,"GGGG", 4 ) ;
 close(fd);
 close(fd2);
 
-fd= Openfile_read("b:/a.txt");
+fd= Openfile_read(log_path("a.txt"));
 
 for (i = 0; i < 5; i++) {
 
@@ -745,32 +1083,92 @@ for (i = 0; i < 5; i++) {
 close(fd);
 }
 	
+/*! \brief Logging test step, called from the main loop every LOG_BLINK_MS.
+ *
+ * Blinks LED1 and appends a character to te.txt on LOG_DRIVE once per period.
+ */
+static void log_timer_callback(void *arg)
+{
+	static bool led_on;
+	uint8_t nav;
+	int fd;
+
+	led_on = !led_on;
+	if (led_on) {
+		gpio_clr_gpio_pin(LED1_GPIO);
+		return;
+	}
+	gpio_set_gpio_pin(LED1_GPIO);
+
+	// The FAT module can't use the drives mounted by the USB host.
+	if (usb_owns_drives)
+		return;
+
+	// fsaccess selects its own navigator: leave the shell one selected.
+	nav = nav_get();
+	fd = Openfile_append(log_path("te.txt"));
+	if (fd < 0) {
+		nav_select(nav);
+		return;
+	}
+	write(fd, &log_char, 1);
+	nav_file_dateset("2012062020202020", FS_DATE_LAST_WRITE);
+	close(fd);
+	nav_select(nav);
+	log_char++;
+	if (log_char > 125) log_char = 48;
+}
+
+/*! \brief Derives the delays and the software timer tick again after a clock
+ *         profile change.
+ */
+static void timing_clock_changed(clock_profile_event_t event,
+                                 unsigned long cpu_hz, unsigned long pba_hz)
+{
+	if (event != CLOCK_PROFILE_POST_CHANGE)
+		return;
+	delay_init(cpu_hz);
+	soft_timer_set_pba_hz(pba_hz);
+}
+
+/*! \brief Drops the clock to the low-power profile, called from the main loop
+ *         once the shell has been idle for CLOCK_IDLE_MS.
+ */
+static void idle_timer_callback(void *arg)
+{
+	// The USB host and the TFTP clients keep the high-speed profile: check
+	// again later.
+	if (usb_owns_drives
+#ifdef EXTPHY_MACB
+	    || tftp_started
+#endif
+	   ) {
+		soft_timer_start(&idle_timer, soft_timer_ms_2_ticks(CLOCK_IDLE_MS), 0);
+		return;
+	}
+	clock_profile_set(CLOCK_PROFILE_LOW_POWER);
+}
+
+#if AT45DBX_FTL == true
+/*! \brief Checkpoints the DF FTL mapping, called from the main loop every
+ *         FTL_SYNC_MS.
+ *
+ * at45dbx_ftl_idle() only checkpoints once many changes are gathered: this
+ * bounds the time the last changes stay out of the checkpoint.
+ */
+static void ftl_sync_timer_callback(void *arg)
+{
+	at45dbx_ftl_sync();
+}
+#endif
+
+/*! \brief Starts the logging test, which then runs from the main loop.
+ */
 void TestUkladaniDat(){
-int i;
-int fd;
-delay_init(PBA_HZ);
-char * a = NULL;
-
-a[1]="\0";
-i=48;
-	while (1) {
-		gpio_clr_gpio_pin(LED0_GPIO);
-		delay_ms(250);
-		gpio_set_gpio_pin(LED0_GPIO);
-		delay_ms(250);
-		
-		fd=  Openfile_append("b:/te.txt");
-		
-		while(fd<0);
-		a[0]=i;
-		write( fd, a, 1 ) ;
-		nav_file_dateset( "2012062020202020",  FS_DATE_LAST_WRITE );
-		close(fd);
-		i++;
-		if(i>125) i=48;
-	}	
-}		
-	
+	if (!soft_timer_is_active(&log_timer))
+		soft_timer_start(&log_timer, 0, soft_timer_ms_2_ticks(LOG_BLINK_MS));
+}
+
 
 /*! \brief Main function. Execution starts here.
  */
@@ -781,6 +1179,9 @@ int main(void)
   Fs_index sav_index;
   static Fs_index mark_index;
   const char *part_type;
+#if (FS_MULTI_PARTITION == true)
+  uint32_t part_size[2];
+#endif
   uint32_t VarTemp;
   int tlacitko;
 
@@ -799,16 +1200,63 @@ int main(void)
   // frequency FOSC0) with an appropriate startup time then switch the main clock
   // source to Osc0.
   pcl_switch_to_osc(PCL_OSC0, FOSC0, OSC0_STARTUP);
+
+  // Then run from PLL0 (still from OSC0 if the frequencies of
+  // conf_clock_profile.h can't be reached): the drivers below are set up for
+  // the high-speed profile and follow the profile changes.
+  clock_profile_init();
+  clock_profile_set(CLOCK_PROFILE_HIGH_SPEED);
+  delay_init(clock_profile_get_cpu_hz());
 #endif
 
+  // The interrupt vectors are needed by the shell USART and the USB.
+  irq_initialize_vectors();
+  cpu_irq_enable();
+
   // Initialize RS232 shell text output.
-  init_shl_rs232(EXAMPLE_TARGET_PBACLK_FREQ_HZ);
+  init_shl_rs232(clock_profile_get_pba_hz());
+
+  // The TC channel only ticks while a software timer is armed.
+  soft_timer_init(SOFT_TIMER_TC, SOFT_TIMER_TC_CHANNEL, SOFT_TIMER_TC_IRQ,
+                  clock_profile_get_pba_hz());
+  soft_timer_setup(&log_timer, log_timer_callback, NULL, true);
+  soft_timer_setup(&idle_timer, idle_timer_callback, NULL, true);
+#if AT45DBX_FTL == true
+  soft_timer_setup(&ftl_sync_timer, ftl_sync_timer_callback, NULL, true);
+  soft_timer_start(&ftl_sync_timer, soft_timer_ms_2_ticks(FTL_SYNC_MS),
+                   soft_timer_ms_2_ticks(FTL_SYNC_MS));
+#endif
+
+  // Load the counters and settings kept out of the FAT.
+  if (!kv_store_init())
+    print_dbg("Key/value store unusable\r\n");
+
+  // The SD/MMC card and the AT45DBX share the SPI: their transfers are
+  // queued to the SPI bus scheduler, so the DF programs its pages while the
+  // card is busy and the other way round. The drivers register their devices
+  // when they are initialized.
+  spi_bus_init(SD_MMC_SPI);
 
   // Initialize AT45DBX resources: GPIO, SPI and AT45DBX.
   at45dbx_resources_init();
 
   sd_mmc_resources_init();
 
+  sd_mmc_spi_set_busy_callback(sd_mmc_busy_yield);
+  at45dbx_set_busy_callback(at45dbx_busy_yield);
+
+  // Follow the clock profile changes: the shell USART is drained first and
+  // set up again last.
+  clock_profile_register(shl_usart_clock_changed);
+  clock_profile_register(spi_clock_changed);
+  clock_profile_register(timing_clock_changed);
+  fat_example_clock_activity();
+
+  // Export the drives through the USB MSC interface.
+  usb_owns_drives = false;
+  cdc_xfer_init();
+  udc_start();
+
 // Read Card capacity
 sd_mmc_spi_get_capacity();
 print_dbg("Capacity SD Card = ");
@@ -830,7 +1278,7 @@ while (CTRL_GOOD != mem_test_unit_ready( LUN_ID_AT45DBX_MEM )) {
 
   
 
-if (nav_drive_get() >= nav_drive_nb() )
+if (0xFF == nav_drive_get())
 {
 	first_ls = false;
 	// Reset navigators .
@@ -846,12 +1294,26 @@ tlacitko=0;
   // always loop
   while (true)
   {
+    // Serve the USB host, the memories are only accessed from this loop.
+    fat_example_usb_ownership();
+    udi_msc_process_trans();
+    // Serve the file transfers over the USB CDC interface.
+    if (!usb_owns_drives)
+      cdc_xfer_task();
+#ifdef EXTPHY_MACB
+    // Serve the TFTP clients.
+    if (tftp_started && !usb_owns_drives)
+      tftp_server_task();
+#endif
+    // Run the software timers which expired.
+    soft_timer_task();
+
     // While a usable user command on RS232 isn't received, build it
    
    
      if (gpio_get_pin_value(GPIO_PUSH_BUTTON_0)==0){
 			 gpio_clr_gpio_pin(LED0_GPIO);
-			if (!tlacitko) appendData();
+			if (!tlacitko && !usb_owns_drives) appendData();
 			tlacitko=1;
 	 }	
      else {
@@ -861,7 +1323,7 @@ tlacitko=0;
 	 }   
    
    
-        if (gpio_get_pin_value(GPIO_PUSH_BUTTON_1)==0){
+        if (gpio_get_pin_value(GPIO_PUSH_BUTTON_1)==0 && !usb_owns_drives){
 	        
 	        TestUkladaniDat();
 	        
@@ -872,8 +1334,33 @@ tlacitko=0;
    
     if (!cmd)
     {
+#if (FS_DISCARD == FS_DISCARD_DEFERRED)
+      // Idle time: discard the clusters freed by the previous commands.
+      if (!usb_owns_drives)
+        nav_discard_flush();
+#endif
+#if AT45DBX_FTL == true
+      // Idle time: merge log blocks, write the gathered page and checkpoint
+      // the DF mapping once enough changes are pending.
+      at45dbx_ftl_idle();
+#else
+      // Idle time: program the DF page still waiting in the SRAM buffer.
+      at45dbx_write_flush();
+#endif
+      // Idle time: send the SPI transactions put off while a device was busy.
+      spi_bus_run();
+      // Idle time: program the on-chip flash page gathering the last writes.
+      virtual_mem_flush();
       fat_example_build_cmd();
     }
+    // the FAT module can't use the drives mounted by the USB host
+    else if (usb_owns_drives)
+    {
+      print(SHL_USART, MSG_ER_USB_OWNED);
+      cmd_type = CMD_NONE;
+      cmd = false;
+      print(SHL_USART, MSG_PROMPT);
+    }
     // perform the command
     else
     {
@@ -883,18 +1370,18 @@ tlacitko=0;
       case CMD_MOUNT:
         // Get drive number
         i = par_str1[0] - 'a';
-        // If drive doesn't exist
-        if (i >= nav_drive_nb())
+        // Reset all navigators.
+        nav_reset();
+        // Select the desired drive; if drive doesn't exist
+        if (!fat_example_select_drive(i))
         {
           // Display error message.
           print(SHL_USART, MSG_ER_DRIVE);
+          // Mount the default drive at next "ls".
+          first_ls = true;
         }
         else
         {
-          // Reset all navigators.
-          nav_reset();
-          // Select the desired drive.
-          nav_drive_set(i);
           // Try to mount it.
           if (!nav_partition_mount())
           {
@@ -937,7 +1424,7 @@ tlacitko=0;
       // this is a "ls" command
       case CMD_LS:
         // Check if params are correct or mount needed.
-        if (nav_drive_get() >= nav_drive_nb() || first_ls)
+        if (0xFF == nav_drive_get() || first_ls)
         {
           first_ls = false;
           // Reset navigators .
@@ -951,7 +1438,7 @@ tlacitko=0;
         nav_dir_name((FS_STRING)str_buff, MAX_FILE_PATH_LENGTH);
         // Display general informations (drive letter and current path)
         print(SHL_USART, "\r\nVolume is ");
-        print_char(SHL_USART, 'A' + nav_drive_get());
+        print_char(SHL_USART, nav_drive_getname());
         print(SHL_USART, ":\r\nDir name is ");
         print(SHL_USART, str_buff);
         print(SHL_USART, CRLF);
@@ -1158,6 +1645,13 @@ tlacitko=0;
         {
           // Select drive.
           nav_drive_set(i);
+#if (FS_MULTI_PARTITION == true)
+          // For all partitions of the drive :
+          for (j = 0; j < nav_partition_nb(); j++)
+          {
+            // Select partition.
+            nav_partition_set(j);
+#endif
           // Try to mount.
           if (nav_partition_mount())
           {
@@ -1165,7 +1659,7 @@ tlacitko=0;
             print(SHL_USART, mem_name(i));
             // Display drive letter name.
             print(SHL_USART, " (");
-            print_char(SHL_USART, 'A' + i);
+            print_char(SHL_USART, nav_drive_getname());
             print(SHL_USART, ":) Free Space: ");
             // Display free space.
             print_ulong(SHL_USART, nav_partition_freespace() << FS_SHIFT_B_TO_SECTOR);
@@ -1174,6 +1668,9 @@ tlacitko=0;
             print_ulong(SHL_USART, nav_partition_space() << FS_SHIFT_B_TO_SECTOR);
             print(SHL_USART, " Bytes\r\n");
           }
+#if (FS_MULTI_PARTITION == true)
+          }
+#endif
         }
         // Restore nav position.
         nav_gotoindex(&sav_index);
@@ -1182,25 +1679,25 @@ tlacitko=0;
       case CMD_FORMAT:
         // Get disk number.
         i = par_str1[0] - 'a';
-        // if drive number isn't valid
-        if (i >= nav_drive_nb())
+        // Get the current drive in the navigator.
+        j = nav_drive_get();
+        // Select drive to format; if drive number isn't valid
+        if (!fat_example_select_drive(i))
         {
           // Display error message.
           print(SHL_USART, MSG_ER_DRIVE);
+          // Return to the previous.
+          fat_example_select_drive(j);
         }
         else
         {
-          // Get the current drive in the navigator.
-          j = nav_drive_get();
-          // Select drive to format.
-          nav_drive_set(i);
           // If format fails.
-          if (!nav_drive_format(FS_FORMAT_DEFAULT))
+          if (!fat_example_format(FS_FORMAT_DEFAULT))
           {
             // Display error message.
             print(SHL_USART, MSG_ER_FORMAT);
             // Return to the previous.
-            nav_drive_set(j);
+            fat_example_select_drive(j);
           }
           // Format succeds, if drives is the one we were navigating on
           else if (i == j)
@@ -1208,7 +1705,7 @@ tlacitko=0;
             // Reset the navigators.
             nav_reset();
             // Set current drive.
-            nav_drive_set(j);
+            fat_example_select_drive(j);
             // If partition mounting fails.
             if (!nav_partition_mount())
             {
@@ -1224,32 +1721,32 @@ tlacitko=0;
             }
           }
           // Format succeds, restore previous navigator drive.
-          else nav_drive_set(j);
+          else fat_example_select_drive(j);
         }
         break;
       // this is a "format32" command: Format disk as FAT 32 if possible.
       case CMD_FORMAT32:
         // Get disk number.
         i = par_str1[0] - 'a';
-        // if drive number isn't valid
-        if (i >= nav_drive_nb())
+        // Get the current drive in the navigator.
+        j = nav_drive_get();
+        // Select drive to format; if drive number isn't valid
+        if (!fat_example_select_drive(i))
         {
           // Display error message.
           print(SHL_USART, MSG_ER_DRIVE);
+          // Return to the previous.
+          fat_example_select_drive(j);
         }
         else
         {
-          // Get the current drive in the navigator.
-          j = nav_drive_get();
-          // Select drive to format.
-          nav_drive_set(i);
           // If format fails.
-          if (!nav_drive_format(FS_FORMAT_FAT32))
+          if (!fat_example_format(FS_FORMAT_FAT32))
           {
             // Display error message.
             print(SHL_USART, MSG_ER_FORMAT);
             // Return to the previous.
-            nav_drive_set(j);
+            fat_example_select_drive(j);
           }
           // Format succeds, if drives is the one we were navigating on
           else if (i == j)
@@ -1257,7 +1754,7 @@ tlacitko=0;
             // Reset the navigators.
             nav_reset();
             // Set current drive.
-            nav_drive_set(j);
+            fat_example_select_drive(j);
             // If partition mounting fails.
             if (!nav_partition_mount())
             {
@@ -1273,9 +1770,95 @@ tlacitko=0;
             }
           }
           // Format succeds, restore previous navigator drive.
-          else nav_drive_set(j);
+          else fat_example_select_drive(j);
+        }
+        break;
+#if (FS_MULTI_PARTITION == true)
+      // this is a "part" command: Display the partitions of the current disk.
+      case CMD_PART:
+        // Save current nav position.
+        sav_index = nav_getindex();
+        // Display memory name.
+        print(SHL_USART, mem_name(nav_drive_get() / FS_MBR_NB_PARTITION));
+        print(SHL_USART, CRLF);
+        // For all partitions of the disk :
+        for (j = 0; j < nav_partition_nb(); j++)
+        {
+          // Select partition.
+          nav_partition_set(j);
+          // Display drive letter name.
+          print(SHL_USART, " ");
+          print_char(SHL_USART, nav_drive_getname());
+          print(SHL_USART, ": ");
+          // Try to mount.
+          if (!nav_partition_mount())
+          {
+            print(SHL_USART, "not formatted\r\n");
+            continue;
+          }
+          // Display FAT type.
+          switch (nav_partition_type())
+          {
+          case FS_TYPE_FAT_12: print(SHL_USART, "FAT12 "); break;
+          case FS_TYPE_FAT_16: print(SHL_USART, "FAT16 "); break;
+          case FS_TYPE_FAT_32: print(SHL_USART, "FAT32 "); break;
+          default:             print(SHL_USART, "????? "); break;
+          }
+          // Display available space.
+          print_ulong(SHL_USART, nav_partition_space() << FS_SHIFT_B_TO_SECTOR);
+          print(SHL_USART, " Bytes\r\n");
+        }
+        // Restore nav position.
+        nav_gotoindex(&sav_index);
+        break;
+      // this is a "mkpart" command: Split disk in two partitions and format them.
+      case CMD_MKPART:
+        // Get disk number.
+        i = par_str1[0] - 'a';
+        // Size of the first partition (unit 512B), the second one uses the remaining space.
+        part_size[0] = (uint32_t)atol(par_str2) * 2;
+        part_size[1] = 0;
+        // Reset the navigators.
+        nav_reset();
+        // if drive number isn't valid
+        if (!fat_example_select_drive(i))
+        {
+          // Display error message.
+          print(SHL_USART, MSG_ER_DRIVE);
+        }
+        // If partitioning fails.
+        else if (!nav_drive_partition(2, part_size))
+        {
+          // Display error message.
+          print(SHL_USART, MSG_ER_FORMAT);
         }
+        // Remount at next "ls".
+        first_ls = true;
         break;
+#endif
+#ifdef EXTPHY_MACB
+      // this is a "tftp" command: Start the TFTP server.
+      case CMD_TFTP:
+        if (!tftp_started)
+        {
+          print(SHL_USART, MSG_TFTP_LINK);
+          if (!fat_example_tftp_start())
+          {
+            print(SHL_USART, MSG_ER_TFTP);
+            break;
+          }
+          tftp_started = true;
+        }
+        print(SHL_USART, MSG_TFTP_STARTED);
+        break;
+#endif
+#if TRACE_ENABLED == true
+      // this is a "trace" command
+      case CMD_TRACE:
+        trace_dump(fat_example_trace_putline);
+        trace_reset();
+        break;
+#endif
       // Unknown command.
       default:
         // Display error message.
@@ -0,0 +1,264 @@
+/*****************************************************************************
+ *
+ * \file
+ *
+ * \brief Host stand-in for the AVR32 part header.
+ *
+ * Copyright (c) 2009 Atmel Corporation. All rights reserved.
+ *
+ * \asf_license_start
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. The name of Atmel may not be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * 4. This software may only be redistributed and used in connection with an
+ *    Atmel microcontroller product.
+ *
+ * THIS SOFTWARE IS PROVIDED BY ATMEL "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT ARE
+ * EXPRESSLY AND SPECIFICALLY DISCLAIMED. IN NO EVENT SHALL ATMEL BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * \asf_license_stop
+ *
+ ******************************************************************************/
+
+
+#ifndef _AVR32_IO_H_
+#define _AVR32_IO_H_
+
+/*
+ * Register numbers and memory layout of the UC3A0512, down to what the
+ * sources under test use. The flash array is a RAM array of the test which
+ * simulates the flash controller, shorter than the real one.
+ */
+
+#include <stdint.h>
+
+
+//! \name System registers
+//! @{
+#define AVR32_COMPARE             264
+#define AVR32_COUNT               268
+//! @}
+
+//! \name Interrupt priority levels
+//! @{
+#define AVR32_INTC_INT0           0
+#define AVR32_INTC_INT1           1
+#define AVR32_INTC_INT2           2
+#define AVR32_INTC_INT3           3
+//! @}
+
+//! \name Internal flash
+//! @{
+extern uint8_t test_flash[];
+#define AVR32_FLASH_ADDRESS       ((uintptr_t)test_flash)
+#define AVR32_FLASH_SIZE          0x4000
+#define AVR32_FLASHC_PAGE_SIZE    512
+//! @}
+
+//! \name USART, revision before 4.0.0 (no LIN nor SPI modes)
+//! @{
+typedef struct
+{
+  unsigned long cr;
+  unsigned long mr;
+  unsigned long ier;
+  unsigned long idr;
+  unsigned long imr;
+  unsigned long csr;
+  unsigned long rhr;
+  unsigned long thr;
+  unsigned long brgr;
+  unsigned long rtor;
+  unsigned long ttgr;
+  unsigned long fidi;
+  unsigned long ner;
+  unsigned long ifr;
+  unsigned long man;
+} avr32_usart_t;
+
+#define AVR32_USART_CR_RSTRX_MASK            0x00000004
+#define AVR32_USART_CR_RSTTX_MASK            0x00000008
+#define AVR32_USART_CR_RXEN_MASK             0x00000010
+#define AVR32_USART_CR_RXDIS_MASK            0x00000020
+#define AVR32_USART_CR_TXEN_MASK             0x00000040
+#define AVR32_USART_CR_TXDIS_MASK            0x00000080
+#define AVR32_USART_CR_RSTSTA_MASK           0x00000100
+#define AVR32_USART_CR_SENDA_MASK            0x00001000
+#define AVR32_USART_CR_RSTIT_MASK            0x00002000
+#define AVR32_USART_CR_RSTNACK_MASK          0x00004000
+#define AVR32_USART_CR_DTRDIS_MASK           0x00020000
+#define AVR32_USART_CR_RTSEN_MASK            0x00040000
+#define AVR32_USART_CR_RTSDIS_MASK           0x00080000
+#define AVR32_USART_MR_MODE_OFFSET           0
+#define AVR32_USART_MR_MODE_MASK             0x0000000F
+#define AVR32_USART_MR_MODE_SIZE             4
+#define AVR32_USART_MR_USCLKS_OFFSET         4
+#define AVR32_USART_MR_USCLKS_MASK           0x00000030
+#define AVR32_USART_MR_USCLKS_SIZE           2
+#define AVR32_USART_MR_CHRL_OFFSET           6
+#define AVR32_USART_MR_CHRL_MASK             0x000000C0
+#define AVR32_USART_MR_CHRL_SIZE             2
+#define AVR32_USART_MR_SYNC_OFFSET           8
+#define AVR32_USART_MR_SYNC_MASK             0x00000100
+#define AVR32_USART_MR_PAR_OFFSET            9
+#define AVR32_USART_MR_PAR_MASK              0x00000E00
+#define AVR32_USART_MR_PAR_SIZE              3
+#define AVR32_USART_MR_NBSTOP_OFFSET         12
+#define AVR32_USART_MR_NBSTOP_MASK           0x00003000
+#define AVR32_USART_MR_NBSTOP_SIZE           2
+#define AVR32_USART_MR_CHMODE_OFFSET         14
+#define AVR32_USART_MR_CHMODE_MASK           0x0000C000
+#define AVR32_USART_MR_CHMODE_SIZE           2
+#define AVR32_USART_MR_MSBF_OFFSET           16
+#define AVR32_USART_MR_MSBF_MASK             0x00010000
+#define AVR32_USART_MR_MODE9_OFFSET          17
+#define AVR32_USART_MR_MODE9_MASK            0x00020000
+#define AVR32_USART_MR_CLKO_OFFSET           18
+#define AVR32_USART_MR_CLKO_MASK             0x00040000
+#define AVR32_USART_MR_OVER_OFFSET           19
+#define AVR32_USART_MR_OVER_MASK             0x00080000
+#define AVR32_USART_MR_INACK_OFFSET          20
+#define AVR32_USART_MR_INACK_MASK            0x00100000
+#define AVR32_USART_MR_DSNACK_OFFSET         21
+#define AVR32_USART_MR_DSNACK_MASK           0x00200000
+#define AVR32_USART_MR_MAX_ITERATION_OFFSET  24
+#define AVR32_USART_MR_MAX_ITERATION_MASK    0x07000000
+#define AVR32_USART_MR_MAX_ITERATION_SIZE    3
+#define AVR32_USART_MR_FILTER_OFFSET         28
+#define AVR32_USART_MR_FILTER_MASK           0x10000000
+#define AVR32_USART_CSR_RXRDY_MASK           0x00000001
+#define AVR32_USART_CSR_TXRDY_MASK           0x00000002
+#define AVR32_USART_CSR_OVRE_MASK            0x00000020
+#define AVR32_USART_CSR_FRAME_MASK           0x00000040
+#define AVR32_USART_CSR_PARE_MASK            0x00000080
+#define AVR32_USART_CSR_TXEMPTY_MASK         0x00000200
+#define AVR32_USART_IER_RXRDY_MASK           0x00000001
+#define AVR32_USART_IER_TXRDY_MASK           0x00000002
+#define AVR32_USART_IDR_RXRDY_MASK           0x00000001
+#define AVR32_USART_IDR_TXRDY_MASK           0x00000002
+#define AVR32_USART_IMR_RXRDY_MASK           0x00000001
+#define AVR32_USART_IMR_TXRDY_MASK           0x00000002
+#define AVR32_USART_RHR_RXCHR_OFFSET         0
+#define AVR32_USART_RHR_RXCHR_MASK           0x000001FF
+#define AVR32_USART_RHR_RXCHR_SIZE           9
+#define AVR32_USART_THR_TXCHR_OFFSET         0
+#define AVR32_USART_THR_TXCHR_MASK           0x000001FF
+#define AVR32_USART_THR_TXCHR_SIZE           9
+#define AVR32_USART_BRGR_CD_OFFSET           0
+#define AVR32_USART_BRGR_CD_MASK             0x0000FFFF
+#define AVR32_USART_BRGR_CD_SIZE             16
+#define AVR32_USART_BRGR_FP_OFFSET           16
+#define AVR32_USART_BRGR_FP_MASK             0x00070000
+#define AVR32_USART_BRGR_FP_SIZE             3
+#define AVR32_USART_MR_MODE_NORMAL           0x00000000
+#define AVR32_USART_MR_MODE_RS485            0x00000001
+#define AVR32_USART_MR_MODE_HARDWARE         0x00000002
+#define AVR32_USART_MR_MODE_MODEM            0x00000003
+#define AVR32_USART_MR_MODE_ISO7816_T0       0x00000004
+#define AVR32_USART_MR_MODE_ISO7816_T1       0x00000006
+#define AVR32_USART_MODE_IRDA                0x00000008
+#define AVR32_USART_MR_USCLKS_MCK            0x00000000
+#define AVR32_USART_MR_USCLKS_SCK            0x00000003
+#define AVR32_USART_MR_PAR_EVEN              0x00000000
+#define AVR32_USART_MR_PAR_ODD               0x00000001
+#define AVR32_USART_MR_PAR_SPACE             0x00000002
+#define AVR32_USART_MR_PAR_MARK              0x00000003
+#define AVR32_USART_MR_PAR_NONE              0x00000004
+#define AVR32_USART_MR_PAR_MULTI             0x00000006
+#define AVR32_USART_MR_NBSTOP_1              0x00000000
+#define AVR32_USART_MR_NBSTOP_1_5            0x00000001
+#define AVR32_USART_MR_NBSTOP_2              0x00000002
+#define AVR32_USART_MR_CHMODE_NORMAL         0x00000000
+#define AVR32_USART_MR_CHMODE_ECHO           0x00000001
+#define AVR32_USART_MR_CHMODE_LOCAL_LOOP     0x00000002
+#define AVR32_USART_MR_CHMODE_REMOTE_LOOP    0x00000003
+#define AVR32_USART_MR_OVER_X16              0x00000000
+#define AVR32_USART_MR_OVER_X8               0x00000001
+//! @}
+
+
+//! \name TWI, revision before 1.8.0 (with the slave mode)
+//! @{
+typedef struct
+{
+  unsigned long cr;
+  unsigned long mmr;
+  unsigned long smr;
+  unsigned long iadr;
+  unsigned long cwgr;
+  unsigned long sr;
+  unsigned long ier;
+  unsigned long idr;
+  unsigned long imr;
+  unsigned long rhr;
+  unsigned long thr;
+} avr32_twi_t;
+
+#define AVR32_TWI_IRQ                        352
+
+#define AVR32_TWI_CR_START_MASK              0x00000001
+#define AVR32_TWI_CR_STOP_MASK               0x00000002
+#define AVR32_TWI_CR_MSEN_MASK               0x00000004
+#define AVR32_TWI_CR_MSDIS_MASK              0x00000008
+#define AVR32_TWI_CR_SVEN_MASK               0x00000010
+#define AVR32_TWI_CR_SVDIS_MASK              0x00000020
+#define AVR32_TWI_CR_SWRST_MASK              0x00000080
+#define AVR32_TWI_MMR_IADRSZ_OFFSET          8
+#define AVR32_TWI_MMR_IADRSZ_MASK            0x00000300
+#define AVR32_TWI_MMR_MREAD_OFFSET           12
+#define AVR32_TWI_MMR_MREAD_MASK             0x00001000
+#define AVR32_TWI_MMR_DADR_OFFSET            16
+#define AVR32_TWI_MMR_DADR_MASK              0x007F0000
+#define AVR32_TWI_SMR_SADR_OFFSET            16
+#define AVR32_TWI_SMR_SADR_MASK              0x007F0000
+#define AVR32_TWI_CWGR_CLDIV_OFFSET          0
+#define AVR32_TWI_CWGR_CLDIV_MASK            0x000000FF
+#define AVR32_TWI_CWGR_CHDIV_OFFSET          8
+#define AVR32_TWI_CWGR_CHDIV_MASK            0x0000FF00
+#define AVR32_TWI_CWGR_CKDIV_OFFSET          16
+#define AVR32_TWI_CWGR_CKDIV_MASK            0x00070000
+#define AVR32_TWI_SR_TXCOMP_MASK             0x00000001
+#define AVR32_TWI_SR_RXRDY_MASK              0x00000002
+#define AVR32_TWI_SR_TXRDY_MASK              0x00000004
+#define AVR32_TWI_SR_SVREAD_MASK             0x00000008
+#define AVR32_TWI_SR_SVACC_MASK              0x00000010
+#define AVR32_TWI_SR_NACK_MASK               0x00000100
+#define AVR32_TWI_SR_EOSACC_MASK             0x00000800
+#define AVR32_TWI_IER_TXCOMP_MASK            0x00000001
+#define AVR32_TWI_IER_RXRDY_MASK             0x00000002
+#define AVR32_TWI_IER_TXRDY_MASK             0x00000004
+#define AVR32_TWI_IER_SVACC_MASK             0x00000010
+#define AVR32_TWI_IER_NACK_MASK              0x00000100
+#define AVR32_TWI_IER_EOSACC_MASK            0x00000800
+#define AVR32_TWI_IDR_TXCOMP_MASK            0x00000001
+#define AVR32_TWI_IDR_RXRDY_MASK             0x00000002
+#define AVR32_TWI_IDR_TXRDY_MASK             0x00000004
+#define AVR32_TWI_IDR_SVACC_MASK             0x00000010
+#define AVR32_TWI_IDR_NACK_MASK              0x00000100
+#define AVR32_TWI_IDR_EOSACC_MASK            0x00000800
+#define AVR32_TWI_START_MASK                 AVR32_TWI_CR_START_MASK
+#define AVR32_TWI_STOP_MASK                  AVR32_TWI_CR_STOP_MASK
+//! @}
+
+
+#endif  // _AVR32_IO_H_
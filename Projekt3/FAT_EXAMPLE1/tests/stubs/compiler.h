@@ -0,0 +1,105 @@
+/*****************************************************************************
+ *
+ * \file
+ *
+ * \brief Host stand-in for the ASF compiler.h.
+ *
+ * Copyright (c) 2009 Atmel Corporation. All rights reserved.
+ *
+ * \asf_license_start
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. The name of Atmel may not be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * 4. This software may only be redistributed and used in connection with an
+ *    Atmel microcontroller product.
+ *
+ * THIS SOFTWARE IS PROVIDED BY ATMEL "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT ARE
+ * EXPRESSLY AND SPECIFICALLY DISCLAIMED. IN NO EVENT SHALL ATMEL BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * \asf_license_stop
+ *
+ ******************************************************************************/
+
+
+#ifndef _COMPILER_H_
+#define _COMPILER_H_
+
+/*
+ * Types, helpers and core registers used by the sources under test, so that
+ * they build with the host compiler. The global interrupt mask and the COUNT
+ * register are variables of test.c.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <avr32/io.h>
+
+
+typedef int8_t    S8;
+typedef uint8_t   U8;
+typedef int16_t   S16;
+typedef uint16_t  U16;
+typedef int32_t   S32;
+typedef uint32_t  U32;
+typedef int64_t   S64;
+typedef uint64_t  U64;
+
+#define DISABLE   0
+#define ENABLE    1
+
+#define Assert(expr)        ((void)0)
+
+#define min(a, b)           (((a) < (b)) ? (a) : (b))
+#define max(a, b)           (((a) > (b)) ? (a) : (b))
+
+#define Min(a, b)           min(a, b)
+#define Max(a, b)           max(a, b)
+
+//! Global interrupt mask: cleared while "interrupts" are disabled.
+extern volatile bool test_irq_enabled;
+
+#define Is_global_interrupt_enabled()   (test_irq_enabled)
+#define Disable_global_interrupt()      (test_irq_enabled = false)
+#define Enable_global_interrupt()       (test_irq_enabled = true)
+
+#define cpu_irq_is_enabled()            Is_global_interrupt_enabled()
+#define cpu_irq_disable()               Disable_global_interrupt()
+#define cpu_irq_enable()                Enable_global_interrupt()
+
+//! COUNT register, advanced by the tests.
+extern volatile uint32_t test_sys_count;
+
+#define Get_system_register(sysreg) \
+  (((sysreg) == AVR32_COUNT) ? test_sys_count : 0)
+#define Set_system_register(sysreg, value) \
+  do { if ((sysreg) == AVR32_COUNT) test_sys_count = (value); } while (0)
+
+//! Busy-wait loops of the drivers call the relax hook of test.c, through
+//! which the tests play the interrupts awaited.
+extern void test_cpu_relax(void);
+#define cpu_relax()                     test_cpu_relax()
+
+
+#endif  // _COMPILER_H_
@@ -0,0 +1,92 @@
+/*****************************************************************************
+ *
+ * \file
+ *
+ * \brief Host stand-in for the UC3A clock services.
+ *
+ * Copyright (c) 2009 Atmel Corporation. All rights reserved.
+ *
+ * \asf_license_start
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. The name of Atmel may not be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * 4. This software may only be redistributed and used in connection with an
+ *    Atmel microcontroller product.
+ *
+ * THIS SOFTWARE IS PROVIDED BY ATMEL "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT ARE
+ * EXPRESSLY AND SPECIFICALLY DISCLAIMED. IN NO EVENT SHALL ATMEL BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * \asf_license_stop
+ *
+ ******************************************************************************/
+
+
+#ifndef _SYSCLK_H_
+#define _SYSCLK_H_
+
+/*
+ * Main clock selection and PLL control, implemented by the tests that use
+ * them. The PLL limits are those of pll.h for the UC3A.
+ */
+
+#include "compiler.h"
+
+
+#define SYSCLK_SRC_RCSYS          0
+#define SYSCLK_SRC_OSC0           1
+#define SYSCLK_SRC_PLL0           2
+
+#define PLL_MIN_HZ                40000000
+#define PLL_MAX_HZ                240000000
+
+enum pll_source
+{
+  PLL_SRC_OSC0              = 0,
+  PLL_SRC_OSC1              = 1,
+  PLL_NR_SOURCES
+};
+
+struct pll_config
+{
+  enum pll_source src;
+  unsigned int div;
+  unsigned int mul;
+};
+
+
+extern void sysclk_set_source(uint_fast8_t src);
+
+extern void sysclk_set_prescalers(unsigned int cpu_shift,
+                                  unsigned int pba_shift, unsigned int pbb_shift);
+
+extern void pll_config_init(struct pll_config *cfg, enum pll_source src,
+                            unsigned int div, unsigned int mul);
+
+extern void pll_enable(const struct pll_config *cfg, unsigned int pll_id);
+
+extern void pll_disable(unsigned int pll_id);
+
+extern bool pll_is_locked(unsigned int pll_id);
+
+
+#endif  // _SYSCLK_H_
@@ -0,0 +1,111 @@
+/*****************************************************************************
+ *
+ * \file
+ *
+ * \brief Host stand-in for the TC driver.
+ *
+ * Copyright (c) 2009 Atmel Corporation. All rights reserved.
+ *
+ * \asf_license_start
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. The name of Atmel may not be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * 4. This software may only be redistributed and used in connection with an
+ *    Atmel microcontroller product.
+ *
+ * THIS SOFTWARE IS PROVIDED BY ATMEL "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT ARE
+ * EXPRESSLY AND SPECIFICALLY DISCLAIMED. IN NO EVENT SHALL ATMEL BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * \asf_license_stop
+ *
+ ******************************************************************************/
+
+
+#ifndef _TC_H_
+#define _TC_H_
+
+/*
+ * The channels of the single TC instance keep the settings written by the
+ * sources under test in test_tc, for the tests to check them.
+ */
+
+#include "compiler.h"
+
+
+#define TC_NB_CHANNELS                      3
+
+#define TC_WAVEFORM_SEL_UP_MODE_RC_TRIGGER  2
+
+#define TC_CLOCK_SOURCE_TC1                 0
+#define TC_CLOCK_SOURCE_TC2                 1
+#define TC_CLOCK_SOURCE_TC3                 2
+#define TC_CLOCK_SOURCE_TC4                 3
+#define TC_CLOCK_SOURCE_TC5                 4
+
+typedef struct
+{
+  uint32_t unused;
+} avr32_tc_t;
+
+typedef struct
+{
+  unsigned int channel;
+  unsigned int wavsel;
+  unsigned int tcclks;
+} tc_waveform_opt_t;
+
+typedef struct
+{
+  unsigned int cpcs;
+} tc_interrupt_t;
+
+//! State of a channel.
+typedef struct
+{
+  unsigned int tcclks;
+  unsigned short rc;
+  bool cpcs;
+  bool started;
+  //! Number of starts, restarts included.
+  unsigned int starts;
+} test_tc_channel_t;
+
+extern test_tc_channel_t test_tc[TC_NB_CHANNELS];
+
+
+extern int tc_configure_interrupts(volatile avr32_tc_t *tc, unsigned int channel,
+                                   const tc_interrupt_t *bitfield);
+
+extern int tc_init_waveform(volatile avr32_tc_t *tc, const tc_waveform_opt_t *opt);
+
+extern int tc_start(volatile avr32_tc_t *tc, unsigned int channel);
+
+extern int tc_stop(volatile avr32_tc_t *tc, unsigned int channel);
+
+extern int tc_read_sr(volatile avr32_tc_t *tc, unsigned int channel);
+
+extern int tc_write_rc(volatile avr32_tc_t *tc, unsigned int channel,
+                       unsigned short value);
+
+
+#endif  // _TC_H_
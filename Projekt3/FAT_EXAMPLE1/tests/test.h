@@ -0,0 +1,102 @@
+/*****************************************************************************
+ *
+ * \file
+ *
+ * \brief Checks shared by the host test programs.
+ *
+ * Copyright (c) 2009 Atmel Corporation. All rights reserved.
+ *
+ * \asf_license_start
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. The name of Atmel may not be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * 4. This software may only be redistributed and used in connection with an
+ *    Atmel microcontroller product.
+ *
+ * THIS SOFTWARE IS PROVIDED BY ATMEL "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT ARE
+ * EXPRESSLY AND SPECIFICALLY DISCLAIMED. IN NO EVENT SHALL ATMEL BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * \asf_license_stop
+ *
+ ******************************************************************************/
+
+
+#ifndef _TEST_H_
+#define _TEST_H_
+
+/*
+ * Each test program compiles the real sources against the stand-ins of
+ * stubs/, checks them with CHECK, and returns the result of test_report()
+ * from main().
+ */
+
+#include <stdio.h>
+#include "compiler.h"
+
+
+//! Number of checks run and failed.
+extern unsigned long test_checks;
+extern unsigned long test_failures;
+
+//! Called by cpu_relax() while a driver busy-waits, or NULL.
+extern void (*test_relax_hook)(void);
+
+//! Checks a condition, reporting it if false.
+#define CHECK(cond) \
+  do \
+  { \
+    test_checks++; \
+    if (!(cond)) \
+    { \
+      test_failures++; \
+      printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+      fflush(stdout); \
+    } \
+  } while (0)
+
+//! Checks that two integers are equal, reporting both if not.
+#define CHECK_EQUAL(actual, expected) \
+  do \
+  { \
+    long long test_actual = (long long)(actual); \
+    long long test_expected = (long long)(expected); \
+    test_checks++; \
+    if (test_actual != test_expected) \
+    { \
+      test_failures++; \
+      printf("%s:%d: check failed: %s == %s (%lld != %lld)\n", __FILE__, \
+             __LINE__, #actual, #expected, test_actual, test_expected); \
+      fflush(stdout); \
+    } \
+  } while (0)
+
+/*! \brief Prints the result of a test program.
+ *
+ * \param name  Name of the test program.
+ *
+ * \return Exit status of the program: 0 if all the checks passed.
+ */
+extern int test_report(const char *name);
+
+
+#endif  // _TEST_H_
@@ -0,0 +1,336 @@
+/*****************************************************************************
+ *
+ * \file
+ *
+ * \brief Host test of the clock profiles: divisor search and switching sequence.
+ *
+ * Copyright (c) 2009 Atmel Corporation. All rights reserved.
+ *
+ * \asf_license_start
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. The name of Atmel may not be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * 4. This software may only be redistributed and used in connection with an
+ *    Atmel microcontroller product.
+ *
+ * THIS SOFTWARE IS PROVIDED BY ATMEL "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT ARE
+ * EXPRESSLY AND SPECIFICALLY DISCLAIMED. IN NO EVENT SHALL ATMEL BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * \asf_license_stop
+ *
+ ******************************************************************************/
+
+
+#include <stdarg.h>
+#include "test.h"
+#include "board.h"
+#include "sysclk.h"
+#include "flashc.h"
+#include "clock_profile.h"
+
+
+//! Largest division of the main clock by a power of 2.
+#define TEST_MAX_SHIFT        8
+
+
+//! Clock operations and callbacks, in their order.
+static char trace[512];
+
+
+static void trace_add(const char *format, ...)
+{
+  size_t len = strlen(trace);
+  va_list args;
+
+  va_start(args, format);
+  vsnprintf(trace + len, sizeof(trace) - len, format, args);
+  va_end(args);
+}
+
+
+void sysclk_set_source(uint_fast8_t src)
+{
+  trace_add("src %u;", (unsigned int)src);
+}
+
+
+void sysclk_set_prescalers(unsigned int cpu_shift,
+                           unsigned int pba_shift, unsigned int pbb_shift)
+{
+  trace_add("div %u/%u/%u;", cpu_shift, pba_shift, pbb_shift);
+}
+
+
+void pll_config_init(struct pll_config *cfg, enum pll_source src,
+                     unsigned int div, unsigned int mul)
+{
+  cfg->src = src;
+  cfg->div = div;
+  cfg->mul = mul;
+}
+
+
+void pll_enable(const struct pll_config *cfg, unsigned int pll_id)
+{
+  trace_add("pll%u on %u*%u/%u;", pll_id, (unsigned int)cfg->src, cfg->mul, cfg->div);
+}
+
+
+void pll_disable(unsigned int pll_id)
+{
+  trace_add("pll%u off;", pll_id);
+}
+
+
+bool pll_is_locked(unsigned int pll_id)
+{
+  return true;
+}
+
+
+void flashc_set_bus_freq(unsigned int cpu_f_hz)
+{
+  trace_add("flash %u;", cpu_f_hz);
+}
+
+
+static void client_a(clock_profile_event_t event, unsigned long cpu_hz,
+                     unsigned long pba_hz)
+{
+  trace_add("a %s %lu/%lu;", (event == CLOCK_PROFILE_PRE_CHANGE) ? "pre" : "post",
+            cpu_hz, pba_hz);
+}
+
+
+static void client_b(clock_profile_event_t event, unsigned long cpu_hz,
+                     unsigned long pba_hz)
+{
+  trace_add("b %s %lu/%lu;", (event == CLOCK_PROFILE_PRE_CHANGE) ? "pre" : "post",
+            cpu_hz, pba_hz);
+}
+
+
+/*! \brief Tells if PLL0 can run at fOSC0 * mul / div.
+ *
+ * Below 2 * PLL_MIN_HZ, the VCO runs at twice the output frequency, so the
+ * multiplier is doubled and must stay within 16.
+ */
+static bool pll_valid(unsigned long osc0_hz, unsigned int mul, unsigned int div)
+{
+  unsigned long pll_hz = osc0_hz * mul / div;
+
+  return mul >= 3 && mul <= 16 && div >= 1 && div <= 15 &&
+         !((osc0_hz * mul) % div) &&
+         pll_hz >= PLL_MIN_HZ && pll_hz <= PLL_MAX_HZ &&
+         (pll_hz >= 2 * PLL_MIN_HZ || mul <= 8);
+}
+
+
+/*! \brief Highest CPU frequency not above \a cpu_hz from a main clock, if the
+ *         PBA prescaler can bring that clock down to \a pba_hz.
+ */
+static unsigned long best_cpu_hz_from(unsigned long main_hz, unsigned long cpu_hz,
+                                      unsigned long pba_hz)
+{
+  unsigned int shift;
+
+  if ((main_hz >> TEST_MAX_SHIFT) > pba_hz)
+    return 0;
+  for (shift = 0; shift <= TEST_MAX_SHIFT; shift++)
+  {
+    if ((main_hz >> shift) <= cpu_hz)
+      return main_hz >> shift;
+  }
+  return 0;
+}
+
+
+/*! \brief Highest CPU frequency not above \a cpu_hz, over all the main clocks
+ *         which can give the PBA frequency.
+ */
+static unsigned long best_cpu_hz(unsigned long osc0_hz, unsigned long cpu_hz,
+                                 unsigned long pba_hz)
+{
+  unsigned long best = best_cpu_hz_from(osc0_hz, cpu_hz, pba_hz);
+  unsigned int mul, div;
+
+  for (mul = 3; mul <= 16; mul++)
+  {
+    for (div = 1; div <= 15; div++)
+    {
+      if (pll_valid(osc0_hz, mul, div))
+        best = max(best, best_cpu_hz_from(osc0_hz * mul / div, cpu_hz, pba_hz));
+    }
+  }
+  return best;
+}
+
+
+/*! \brief Checks a setting derived for \a cpu_hz and \a pba_hz: consistent,
+ *         within the PLL limits, giving the highest CPU frequency, then the
+ *         highest PBA frequency from the same main clock.
+ */
+static void check_setting(unsigned long osc0_hz, unsigned long cpu_hz,
+                          unsigned long pba_hz,
+                          const clock_profile_setting_t *setting)
+{
+  unsigned long main_hz = osc0_hz;
+
+  if (setting->pll_mul)
+  {
+    CHECK(pll_valid(osc0_hz, setting->pll_mul, setting->pll_div));
+    main_hz = osc0_hz * setting->pll_mul / setting->pll_div;
+  }
+  CHECK_EQUAL(setting->cpu_hz, main_hz >> setting->cpu_shift);
+  CHECK_EQUAL(setting->pba_hz, main_hz >> setting->pba_shift);
+  CHECK(setting->cpu_shift <= TEST_MAX_SHIFT);
+  CHECK(setting->pba_shift <= TEST_MAX_SHIFT);
+  CHECK(setting->cpu_shift <= setting->pba_shift);
+  CHECK(setting->cpu_hz <= cpu_hz);
+  CHECK(setting->pba_hz <= pba_hz);
+  CHECK_EQUAL(setting->cpu_hz, best_cpu_hz(osc0_hz, cpu_hz, pba_hz));
+  // One prescaler step less would be too fast for the PBA.
+  CHECK(setting->pba_shift == setting->cpu_shift ||
+        (main_hz >> (setting->pba_shift - 1)) > pba_hz);
+}
+
+
+/*! \brief Settings of the usual targets, and the search over a range of
+ *         them.
+ */
+static void test_compute(void)
+{
+  static const struct
+  {
+    unsigned long cpu_hz, pba_hz;
+    clock_profile_setting_t expected;
+  } targets[] =
+  {
+    // Default high-speed profile: 132 MHz PLL, divided by 2 and 4.
+    {66000000, 33000000, {66000000, 33000000, 11, 1, 1, 2}},
+    // OSC0 is kept when PLL0 gives no more.
+    {12000000, 12000000, {12000000, 12000000,  0, 0, 0, 0}},
+    // Among the PLL settings giving 48 MHz, the highest PLL frequency.
+    {48000000, 24000000, {48000000, 24000000, 16, 1, 2, 3}},
+    {60000000, 60000000, {60000000, 60000000, 10, 1, 1, 1}},
+    // OSC0 divided.
+    { 6000000,  3000000, { 6000000,  3000000,  0, 0, 1, 2}}
+  };
+  clock_profile_setting_t setting;
+  unsigned long cpu_hz, pba_hz;
+  unsigned int i;
+
+  for (i = 0; i < sizeof(targets) / sizeof(targets[0]); i++)
+  {
+    CHECK(clock_profile_compute(BOARD_OSC0_HZ, targets[i].cpu_hz,
+                                targets[i].pba_hz, &setting));
+    CHECK_EQUAL(setting.cpu_hz, targets[i].expected.cpu_hz);
+    CHECK_EQUAL(setting.pba_hz, targets[i].expected.pba_hz);
+    CHECK_EQUAL(setting.pll_mul, targets[i].expected.pll_mul);
+    CHECK_EQUAL(setting.pll_div, targets[i].expected.pll_div);
+    CHECK_EQUAL(setting.cpu_shift, targets[i].expected.cpu_shift);
+    CHECK_EQUAL(setting.pba_shift, targets[i].expected.pba_shift);
+    check_setting(BOARD_OSC0_HZ, targets[i].cpu_hz, targets[i].pba_hz, &setting);
+  }
+
+  // Below fOSC0 / 256 and fPLL / 256.
+  CHECK(!clock_profile_compute(BOARD_OSC0_HZ, 10000, 10000, &setting));
+
+  // The PBA clock cannot be divided down from the fastest main clock: a
+  // slower one is taken.
+  CHECK(clock_profile_compute(BOARD_OSC0_HZ, 1000000, 125000, &setting));
+  CHECK_EQUAL(setting.pll_mul, 0);
+  CHECK_EQUAL(setting.cpu_hz, BOARD_OSC0_HZ >> 4);
+  CHECK_EQUAL(setting.pba_hz, BOARD_OSC0_HZ >> 7);
+
+  // Other crystals and targets.
+  for (cpu_hz = 1000000; cpu_hz <= 66000000; cpu_hz += 1500000)
+  {
+    for (pba_hz = cpu_hz / 8; pba_hz <= cpu_hz; pba_hz += cpu_hz / 4)
+    {
+      CHECK(clock_profile_compute(BOARD_OSC0_HZ, cpu_hz, pba_hz, &setting));
+      check_setting(BOARD_OSC0_HZ, cpu_hz, pba_hz, &setting);
+      CHECK(clock_profile_compute(16000000, cpu_hz, pba_hz, &setting));
+      check_setting(16000000, cpu_hz, pba_hz, &setting);
+    }
+  }
+}
+
+
+/*! \brief Profile settings, and the switching sequence: the drivers are told
+ *         before the change in their registration order, and after it in the
+ *         reverse order; the flash wait state is set while running from OSC0.
+ */
+static void test_switch(void)
+{
+  const clock_profile_setting_t *setting;
+  unsigned int i;
+
+  CHECK(clock_profile_init());
+  CHECK_EQUAL(clock_profile_get(), CLOCK_PROFILE_LOW_POWER);
+  CHECK_EQUAL(clock_profile_get_cpu_hz(), BOARD_OSC0_HZ);
+  CHECK_EQUAL(clock_profile_get_pba_hz(), BOARD_OSC0_HZ);
+  CHECK_EQUAL(clock_profile_get_setting(CLOCK_PROFILE_LOW_POWER)->pll_mul, 0);
+
+  setting = clock_profile_get_setting(CLOCK_PROFILE_HIGH_SPEED);
+  CHECK_EQUAL(setting->cpu_hz, 66000000);
+  CHECK_EQUAL(setting->pba_hz, 33000000);
+  check_setting(BOARD_OSC0_HZ, CLOCK_PROFILE_HIGH_SPEED_CPU_HZ,
+                CLOCK_PROFILE_HIGH_SPEED_PBA_HZ, setting);
+
+  CHECK(clock_profile_register(client_a));
+  CHECK(clock_profile_register(client_b));
+
+  trace[0] = '\0';
+  clock_profile_set(CLOCK_PROFILE_HIGH_SPEED);
+  CHECK_EQUAL(clock_profile_get(), CLOCK_PROFILE_HIGH_SPEED);
+  CHECK(!strcmp(trace,
+                "a pre 12000000/12000000;b pre 12000000/12000000;"
+                "src 1;div 0/0/0;pll0 off;flash 66000000;"
+                "pll0 on 0*11/1;div 1/2/1;src 2;"
+                "b post 66000000/33000000;a post 66000000/33000000;"));
+
+  trace[0] = '\0';
+  clock_profile_set(CLOCK_PROFILE_HIGH_SPEED);
+  CHECK(!strcmp(trace, ""));
+
+  clock_profile_set(CLOCK_PROFILE_LOW_POWER);
+  CHECK_EQUAL(clock_profile_get_cpu_hz(), BOARD_OSC0_HZ);
+  CHECK(!strcmp(trace,
+                "a pre 66000000/33000000;b pre 66000000/33000000;"
+                "src 1;div 0/0/0;pll0 off;flash 12000000;div 0/0/0;"
+                "b post 12000000/12000000;a post 12000000/12000000;"));
+
+  // Room for CLOCK_PROFILE_NB_CLIENTS callbacks.
+  for (i = 2; i < CLOCK_PROFILE_NB_CLIENTS; i++)
+    CHECK(clock_profile_register(client_a));
+  CHECK(!clock_profile_register(client_a));
+}
+
+
+int main(void)
+{
+  test_compute();
+  test_switch();
+  return test_report("test_clock_profile");
+}
@@ -0,0 +1,479 @@
+/*****************************************************************************
+ *
+ * \file
+ *
+ * \brief Host test of the key/value store: power loss at each flash operation, scan and compaction.
+ *
+ * Copyright (c) 2009 Atmel Corporation. All rights reserved.
+ *
+ * \asf_license_start
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. The name of Atmel may not be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * 4. This software may only be redistributed and used in connection with an
+ *    Atmel microcontroller product.
+ *
+ * THIS SOFTWARE IS PROVIDED BY ATMEL "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT ARE
+ * EXPRESSLY AND SPECIFICALLY DISCLAIMED. IN NO EVENT SHALL ATMEL BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * \asf_license_stop
+ *
+ ******************************************************************************/
+
+
+#include <setjmp.h>
+#include "test.h"
+#include "flashc.h"
+#include "kv_store.h"
+
+
+//! Keys used by the scenario.
+#define TEST_KEYS             8
+
+//! Writes of the scenario: enough for several compactions.
+#define TEST_WRITES           120
+
+//! Size of a bank in bytes.
+#define TEST_BANK_SIZE        (KV_STORE_BANK_PAGES * AVR32_FLASHC_PAGE_SIZE)
+
+//! \name Part of the flash operation done when the power is lost
+//! @{
+#define TEST_CUT_NONE         0   //!< Nothing.
+#define TEST_CUT_HALF         1   //!< The first half of the bytes.
+#define TEST_CUT_ALMOST       2   //!< All the bytes but the last one.
+#define TEST_CUTS             3
+//! @}
+
+
+uint8_t test_flash[AVR32_FLASH_SIZE];
+
+//! Flash operations (programs and page erases) done since the last reset.
+static unsigned long flash_ops;
+
+//! Flash operations left before the power is lost, -1 to keep the power.
+static long flash_ops_left = -1;
+static int flash_cut;
+static jmp_buf power_loss;
+
+//! Values expected, KV_STORE_NOT_FOUND as length for a key without value.
+static uint8_t model_value[KV_STORE_NB_KEYS][KV_STORE_VALUE_MAX];
+static int model_len[KV_STORE_NB_KEYS];
+
+//! Write in progress, kept out of the stack frame left by longjmp().
+static int pending_key;
+static uint8_t pending_value[KV_STORE_VALUE_MAX];
+static uint16_t pending_len;
+static uint32_t scenario_seed;
+
+
+/*! \brief Counts a flash operation and tells if the power is lost during it.
+ */
+static bool flash_power_lost(void)
+{
+  flash_ops++;
+  return flash_ops_left >= 0 && !flash_ops_left--;
+}
+
+
+/*! \brief Number of bytes of an interrupted operation that are done.
+ */
+static size_t flash_cut_size(size_t nbytes)
+{
+  switch (flash_cut)
+  {
+  case TEST_CUT_HALF:   return nbytes / 2;
+  case TEST_CUT_ALMOST: return nbytes - 1;
+  default:              return 0;
+  }
+}
+
+
+volatile void *flashc_memcpy(volatile void *dst, const void *src,
+                             size_t nbytes, bool erase)
+{
+  uint8_t *d = (uint8_t *)dst;
+  const uint8_t *s = src;
+  size_t n = nbytes;
+  size_t i;
+
+  // The store erases its banks itself.
+  CHECK(!erase);
+  CHECK(d >= test_flash && d + nbytes <= test_flash + AVR32_FLASH_SIZE);
+
+  if (flash_power_lost())
+  {
+    n = flash_cut_size(nbytes);
+    for (i = 0; i < n; i++) d[i] &= s[i];
+    longjmp(power_loss, 1);
+  }
+
+  // Programming only clears bits.
+  for (i = 0; i < n; i++) d[i] &= s[i];
+  return dst;
+}
+
+
+bool flashc_erase_page(int page_number, bool check)
+{
+  uint8_t *page = test_flash + page_number * AVR32_FLASHC_PAGE_SIZE;
+
+  CHECK(page_number >= 0 &&
+        (page_number + 1) * AVR32_FLASHC_PAGE_SIZE <= AVR32_FLASH_SIZE);
+
+  if (flash_power_lost())
+  {
+    memset(page, 0xFF, flash_cut_size(AVR32_FLASHC_PAGE_SIZE));
+    longjmp(power_loss, 1);
+  }
+
+  memset(page, 0xFF, AVR32_FLASHC_PAGE_SIZE);
+  return true;
+}
+
+
+bool flashc_is_lock_error(void)
+{
+  return false;
+}
+
+
+bool flashc_is_programming_error(void)
+{
+  return false;
+}
+
+
+void flashc_set_bus_freq(unsigned int cpu_f_hz)
+{
+}
+
+
+/*! \brief Erases the whole flash and forgets the values.
+ */
+static void store_wipe(void)
+{
+  int key;
+
+  memset(test_flash, 0xFF, sizeof(test_flash));
+  for (key = 0; key < KV_STORE_NB_KEYS; key++)
+    model_len[key] = KV_STORE_NOT_FOUND;
+}
+
+
+/*! \brief Gets the active bank in the flash array.
+ *
+ * The store is created in bank 0 with the sequence number 1, and each
+ * compaction moves it to the other bank.
+ */
+static uint8_t *store_active_bank(void)
+{
+  kv_store_stats_t stats;
+
+  kv_store_get_stats(&stats);
+  return test_flash + KV_STORE_FLASH_OFFSET + ((stats.sequence - 1) & 1) * TEST_BANK_SIZE;
+}
+
+
+/*! \brief Tells if a key holds the value expected by the model.
+ */
+static bool store_has_model(int key)
+{
+  uint8_t buf[KV_STORE_VALUE_MAX];
+  int len = kv_store_read(key, buf, sizeof(buf));
+
+  return len == model_len[key] &&
+         (len == KV_STORE_NOT_FOUND || !memcmp(buf, model_value[key], len));
+}
+
+
+/*! \brief Tells if a key holds the value of the pending write.
+ */
+static bool store_has_pending(int key)
+{
+  uint8_t buf[KV_STORE_VALUE_MAX];
+  int len = kv_store_read(key, buf, sizeof(buf));
+
+  if (!pending_len)
+    return len == KV_STORE_NOT_FOUND;
+  return len == pending_len && !memcmp(buf, pending_value, len);
+}
+
+
+/*! \brief Applies the pending write to the model.
+ */
+static void model_apply_pending(void)
+{
+  model_len[pending_key] = (pending_len) ? pending_len : KV_STORE_NOT_FOUND;
+  memcpy(model_value[pending_key], pending_value, pending_len);
+}
+
+
+/*! \brief Checks all the keys against the model.
+ */
+static void store_check(void)
+{
+  int key;
+
+  for (key = 0; key < KV_STORE_NB_KEYS; key++)
+    CHECK(store_has_model(key));
+}
+
+
+static uint32_t scenario_random(void)
+{
+  scenario_seed = scenario_seed * 1103515245 + 12345;
+  return scenario_seed >> 8;
+}
+
+
+/*! \brief Sets up the next write of the scenario: new values of all lengths,
+ *         deletions, and rewrites of the current value.
+ */
+static void scenario_next(int write)
+{
+  uint16_t i;
+
+  pending_key = scenario_random() % TEST_KEYS;
+  if (write % 9 == 8 && model_len[pending_key] != KV_STORE_NOT_FOUND)
+  {
+    // Unchanged value: nothing is programmed.
+    pending_len = model_len[pending_key];
+    memcpy(pending_value, model_value[pending_key], pending_len);
+    return;
+  }
+  pending_len = (write % 11 == 10) ? 0 : scenario_random() % KV_STORE_VALUE_MAX + 1;
+  for (i = 0; i < pending_len; i++)
+    pending_value[i] = scenario_random();
+}
+
+
+/*! \brief Runs the scenario on an empty flash, the power being lost at a
+ *         flash operation.
+ *
+ * After the power loss, the key written holds either its old or its new
+ * value, the others are unchanged, and the store is usable.
+ *
+ * \param fail_at Index of the flash operation interrupted, -1 for none.
+ *
+ * \return Number of flash operations done.
+ */
+static unsigned long scenario_run(long fail_at)
+{
+  static int write;
+  kv_store_stats_t stats;
+
+  store_wipe();
+  scenario_seed = 1;
+  flash_ops = 0;
+  flash_ops_left = fail_at;
+  pending_key = -1;
+
+  if (setjmp(power_loss))
+  {
+    unsigned long ops = flash_ops;
+
+    // Power back, without further losses.
+    flash_ops_left = -1;
+    CHECK(kv_store_init());
+    if (pending_key >= 0)
+    {
+      CHECK(store_has_model(pending_key) || store_has_pending(pending_key));
+      if (store_has_pending(pending_key))
+        model_apply_pending();
+    }
+    store_check();
+
+    // The recovered store takes new writes and survives another reset.
+    scenario_next(write);
+    CHECK(kv_store_write(pending_key, pending_value, pending_len));
+    model_apply_pending();
+    store_check();
+    CHECK(kv_store_init());
+    store_check();
+    return ops;
+  }
+
+  CHECK(kv_store_init());
+  for (write = 0; write < TEST_WRITES; write++)
+  {
+    if (write == TEST_WRITES / 2)
+    {
+      // Explicit compaction.
+      pending_key = -1;
+      CHECK(kv_store_compact());
+      store_check();
+    }
+    scenario_next(write);
+    CHECK(kv_store_write(pending_key, pending_value, pending_len));
+    model_apply_pending();
+    store_check();
+  }
+  pending_key = -1;
+
+  // Scan of the bank left by the scenario.
+  CHECK(kv_store_init());
+  store_check();
+
+  kv_store_get_stats(&stats);
+  CHECK(stats.compactions >= 3);
+  CHECK(stats.unchanged > 0);
+  CHECK(stats.used + stats.free == TEST_BANK_SIZE);
+
+  // A clean run must not be cut.
+  CHECK(fail_at < 0);
+  return flash_ops;
+}
+
+
+/*! \brief Loses the power at each flash operation of the scenario, with each
+ *         part of the operation done.
+ */
+static void test_power_loss(void)
+{
+  unsigned long ops = scenario_run(-1);
+  unsigned long op;
+
+  CHECK(ops > TEST_WRITES);
+  for (flash_cut = 0; flash_cut < TEST_CUTS; flash_cut++)
+  {
+    for (op = 0; op < ops; op++)
+      CHECK_EQUAL(scenario_run(op), op + 1);
+  }
+  flash_cut = TEST_CUT_NONE;
+}
+
+
+/*! \brief A record with a wrong CRC ends the scan: the key gets its previous
+ *         value back and the bank is compacted.
+ */
+static void test_scan_bad_crc(void)
+{
+  kv_store_stats_t stats;
+  uint32_t sequence;
+  uint8_t *record;
+  char buf[KV_STORE_VALUE_MAX];
+
+  store_wipe();
+  CHECK(kv_store_init());
+  CHECK(kv_store_write(1, "AAAA", 4));
+  CHECK(kv_store_write(2, "CC", 2));
+  kv_store_get_stats(&stats);
+  record = store_active_bank() + stats.used;
+  CHECK(kv_store_write(1, "BBBB", 4));
+  CHECK(kv_store_write(3, "DDDD", 4));
+  sequence = stats.sequence;
+
+  // Clear a bit of the value of the second record of key 1.
+  record[4] &= ~0x02;
+
+  CHECK(kv_store_init());
+  kv_store_get_stats(&stats);
+  CHECK_EQUAL(stats.sequence, sequence + 1);
+  CHECK_EQUAL(kv_store_read(1, buf, sizeof(buf)), 4);
+  CHECK(!memcmp(buf, "AAAA", 4));
+  CHECK_EQUAL(kv_store_read(2, buf, sizeof(buf)), 2);
+  // The records after the bad one are lost.
+  CHECK_EQUAL(kv_store_read(3, buf, sizeof(buf)), KV_STORE_NOT_FOUND);
+}
+
+
+/*! \brief Data programmed after the last record (interrupted write) makes
+ *         the init compact the bank.
+ */
+static void test_scan_trailing_data(void)
+{
+  kv_store_stats_t stats;
+  uint32_t sequence;
+  char buf[KV_STORE_VALUE_MAX];
+
+  store_wipe();
+  CHECK(kv_store_init());
+  CHECK(kv_store_write(5, "value", 5));
+  kv_store_get_stats(&stats);
+  sequence = stats.sequence;
+  store_active_bank()[stats.used + 40] = 0x5A;
+
+  CHECK(kv_store_init());
+  kv_store_get_stats(&stats);
+  CHECK_EQUAL(stats.sequence, sequence + 1);
+  CHECK_EQUAL(kv_store_read(5, buf, sizeof(buf)), 5);
+  CHECK(!memcmp(buf, "value", 5));
+
+  // The new bank is clean.
+  CHECK(kv_store_init());
+  kv_store_get_stats(&stats);
+  CHECK_EQUAL(stats.sequence, sequence + 1);
+}
+
+
+/*! \brief The compaction keeps the last record of each key only.
+ */
+static void test_compaction(void)
+{
+  kv_store_stats_t stats;
+  uint8_t value[KV_STORE_VALUE_MAX];
+  uint32_t compactions;
+  int i;
+
+  store_wipe();
+  CHECK(kv_store_init());
+  kv_store_get_stats(&stats);
+  CHECK_EQUAL(stats.sequence, 1);
+  CHECK_EQUAL(stats.used, 12);
+  compactions = stats.compactions;
+
+  // Fill the bank with versions of two keys, and delete a third one.
+  memset(value, 0x11, sizeof(value));
+  CHECK(kv_store_write(7, value, 8));
+  CHECK(kv_store_delete(7));
+  for (i = 0; stats.compactions == compactions; i++)
+  {
+    value[0] = i;
+    CHECK(kv_store_write(i & 1, value, KV_STORE_VALUE_MAX));
+    kv_store_get_stats(&stats);
+  }
+
+  // The write which did not fit was appended after the two kept records.
+  CHECK_EQUAL(stats.sequence, 2);
+  CHECK_EQUAL(stats.used, 12 + 3 * ((4 + KV_STORE_VALUE_MAX + 2 + 3) & ~3));
+  CHECK_EQUAL(kv_store_read(7, value, sizeof(value)), KV_STORE_NOT_FOUND);
+  CHECK_EQUAL(kv_store_read((i - 1) & 1, value, sizeof(value)), KV_STORE_VALUE_MAX);
+  CHECK_EQUAL(value[0], (uint8_t)(i - 1));
+  CHECK_EQUAL(kv_store_read(i & 1, value, sizeof(value)), KV_STORE_VALUE_MAX);
+  CHECK_EQUAL(value[0], (uint8_t)(i - 2));
+
+  // Arguments out of range.
+  CHECK(!kv_store_write(KV_STORE_NB_KEYS, value, 1));
+  CHECK(!kv_store_write(0, value, KV_STORE_VALUE_MAX + 1));
+  CHECK_EQUAL(kv_store_read(0, value, 1), KV_STORE_INVALID_ARGUMENT);
+}
+
+
+int main(void)
+{
+  test_power_loss();
+  test_scan_bad_crc();
+  test_scan_trailing_data();
+  test_compaction();
+  return test_report("test_kv_store");
+}
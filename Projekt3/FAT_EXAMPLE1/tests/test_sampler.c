@@ -0,0 +1,288 @@
+/*****************************************************************************
+ *
+ * \file
+ *
+ * \brief Host test of the sampling engine: ring, overruns, jitter statistics and clock changes.
+ *
+ * Copyright (c) 2009 Atmel Corporation. All rights reserved.
+ *
+ * \asf_license_start
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. The name of Atmel may not be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * 4. This software may only be redistributed and used in connection with an
+ *    Atmel microcontroller product.
+ *
+ * THIS SOFTWARE IS PROVIDED BY ATMEL "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT ARE
+ * EXPRESSLY AND SPECIFICALLY DISCLAIMED. IN NO EVENT SHALL ATMEL BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * \asf_license_stop
+ *
+ ******************************************************************************/
+
+
+#include "test.h"
+#include "intc.h"
+#include "tc.h"
+#include "clock_profile.h"
+#include "sampler.h"
+
+
+#define TEST_TC_CHANNEL       2
+
+#define TEST_CPU_HZ           66000000
+#define TEST_PBA_HZ           33000000
+
+
+//! Clock profile callback registered by the sampler.
+static clock_profile_callback_t clock_changed;
+
+//! Value returned by the next acquisition.
+static uint32_t acquire_value;
+
+
+bool clock_profile_register(clock_profile_callback_t callback)
+{
+  clock_changed = callback;
+  return true;
+}
+
+
+static uint32_t acquire(void)
+{
+  return acquire_value++;
+}
+
+
+/*! \brief Takes a sample from the TC interrupt handler at a cycle count.
+ */
+static void sample_at(uint32_t count)
+{
+  test_sys_count = count;
+  test_intc_handler();
+}
+
+
+/*! \brief The TC period and the nominal period in CPU cycles follow the
+ *         rate, from the fastest TC clock that fits.
+ */
+static void test_rate(void)
+{
+  sampler_stats_t stats;
+
+  CHECK(clock_changed != NULL);
+  CHECK_EQUAL(test_intc_level, AVR32_INTC_INT1);
+
+  CHECK(sampler_start(1000, acquire));
+  sampler_get_stats(&stats);
+  CHECK_EQUAL(test_tc[TEST_TC_CHANNEL].tcclks, TC_CLOCK_SOURCE_TC2);
+  CHECK_EQUAL(test_tc[TEST_TC_CHANNEL].rc, 16500);
+  CHECK(test_tc[TEST_TC_CHANNEL].started);
+  CHECK_EQUAL(stats.period_cy, 66000);
+
+  CHECK(sampler_start(10, acquire));
+  sampler_get_stats(&stats);
+  CHECK_EQUAL(test_tc[TEST_TC_CHANNEL].tcclks, TC_CLOCK_SOURCE_TC5);
+  CHECK_EQUAL(test_tc[TEST_TC_CHANNEL].rc, 25781);
+  CHECK_EQUAL(stats.period_cy, 25781 * 128 * 2);
+
+  // Out of range at this PBA frequency.
+  CHECK(!sampler_start(1, acquire));
+  CHECK(!sampler_start(20000000, acquire));
+  CHECK(!sampler_start(0, acquire));
+  CHECK(!sampler_start(1000, NULL));
+
+  sampler_stop();
+  CHECK(!test_tc[TEST_TC_CHANNEL].started);
+}
+
+
+/*! \brief The samples are read back in order across the wrap-around of the
+ *         ring.
+ */
+static void test_ring(void)
+{
+  sampler_sample_t samples[SAMPLER_RING_SIZE];
+  uint32_t value = 0, count = 0;
+  unsigned int round, i;
+  bool in_order = true;
+
+  CHECK(sampler_start(1000, acquire));
+  acquire_value = 0;
+  CHECK_EQUAL(sampler_available(), 0);
+  CHECK_EQUAL(sampler_read(samples, SAMPLER_RING_SIZE), 0);
+
+  for (round = 0; round < 10; round++)
+  {
+    for (i = 0; i < SAMPLER_RING_SIZE * 2 / 5; i++)
+      sample_at(count++ * 66000);
+    CHECK_EQUAL(sampler_available(), SAMPLER_RING_SIZE * 2 / 5);
+    CHECK_EQUAL(sampler_read(samples, SAMPLER_RING_SIZE), SAMPLER_RING_SIZE * 2 / 5);
+    for (i = 0; i < SAMPLER_RING_SIZE * 2 / 5; i++)
+    {
+      in_order &= samples[i].value == value;
+      in_order &= samples[i].timestamp == value * 66000;
+      value++;
+    }
+  }
+  CHECK(in_order);
+  CHECK_EQUAL(sampler_available(), 0);
+}
+
+
+/*! \brief A full ring drops the new samples and counts them; reading frees
+ *         the slots.
+ */
+static void test_overrun(void)
+{
+  sampler_sample_t samples[SAMPLER_RING_SIZE];
+  sampler_stats_t stats;
+  unsigned int i;
+
+  CHECK(sampler_start(1000, acquire));
+  acquire_value = 0;
+  for (i = 0; i < SAMPLER_RING_SIZE + 5; i++)
+    sampler_push(i * 66000, i);
+
+  sampler_get_stats(&stats);
+  CHECK_EQUAL(stats.samples, SAMPLER_RING_SIZE + 5);
+  CHECK_EQUAL(stats.overruns, 5);
+  CHECK_EQUAL(sampler_available(), SAMPLER_RING_SIZE);
+
+  // The oldest samples are kept.
+  CHECK_EQUAL(sampler_read(samples, 3), 3);
+  CHECK_EQUAL(samples[0].value, 0);
+  CHECK_EQUAL(samples[2].value, 2);
+
+  sampler_push(1000 * 66000, 1000);
+  CHECK_EQUAL(sampler_available(), SAMPLER_RING_SIZE - 2);
+  CHECK_EQUAL(sampler_read(samples, SAMPLER_RING_SIZE), SAMPLER_RING_SIZE - 2);
+  CHECK_EQUAL(samples[0].value, 3);
+  CHECK_EQUAL(samples[SAMPLER_RING_SIZE - 4].value, SAMPLER_RING_SIZE - 1);
+  CHECK_EQUAL(samples[SAMPLER_RING_SIZE - 3].value, 1000);
+  sampler_get_stats(&stats);
+  CHECK_EQUAL(stats.overruns, 5);
+}
+
+
+/*! \brief The jitter of each interval is its deviation from the nominal
+ *         period, kept as extremes and in the histogram.
+ */
+static void test_jitter(void)
+{
+  static const int32_t jitters[] = {5, -20, 40, -3};
+  sampler_stats_t stats;
+  uint32_t count = 1000;
+  unsigned int i;
+
+  CHECK(sampler_start(1000, acquire));
+  CHECK_EQUAL(sampler_get_jitter_percentile(50), 0);
+
+  sample_at(count);
+  for (i = 0; i < sizeof(jitters) / sizeof(jitters[0]); i++)
+  {
+    count += 66000 + jitters[i];
+    sample_at(count);
+  }
+
+  sampler_get_stats(&stats);
+  CHECK_EQUAL(stats.samples, 5);
+  CHECK_EQUAL(stats.jitter_min, -20);
+  CHECK_EQUAL(stats.jitter_max, 40);
+  // Buckets of 16 cycles: 5 and 3 in the first one, 20 and 40 above.
+  CHECK_EQUAL(sampler_get_jitter_percentile(50), SAMPLER_JITTER_BUCKET_CY);
+  CHECK_EQUAL(sampler_get_jitter_percentile(75), 2 * SAMPLER_JITTER_BUCKET_CY);
+  CHECK_EQUAL(sampler_get_jitter_percentile(100), 3 * SAMPLER_JITTER_BUCKET_CY);
+  CHECK_EQUAL(sampler_get_jitter_percentile(0), SAMPLER_JITTER_BUCKET_CY);
+
+  // A jitter in the last bucket: the maximal jitter is returned.
+  count += 66000 - 10000;
+  sample_at(count);
+  CHECK_EQUAL(sampler_get_jitter_percentile(100), 10000);
+
+  // The cycle counter wraps around between two samples.
+  CHECK(sampler_start(1000, acquire));
+  sample_at(0xFFFFFFFF - 1000);
+  sample_at(0xFFFFFFFF - 1000 + 66000 + 7);
+  sampler_get_stats(&stats);
+  CHECK_EQUAL(stats.jitter_min, 7);
+  CHECK_EQUAL(stats.jitter_max, 7);
+}
+
+
+/*! \brief The TC channel is held during a clock change, then the periods
+ *         are derived again; the interval across the change is not a jitter
+ *         sample. Sampling stops if the rate is out of range.
+ */
+static void test_clock_change(void)
+{
+  sampler_stats_t stats;
+
+  CHECK(sampler_start(1000, acquire));
+  sample_at(0);
+  sample_at(66000);
+
+  clock_changed(CLOCK_PROFILE_PRE_CHANGE, TEST_CPU_HZ, TEST_PBA_HZ);
+  CHECK(!test_tc[TEST_TC_CHANNEL].started);
+  clock_changed(CLOCK_PROFILE_POST_CHANGE, 12000000, 12000000);
+  CHECK(test_tc[TEST_TC_CHANNEL].started);
+  CHECK_EQUAL(test_tc[TEST_TC_CHANNEL].rc, 6000);
+  sampler_get_stats(&stats);
+  CHECK_EQUAL(stats.period_cy, 12000);
+
+  // The interval across the change is skipped, the next ones are measured
+  // against the new period.
+  sample_at(500000);
+  sample_at(500000 + 12000 + 2);
+  sampler_get_stats(&stats);
+  CHECK_EQUAL(stats.samples, 4);
+  CHECK_EQUAL(stats.jitter_min, 0);
+  CHECK_EQUAL(stats.jitter_max, 2);
+
+  // 10 MHz fits a 33 MHz PBA clock, not a 12 MHz one.
+  clock_changed(CLOCK_PROFILE_PRE_CHANGE, 12000000, 12000000);
+  clock_changed(CLOCK_PROFILE_POST_CHANGE, TEST_CPU_HZ, TEST_PBA_HZ);
+  CHECK(sampler_start(10000000, acquire));
+  clock_changed(CLOCK_PROFILE_PRE_CHANGE, TEST_CPU_HZ, TEST_PBA_HZ);
+  clock_changed(CLOCK_PROFILE_POST_CHANGE, 12000000, 12000000);
+  CHECK(!test_tc[TEST_TC_CHANNEL].started);
+
+  // Stopped: a clock change leaves the TC channel alone.
+  clock_changed(CLOCK_PROFILE_PRE_CHANGE, 12000000, 12000000);
+  clock_changed(CLOCK_PROFILE_POST_CHANGE, TEST_CPU_HZ, TEST_PBA_HZ);
+  CHECK(!test_tc[TEST_TC_CHANNEL].started);
+}
+
+
+int main(void)
+{
+  static avr32_tc_t tc;
+
+  sampler_init(&tc, TEST_TC_CHANNEL, 0, TEST_PBA_HZ, TEST_CPU_HZ);
+  test_rate();
+  test_ring();
+  test_overrun();
+  test_jitter();
+  test_clock_change();
+  return test_report("test_sampler");
+}
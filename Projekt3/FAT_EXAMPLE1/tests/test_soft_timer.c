@@ -0,0 +1,343 @@
+/*****************************************************************************
+ *
+ * \file
+ *
+ * \brief Host test of the software timers: timing wheel on a virtual tick.
+ *
+ * Copyright (c) 2009 Atmel Corporation. All rights reserved.
+ *
+ * \asf_license_start
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. The name of Atmel may not be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * 4. This software may only be redistributed and used in connection with an
+ *    Atmel microcontroller product.
+ *
+ * THIS SOFTWARE IS PROVIDED BY ATMEL "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT ARE
+ * EXPRESSLY AND SPECIFICALLY DISCLAIMED. IN NO EVENT SHALL ATMEL BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * \asf_license_stop
+ *
+ ******************************************************************************/
+
+
+#include "test.h"
+#include "intc.h"
+#include "tc.h"
+#include "soft_timer.h"
+
+
+//! Wheel geometry of soft_timer.c: 4 levels of 64 slots.
+#define TEST_LEVEL_TICKS(level)   (1UL << (6 * (level)))
+#define TEST_RANGE_MAX            (TEST_LEVEL_TICKS(4) - 1)
+
+//! Timers of the wheel test.
+#define TEST_TIMERS               300
+
+#define TEST_TC_CHANNEL           1
+
+
+//! Expiries seen by a timer.
+typedef struct
+{
+  soft_timer_t timer;
+  uint32_t expected;
+  uint32_t fired_at;
+  unsigned int fired;
+} test_timer_t;
+
+static test_timer_t timers[TEST_TIMERS];
+
+
+/*! \brief Tick being processed, as seen by the callbacks.
+ */
+static uint32_t tick_now(void)
+{
+  return soft_timer_get_ticks() - 1;
+}
+
+
+/*! \brief Runs ticks.
+ */
+static void tick_run(uint32_t ticks)
+{
+  while (ticks--)
+    soft_timer_tick();
+}
+
+
+static void timer_record(void *arg)
+{
+  test_timer_t *t = arg;
+
+  t->fired_at = tick_now();
+  t->fired++;
+}
+
+
+/*! \brief Sets up a timer recording its expiries.
+ *
+ * The timer is stopped first: a failed check may leave it armed.
+ */
+static void timer_setup(test_timer_t *t, soft_timer_callback_t callback,
+                        bool deferred)
+{
+  soft_timer_stop(&t->timer);
+  soft_timer_setup(&t->timer, callback, t, deferred);
+  t->fired = 0;
+}
+
+
+/*! \brief Starts a one-shot timer expected \a delay ticks from now.
+ */
+static void timer_start(test_timer_t *t, uint32_t delay)
+{
+  t->expected = soft_timer_get_ticks() + delay;
+  t->fired = 0;
+  soft_timer_start(&t->timer, delay, 0);
+}
+
+
+static uint32_t test_seed = 1;
+
+static uint32_t test_random(void)
+{
+  test_seed = test_seed * 1103515245 + 12345;
+  return test_seed >> 4;
+}
+
+
+/*! \brief One-shot timers at each level of the wheel, on its boundaries and
+ *         beyond its range, started at various ticks, expire exactly once
+ *         at their tick.
+ */
+static void test_wheel(void)
+{
+  static const uint32_t edges[] =
+  {
+    0, 1, 62, 63, 64, 65, 127, 128,
+    TEST_LEVEL_TICKS(2) - 1, TEST_LEVEL_TICKS(2), TEST_LEVEL_TICKS(2) + 1,
+    TEST_LEVEL_TICKS(3) - 1, TEST_LEVEL_TICKS(3), TEST_LEVEL_TICKS(3) + 1,
+    TEST_RANGE_MAX - 1, TEST_RANGE_MAX, TEST_RANGE_MAX + 1,
+    // Over the range: placed again from the last level.
+    TEST_RANGE_MAX + 64 + 5, 2 * TEST_RANGE_MAX + 3
+  };
+  const unsigned int nb_edges = sizeof(edges) / sizeof(edges[0]);
+  uint32_t last = 0, delay;
+  unsigned int i, level;
+
+  for (i = 0; i < TEST_TIMERS; i++)
+  {
+    // Start the timers at ticks spread over the slots.
+    tick_run(test_random() % 97);
+    if (i < nb_edges)
+      delay = edges[i];
+    else
+    {
+      level = test_random() % 4 + 1;
+      delay = test_random() % TEST_LEVEL_TICKS(level);
+    }
+    timer_setup(&timers[i], timer_record, false);
+    timer_start(&timers[i], delay);
+    last = max(last, timers[i].expected);
+  }
+
+  while ((int32_t)(soft_timer_get_ticks() - last) <= 0)
+    soft_timer_tick();
+
+  for (i = 0; i < TEST_TIMERS; i++)
+  {
+    CHECK_EQUAL(timers[i].fired, 1);
+    CHECK_EQUAL(timers[i].fired_at, timers[i].expected);
+    CHECK(!soft_timer_is_active(&timers[i].timer));
+  }
+}
+
+
+/*! \brief Delays beyond SOFT_TIMER_DELAY_MAX are clamped to it.
+ */
+static void test_delay_max(void)
+{
+  test_timer_t *t = &timers[0];
+
+  timer_setup(t, timer_record, false);
+  timer_start(t, 0xFFFFFFFF);
+  CHECK_EQUAL(t->timer.expires, soft_timer_get_ticks() + 0x7FFFFFFF);
+  CHECK(soft_timer_is_active(&t->timer));
+  tick_run(3 * TEST_LEVEL_TICKS(3));
+  CHECK_EQUAL(t->fired, 0);
+  soft_timer_stop(&t->timer);
+  CHECK(!soft_timer_is_active(&t->timer));
+}
+
+
+/*! \brief Periodic timers expire every period from their first expiry, also
+ *         across the levels.
+ */
+static void test_periodic(void)
+{
+  static const uint32_t periods[] = {1, 63, 64, 100, 5000, 300000};
+  const unsigned int nb = sizeof(periods) / sizeof(periods[0]);
+  uint32_t start = soft_timer_get_ticks();
+  unsigned int i;
+
+  for (i = 0; i < nb; i++)
+  {
+    timer_setup(&timers[i], timer_record, false);
+    soft_timer_start(&timers[i].timer, 7, periods[i]);
+  }
+  tick_run(1000000);
+  for (i = 0; i < nb; i++)
+  {
+    // Expiries at start + 7 + k * period, for k < fired.
+    CHECK_EQUAL(timers[i].fired, (1000000 - 7 - 1) / periods[i] + 1);
+    CHECK_EQUAL(timers[i].fired_at, start + 7 + (timers[i].fired - 1) * periods[i]);
+    soft_timer_stop(&timers[i].timer);
+  }
+}
+
+
+static test_timer_t *late_restarted;
+static test_timer_t *late_stopped;
+
+/*! \brief Restarts a timer with no delay and stops another one expiring at
+ *         the same tick.
+ */
+static void timer_restart_others(void *arg)
+{
+  timer_record(arg);
+  timer_start(late_restarted, 0);
+  soft_timer_stop(&late_stopped->timer);
+}
+
+
+/*! \brief A timer started from a callback with no delay expires at the next
+ *         tick, and a timer stopped by a callback of its own tick does not
+ *         expire.
+ */
+static void test_late(void)
+{
+  test_timer_t *first = &timers[0];
+  uint32_t now;
+
+  late_restarted = &timers[1];
+  late_stopped = &timers[2];
+
+  timer_setup(first, timer_restart_others, false);
+  timer_setup(late_restarted, timer_record, false);
+  timer_setup(late_stopped, timer_record, false);
+
+  // Expiring at the same tick: the slot runs the last started first.
+  now = soft_timer_get_ticks();
+  timer_start(late_stopped, 10);
+  timer_start(first, 10);
+
+  tick_run(11);
+  CHECK_EQUAL(first->fired, 1);
+  CHECK_EQUAL(first->fired_at, now + 10);
+  CHECK_EQUAL(late_stopped->fired, 0);
+  CHECK_EQUAL(late_restarted->fired, 0);
+  CHECK(soft_timer_is_active(&late_restarted->timer));
+
+  tick_run(1);
+  CHECK_EQUAL(late_restarted->fired, 1);
+  CHECK_EQUAL(late_restarted->fired_at, now + 11);
+
+  // A timer started again before its expiry only expires at its new tick.
+  timer_setup(first, timer_record, false);
+  timer_start(first, 50);
+  tick_run(20);
+  timer_start(first, 50);
+  tick_run(100);
+  CHECK_EQUAL(first->fired, 1);
+  CHECK_EQUAL(first->fired_at, first->expected);
+}
+
+
+/*! \brief The expiries of a deferred timer are merged until
+ *         soft_timer_task() is called, and stopping it cancels the call.
+ */
+static void test_deferred(void)
+{
+  test_timer_t *t = &timers[0];
+
+  timer_setup(t, timer_record, true);
+  soft_timer_start(&t->timer, 0, 1);
+  tick_run(5);
+  CHECK_EQUAL(t->fired, 0);
+  soft_timer_task();
+  CHECK_EQUAL(t->fired, 1);
+  soft_timer_task();
+  CHECK_EQUAL(t->fired, 1);
+
+  tick_run(1);
+  soft_timer_stop(&t->timer);
+  soft_timer_task();
+  CHECK_EQUAL(t->fired, 1);
+}
+
+
+/*! \brief The TC channel runs while timers are armed, at the tick rate of
+ *         the PBA frequency.
+ */
+static void test_tickless(void)
+{
+  static avr32_tc_t tc;
+  test_timer_t *t = &timers[0];
+  uint32_t ticks;
+
+  soft_timer_init(&tc, TEST_TC_CHANNEL, 0, 12000000);
+  CHECK_EQUAL(test_tc[TEST_TC_CHANNEL].rc, 1500);
+  CHECK_EQUAL(test_tc[TEST_TC_CHANNEL].tcclks, TC_CLOCK_SOURCE_TC3);
+  CHECK(test_tc[TEST_TC_CHANNEL].cpcs);
+  CHECK(!test_tc[TEST_TC_CHANNEL].started);
+  CHECK(test_intc_handler != NULL);
+
+  timer_setup(t, timer_record, false);
+  timer_start(t, 3);
+  CHECK(test_tc[TEST_TC_CHANNEL].started);
+
+  // PBA clock change: the tick being counted is restarted.
+  soft_timer_set_pba_hz(33000000);
+  CHECK_EQUAL(test_tc[TEST_TC_CHANNEL].rc, 4125);
+  CHECK_EQUAL(test_tc[TEST_TC_CHANNEL].starts, 2);
+
+  // Ticks from the TC interrupt.
+  ticks = soft_timer_get_ticks();
+  while (test_tc[TEST_TC_CHANNEL].started)
+    test_intc_handler();
+  CHECK_EQUAL(soft_timer_get_ticks() - ticks, 4);
+  CHECK_EQUAL(t->fired, 1);
+}
+
+
+int main(void)
+{
+  test_wheel();
+  test_delay_max();
+  test_periodic();
+  test_late();
+  test_deferred();
+  test_tickless();
+  return test_report("test_soft_timer");
+}
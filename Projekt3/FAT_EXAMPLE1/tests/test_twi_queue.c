@@ -0,0 +1,380 @@
+/*****************************************************************************
+ *
+ * \file
+ *
+ * \brief Host test of the TWI master transaction queue.
+ *
+ * Copyright (c) 2009 Atmel Corporation. All rights reserved.
+ *
+ * \asf_license_start
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. The name of Atmel may not be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * 4. This software may only be redistributed and used in connection with an
+ *    Atmel microcontroller product.
+ *
+ * THIS SOFTWARE IS PROVIDED BY ATMEL "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT ARE
+ * EXPRESSLY AND SPECIFICALLY DISCLAIMED. IN NO EVENT SHALL ATMEL BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * \asf_license_stop
+ *
+ ******************************************************************************/
+
+
+#include "test.h"
+#include "intc.h"
+#include "twi.h"
+
+
+#define TEST_CPU_HZ           66000000
+#define TEST_PBA_HZ           33000000
+#define TEST_SPEED            100000
+
+//! Value left in THR when the driver writes nothing.
+#define TEST_THR_NONE         0xFFFFFFFF
+
+//! Maximal number of bus events of a test scenario.
+#define TEST_MAX_STEPS        100
+
+
+static avr32_twi_t twi;
+
+//! Bytes sent on the bus.
+static uint8_t tx_log[32];
+static unsigned int tx_count;
+
+//! Next byte received from the bus.
+static uint8_t rx_next;
+
+//! The slave does not acknowledge.
+static bool bus_nack;
+
+//! Transactions completed, in order.
+static twi_trans_t *done_log[8];
+static unsigned int done_count;
+
+//! Cycle count at the last completion.
+static uint32_t done_at;
+
+//! Transaction submitted by the relax hook, while the driver busy-waits.
+static twi_trans_t *late_trans;
+
+
+static void trans_done(twi_trans_t *trans)
+{
+  done_at = test_sys_count;
+  if (done_count < sizeof(done_log) / sizeof(done_log[0]))
+    done_log[done_count++] = trans;
+}
+
+
+static void trans_setup(twi_trans_t *trans, bool read, char chip,
+                        void *buffer, unsigned int length)
+{
+  memset(trans, 0, sizeof(*trans));
+  trans->read = read;
+  trans->package.chip = chip;
+  trans->package.buffer = buffer;
+  trans->package.length = length;
+  trans->callback = trans_done;
+}
+
+
+/*! \brief Plays one event of a slave always ready: the byte in THR is sent,
+ *         a byte is received in RHR and the transfer can complete.
+ */
+static void bus_step(void)
+{
+  if (twi.thr != TEST_THR_NONE && tx_count < sizeof(tx_log))
+    tx_log[tx_count++] = twi.thr;
+  twi.thr = TEST_THR_NONE;
+  if (twi.mmr & AVR32_TWI_MMR_MREAD_MASK)
+    twi.rhr = rx_next++;
+  twi.sr = AVR32_TWI_SR_TXCOMP_MASK | AVR32_TWI_SR_RXRDY_MASK |
+           AVR32_TWI_SR_TXRDY_MASK | ((bus_nack) ? AVR32_TWI_SR_NACK_MASK : 0);
+  test_intc_handler();
+}
+
+
+/*! \brief Plays the bus events until the queue is empty.
+ */
+static void bus_run(void)
+{
+  unsigned int steps = 0;
+
+  while (twi_is_busy() && steps++ < TEST_MAX_STEPS)
+    bus_step();
+  CHECK(!twi_is_busy());
+}
+
+
+static void bus_relax(void)
+{
+  if (late_trans)
+  {
+    twi_master_submit(&twi, late_trans);
+    late_trans = NULL;
+  }
+  if (twi_is_busy()) bus_step();
+}
+
+
+static void time_relax(void)
+{
+  test_sys_count += 10000;
+}
+
+
+static void log_reset(void)
+{
+  twi.thr = TEST_THR_NONE;
+  tx_count = 0;
+  done_count = 0;
+  rx_next = 0x40;
+}
+
+
+/*! \brief The handler is registered and the bus clock set from the PBA
+ *         frequency.
+ */
+static void test_init(void)
+{
+  twi_options_t opt =
+  {
+    .pba_hz = TEST_PBA_HZ,
+    .cpu_hz = TEST_CPU_HZ,
+    .speed  = TEST_SPEED,
+    .chip   = 0x50
+  };
+
+  CHECK_EQUAL(twi_master_init(&twi, &opt), TWI_SUCCESS);
+  CHECK(test_intc_handler != NULL);
+  CHECK_EQUAL(test_intc_irq, AVR32_TWI_IRQ);
+  CHECK_EQUAL(twi.cr, AVR32_TWI_CR_SWRST_MASK);
+  CHECK_EQUAL(twi.cwgr, 161 << AVR32_TWI_CWGR_CLDIV_OFFSET |
+                        161 << AVR32_TWI_CWGR_CHDIV_OFFSET);
+  CHECK(!twi_is_busy());
+}
+
+
+/*! \brief The transactions run one after the other in submission order, each
+ *         completed with its status before its callback.
+ */
+static void test_queue(void)
+{
+  static uint8_t w1_data[] = {0xA1, 0xA2};
+  static uint8_t w2_data[] = {0xB1};
+  uint8_t r1_data[3] = {0};
+  twi_trans_t w1, r1, w2, empty;
+
+  log_reset();
+  trans_setup(&w1, false, 0x50, w1_data, sizeof(w1_data));
+  w1.package.addr[0] = 0x12;
+  w1.package.addr[1] = 0x34;
+  w1.package.addr_length = 2;
+  trans_setup(&r1, true, 0x51, r1_data, sizeof(r1_data));
+  trans_setup(&w2, false, 0x52, w2_data, sizeof(w2_data));
+  trans_setup(&empty, false, 0x53, w2_data, 0);
+
+  CHECK_EQUAL(twi_master_submit(&twi, &empty), TWI_INVALID_ARGUMENT);
+  CHECK(!twi_is_busy());
+
+  CHECK_EQUAL(twi_master_submit(&twi, &w1), TWI_SUCCESS);
+  CHECK_EQUAL(twi_master_submit(&twi, &r1), TWI_SUCCESS);
+  CHECK_EQUAL(twi_master_submit(&twi, &w2), TWI_SUCCESS);
+  CHECK(twi_is_busy());
+  CHECK(!w1.done && !r1.done && !w2.done);
+  CHECK_EQUAL(w1.status, TWI_BUSY);
+
+  // Only the first one is on the bus.
+  CHECK_EQUAL(twi.mmr, 0x50 << AVR32_TWI_MMR_DADR_OFFSET |
+                       2 << AVR32_TWI_MMR_IADRSZ_OFFSET);
+  CHECK_EQUAL(twi.iadr, 0x1234);
+  CHECK_EQUAL(twi.thr, 0xA1);
+
+  bus_run();
+  CHECK(w1.done && r1.done && w2.done);
+  CHECK_EQUAL(w1.status, TWI_SUCCESS);
+  CHECK_EQUAL(r1.status, TWI_SUCCESS);
+  CHECK_EQUAL(w2.status, TWI_SUCCESS);
+  CHECK_EQUAL(done_count, 3);
+  CHECK(done_log[0] == &w1 && done_log[1] == &r1 && done_log[2] == &w2);
+
+  CHECK_EQUAL(tx_count, 3);
+  CHECK_EQUAL(tx_log[0], 0xA1);
+  CHECK_EQUAL(tx_log[1], 0xA2);
+  CHECK_EQUAL(tx_log[2], 0xB1);
+  CHECK_EQUAL(r1_data[0], 0x40);
+  CHECK_EQUAL(r1_data[1], 0x41);
+  CHECK_EQUAL(r1_data[2], 0x42);
+
+  // The master is disabled once the queue is empty.
+  CHECK_EQUAL(twi.cr, AVR32_TWI_CR_MSDIS_MASK);
+}
+
+
+/*! \brief A NACK completes the transaction in progress and the next one
+ *         starts.
+ */
+static void test_nack(void)
+{
+  static uint8_t w_data[] = {0xC1, 0xC2};
+  uint8_t r_data[1] = {0};
+  twi_trans_t w, r;
+
+  log_reset();
+  trans_setup(&w, false, 0x50, w_data, sizeof(w_data));
+  trans_setup(&r, true, 0x51, r_data, sizeof(r_data));
+  CHECK_EQUAL(twi_master_submit(&twi, &w), TWI_SUCCESS);
+  CHECK_EQUAL(twi_master_submit(&twi, &r), TWI_SUCCESS);
+
+  bus_nack = true;
+  bus_step();
+  bus_nack = false;
+  CHECK(w.done);
+  CHECK_EQUAL(w.status, TWI_RECEIVE_NACK);
+  CHECK(!r.done);
+  CHECK(twi.mmr & AVR32_TWI_MMR_MREAD_MASK);
+
+  bus_run();
+  CHECK_EQUAL(r.status, TWI_SUCCESS);
+  CHECK_EQUAL(r_data[0], 0x40);
+}
+
+
+/*! \brief A transaction holding the bus past its timeout, counted at the CPU
+ *         frequency, is aborted with a reset of the TWI and the next one
+ *         starts.
+ */
+static void test_timeout(void)
+{
+  static uint8_t data[] = {0xD1, 0xD2};
+  twi_trans_t t, n;
+  uint32_t start;
+
+  log_reset();
+  twi_master_set_clocks(&twi, 12000000, 12000000);
+  CHECK_EQUAL(twi.cwgr, 56 << AVR32_TWI_CWGR_CLDIV_OFFSET |
+                        56 << AVR32_TWI_CWGR_CHDIV_OFFSET);
+
+  trans_setup(&t, false, 0x50, data, sizeof(data));
+  t.timeout_ms = 2;
+  trans_setup(&n, false, 0x51, data, sizeof(data));
+  test_sys_count = 1000;
+  CHECK_EQUAL(twi_master_submit(&twi, &t), TWI_SUCCESS);
+  CHECK_EQUAL(twi_master_submit(&twi, &n), TWI_SUCCESS);
+
+  // 2 ms at 12 MHz.
+  test_sys_count = 1000 + 24000;
+  twi_master_poll();
+  CHECK(!t.done);
+
+  twi.cwgr = 0;
+  test_sys_count = 1000 + 24001;
+  twi_master_poll();
+  CHECK(t.done);
+  CHECK_EQUAL(t.status, TWI_TIMEOUT);
+  CHECK_EQUAL(twi.cwgr, 56 << AVR32_TWI_CWGR_CLDIV_OFFSET |
+                        56 << AVR32_TWI_CWGR_CHDIV_OFFSET);
+  CHECK(!n.done);
+  CHECK_EQUAL(twi.mmr, 0x51 << AVR32_TWI_MMR_DADR_OFFSET);
+
+  // No timeout: never aborted.
+  test_sys_count += 1000000;
+  twi_master_poll();
+  CHECK(!n.done);
+  bus_run();
+  CHECK_EQUAL(n.status, TWI_SUCCESS);
+
+  // Waiting polls the timeout, 2 ms at 66 MHz.
+  twi_master_set_clocks(&twi, TEST_CPU_HZ, TEST_PBA_HZ);
+  trans_setup(&t, false, 0x50, data, sizeof(data));
+  t.timeout_ms = 2;
+  start = test_sys_count;
+  CHECK_EQUAL(twi_master_submit(&twi, &t), TWI_SUCCESS);
+  test_relax_hook = time_relax;
+  CHECK_EQUAL(twi_master_wait(&t), TWI_TIMEOUT);
+  test_relax_hook = NULL;
+  CHECK(done_at - start > 132000);
+  CHECK(done_at - start <= 142000);
+  CHECK(!twi_is_busy());
+}
+
+
+/*! \brief The blocking transfers wait for the queue, and a transaction
+ *         submitted meanwhile waits for them.
+ */
+static void test_blocking(void)
+{
+  static uint8_t q_data[] = {0xE1, 0xE2};
+  static uint8_t w_data[] = {0xF1, 0xF2, 0xF3};
+  static uint8_t l_data[] = {0x71};
+  uint8_t r_data[2] = {0};
+  twi_package_t pkg;
+  twi_trans_t q, l;
+
+  log_reset();
+  test_relax_hook = bus_relax;
+
+  trans_setup(&q, false, 0x50, q_data, sizeof(q_data));
+  CHECK_EQUAL(twi_master_submit(&twi, &q), TWI_SUCCESS);
+  memset(&pkg, 0, sizeof(pkg));
+  pkg.chip = 0x51;
+  pkg.buffer = r_data;
+  pkg.length = sizeof(r_data);
+  CHECK_EQUAL(twi_master_read(&twi, &pkg), TWI_SUCCESS);
+  CHECK(q.done);
+  CHECK_EQUAL(q.status, TWI_SUCCESS);
+  CHECK_EQUAL(r_data[0], 0x40);
+  CHECK_EQUAL(r_data[1], 0x41);
+
+  trans_setup(&l, false, 0x52, l_data, sizeof(l_data));
+  late_trans = &l;
+  pkg.chip = 0x53;
+  pkg.buffer = w_data;
+  pkg.length = sizeof(w_data);
+  CHECK_EQUAL(twi_master_write(&twi, &pkg), TWI_SUCCESS);
+  CHECK(late_trans == NULL);
+  CHECK_EQUAL(twi_master_wait(&l), TWI_SUCCESS);
+  test_relax_hook = NULL;
+
+  CHECK_EQUAL(tx_count, 6);
+  CHECK_EQUAL(tx_log[0], 0xE1);
+  CHECK_EQUAL(tx_log[1], 0xE2);
+  CHECK_EQUAL(tx_log[2], 0xF1);
+  CHECK_EQUAL(tx_log[3], 0xF2);
+  CHECK_EQUAL(tx_log[4], 0xF3);
+  CHECK_EQUAL(tx_log[5], 0x71);
+  CHECK(!twi_is_busy());
+}
+
+
+int main(void)
+{
+  test_init();
+  test_queue();
+  test_nack();
+  test_timeout();
+  test_blocking();
+  return test_report("test_twi_queue");
+}
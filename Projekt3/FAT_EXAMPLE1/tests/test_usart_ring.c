@@ -0,0 +1,296 @@
+/*****************************************************************************
+ *
+ * \file
+ *
+ * \brief Host test of the USART ring buffers.
+ *
+ * Copyright (c) 2009 Atmel Corporation. All rights reserved.
+ *
+ * \asf_license_start
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. The name of Atmel may not be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * 4. This software may only be redistributed and used in connection with an
+ *    Atmel microcontroller product.
+ *
+ * THIS SOFTWARE IS PROVIDED BY ATMEL "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT ARE
+ * EXPRESSLY AND SPECIFICALLY DISCLAIMED. IN NO EVENT SHALL ATMEL BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * \asf_license_stop
+ *
+ ******************************************************************************/
+
+
+#include "test.h"
+#include "usart.h"
+
+
+#define TEST_TX_SIZE          8
+#define TEST_RX_SIZE          8
+
+//! Value left in THR when the driver writes nothing.
+#define TEST_THR_NONE         0xFFFFFFFF
+
+
+static avr32_usart_t usart;
+static usart_ring_t ring;
+static unsigned char tx_buf[TEST_TX_SIZE];
+static unsigned char rx_buf[TEST_RX_SIZE];
+
+
+/*! \brief Applies the writes to IER and IDR to IMR, as the USART does.
+ */
+static void usart_update(void)
+{
+  usart.imr = (usart.imr | usart.ier) & ~usart.idr;
+  usart.ier = 0;
+  usart.idr = 0;
+}
+
+
+/*! \brief Runs the interrupt handler with a status.
+ */
+static void usart_interrupt(unsigned long csr)
+{
+  usart.csr = csr;
+  usart.thr = TEST_THR_NONE;
+  usart.cr = 0;
+  usart_ring_interrupt(&ring);
+  usart_update();
+}
+
+
+/*! \brief Sends a character queued in the TX ring.
+ *
+ * \return The character written to THR, or \c TEST_THR_NONE.
+ */
+static unsigned long usart_send(void)
+{
+  usart_interrupt(AVR32_USART_CSR_TXRDY_MASK);
+  return usart.thr;
+}
+
+
+/*! \brief Receives a character in the RX ring.
+ */
+static void usart_receive(int c)
+{
+  usart.rhr = c;
+  usart_interrupt(AVR32_USART_CSR_RXRDY_MASK);
+}
+
+
+static void ring_setup(void)
+{
+  memset(&usart, 0, sizeof(usart));
+  usart_ring_init(&ring, &usart, tx_buf, sizeof(tx_buf), rx_buf, sizeof(rx_buf));
+  usart_update();
+}
+
+
+/*! \brief The ring is attached to its USART with only the RX interrupt
+ *         enabled.
+ */
+static void test_init(void)
+{
+  avr32_usart_t other;
+
+  ring_setup();
+  CHECK_EQUAL(usart.cr, AVR32_USART_CR_RSTSTA_MASK);
+  CHECK_EQUAL(usart.imr, AVR32_USART_IMR_RXRDY_MASK);
+  CHECK(usart_ring_get(&usart) == &ring);
+  CHECK(usart_ring_get(&other) == NULL);
+  CHECK_EQUAL(usart_ring_tx_pending(&ring), 0);
+
+  // Nothing to send: the TX interrupt stays disabled.
+  CHECK_EQUAL(usart_send(), TEST_THR_NONE);
+}
+
+
+/*! \brief The TX ring holds one character less than its size, then refuses
+ *         and counts the characters not written.
+ */
+static void test_tx_full(void)
+{
+  unsigned int i;
+
+  ring_setup();
+  for (i = 0; i < TEST_TX_SIZE - 1; i++)
+    CHECK_EQUAL(usart_ring_write_char(&ring, 'a' + i), USART_SUCCESS);
+  usart_update();
+  CHECK(usart.imr & AVR32_USART_IMR_TXRDY_MASK);
+  CHECK_EQUAL(usart_ring_tx_pending(&ring), TEST_TX_SIZE - 1);
+
+  CHECK_EQUAL(usart_ring_write_char(&ring, 'z'), USART_TX_BUSY);
+  CHECK_EQUAL(usart_ring_write(&ring, "xyz", 3), 0);
+  CHECK_EQUAL(ring.tx_overflows, 3);
+  CHECK_EQUAL(usart_ring_putchar(&ring, 'z'), USART_FAILURE);
+  CHECK_EQUAL(ring.tx_overflows, 4);
+
+  // Sending one character makes room for one.
+  CHECK_EQUAL(usart_send(), 'a');
+  CHECK_EQUAL(usart_ring_write(&ring, "xyz", 3), 1);
+  CHECK_EQUAL(ring.tx_overflows, 6);
+  CHECK_EQUAL(usart_ring_tx_pending(&ring), TEST_TX_SIZE - 1);
+
+  for (i = 1; i < TEST_TX_SIZE - 1; i++)
+    CHECK_EQUAL(usart_send(), 'a' + i);
+  CHECK_EQUAL(usart_send(), 'x');
+
+  // Empty: the handler disables the TX interrupt without writing THR.
+  CHECK_EQUAL(usart_ring_tx_pending(&ring), 0);
+  CHECK(usart.imr & AVR32_USART_IMR_TXRDY_MASK);
+  CHECK_EQUAL(usart_send(), TEST_THR_NONE);
+  CHECK(!(usart.imr & AVR32_USART_IMR_TXRDY_MASK));
+  CHECK_EQUAL(usart_send(), TEST_THR_NONE);
+}
+
+
+/*! \brief The characters are sent in order across the wrap-around of the TX
+ *         ring, whatever the fill level.
+ */
+static void test_tx_wrap(void)
+{
+  unsigned char next_in = 0, next_out = 0;
+  unsigned int round, i, len;
+  unsigned char buf[TEST_TX_SIZE];
+
+  ring_setup();
+  for (round = 0; round < 40; round++)
+  {
+    len = round % TEST_TX_SIZE;
+    for (i = 0; i < len; i++) buf[i] = next_in + i;
+    CHECK_EQUAL(usart_ring_write(&ring, buf, len), len);
+    next_in += len;
+    usart_update();
+    CHECK_EQUAL(usart_ring_tx_pending(&ring), len);
+
+    // Leave one character in the ring every other round.
+    while (usart_ring_tx_pending(&ring) > round % 2)
+      CHECK_EQUAL(usart_send(), next_out++);
+    CHECK(ring.tx_head < TEST_TX_SIZE && ring.tx_tail < TEST_TX_SIZE);
+    while (usart_ring_tx_pending(&ring))
+      CHECK_EQUAL(usart_send(), next_out++);
+  }
+  CHECK_EQUAL(next_out, next_in);
+  CHECK_EQUAL(ring.tx_overflows, 0);
+}
+
+
+/*! \brief The characters are received in order across the wrap-around of the
+ *         RX ring; those arriving while it is full are counted and dropped.
+ */
+static void test_rx(void)
+{
+  unsigned char next_in = 0, next_out = 0;
+  unsigned char buf[TEST_RX_SIZE];
+  unsigned int round, i, len;
+  int c;
+
+  ring_setup();
+  CHECK_EQUAL(usart_ring_read_char(&ring, &c), USART_RX_EMPTY);
+
+  for (round = 0; round < 40; round++)
+  {
+    len = round % TEST_RX_SIZE;
+    for (i = 0; i < len; i++) usart_receive(next_in++);
+    len = usart_ring_read(&ring, buf, round % 3 + 1);
+    for (i = 0; i < len; i++) CHECK_EQUAL(buf[i], next_out++);
+    while (usart_ring_read_char(&ring, &c) == USART_SUCCESS)
+      CHECK_EQUAL(c, next_out++);
+  }
+  CHECK_EQUAL(next_out, next_in);
+  CHECK_EQUAL(ring.rx_overflows, 0);
+
+  // Full: one character less than the size is kept.
+  for (i = 0; i < TEST_RX_SIZE + 2; i++) usart_receive('a' + i);
+  CHECK_EQUAL(ring.rx_overflows, 3);
+  CHECK_EQUAL(usart_ring_read(&ring, buf, sizeof(buf)), TEST_RX_SIZE - 1);
+  for (i = 0; i < TEST_RX_SIZE - 1; i++) CHECK_EQUAL(buf[i], 'a' + i);
+  CHECK_EQUAL(usart_ring_read_char(&ring, &c), USART_RX_EMPTY);
+}
+
+
+/*! \brief A reception error is counted and its status reset, the character
+ *         received along with it is kept.
+ */
+static void test_rx_errors(void)
+{
+  int c;
+
+  ring_setup();
+  usart.rhr = 'e';
+  usart_interrupt(AVR32_USART_CSR_RXRDY_MASK | AVR32_USART_CSR_OVRE_MASK);
+  CHECK_EQUAL(ring.rx_errors, 1);
+  CHECK_EQUAL(usart.cr, AVR32_USART_CR_RSTSTA_MASK);
+  usart_interrupt(AVR32_USART_CSR_FRAME_MASK);
+  usart_interrupt(AVR32_USART_CSR_PARE_MASK);
+  CHECK_EQUAL(ring.rx_errors, 3);
+
+  CHECK_EQUAL(usart_ring_read_char(&ring, &c), USART_SUCCESS);
+  CHECK_EQUAL(c, 'e');
+  CHECK_EQUAL(usart_ring_read_char(&ring, &c), USART_RX_EMPTY);
+  CHECK_EQUAL(ring.rx_overflows, 0);
+}
+
+
+/*! \brief The polled functions go through the ring once it is attached.
+ */
+static void test_routing(void)
+{
+  const char *line = "ok\r\n";
+  int c;
+
+  ring_setup();
+  usart.csr = AVR32_USART_CSR_TXRDY_MASK | AVR32_USART_CSR_RXRDY_MASK;
+  usart.thr = TEST_THR_NONE;
+  usart.rhr = 'r';
+
+  CHECK_EQUAL(usart_putchar(&usart, 'p'), USART_SUCCESS);
+  usart_write_line(&usart, line);
+  CHECK_EQUAL(usart.thr, TEST_THR_NONE);
+  CHECK_EQUAL(usart_ring_tx_pending(&ring), 5);
+
+  // Nothing read from RHR outside the interrupt handler.
+  CHECK_EQUAL(usart_read_char(&usart, &c), USART_RX_EMPTY);
+  usart_receive('r');
+  CHECK_EQUAL(usart_read_char(&usart, &c), USART_SUCCESS);
+  CHECK_EQUAL(c, 'r');
+
+  usart_update();
+  CHECK_EQUAL(usart_send(), 'p');
+  while (*line) CHECK_EQUAL(usart_send(), *line++);
+  CHECK_EQUAL(usart_send(), TEST_THR_NONE);
+}
+
+
+int main(void)
+{
+  test_init();
+  test_tx_full();
+  test_tx_wrap();
+  test_rx();
+  test_rx_errors();
+  test_routing();
+  return test_report("test_usart_ring");
+}